@@ -1,9 +1,13 @@
 #include "layer.h"
 
+#ifndef __ACTIVATION__
+#define __ACTIVATION__
+
 class Sigmoid: public Layer
 {
 public:
     Sigmoid(): Layer(false, false) {}
+    const char *getName() const override {return "Sigmoid";}
 
     Matrix forward(const Matrix &input_tensor)
     {   
@@ -22,6 +26,7 @@ class ReLU: public Layer
 {
 public:
     ReLU(): Layer(false, false) {}
+    const char *getName() const override {return "ReLU";}
     
     Matrix forward(const Matrix &input_tensor)
     {
@@ -41,3 +46,4 @@ public:
     }
 };
 
+#endif
@@ -0,0 +1,370 @@
+#include "autotune.h"
+#include "profiler.h"
+#include "opstats.h"
+#include "jit.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <omp.h>
+#include <cuda_runtime.h>
+
+// the naive kernel is only worth timing on small products
+static const size_t STANDARD_LIMIT = 1 << 22;
+// multiply_thread keeps its threads in a fixed array
+static const int MAX_GEMM_THREADS = 16;
+// a candidate whose warm-up run is this much slower than the best is not repeated
+static const double PRUNE_FACTOR = 8.0;
+static const char *CACHE_MAGIC = "# MOFramework GEMM autotune cache v1";
+
+static size_t round_pow2(size_t n)
+{
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+static bool cuda_available()
+{
+    static const bool available = [] {
+        int count = 0;
+        return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+    }();
+    return available;
+}
+
+// thread counts worth trying: powers of two up to the limit, and the limit itself
+static std::vector<int> thread_counts(int limit)
+{
+    std::vector<int> counts;
+    for (int t = 1; t < limit; t *= 2) {
+        counts.push_back(t);
+    }
+    counts.push_back(std::max(limit, 1));
+    return counts;
+}
+
+static std::vector<GemmConfig> candidates(size_t m, size_t n, size_t k)
+{
+    std::vector<GemmConfig> list;
+    // MKL first, it is the reference the others are checked against
+    list.push_back({Matrix::MKL, 0, 0, 0.0});
+    if (m * n * k <= STANDARD_LIMIT) {
+        list.push_back({Matrix::STANDARD, 0, 0, 0.0});
+    }
+    size_t largest = std::max(m, std::max(n, k));
+    for (size_t tile : {16, 32, 64}) {
+        if (tile == 16 || tile <= largest) {
+            list.push_back({Matrix::TILE, tile, 0, 0.0});
+        }
+    }
+    for (int threads : thread_counts(omp_get_max_threads())) {
+        list.push_back({Matrix::OPENMP, 0, threads, 0.0});
+    }
+    int hardware = std::max(1, int(std::thread::hardware_concurrency()));
+    int thread_limit = int(std::min<size_t>(m, std::min(hardware, MAX_GEMM_THREADS)));
+    for (int threads : thread_counts(thread_limit)) {
+        list.push_back({Matrix::THREAD, 0, threads, 0.0});
+    }
+    if (cuda_available()) {
+        list.push_back({Matrix::CUDA, 0, 0, 0.0});
+    }
+    if (JitGemm::available()) {
+        list.push_back({Matrix::JIT, 0, 0, 0.0});
+    }
+    return list;
+}
+
+static bool close_to(const Matrix &result, const Matrix &reference)
+{
+    size_t n = reference.row * reference.col;
+    double scale = 0.0, error = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        scale = std::max(scale, std::abs(reference.data[i]));
+        error = std::max(error, std::abs(result.data[i] - reference.data[i]));
+    }
+    // also rejects NaN results
+    return error <= 1e-9 * (scale + 1.0);
+}
+
+Matrix multiply_config(const Matrix &mat1, const Matrix &mat2, const GemmConfig &config)
+{
+    switch (config.mode) {
+        case Matrix::STANDARD:
+            return multiply(mat1, mat2);
+        case Matrix::MKL:
+            return multiply_mkl(mat1, mat2);
+        case Matrix::TILE:
+            return multiply_tile(mat1, mat2, config.tileSize);
+        case Matrix::OPENMP:
+            return multiply_openmp(mat1, mat2, config.numThreads);
+        case Matrix::THREAD:
+            return multiply_thread(mat1, mat2, config.numThreads);
+        case Matrix::CUDA:
+            return multiply_cuda(mat1, mat2);
+        case Matrix::JIT:
+            return multiply_jit(mat1, mat2);
+        case Matrix::STRASSEN:
+            return multiply_strassen(mat1, mat2);
+        default:
+            throw std::runtime_error("multiply_config: invalid multiplication mode");
+    }
+}
+
+GemmAutotuner &GemmAutotuner::instance()
+{
+    static GemmAutotuner tuner;
+    return tuner;
+}
+
+GemmAutotuner::GemmAutotuner() : repeats(3) {}
+
+ShapeClass GemmAutotuner::shape_class(size_t m, size_t n, size_t k)
+{
+    return {round_pow2(m), round_pow2(n), round_pow2(k)};
+}
+
+GemmConfig GemmAutotuner::measure(const Matrix &mat1, const Matrix &mat2, Matrix &result) const
+{
+    int runs;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        runs = repeats;
+    }
+    size_t m = mat1.row, n = mat2.col, k = mat1.col;
+    GemmConfig best = {Matrix::MKL, 0, 0, INFINITY};
+    Matrix reference;
+    for (const GemmConfig &candidate : candidates(m, n, k)) {
+        double fastest = INFINITY;
+        Matrix output;
+        // the first run warms caches and pages in the output
+        for (int r = 0; r <= runs; r++) {
+            auto begin = std::chrono::steady_clock::now();
+            output = multiply_config(mat1, mat2, candidate);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+            fastest = std::min(fastest, elapsed.count());
+            if (r == 0 && fastest > PRUNE_FACTOR * best.seconds) {
+                break;
+            }
+        }
+        if (reference.data == nullptr) {
+            reference = output;
+        }
+        else if (!close_to(output, reference)) {
+            continue;
+        }
+        if (fastest < best.seconds) {
+            best = candidate;
+            best.seconds = fastest;
+            result = std::move(output);
+        }
+    }
+    return best;
+}
+
+void GemmAutotuner::store(const ShapeClass &key, const GemmConfig &config)
+{
+    std::string path;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        cache[key] = config;
+        path = cachePath;
+    }
+    if (path.empty()) {
+        return;
+    }
+    // the product is already computed and cached in memory, a failed write only loses
+    // the entry for the next process; reported once per path
+    try {
+        save(path);
+    }
+    catch (const std::exception &e) {
+        if (path != failedPath) {
+            std::cerr << "GemmAutotuner: cache not saved: " << e.what() << std::endl;
+            failedPath = path;
+        }
+    }
+}
+
+Matrix GemmAutotuner::multiply(const Matrix &mat1, const Matrix &mat2)
+{
+    size_t m = mat1.row, n = mat2.col, k = mat1.col;
+    if (k != mat2.row) {
+        throw std::runtime_error("matrix dimension not match");
+    }
+    if (m == 0 || n == 0 || k == 0) {
+        return ::multiply(mat1, mat2);
+    }
+    GemmConfig config;
+    if (lookup(m, n, k, config)) {
+        ProfileScope scope("gemm", mul_mode_name(config.mode), m, n, k);
+        return multiply_config(mat1, mat2, config);
+    }
+    std::lock_guard<std::mutex> tuning(tuneMutex);
+    // another thread may have tuned this class while we waited
+    if (lookup(m, n, k, config)) {
+        ProfileScope scope("gemm", mul_mode_name(config.mode), m, n, k);
+        return multiply_config(mat1, mat2, config);
+    }
+    ProfileScope scope("autotune", "tune", m, n, k);
+    OpContext context("autotune");
+    Matrix result;
+    config = measure(mat1, mat2, result);
+    store(shape_class(m, n, k), config);
+    return result;
+}
+
+GemmConfig GemmAutotuner::tune(const Matrix &mat1, const Matrix &mat2)
+{
+    if (mat1.col != mat2.row) {
+        throw std::runtime_error("matrix dimension not match");
+    }
+    if (mat1.row == 0 || mat2.col == 0 || mat1.col == 0) {
+        throw std::runtime_error("GemmAutotuner::tune: empty matrix");
+    }
+    std::lock_guard<std::mutex> tuning(tuneMutex);
+    Matrix result;
+    GemmConfig config = measure(mat1, mat2, result);
+    store(shape_class(mat1.row, mat2.col, mat1.col), config);
+    return config;
+}
+
+bool GemmAutotuner::lookup(size_t m, size_t n, size_t k, GemmConfig &config) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = cache.find(shape_class(m, n, k));
+    if (it == cache.end()) {
+        return false;
+    }
+    config = it->second;
+    return true;
+}
+
+std::vector<std::pair<ShapeClass, GemmConfig>> GemmAutotuner::entries() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return std::vector<std::pair<ShapeClass, GemmConfig>>(cache.begin(), cache.end());
+}
+
+void GemmAutotuner::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    cache.clear();
+}
+
+void GemmAutotuner::setRepeats(int repeats)
+{
+    if (repeats < 1) {
+        throw std::runtime_error("GemmAutotuner: repeats must be positive");
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    this->repeats = repeats;
+}
+
+void GemmAutotuner::setCachePath(const std::string &path)
+{
+    if (!path.empty()) {
+        std::ifstream probe(path);
+        if (probe) {
+            load(path);
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    cachePath = path;
+}
+
+std::string GemmAutotuner::getCachePath() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return cachePath;
+}
+
+// text format: magic line, "# threads <omp max threads>", then one line per entry
+// "m n k mode tile threads seconds" with the shape class dims
+void GemmAutotuner::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("GemmAutotuner::load: cannot open " + path);
+    }
+    std::string line;
+    if (!std::getline(file, line) || line != CACHE_MAGIC) {
+        throw std::runtime_error("GemmAutotuner::load: not an autotune cache: " + path);
+    }
+    int threads = 0;
+    if (!std::getline(file, line) || std::sscanf(line.c_str(), "# threads %d", &threads) != 1) {
+        throw std::runtime_error("GemmAutotuner::load: missing thread count: " + path);
+    }
+    if (threads != omp_get_max_threads()) {
+        return;
+    }
+    std::map<ShapeClass, GemmConfig> loaded;
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::istringstream fields(line);
+        ShapeClass key;
+        GemmConfig config;
+        if (!(fields >> key[0] >> key[1] >> key[2] >> config.mode
+                     >> config.tileSize >> config.numThreads >> config.seconds)
+            || config.mode < Matrix::STANDARD || (config.mode > Matrix::CUDA && config.mode != Matrix::JIT)
+            || (config.mode == Matrix::TILE && config.tileSize == 0)
+            || ((config.mode == Matrix::THREAD || config.mode == Matrix::OPENMP) && config.numThreads < 1)
+            || (config.mode == Matrix::THREAD && config.numThreads > MAX_GEMM_THREADS)) {
+            throw std::runtime_error("GemmAutotuner::load: malformed entry in " + path);
+        }
+        // a cache written on a machine with a GPU, or one allowing executable memory
+        if ((config.mode == Matrix::CUDA && !cuda_available()) || (config.mode == Matrix::JIT && !JitGemm::available())) {
+            continue;
+        }
+        loaded[key] = config;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    for (const auto &entry : loaded) {
+        cache[entry.first] = entry.second;
+    }
+}
+
+void GemmAutotuner::save(const std::string &path) const
+{
+    std::vector<std::pair<ShapeClass, GemmConfig>> snapshot = entries();
+    // written next to the target and renamed, readers never see a partial file; the pid
+    // keeps processes sharing the cache file off each other's temporary
+    std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream file(tmp_path);
+        if (!file) {
+            throw std::runtime_error("GemmAutotuner::save: cannot open " + tmp_path);
+        }
+        file << CACHE_MAGIC << "\n# threads " << omp_get_max_threads() << "\n";
+        file.precision(9);
+        for (const auto &entry : snapshot) {
+            const GemmConfig &config = entry.second;
+            file << entry.first[0] << " " << entry.first[1] << " " << entry.first[2] << " "
+                 << config.mode << " " << config.tileSize << " " << config.numThreads << " "
+                 << config.seconds << "\n";
+        }
+        if (!file.flush()) {
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error("GemmAutotuner::save: cannot write " + tmp_path);
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("GemmAutotuner::save: cannot rename " + tmp_path);
+    }
+}
+
+Matrix multiply_auto(const Matrix &mat1, const Matrix &mat2)
+{
+    return GemmAutotuner::instance().multiply(mat1, mat2);
+}
@@ -0,0 +1,70 @@
+// shape-aware GEMM dispatch for Matrix::AUTO
+// the first multiply of each (M, N, K) shape class times the available backends,
+// tile sizes and thread counts on its own operands, the winner serves every later
+// multiply of the class; results can be kept in a cache file per machine
+#include "matrix.h"
+#include <array>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#ifndef __AUTOTUNE__
+#define __AUTOTUNE__
+
+struct GemmConfig {
+    int mode;           // Matrix::MulMode, never AUTO
+    size_t tileSize;    // TILE only
+    int numThreads;     // OPENMP and THREAD only
+    double seconds;     // best time measured while tuning
+};
+
+// M, N, K rounded up to powers of two
+typedef std::array<size_t, 3> ShapeClass;
+
+// runs one backend with its parameters
+Matrix multiply_config(const Matrix &mat1, const Matrix &mat2, const GemmConfig &config);
+
+class GemmAutotuner {
+public:
+    // the process-wide tuner behind Matrix::AUTO
+    static GemmAutotuner &instance();
+    static ShapeClass shape_class(size_t m, size_t n, size_t k);
+
+    // tunes the shape class on first use, thread-safe
+    Matrix multiply(const Matrix &mat1, const Matrix &mat2);
+    // measures the candidates again and replaces the cached winner
+    GemmConfig tune(const Matrix &mat1, const Matrix &mat2);
+    bool lookup(size_t m, size_t n, size_t k, GemmConfig &config) const;
+    std::vector<std::pair<ShapeClass, GemmConfig>> entries() const;
+    void clear();
+
+    // timed runs per candidate after a warm-up run
+    void setRepeats(int repeats);
+    // loads the file if it exists and rewrites it whenever a shape is tuned,
+    // an empty path keeps the cache in memory only; a failed rewrite is reported on
+    // stderr and never fails the multiply
+    void setCachePath(const std::string &path);
+    std::string getCachePath() const;
+    // entries tuned with a different thread count are ignored
+    void load(const std::string &path);
+    void save(const std::string &path) const;
+
+private:
+    GemmAutotuner();
+    GemmConfig measure(const Matrix &mat1, const Matrix &mat2, Matrix &result) const;
+    void store(const ShapeClass &key, const GemmConfig &config);
+
+    std::map<ShapeClass, GemmConfig> cache;
+    std::string cachePath;
+    int repeats;
+    // guards cache, cachePath and repeats
+    mutable std::shared_mutex mutex;
+    // one shape is timed at a time, concurrent tuning would skew the measurements
+    std::mutex tuneMutex;
+    // last cache path whose save failed, guarded by tuneMutex
+    std::string failedPath;
+};
+
+#endif
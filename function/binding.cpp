@@ -1,8 +1,8 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/operators.h>
 #include <pybind11/stl.h> 
+#include <pybind11/numpy.h>
 #include <iostream>
-#include <fstream>
 
 #include "matrix.h"
 #include "activation.h"
@@ -11,88 +11,105 @@
 #include "network.h"
 #include "loss.h"
 #include "optimizer.h"
+#include "dataset.h"
+#include "dataloader.h"
+#include "stream.h"
+#include "npy.h"
+#include "checkpoint.h"
+#include "model.h"
+#include "trainer.h"
+#include "metrics.h"
+#include "autotune.h"
+#include "profiler.h"
+#include "opstats.h"
+#include "codegen.h"
+#include "jit.h"
+#include "strassen.h"
+#include "quantize.h"
 
-std::pair<Matrix, Matrix> load_mnist_data(const std::string& images_path, const std::string& labels_path, int num_samples) {
-    // Open files
-    std::ifstream images_file(images_path, std::ios::binary);
-    std::ifstream labels_file(labels_path, std::ios::binary);
-    
-    if (!images_file.is_open() || !labels_file.is_open()) {
-        throw std::runtime_error("Cannot open MNIST data files");
-    }
+namespace py = pybind11;
 
-    // Read headers
-    uint32_t magic_number, n_images, n_rows, n_cols;
-    images_file.read(reinterpret_cast<char*>(&magic_number), sizeof(magic_number));
-    images_file.read(reinterpret_cast<char*>(&n_images), sizeof(n_images));
-    images_file.read(reinterpret_cast<char*>(&n_rows), sizeof(n_rows));
-    images_file.read(reinterpret_cast<char*>(&n_cols), sizeof(n_cols));
-
-    // Convert from big-endian to host byte order
-    magic_number = __builtin_bswap32(magic_number);
-    n_images = __builtin_bswap32(n_images);
-    n_rows = __builtin_bswap32(n_rows);
-    n_cols = __builtin_bswap32(n_cols);
-
-    // Skip label file header
-    labels_file.seekg(8);
-
-    // Prepare matrices
-    Matrix images(num_samples, 784);  // 28*28 = 784
-    Matrix labels(num_samples, 10);   // 10 classes for digits 0-9
-
-    // Read data
-    for (int i = 0; i < num_samples; i++) {
-        // Read image
-        unsigned char pixel;
-        for (int j = 0; j < 784; j++) {
-            images_file.read(reinterpret_cast<char*>(&pixel), 1);
-            images(i, j) = static_cast<double>(pixel) / 255.0 - 0.5;  // Simple [0,1] normalization
+// dst[i][j] = array[i][j] for a 1-d (one row) or 2-d array of any strides
+template<typename Type>
+static void copy_strided(const py::array &array, double *dst)
+{
+    const char *base = static_cast<const char *>(array.data());
+    bool vector = array.ndim() == 1;
+    py::ssize_t rows = vector ? 1 : array.shape(0);
+    py::ssize_t cols = vector ? array.shape(0) : array.shape(1);
+    py::ssize_t row_stride = vector ? 0 : array.strides(0);
+    py::ssize_t col_stride = vector ? array.strides(0) : array.strides(1);
+    // only raw memory is touched, other Python threads may run
+    py::gil_scoped_release release;
+    #pragma omp parallel for schedule(static) if (rows * cols > (1 << 16))
+    for (py::ssize_t i = 0; i < rows; i++) {
+        const char *src = base + i * row_stride;
+        double *out = dst + i * cols;
+        if (col_stride == sizeof(Type)) {
+            const Type *values = reinterpret_cast<const Type *>(src);
+            #pragma omp simd
+            for (py::ssize_t j = 0; j < cols; j++) {
+                out[j] = static_cast<double>(values[j]);
+            }
         }
-
-        // Read and one-hot encode label
-        unsigned char label;
-        labels_file.read(reinterpret_cast<char*>(&label), 1);
-        for (int j = 0; j < 10; j++) {
-            labels(i, j) = (j == label) ? 1.0 : 0.0;
+        else {
+            for (py::ssize_t j = 0; j < cols; j++) {
+                out[j] = static_cast<double>(*reinterpret_cast<const Type *>(src + j * col_stride));
+            }
         }
     }
+}
 
-    images_file.close();
-    labels_file.close();
+// single conversion pass into a new matrix
+static Matrix array_to_matrix(const py::array &array)
+{
+    if (array.ndim() != 1 && array.ndim() != 2) {
+        throw std::runtime_error("Matrix: expected a 1-d or 2-d array");
+    }
+    size_t row = array.ndim() == 1 ? 1 : array.shape(0);
+    size_t col = array.ndim() == 1 ? array.shape(0) : array.shape(1);
+    Matrix result(row, col);
+    char kind = array.dtype().kind();
+    size_t item = array.itemsize();
+    if (kind == 'f' && item == 8) copy_strided<double>(array, result.data);
+    else if (kind == 'f' && item == 4) copy_strided<float>(array, result.data);
+    else if (kind == 'f' && item == sizeof(long double)) copy_strided<long double>(array, result.data);
+    else if (kind == 'i' && item == 8) copy_strided<int64_t>(array, result.data);
+    else if (kind == 'i' && item == 4) copy_strided<int32_t>(array, result.data);
+    else if (kind == 'i' && item == 2) copy_strided<int16_t>(array, result.data);
+    else if (kind == 'i' && item == 1) copy_strided<int8_t>(array, result.data);
+    else if (kind == 'u' && item == 8) copy_strided<uint64_t>(array, result.data);
+    else if (kind == 'u' && item == 4) copy_strided<uint32_t>(array, result.data);
+    else if (kind == 'u' && item == 2) copy_strided<uint16_t>(array, result.data);
+    else if ((kind == 'u' || kind == 'b') && item == 1) copy_strided<uint8_t>(array, result.data);
+    else {
+        throw std::runtime_error("Matrix: unsupported dtype");
+    }
+    return result;
+}
 
-    return {images, labels}; // [batch, 784], [batch, 10]
+// the matrix can use the array memory directly
+static bool wrappable(const py::array &array)
+{
+    return (array.ndim() == 1 || array.ndim() == 2)
+        && array.dtype().is(py::dtype::of<double>())
+        && (array.flags() & py::array::c_style)
+        && array.writeable();
 }
 
-float compute_accuracy(const Matrix& predictions, const Matrix& labels) {
-    int correct = 0;
-    int total = predictions.getRow();
-    
-    for(int i = 0; i < total; i++) {
-        int pred_idx = 0;
-        float max_val = predictions(i,0);
-        for(int j = 1; j < 10; j++) {
-            if(predictions(i,j) > max_val) {
-                max_val = predictions(i,j);
-                pred_idx = j;
-            }
-        }
-        
-        int true_idx = 0;
-        for(int j = 0; j < 10; j++) {
-            if(labels(i,j) == 1.0) {
-                true_idx = j;
-                break;
-            }
-        }
-        
-        if(pred_idx == true_idx) correct++;
+static py::array matrix_to_array(py::object self)
+{
+    Matrix &mat = self.cast<Matrix&>();
+    py::array_t<double> array(std::vector<size_t>{mat.getRow(), mat.getCol()},
+                              std::vector<size_t>{sizeof(double) * mat.getCol(), sizeof(double)},
+                              mat.getData(), self);
+    // a write through a view of a PROT_READ mapping would fault the interpreter
+    if (mat.isReadOnly()) {
+        array.attr("setflags")(py::arg("write") = false);
     }
-    
-    return float(correct) / total;
+    return array;
 }
 
-namespace py = pybind11;
 PYBIND11_MODULE(pynet, m) {
     m.doc() = "python binding for easy network";
 
@@ -106,47 +123,39 @@ PYBIND11_MODULE(pynet, m) {
                 py::format_descriptor<double>::format(),
                 2,
                 {m.getRow(), m.getCol()},
-                {sizeof(double) * m.getCol(), sizeof(double)}
+                {sizeof(double) * m.getCol(), sizeof(double)},
+                m.isReadOnly()
             );
         })
         // Matrix(size_t r, size_t c);
         .def(py::init<size_t, size_t>())
-        // Matrix(Type* ptr, size_t r, size_t c);
-        .def(py::init([](py::buffer b)->Matrix {
-            py::buffer_info info = b.request();
-            size_t row = info.shape[0], col = info.shape[1];
-            if (info.format == "L") // uint64
-                return Matrix((uint64_t*)info.ptr, row, col);
-            else if (info.format == "l") // int64
-                return Matrix((int64_t*)info.ptr, row, col);
-            else if (info.format == "I") // uint32
-                return Matrix((uint32_t*)info.ptr, row, col);
-            else if (info.format == "i") // int32
-                return Matrix((int32_t*)info.ptr, row, col);
-            else if (info.format == "H") // uint16
-                return Matrix((uint16_t*)info.ptr, row, col);
-            else if (info.format == "h") // int16
-                return Matrix((int16_t*)info.ptr, row, col);
-            else if (info.format == "B") // uint8
-                return Matrix((uint8_t*)info.ptr, row, col);
-            else if (info.format == "b") // int8
-                return Matrix((int8_t*)info.ptr, row, col);
-            else if (info.format == "f") // float32
-                return Matrix((float*)info.ptr, row, col);
-            else if (info.format == "d") // float64
-                return Matrix((double*)info.ptr, row, col);
-            else if (info.format == "g") // float128
-                return Matrix((long double*)info.ptr, row, col);
-            else 
-                return Matrix();
-            return Matrix();
-        }))
+        // array -> Matrix, always a copy (any dtype, any strides)
+        .def(py::init([](py::array array) {
+            return array_to_matrix(array);
+        }), py::arg("array"))
+        // zero-copy wrap of a writeable C-contiguous float64 array, the array is kept
+        // alive by the matrix and sees its in-place updates; other layouts are copied
+        .def_static("from_numpy", [](py::array array, bool copy) -> py::object {
+            if (copy || !wrappable(array)) {
+                return py::cast(array_to_matrix(array));
+            }
+            size_t row = array.ndim() == 1 ? 1 : array.shape(0);
+            size_t col = array.ndim() == 1 ? array.shape(0) : array.shape(1);
+            py::object result = py::cast(Matrix::view(static_cast<double *>(array.mutable_data()), row, col));
+            py::detail::keep_alive_impl(result, array);
+            return result;
+        }, py::arg("array"), py::arg("copy") = false)
         .def(py::init<const Matrix&>())
         // bool operator==(const Matrix &mat) const;
         .def("__eq__", &Matrix::operator==)
         
         //void operator=(const Matrix &mat);
-        .def("__setitem__", [](Matrix &mat, std::pair<size_t, size_t> idx, double val) {return mat(idx.first, idx.second) = val;})
+        .def("__setitem__", [](Matrix &mat, std::pair<size_t, size_t> idx, double val) {
+            if (mat.isReadOnly()) {
+                throw std::runtime_error("Matrix is read-only (mapped model)");
+            }
+            return mat(idx.first, idx.second) = val;
+        })
         .def("__getitem__", [](const Matrix &mat, std::pair<size_t, size_t> idx) {return mat(idx.first, idx.second);})
 
         .def("__add__", [](const Matrix &mat, int32_t num) {return mat + double(num);}, py::is_operator())
@@ -185,8 +194,12 @@ PYBIND11_MODULE(pynet, m) {
         .def("__truediv__", [](const Matrix &mat, int64_t num) {return mat / double(num);}, py::is_operator())
         
         .def("T", &Matrix::T)
-        .def("getData", &Matrix::getData)
-        .def("mean", &Matrix::mean)
+        // numpy array sharing the matrix memory, it keeps the matrix alive
+        // (valid until the matrix is reassigned, in-place operators are fine)
+        .def("getData", &matrix_to_array)
+        .def("numpy", &matrix_to_array)
+        .def_property_readonly("is_view", &Matrix::isView)
+        .def_property_readonly("is_read_only", &Matrix::isReadOnly)
         .def("power", &Matrix::power)
         .def("exp", &Matrix::exp)
         .def("log", &Matrix::log)
@@ -200,10 +213,99 @@ PYBIND11_MODULE(pynet, m) {
         .def_static("ones", &Matrix::ones)
 
         .def("slice", &Matrix::slice)
-        .def("sum", &Matrix::sum)
-        .def("mean", &Matrix::mean);
-
-    m.def("multiply", &multiply, "Matrix multiplication");
+        .def("sum", py::overload_cast<>(&Matrix::sum, py::const_))
+        .def("mean", py::overload_cast<>(&Matrix::mean, py::const_))
+        .def("max", py::overload_cast<>(&Matrix::max, py::const_))
+        // axis 0 reduces over rows, axis 1 over columns
+        .def("sum", py::overload_cast<int>(&Matrix::sum, py::const_), py::arg("axis"))
+        .def("mean", py::overload_cast<int>(&Matrix::mean, py::const_), py::arg("axis"))
+        .def("max", py::overload_cast<int>(&Matrix::max, py::const_), py::arg("axis"))
+        .def("argmax", &Matrix::argmax, py::arg("axis"));
+
+    m.def("multiply", &multiply, "Matrix multiplication", py::call_guard<py::gil_scoped_release>());
+    m.def("mat_multiply", &mat_multiply, "Matrix multiplication with the current mode",
+        py::call_guard<py::gil_scoped_release>());
+    // one dispatch for many products, a one-entry list is shared
+    m.def("multiply_batch",
+        py::overload_cast<const std::vector<Matrix>&, const std::vector<Matrix>&>(&multiply_batch),
+        py::arg("mat1"), py::arg("mat2"), py::call_guard<py::gil_scoped_release>());
+    m.def("multiply_batch_strided", &multiply_batch_strided, py::arg("mat1"), py::arg("mat2"), py::arg("batch"),
+        py::arg("shared1") = false, py::arg("shared2") = false, py::call_guard<py::gil_scoped_release>());
+    // a kernel generated for the exact shape, compiled and checked on first use
+    m.def("multiply_jit", &multiply_jit, py::arg("mat1"), py::arg("mat2"), py::arg("trans1") = false,
+        py::arg("trans2") = false, py::call_guard<py::gil_scoped_release>());
+    m.def("jit_available", &JitGemm::available);
+
+    py::enum_<Matrix::MulMode>(m, "MulMode")
+        .value("STANDARD", Matrix::STANDARD)
+        .value("MKL", Matrix::MKL)
+        .value("TILE", Matrix::TILE)
+        .value("OPENMP", Matrix::OPENMP)
+        .value("THREAD", Matrix::THREAD)
+        .value("CUDA", Matrix::CUDA)
+        .value("AUTO", Matrix::AUTO)
+        .value("JIT", Matrix::JIT)
+        .value("STRASSEN", Matrix::STRASSEN);
+    m.def("set_mul_mode", [](Matrix::MulMode mode) {Matrix::setMulMode(mode);});
+    m.def("get_mul_mode", []() {return Matrix::MulMode(Matrix::mulMode.load());});
+
+    py::enum_<Matrix::HugePages>(m, "HugePages")
+        .value("NONE", Matrix::HUGE_NONE)
+        .value("TRANSPARENT", Matrix::HUGE_TRANSPARENT)
+        .value("EXPLICIT", Matrix::HUGE_EXPLICIT);
+    // applies to buffers allocated afterwards
+    py::class_<Matrix::AllocPolicy>(m, "AllocPolicy")
+        .def(py::init([](bool parallel_touch, bool interleave, Matrix::HugePages huge_pages, size_t min_bytes) {
+            return Matrix::AllocPolicy{parallel_touch, interleave, huge_pages, min_bytes};
+        }), py::arg("parallel_touch") = false, py::arg("interleave") = false,
+            py::arg("huge_pages") = Matrix::HUGE_NONE, py::arg("min_bytes") = size_t(1) << 21)
+        .def_readwrite("parallel_touch", &Matrix::AllocPolicy::parallelTouch)
+        .def_readwrite("interleave", &Matrix::AllocPolicy::interleave)
+        .def_readwrite("huge_pages", &Matrix::AllocPolicy::hugePages)
+        .def_readwrite("min_bytes", &Matrix::AllocPolicy::minBytes);
+    m.def("set_alloc_policy", &Matrix::setAllocPolicy);
+    m.def("get_alloc_policy", &Matrix::getAllocPolicy);
+
+    // STRASSEN mode tunes itself on first use unless a configuration is set
+    py::class_<StrassenConfig>(m, "StrassenConfig")
+        .def(py::init([](size_t cutoff, Matrix::MulMode base) {return StrassenConfig{cutoff, base};}),
+            py::arg("cutoff"), py::arg("base") = Matrix::MKL)
+        .def_readwrite("cutoff", &StrassenConfig::cutoff)
+        .def_property_readonly("base", [](const StrassenConfig &config) {return Matrix::MulMode(config.base);});
+    m.def("tune_strassen", &tune_strassen, py::arg("largest") = 1024, py::call_guard<py::gil_scoped_release>());
+    m.def("strassen_config", &strassen_config, py::call_guard<py::gil_scoped_release>());
+    m.def("set_strassen_config", &set_strassen_config);
+
+    py::class_<GemmConfig>(m, "GemmConfig")
+        .def_property_readonly("mode", [](const GemmConfig &config) {return Matrix::MulMode(config.mode);})
+        .def_readonly("tile_size", &GemmConfig::tileSize)
+        .def_readonly("num_threads", &GemmConfig::numThreads)
+        .def_readonly("seconds", &GemmConfig::seconds)
+        .def("__repr__", [](const GemmConfig &config) {
+            return "GemmConfig(mode=" + std::to_string(config.mode) + ", tile_size="
+                + std::to_string(config.tileSize) + ", num_threads="
+                + std::to_string(config.numThreads) + ")";
+        });
+
+    // the process-wide tuner used by MulMode.AUTO
+    py::class_<GemmAutotuner, std::unique_ptr<GemmAutotuner, py::nodelete>>(m, "GemmAutotuner")
+        .def_static("instance", &GemmAutotuner::instance, py::return_value_policy::reference)
+        .def_static("shape_class", &GemmAutotuner::shape_class)
+        .def("multiply", &GemmAutotuner::multiply, py::call_guard<py::gil_scoped_release>())
+        .def("tune", &GemmAutotuner::tune, py::call_guard<py::gil_scoped_release>())
+        .def("lookup", [](const GemmAutotuner &tuner, size_t m, size_t n, size_t k) -> py::object {
+            GemmConfig config;
+            if (!tuner.lookup(m, n, k, config)) {
+                return py::none();
+            }
+            return py::cast(config);
+        })
+        .def("entries", &GemmAutotuner::entries)
+        .def("clear", &GemmAutotuner::clear)
+        .def("set_repeats", &GemmAutotuner::setRepeats)
+        .def_property("cache_path", &GemmAutotuner::getCachePath, &GemmAutotuner::setCachePath)
+        .def("load", &GemmAutotuner::load)
+        .def("save", &GemmAutotuner::save);
 
     py::class_<Layer>(m, "Layer")
         .def(py::init<bool, bool>());
@@ -214,6 +316,8 @@ PYBIND11_MODULE(pynet, m) {
         .def("__call__", &Linear::forward)
         .def("set_weight", &Linear::set_weight)
         .def("get_weight", &Linear::get_weight)
+        .def_static("forward_batch", &Linear::forward_batch, py::arg("layers"), py::arg("inputs"),
+            py::call_guard<py::gil_scoped_release>())
         .def_property_readonly("weight", &Linear::getWeight)
         .def_property_readonly("bias", &Linear::getBias);
 
@@ -227,39 +331,461 @@ PYBIND11_MODULE(pynet, m) {
 
     py::class_<Network>(m, "Network")
         .def(py::init<std::vector<Layer*>>(), py::keep_alive<1, 2>())
+        // heavy calls drop the GIL, Network serializes training calls itself
         .def("__call__", [](Network &net, const Matrix &mat1) {
             return net.forward(mat1);
-        })
-        .def("backward", &Network::backward)
+        }, py::call_guard<py::gil_scoped_release>())
+        // inference without recording inputs, threads run it in parallel
+        .def("predict", &Network::predict, py::call_guard<py::gil_scoped_release>())
+        // ensembles: one batched GEMM per Linear depth across the networks
+        .def_static("predict_batch", &Network::predict_batch, py::arg("networks"), py::arg("inputs"),
+            py::call_guard<py::gil_scoped_release>())
+        .def("backward", &Network::backward, py::call_guard<py::gil_scoped_release>())
         .def_property("layers", &Network::get_layers, nullptr);
 
+    // the header source, or written to path when one is given
+    m.def("export_header", [](Network &network, const std::string &name, const std::string &path) {
+        if (path.empty()) {
+            return export_header(network, name);
+        }
+        export_header(network, name, path);
+        return std::string();
+    }, py::arg("network"), py::arg("name"), py::arg("path") = "");
+
+    // forward goes through operator(), which holds the loss lock
     py::class_<BaseLoss>(m, "BaseLoss")
         .def(py::init<>())
-        .def("__call__", &BaseLoss::operator())
-        .def("forward", &BaseLoss::forward)
-        .def("backward", &BaseLoss::backward);
+        .def("__call__", &BaseLoss::operator(), py::call_guard<py::gil_scoped_release>())
+        .def("forward", &BaseLoss::operator(), py::call_guard<py::gil_scoped_release>())
+        .def("backward", &BaseLoss::backward, py::call_guard<py::gil_scoped_release>());
 
     py::class_<MSE, BaseLoss>(m, "MSE")
-        .def(py::init<>())
-        .def("forward", &MSE::forward)
-        .def("backward", &MSE::backward);
+        .def(py::init<>());
 
     py::class_<CategoricalCrossentropy, BaseLoss>(m, "CategoricalCrossentropy")
-        .def(py::init<>())
-        .def("forward", &CategoricalCrossentropy::forward)
-        .def("backward", &CategoricalCrossentropy::backward);
+        .def(py::init<>());
 
     py::class_<SGD>(m, "SGD")
         .def(py::init<double, double>())
-        .def("apply_gradient", &SGD::apply_gradient);
+        .def_property("learning_rate", &SGD::getLearningRate, &SGD::setLearningRate)
+        .def_property("momentum", &SGD::getMomentum, &SGD::setMomentum)
+        .def("apply_gradient", &SGD::apply_gradient, py::call_guard<py::gil_scoped_release>());
     
+    py::class_<Dataset>(m, "Dataset")
+        // features [N, ...] and labels [N] are copied once as uint8; other dtypes are
+        // refused rather than cast (normalized floats would truncate to 0)
+        .def(py::init([](py::array feature_array, py::array label_array,
+                         size_t num_classes, double scale, double shift) {
+            if (!py::isinstance<py::array_t<uint8_t>>(feature_array) || !py::isinstance<py::array_t<uint8_t>>(label_array)) {
+                throw std::runtime_error("Dataset: features and labels must be uint8 arrays (got "
+                                         + std::string(py::str(feature_array.dtype())) + " and "
+                                         + std::string(py::str(label_array.dtype()))
+                                         + "), pass raw values and normalize with scale and shift");
+            }
+            // same dtype, only the layout may change
+            auto features = py::array_t<uint8_t, py::array::c_style | py::array::forcecast>::ensure(feature_array);
+            auto labels = py::array_t<uint8_t, py::array::c_style | py::array::forcecast>::ensure(label_array);
+            if (features.ndim() < 2 || labels.ndim() != 1 || features.shape(0) != labels.shape(0)) {
+                throw std::runtime_error("Dataset: expected features [N, ...] and labels [N]");
+            }
+            size_t samples = features.shape(0);
+            std::vector<uint8_t> x(features.data(), features.data() + features.size());
+            std::vector<uint8_t> y(labels.data(), labels.data() + labels.size());
+            return Dataset(std::move(x), std::move(y), samples, features.size() / samples,
+                           num_classes, scale, shift);
+        }),
+            py::arg("features"),
+            py::arg("labels"),
+            py::arg("num_classes"),
+            py::arg("scale") = 1.0 / 255.0,
+            py::arg("shift") = -0.5)
+        .def("__len__", &Dataset::size)
+        .def("getFeatureCount", &Dataset::getFeatureCount)
+        .def("getClassCount", &Dataset::getClassCount)
+        // read-only uint8 views of the stored samples, the dataset stays alive with them
+        .def_property_readonly("features", [](py::object self) {
+            const Dataset &dataset = self.cast<const Dataset&>();
+            py::array_t<uint8_t> view(std::vector<size_t>{dataset.size(), dataset.getFeatureCount()},
+                                      dataset.getFeatures(), self);
+            view.attr("setflags")(py::arg("write") = false);
+            return view;
+        })
+        .def_property_readonly("labels", [](py::object self) {
+            const Dataset &dataset = self.cast<const Dataset&>();
+            py::array_t<uint8_t> view(std::vector<size_t>{dataset.size()}, dataset.getLabels(), self);
+            view.attr("setflags")(py::arg("write") = false);
+            return view;
+        })
+        .def("toMatrix", py::overload_cast<>(&Dataset::toMatrix, py::const_),
+            py::call_guard<py::gil_scoped_release>())
+        .def("toMatrix", py::overload_cast<size_t, size_t>(&Dataset::toMatrix, py::const_),
+            py::call_guard<py::gil_scoped_release>());
+
+    py::class_<BatchStream>(m, "BatchStream")
+        .def("start", &BatchStream::start)
+        .def("stop", &BatchStream::stop)
+        .def("num_batches", &BatchStream::num_batches)
+        .def("__len__", &BatchStream::num_batches)
+        .def("__iter__", [](BatchStream &stream) -> BatchStream& {
+            stream.start();
+            return stream;
+        }, py::return_value_policy::reference_internal)
+        // the returned matrices are reused buffers, overwritten by the following batch
+        .def("__next__", [](py::object self) {
+            BatchStream &stream = self.cast<BatchStream&>();
+            const Matrix *batch_data, *batch_labels;
+            bool has_next;
+            {
+                py::gil_scoped_release release;
+                has_next = stream.next(batch_data, batch_labels);
+            }
+            if (!has_next) {
+                throw py::stop_iteration();
+            }
+            return py::make_tuple(
+                py::cast(batch_data, py::return_value_policy::reference_internal, self),
+                py::cast(batch_labels, py::return_value_policy::reference_internal, self));
+        });
+
+    py::class_<DataLoader, BatchStream>(m, "DataLoader")
+        .def(py::init<const Matrix&, const Matrix&, size_t, bool, size_t, unsigned int>(),
+            py::arg("data"),
+            py::arg("labels"),
+            py::arg("batch_size"),
+            py::arg("shuffle") = true,
+            py::arg("num_buffers") = 2,
+            py::arg("seed") = 0,
+            py::keep_alive<1, 2>(),
+            py::keep_alive<1, 3>())
+        .def(py::init<const Dataset&, size_t, bool, size_t, unsigned int>(),
+            py::arg("dataset"),
+            py::arg("batch_size"),
+            py::arg("shuffle") = true,
+            py::arg("num_buffers") = 2,
+            py::arg("seed") = 0,
+            py::keep_alive<1, 2>());
+
+    py::class_<SampleFile, std::shared_ptr<SampleFile>>(m, "SampleFile")
+        .def("__len__", &SampleFile::size)
+        .def("getFeatureCount", &SampleFile::getFeatureCount);
+
+    py::class_<IdxSampleFile, SampleFile, std::shared_ptr<IdxSampleFile>>(m, "IdxSampleFile")
+        .def(py::init<const std::string&, const std::string&>(),
+            py::arg("images_path"),
+            py::arg("labels_path"));
+
+    py::class_<NpySampleFile, SampleFile, std::shared_ptr<NpySampleFile>>(m, "NpySampleFile")
+        .def(py::init<const std::string&, const std::string&>(),
+            py::arg("features_path"),
+            py::arg("labels_path"));
+
+    py::class_<BinarySampleFile, SampleFile, std::shared_ptr<BinarySampleFile>>(m, "BinarySampleFile")
+        .def(py::init<const std::string&>(), py::arg("path"))
+        .def("getClassCount", &BinarySampleFile::getClassCount);
+
+    m.def("write_binary_dataset", &write_binary_dataset,
+        py::arg("dataset"),
+        py::arg("path"),
+        py::arg("start") = 0,
+        py::arg("end") = 0);
+
+    py::class_<StreamingDataset, BatchStream>(m, "StreamingDataset")
+        .def(py::init<std::vector<std::shared_ptr<SampleFile>>, size_t, size_t, size_t, size_t, size_t,
+                      bool, bool, unsigned int, double, double>(),
+            py::arg("shards"),
+            py::arg("num_classes"),
+            py::arg("batch_size"),
+            py::arg("chunk_rows") = 8192,
+            py::arg("readahead") = 4,
+            py::arg("num_workers") = 2,
+            py::arg("shuffle") = true,
+            py::arg("drop_last") = true,
+            py::arg("seed") = 0,
+            py::arg("scale") = 1.0 / 255.0,
+            py::arg("shift") = -0.5)
+        .def("__len__", &StreamingDataset::num_batches)
+        .def("size", &StreamingDataset::size);
+
     m.def("load_mnist_data", &load_mnist_data,
         py::arg("images_path"),
         py::arg("labels_path"),
-        py::arg("num_samples"));
+        py::arg("num_samples"),
+        py::arg("num_classes") = 0,
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("load_idx_dataset", &load_idx_dataset,
+        py::arg("images_path"),
+        py::arg("labels_path"),
+        py::arg("num_samples") = 0,
+        py::arg("num_classes") = 0,
+        py::arg("scale") = 1.0 / 255.0,
+        py::arg("shift") = -0.5,
+        py::call_guard<py::gil_scoped_release>());
+
+    // .npy files are mapped and converted inside the library, the GIL is not needed
+    m.def("load_npy_dataset", &load_npy_dataset,
+        py::arg("features_path"),
+        py::arg("labels_path"),
+        py::arg("num_samples") = 0,
+        py::arg("num_classes") = 0,
+        py::arg("scale") = 1.0 / 255.0,
+        py::arg("shift") = -0.5,
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("load_npy_data", &load_npy_data,
+        py::arg("features_path"),
+        py::arg("labels_path"),
+        py::arg("num_samples") = 0,
+        py::arg("num_classes") = 0,
+        py::arg("scale") = 1.0 / 255.0,
+        py::arg("shift") = -0.5,
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("load_npy_matrix", &load_npy_matrix,
+        py::arg("path"),
+        py::arg("scale") = 1.0,
+        py::arg("shift") = 0.0,
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("save_checkpoint", &save_checkpoint,
+        py::arg("path"),
+        py::arg("network"),
+        py::arg("optimizer") = nullptr,
+        py::arg("step") = 0,
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("load_checkpoint", &load_checkpoint,
+        py::arg("path"),
+        py::arg("network"),
+        py::arg("optimizer") = nullptr,
+        py::call_guard<py::gil_scoped_release>());
+
+    // the returned layers are owned by Python
+    m.def("load_checkpoint_layers", &load_checkpoint_layers,
+        py::arg("path"));
+
+    py::class_<CheckpointWriter>(m, "CheckpointWriter")
+        .def(py::init<>())
+        .def("snapshot", &CheckpointWriter::snapshot,
+            py::arg("path"),
+            py::arg("network"),
+            py::arg("optimizer") = nullptr,
+            py::arg("step") = 0,
+            py::call_guard<py::gil_scoped_release>())
+        .def("wait", &CheckpointWriter::wait, py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("written", &CheckpointWriter::getWritten);
+
+    // serving: weights stay in the read-only mapping, shared across processes
+    py::class_<MappedModel>(m, "MappedModel")
+        .def(py::init<const std::string&>(), py::arg("path"))
+        .def("__call__", &MappedModel::forward, py::call_guard<py::gil_scoped_release>())
+        .def("forward", &MappedModel::forward, py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("layers", [](MappedModel &model) {
+            return model.getNetwork().get_layers();
+        }, py::return_value_policy::reference_internal)
+        .def_property_readonly("step", &MappedModel::getStep)
+        .def_property_readonly("mapped_size", &MappedModel::getMappedSize);
+
+    // post-training int8: per-channel weight scales, activations quantized per row
+    py::enum_<QuantKernel>(m, "QuantKernel")
+        .value("SCALAR", QUANT_SCALAR)
+        .value("AVX2", QUANT_AVX2)
+        .value("VNNI", QUANT_VNNI);
+    m.def("quant_kernel_available", &quant_kernel_available);
+    m.def("get_quant_kernel", [] {return QuantKernel(get_quant_kernel());});
+    m.def("set_quant_kernel", [](QuantKernel kernel) {set_quant_kernel(kernel);});
+
+    py::class_<QuantizedLinear, Layer>(m, "QuantizedLinear")
+        .def(py::init<const Linear&>(), py::arg("linear"))
+        .def("forward", &QuantizedLinear::forward, py::call_guard<py::gil_scoped_release>())
+        .def("__call__", &QuantizedLinear::forward, py::call_guard<py::gil_scoped_release>())
+        .def("dequantized_weight", &QuantizedLinear::dequantized_weight)
+        .def_property_readonly("scales", &QuantizedLinear::getScales)
+        .def_property_readonly("bytes", &QuantizedLinear::getBytes);
+
+    py::class_<QuantizedModel>(m, "QuantizedModel")
+        .def(py::init<Network&>(), py::arg("network"))
+        .def("__call__", &QuantizedModel::forward, py::call_guard<py::gil_scoped_release>())
+        .def("forward", &QuantizedModel::forward, py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("layers", [](QuantizedModel &model) {
+            return model.getNetwork().get_layers();
+        }, py::return_value_policy::reference_internal)
+        .def_property_readonly("bytes", &QuantizedModel::getBytes);
+
+    py::class_<QuantReport>(m, "QuantReport")
+        .def_readonly("samples", &QuantReport::samples)
+        .def_readonly("reference_accuracy", &QuantReport::referenceAccuracy)
+        .def_readonly("quantized_accuracy", &QuantReport::quantizedAccuracy)
+        .def_readonly("agreement", &QuantReport::agreement)
+        .def_readonly("max_error", &QuantReport::maxError)
+        .def_readonly("mean_error", &QuantReport::meanError)
+        .def_readonly("relative_error", &QuantReport::relativeError)
+        .def_readonly("reference_bytes", &QuantReport::referenceBytes)
+        .def_readonly("quantized_bytes", &QuantReport::quantizedBytes)
+        .def_readonly("reference_seconds", &QuantReport::referenceSeconds)
+        .def_readonly("quantized_seconds", &QuantReport::quantizedSeconds)
+        .def("__str__", &QuantReport::str);
+    m.def("quantization_report", &quantization_report, py::arg("reference"), py::arg("model"),
+        py::arg("inputs"), py::arg("labels"), py::call_guard<py::gil_scoped_release>());
+
+    py::class_<TrainProgress>(m, "TrainProgress")
+        .def_readonly("epoch", &TrainProgress::epoch)
+        .def_readonly("batch", &TrainProgress::batch)
+        .def_readonly("num_batches", &TrainProgress::numBatches)
+        .def_readonly("step", &TrainProgress::step)
+        .def_readonly("loss", &TrainProgress::loss)
+        .def_readonly("average_loss", &TrainProgress::averageLoss);
+
+    py::class_<EpochStats>(m, "EpochStats")
+        .def_readonly("epoch", &EpochStats::epoch)
+        .def_readonly("batches", &EpochStats::batches)
+        .def_readonly("samples", &EpochStats::samples)
+        .def_readonly("loss", &EpochStats::loss)
+        .def_readonly("seconds", &EpochStats::seconds)
+        .def_readonly("samples_per_second", &EpochStats::samplesPerSecond);
+
+    py::class_<EvalStats>(m, "EvalStats")
+        .def_readonly("samples", &EvalStats::samples)
+        .def_readonly("loss", &EvalStats::loss)
+        .def_readonly("accuracy", &EvalStats::accuracy);
+
+    // epochs run with the GIL released, callbacks take it back only while they run
+    py::class_<Trainer>(m, "Trainer")
+        .def(py::init<Network&, BaseLoss&, SGD&>(),
+            py::arg("network"),
+            py::arg("loss"),
+            py::arg("optimizer"),
+            py::keep_alive<1, 2>(),
+            py::keep_alive<1, 3>(),
+            py::keep_alive<1, 4>())
+        .def("set_progress_callback", [](Trainer &trainer, py::object callback, size_t interval) {
+            if (callback.is_none()) {
+                trainer.setProgressCallback(nullptr, interval);
+                return;
+            }
+            // the std::function owns a reference, copied and destroyed with the GIL held
+            auto shared = std::make_shared<py::object>(callback);
+            trainer.setProgressCallback([shared](const TrainProgress &progress) {
+                py::gil_scoped_acquire acquire;
+                (*shared)(progress);
+                // Ctrl-C interrupts the epoch at the next report
+                if (PyErr_CheckSignals() != 0) {
+                    throw py::error_already_set();
+                }
+            }, interval);
+        }, py::arg("callback"), py::arg("interval") = 100)
+        .def("set_epoch_callback", [](Trainer &trainer, py::object callback) {
+            if (callback.is_none()) {
+                trainer.setEpochCallback(nullptr);
+                return;
+            }
+            auto shared = std::make_shared<py::object>(callback);
+            trainer.setEpochCallback([shared](const EpochStats &stats) {
+                py::gil_scoped_acquire acquire;
+                (*shared)(stats);
+            });
+        }, py::arg("callback"))
+        .def("train_epoch", &Trainer::train_epoch, py::arg("data"),
+            py::call_guard<py::gil_scoped_release>())
+        .def("fit", &Trainer::fit, py::arg("data"), py::arg("epochs"),
+            py::call_guard<py::gil_scoped_release>())
+        .def("evaluate", &Trainer::evaluate, py::arg("data"),
+            py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("step", &Trainer::getStep)
+        .def_property_readonly("epoch", &Trainer::getEpoch);
 
     m.def("compute_accuracy", &compute_accuracy,
         py::arg("predictions"),
-        py::arg("labels"));
+        py::arg("labels"),
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("count_correct", &count_correct,
+        py::arg("predictions"),
+        py::arg("labels"),
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("argmax_rows", &argmax_rows,
+        py::arg("matrix"),
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("top_k_accuracy", &top_k_accuracy,
+        py::arg("predictions"),
+        py::arg("labels"),
+        py::arg("k"),
+        py::call_guard<py::gil_scoped_release>());
+
+    m.def("confusion_matrix", &confusion_matrix,
+        py::arg("predictions"),
+        py::arg("labels"),
+        py::call_guard<py::gil_scoped_release>());
+
+    py::enum_<Reduction>(m, "Reduction")
+        .value("SUM", Reduction::SUM)
+        .value("MEAN", Reduction::MEAN)
+        .value("SAMPLE_MEAN", Reduction::SAMPLE_MEAN);
+
+    m.def("reduce_loss", &reduce_loss,
+        py::arg("loss"),
+        py::arg("reduction") = Reduction::SAMPLE_MEAN,
+        py::call_guard<py::gil_scoped_release>());
+
+    py::class_<ProfileSummary>(m, "ProfileSummary")
+        .def_readonly("category", &ProfileSummary::category)
+        .def_readonly("name", &ProfileSummary::name)
+        .def_property_readonly("dims", [](const ProfileSummary &group) {
+            std::vector<int64_t> dims;
+            for (int i = 0; i < 3 && group.dims[i] >= 0; i++) {
+                dims.push_back(group.dims[i]);
+            }
+            return dims;
+        })
+        .def_readonly("calls", &ProfileSummary::calls)
+        .def_readonly("total", &ProfileSummary::total)
+        .def_readonly("min", &ProfileSummary::min)
+        .def_readonly("max", &ProfileSummary::max);
+
+    // runtime toggle, events of Python-driven training land in the same buffers
+    py::class_<Profiler>(m, "Profiler")
+        .def_static("enable", &Profiler::enable, py::arg("on") = true)
+        .def_static("disable", &Profiler::disable)
+        .def_static("enabled", &Profiler::enabled)
+        .def_static("clear", &Profiler::clear)
+        .def_static("set_buffer_size", &Profiler::setBufferSize)
+        .def_static("get_buffer_size", &Profiler::getBufferSize)
+        .def_static("dropped", &Profiler::dropped)
+        .def_static("summary", &Profiler::summary)
+        .def_static("report", &Profiler::report)
+        .def_static("chrome_trace", &Profiler::chrome_trace)
+        .def_static("write_chrome_trace", &Profiler::write_chrome_trace, py::arg("path"));
+
+    py::class_<OpTotals>(m, "OpTotals")
+        .def_readonly("context", &OpTotals::context)
+        .def_readonly("op", &OpTotals::op)
+        .def_property_readonly("op_class", [](const OpTotals &t) {return OpStats::className(t.opClass);})
+        .def_property_readonly("dims", [](const OpTotals &t) {
+            std::vector<int64_t> dims;
+            for (int i = 0; i < 3 && t.dims[i] >= 0; i++) {
+                dims.push_back(t.dims[i]);
+            }
+            return dims;
+        })
+        .def_readonly("calls", &OpTotals::calls)
+        .def_readonly("flops", &OpTotals::flops)
+        .def_readonly("bytes_read", &OpTotals::bytesRead)
+        .def_readonly("bytes_written", &OpTotals::bytesWritten)
+        .def_readonly("seconds", &OpTotals::seconds)
+        .def("gflops", &OpTotals::gflops)
+        .def("gbps", &OpTotals::gbps)
+        .def("intensity", &OpTotals::intensity);
+
+    // clear() at the start of an epoch, report(steps) at its end
+    py::class_<OpStats>(m, "OpStats")
+        .def_static("enable", &OpStats::enable, py::arg("on") = true)
+        .def_static("disable", &OpStats::disable)
+        .def_static("enabled", &OpStats::enabled)
+        .def_static("clear", &OpStats::clear)
+        .def_static("totals", &OpStats::totals)
+        .def_static("classes", &OpStats::classes)
+        .def_static("report", &OpStats::report, py::arg("steps") = 1, py::arg("max_rows") = 40);
 }
     
\ No newline at end of file
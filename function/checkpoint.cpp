@@ -0,0 +1,465 @@
+#include "checkpoint.h"
+#include "dataset.h"
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char CHECKPOINT_MAGIC[8] = {'M', 'O', 'F', 'C', 'K', 'P', 'T', '\0'};
+
+static size_t round_up(size_t value, size_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+// rows * cols doubles, checked by division before the product can wrap
+static size_t tensor_bytes(uint64_t rows, uint64_t cols)
+{
+    if (cols != 0 && rows > SIZE_MAX / sizeof(double) / cols) {
+        throw std::runtime_error("Checkpoint: tensor size overflows");
+    }
+    return rows * cols * sizeof(double);
+}
+
+Checkpoint::Checkpoint(const uint8_t *data, size_t size)
+{
+    if (size < sizeof(CheckpointHeader) || memcmp(data, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+        throw std::runtime_error("Checkpoint: invalid magic");
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.version != VERSION) {
+        throw std::runtime_error("Checkpoint: unsupported version " + std::to_string(header.version));
+    }
+    size_t records = sizeof(CheckpointHeader) + header.numLayers * sizeof(LayerRecord)
+                   + header.numTensors * sizeof(TensorRecord);
+    if (header.headerSize < records || header.headerSize > size || header.dataSize > size - header.headerSize) {
+        throw std::runtime_error("Checkpoint: truncated file");
+    }
+    layers.resize(header.numLayers);
+    tensors.resize(header.numTensors);
+    const uint8_t *ptr = data + sizeof(CheckpointHeader);
+    memcpy(layers.data(), ptr, layers.size() * sizeof(LayerRecord));
+    ptr += layers.size() * sizeof(LayerRecord);
+    memcpy(tensors.data(), ptr, tensors.size() * sizeof(TensorRecord));
+    size_t end = header.headerSize + header.dataSize;
+    for (const TensorRecord &tensor : tensors) {
+        if (tensor.layer >= header.numLayers || tensor.offset < header.headerSize
+            || tensor.offset % sizeof(double) != 0 || tensor.offset > end
+            || tensor_bytes(tensor.rows, tensor.cols) > end - tensor.offset) {
+            throw std::runtime_error("Checkpoint: tensor outside the data section");
+        }
+    }
+}
+
+const TensorRecord *Checkpoint::find(size_t layer, uint32_t kind) const
+{
+    for (const TensorRecord &tensor : tensors) {
+        if (tensor.layer == layer && tensor.kind == kind) {
+            return &tensor;
+        }
+    }
+    return nullptr;
+}
+
+CheckpointImage::CheckpointImage() : data(nullptr), size(0), capacity(0) {}
+
+CheckpointImage::~CheckpointImage()
+{
+    free(data);
+}
+
+struct TensorSource {
+    TensorRecord record;
+    const Matrix *matrix;
+};
+
+void CheckpointImage::capture(Network &network, const SGD *optimizer, uint64_t step)
+{
+    // parameters must not change while they are copied
+    std::shared_lock<std::shared_mutex> lock(network.getMutex());
+    std::vector<Layer*> &network_layers = network.get_layers();
+    std::vector<LayerRecord> layers;
+    std::vector<TensorSource> sources;
+    const std::vector<std::vector<Matrix>> *velocity = nullptr;
+    if (optimizer != nullptr && optimizer->getVelocity().size() == network_layers.size()) {
+        velocity = &optimizer->getVelocity();
+    }
+
+    for (size_t i = 0; i < network_layers.size(); i++) {
+        LayerRecord layer = {};
+        if (Linear *linear = dynamic_cast<Linear *>(network_layers[i])) {
+            layer.type = Checkpoint::LINEAR;
+            layer.flags = (linear->getUseBias() ? Checkpoint::HAS_BIAS : 0)
+                        | (linear->getTrainableVar() ? Checkpoint::TRAINABLE : 0);
+            layer.inChannel = linear->getWeight().getRow();
+            layer.outChannel = linear->getWeight().getCol();
+            uint32_t index = i;
+            sources.push_back({{index, Checkpoint::WEIGHT, 0, 0, 0}, &linear->getWeight()});
+            if (linear->getUseBias()) {
+                sources.push_back({{index, Checkpoint::BIAS, 0, 0, 0}, &linear->getBias()});
+            }
+            if (velocity != nullptr && !(*velocity)[i].empty()) {
+                sources.push_back({{index, Checkpoint::WEIGHT_VELOCITY, 0, 0, 0}, &(*velocity)[i][0]});
+                if ((*velocity)[i].size() > 1) {
+                    sources.push_back({{index, Checkpoint::BIAS_VELOCITY, 0, 0, 0}, &(*velocity)[i][1]});
+                }
+            }
+        }
+        else if (dynamic_cast<Sigmoid *>(network_layers[i]) != nullptr) {
+            layer.type = Checkpoint::SIGMOID;
+        }
+        else if (dynamic_cast<ReLU *>(network_layers[i]) != nullptr) {
+            layer.type = Checkpoint::RELU;
+        }
+        else {
+            throw std::runtime_error("CheckpointImage: unsupported layer type");
+        }
+        layers.push_back(layer);
+    }
+
+    // layout: records fill the header pages, tensors follow 64-byte aligned
+    size_t header_size = round_up(sizeof(CheckpointHeader) + layers.size() * sizeof(LayerRecord)
+                                  + sources.size() * sizeof(TensorRecord), Checkpoint::DATA_ALIGN);
+    size_t end = header_size;
+    for (TensorSource &source : sources) {
+        source.record.rows = source.matrix->getRow();
+        source.record.cols = source.matrix->getCol();
+        source.record.offset = round_up(end, Checkpoint::TENSOR_ALIGN);
+        end = source.record.offset + tensor_bytes(source.record.rows, source.record.cols);
+    }
+    size_t total = round_up(end, Checkpoint::DATA_ALIGN);
+    if (total > capacity) {
+        free(data);
+        data = nullptr;
+        capacity = 0;
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, Checkpoint::DATA_ALIGN, total) != 0) {
+            throw std::runtime_error("CheckpointImage: out of memory");
+        }
+        data = static_cast<uint8_t *>(ptr);
+        capacity = total;
+    }
+    size = total;
+
+    CheckpointHeader header = {};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = Checkpoint::VERSION;
+    header.numLayers = layers.size();
+    header.numTensors = sources.size();
+    header.headerSize = header_size;
+    header.dataSize = end - header_size;
+    header.step = step;
+    header.learningRate = optimizer != nullptr ? optimizer->getLearningRate() : 0.0;
+    header.momentum = optimizer != nullptr ? optimizer->getMomentum() : 0.0;
+
+    memset(data, 0, header_size);
+    uint8_t *ptr = data;
+    memcpy(ptr, &header, sizeof(header));
+    ptr += sizeof(header);
+    memcpy(ptr, layers.data(), layers.size() * sizeof(LayerRecord));
+    ptr += layers.size() * sizeof(LayerRecord);
+    size_t cursor = header_size;
+    for (const TensorSource &source : sources) {
+        memcpy(ptr, &source.record, sizeof(TensorRecord));
+        ptr += sizeof(TensorRecord);
+        size_t bytes = tensor_bytes(source.record.rows, source.record.cols);
+        memset(data + cursor, 0, source.record.offset - cursor);
+        memcpy(data + source.record.offset, source.matrix->getData(), bytes);
+        cursor = source.record.offset + bytes;
+    }
+    memset(data + cursor, 0, total - cursor);
+}
+
+static int open_output(const std::string &path, bool direct)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (direct) {
+        flags |= O_DIRECT;
+    }
+#endif
+    return ::open(path.c_str(), flags, 0644);
+}
+
+void CheckpointImage::write(const std::string &path) const
+{
+    // the image is page-aligned and padded, so it can bypass the page cache
+    std::string tmp = path + ".tmp";
+    bool direct = true;
+    int fd = open_output(tmp, true);
+    if (fd < 0) {
+        // filesystems without O_DIRECT support (tmpfs, ...)
+        direct = false;
+        fd = open_output(tmp, false);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("CheckpointImage: cannot open " + tmp);
+    }
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::write(fd, data + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+#ifdef O_DIRECT
+        if (n < 0 && errno == EINVAL && direct) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+            continue;
+        }
+#endif
+        if (n <= 0) {
+            ::close(fd);
+            unlink(tmp.c_str());
+            throw std::runtime_error("CheckpointImage: cannot write " + tmp);
+        }
+        done += n;
+    }
+    if (fdatasync(fd) != 0) {
+        ::close(fd);
+        unlink(tmp.c_str());
+        throw std::runtime_error("CheckpointImage: cannot sync " + tmp);
+    }
+    ::close(fd);
+    // readers never see a partially written checkpoint
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw std::runtime_error("CheckpointImage: cannot rename " + tmp);
+    }
+}
+
+void save_checkpoint(const std::string &path, Network &network, const SGD *optimizer, uint64_t step)
+{
+    CheckpointImage image;
+    image.capture(network, optimizer, step);
+    image.write(path);
+}
+
+static Matrix tensor_matrix(const MappedFile &file, const TensorRecord &tensor)
+{
+    const double *values = reinterpret_cast<const double *>(file.getData() + tensor.offset);
+    return Matrix(values, tensor.rows, tensor.cols);
+}
+
+// weight and bias of a linear layer record
+static std::vector<Matrix> linear_weights(const MappedFile &file, const Checkpoint &checkpoint, size_t layer)
+{
+    const TensorRecord *weight = checkpoint.find(layer, Checkpoint::WEIGHT);
+    if (weight == nullptr) {
+        throw std::runtime_error("load_checkpoint: missing weight of layer " + std::to_string(layer));
+    }
+    std::vector<Matrix> weights = {tensor_matrix(file, *weight)};
+    if (checkpoint.layers[layer].flags & Checkpoint::HAS_BIAS) {
+        const TensorRecord *bias = checkpoint.find(layer, Checkpoint::BIAS);
+        if (bias == nullptr) {
+            throw std::runtime_error("load_checkpoint: missing bias of layer " + std::to_string(layer));
+        }
+        weights.push_back(tensor_matrix(file, *bias));
+    }
+    return weights;
+}
+
+// velocity tensor of a layer, shaped like its parameter
+static Matrix velocity_matrix(const MappedFile &file, const TensorRecord *tensor, const Matrix &parameter,
+                              size_t layer)
+{
+    if (tensor == nullptr || tensor->rows != parameter.getRow() || tensor->cols != parameter.getCol()) {
+        throw std::runtime_error("load_checkpoint: velocity of layer " + std::to_string(layer)
+                                 + " is missing or does not match its parameter");
+    }
+    return tensor_matrix(file, *tensor);
+}
+
+uint64_t load_checkpoint(const std::string &path, Network &network, SGD *optimizer)
+{
+    MappedFile file(path);
+    Checkpoint checkpoint(file.getData(), file.getSize());
+    std::vector<Layer*> &layers = network.get_layers();
+    if (checkpoint.layers.size() != layers.size()) {
+        throw std::runtime_error("load_checkpoint: layer count does not match the network");
+    }
+
+    // everything is checked before the network or the optimizer is touched
+    std::vector<std::vector<Matrix>> weights(layers.size());
+    std::vector<std::vector<Matrix>> velocity(layers.size());
+    size_t linear_layers = 0, with_velocity = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        const LayerRecord &record = checkpoint.layers[i];
+        if (Linear *linear = dynamic_cast<Linear *>(layers[i])) {
+            if (record.type != Checkpoint::LINEAR || record.inChannel != linear->getWeight().getRow()
+                || record.outChannel != linear->getWeight().getCol()
+                || ((record.flags & Checkpoint::HAS_BIAS) != 0) != linear->getUseBias()) {
+                throw std::runtime_error("load_checkpoint: layer " + std::to_string(i) + " does not match");
+            }
+            weights[i] = linear_weights(file, checkpoint, i);
+            linear_layers++;
+            // SGD indexes the velocity like the gradients: every Linear has it, bias included, or none does
+            const TensorRecord *weight_velocity = checkpoint.find(i, Checkpoint::WEIGHT_VELOCITY);
+            const TensorRecord *bias_velocity = checkpoint.find(i, Checkpoint::BIAS_VELOCITY);
+            if (weight_velocity != nullptr || bias_velocity != nullptr) {
+                with_velocity++;
+                for (size_t j = 0; j < weights[i].size(); j++) {
+                    velocity[i].push_back(velocity_matrix(file, j == 0 ? weight_velocity : bias_velocity,
+                                                          weights[i][j], i));
+                }
+                if (!linear->getUseBias() && bias_velocity != nullptr) {
+                    throw std::runtime_error("load_checkpoint: bias velocity on layer " + std::to_string(i)
+                                             + " without a bias");
+                }
+            }
+        }
+        else if ((dynamic_cast<Sigmoid *>(layers[i]) != nullptr && record.type != Checkpoint::SIGMOID)
+                 || (dynamic_cast<ReLU *>(layers[i]) != nullptr && record.type != Checkpoint::RELU)) {
+            throw std::runtime_error("load_checkpoint: layer " + std::to_string(i) + " does not match");
+        }
+    }
+    if (with_velocity != 0 && with_velocity != linear_layers) {
+        throw std::runtime_error("load_checkpoint: velocity is stored for some Linear layers only");
+    }
+    // a zero learning rate means the checkpoint was saved without an optimizer
+    bool has_optimizer = checkpoint.header.learningRate != 0.0;
+    if (has_optimizer && !(std::isfinite(checkpoint.header.learningRate) && std::isfinite(checkpoint.header.momentum))) {
+        throw std::runtime_error("load_checkpoint: invalid optimizer hyperparameters");
+    }
+
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (!weights[i].empty()) {
+            dynamic_cast<Linear *>(layers[i])->set_weight(weights[i]);
+        }
+    }
+    if (optimizer != nullptr) {
+        if (has_optimizer) {
+            optimizer->setLearningRate(checkpoint.header.learningRate);
+            optimizer->setMomentum(checkpoint.header.momentum);
+        }
+        optimizer->setVelocity(with_velocity != 0 ? std::move(velocity) : std::vector<std::vector<Matrix>>());
+    }
+    return checkpoint.header.step;
+}
+
+std::vector<Layer*> load_checkpoint_layers(const std::string &path)
+{
+    MappedFile file(path);
+    Checkpoint checkpoint(file.getData(), file.getSize());
+    std::vector<Layer*> layers;
+    try {
+        for (size_t i = 0; i < checkpoint.layers.size(); i++) {
+            const LayerRecord &record = checkpoint.layers[i];
+            if (record.type == Checkpoint::LINEAR) {
+                Linear *linear = new Linear(record.inChannel, record.outChannel,
+                                            record.flags & Checkpoint::HAS_BIAS,
+                                            record.flags & Checkpoint::TRAINABLE);
+                layers.push_back(linear);
+                linear->set_weight(linear_weights(file, checkpoint, i));
+            }
+            else if (record.type == Checkpoint::SIGMOID) {
+                layers.push_back(new Sigmoid());
+            }
+            else if (record.type == Checkpoint::RELU) {
+                layers.push_back(new ReLU());
+            }
+            else {
+                throw std::runtime_error("load_checkpoint_layers: unknown layer type");
+            }
+        }
+    }
+    catch (...) {
+        for (Layer *layer : layers) {
+            delete layer;
+        }
+        throw;
+    }
+    return layers;
+}
+
+CheckpointWriter::CheckpointWriter()
+    : writing(-1), pending(-1), written(0), stopping(false)
+{
+    worker = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    // the queued snapshot is still written before the thread exits
+    worker.join();
+}
+
+void CheckpointWriter::snapshot(const std::string &path, Network &network, const SGD *optimizer, uint64_t step)
+{
+    int target;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error) {
+            std::exception_ptr failure = error;
+            error = nullptr;
+            std::rethrow_exception(failure);
+        }
+        // the image not being written, a queued older snapshot there is dropped
+        target = writing == 0 ? 1 : 0;
+        if (pending == target) {
+            pending = -1;
+        }
+    }
+    images[target].capture(network, optimizer, step);
+    paths[target] = path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = target;
+    }
+    cv.notify_all();
+}
+
+void CheckpointWriter::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] {return pending == -1 && writing == -1;});
+    if (error) {
+        std::exception_ptr failure = error;
+        error = nullptr;
+        std::rethrow_exception(failure);
+    }
+}
+
+size_t CheckpointWriter::getWritten() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return written;
+}
+
+void CheckpointWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] {return stopping || pending != -1;});
+        if (pending == -1) {
+            break;
+        }
+        writing = pending;
+        pending = -1;
+        lock.unlock();
+        std::exception_ptr failure;
+        try {
+            images[writing].write(paths[writing]);
+        }
+        catch (...) {
+            failure = std::current_exception();
+        }
+        lock.lock();
+        if (failure) {
+            error = failure;
+        }
+        else {
+            written++;
+        }
+        writing = -1;
+        cv.notify_all();
+    }
+}
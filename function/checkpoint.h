@@ -0,0 +1,142 @@
+// versioned binary checkpoints: layer topology, parameters and SGD velocity
+// header (padded to 4096): CheckpointHeader, LayerRecord[numLayers], TensorRecord[numTensors]
+// data: row-major doubles, each tensor 64-byte aligned, file padded to 4096
+// the whole image is built in memory and written with one sequential (O_DIRECT) write
+#include "network.h"
+#include "linear.h"
+#include "activation.h"
+#include "optimizer.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#ifndef __CHECKPOINT__
+#define __CHECKPOINT__
+
+struct CheckpointHeader {
+    char magic[8];         // "MOFCKPT\0"
+    uint32_t version;
+    uint32_t numLayers;
+    uint32_t numTensors;
+    uint32_t reserved;
+    uint64_t headerSize;   // offset of the data section
+    uint64_t dataSize;     // bytes of tensor data (without the final padding)
+    uint64_t step;         // training step given by the caller
+    double learningRate;
+    double momentum;
+};
+
+struct LayerRecord {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t inChannel;
+    uint64_t outChannel;
+    uint64_t reserved;
+};
+
+struct TensorRecord {
+    uint32_t layer;
+    uint32_t kind;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t offset;       // from the start of the file
+};
+
+// parsed checkpoint header, validated against the image size
+class Checkpoint {
+public:
+    Checkpoint(const uint8_t *data, size_t size);
+
+    // tensor of the given kind for a layer, nullptr when absent
+    const TensorRecord *find(size_t layer, uint32_t kind) const;
+
+    CheckpointHeader header;
+    std::vector<LayerRecord> layers;
+    std::vector<TensorRecord> tensors;
+
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t DATA_ALIGN = 4096;
+    static const size_t TENSOR_ALIGN = 64;
+
+    enum LayerType {
+        LINEAR = 1,
+        SIGMOID,
+        RELU
+    };
+    enum LayerFlag {
+        HAS_BIAS = 1,
+        TRAINABLE = 2
+    };
+    enum TensorKind {
+        WEIGHT = 0,
+        BIAS,
+        WEIGHT_VELOCITY,
+        BIAS_VELOCITY
+    };
+};
+
+// page-aligned byte buffer, suitable for O_DIRECT writes
+class CheckpointImage {
+public:
+    CheckpointImage();
+    CheckpointImage(const CheckpointImage &target) = delete;
+    ~CheckpointImage();
+
+    CheckpointImage &operator=(const CheckpointImage &target) = delete;
+
+    // image of the network (and optimizer state), reusing the buffer when it is large enough
+    void capture(Network &network, const SGD *optimizer, uint64_t step);
+    // single sequential write to path.tmp, then renamed over path
+    void write(const std::string &path) const;
+
+    const uint8_t *getData() const {return data;}
+    size_t getSize() const {return size;}
+
+private:
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+};
+
+void save_checkpoint(const std::string &path, Network &network, const SGD *optimizer = nullptr, uint64_t step = 0);
+// restore parameters into a network of the same topology, returns the step; the optimizer gets
+// the velocity and the learning rate and momentum of the checkpoint (kept when it was saved without one)
+uint64_t load_checkpoint(const std::string &path, Network &network, SGD *optimizer = nullptr);
+// rebuild the layers of a checkpoint, the caller owns them
+std::vector<Layer*> load_checkpoint_layers(const std::string &path);
+
+// background checkpointing with two images: snapshot() copies the parameters
+// (one memcpy per tensor) and returns, a writer thread writes the image out
+// a snapshot taken while the previous one is still queued replaces it
+class CheckpointWriter {
+public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+
+    // call between training steps, rethrows a failure of an earlier write
+    void snapshot(const std::string &path, Network &network, const SGD *optimizer = nullptr, uint64_t step = 0);
+    // block until every queued snapshot is on disk
+    void wait();
+    size_t getWritten() const;
+
+private:
+    void run();
+
+    CheckpointImage images[2];
+    std::string paths[2];
+    int writing;
+    int pending;
+    size_t written;
+    bool stopping;
+    std::exception_ptr error;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "codegen.h"
+#include "linear.h"
+#include "activation.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+// columns per weight panel, the generated kernel keeps a panel's sums in registers
+static const size_t PANEL = 8;
+
+// the kernels are the same for every model, only the instantiations differ
+static const char *KERNELS = R"(namespace detail {
+
+// with IN a constant GCC vectorizes the k reduction instead of the panel, a shuffle per load
+#if defined(__GNUC__) && !defined(__clang__)
+#define MOF_PANEL_LOOPS __attribute__((optimize("no-tree-loop-vectorize")))
+#else
+#define MOF_PANEL_LOOPS
+#endif
+
+// y = x W (+ b) with W stored as column panels of 8, each k-major and zero padded, so
+// every panel streams through once; the sums run over k in order, the bias comes after
+template<std::size_t IN, std::size_t OUT, bool BIAS>
+MOF_PANEL_LOOPS inline void linear(const double *__restrict x, const double *__restrict w, const double *__restrict b,
+                   double *__restrict y)
+{
+    constexpr std::size_t PANELS = (OUT + 7) / 8;
+    std::size_t q = 0;
+    // two panels at a time keep twice as many sums in flight
+    for (; q + 1 < PANELS; q += 2) {
+        const double *w0 = w + q * IN * 8;
+        const double *w1 = w0 + IN * 8;
+        double acc[16] = {};
+        for (std::size_t k = 0; k < IN; k++) {
+            const double xk = x[k];
+#pragma GCC unroll 8
+            for (std::size_t j = 0; j < 8; j++) {
+                acc[j] += xk * w0[k * 8 + j];
+                acc[8 + j] += xk * w1[k * 8 + j];
+            }
+        }
+        for (std::size_t j = 0; j < 16 && q * 8 + j < OUT; j++) {
+            y[q * 8 + j] = BIAS ? acc[j] + b[q * 8 + j] : acc[j];
+        }
+    }
+    if (q < PANELS) {
+        const double *w0 = w + q * IN * 8;
+        double acc[8] = {};
+        for (std::size_t k = 0; k < IN; k++) {
+            const double xk = x[k];
+#pragma GCC unroll 8
+            for (std::size_t j = 0; j < 8; j++) {
+                acc[j] += xk * w0[k * 8 + j];
+            }
+        }
+        for (std::size_t j = 0; j < 8 && q * 8 + j < OUT; j++) {
+            y[q * 8 + j] = BIAS ? acc[j] + b[q * 8 + j] : acc[j];
+        }
+    }
+}
+
+// element-wise, in may alias out
+template<std::size_t N>
+inline void sigmoid(const double *x, double *y)
+{
+    for (std::size_t i = 0; i < N; i++) {
+        y[i] = 1.0 / (1.0 + std::exp(-x[i]));
+    }
+}
+
+template<std::size_t N>
+inline void relu(const double *x, double *y)
+{
+    for (std::size_t i = 0; i < N; i++) {
+        y[i] = x[i] > 0.0 ? x[i] : 0.0;
+    }
+}
+
+)";
+
+// C++17 keywords and alternative tokens, none can name a namespace
+static const std::set<std::string> KEYWORDS = {
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case",
+    "catch", "char", "char16_t", "char32_t", "class", "compl", "const", "constexpr", "const_cast",
+    "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum",
+    "explicit", "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int",
+    "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or",
+    "or_eq", "private", "protected", "public", "register", "reinterpret_cast", "return", "short",
+    "signed", "sizeof", "static", "static_assert", "static_cast", "struct", "switch", "template",
+    "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename", "union",
+    "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq"
+};
+
+static bool is_identifier(const std::string &name)
+{
+    if (name.empty() || std::isdigit((unsigned char)name[0]) || KEYWORDS.count(name)) {
+        return false;
+    }
+    return std::all_of(name.begin(), name.end(), [](char c) {return std::isalnum((unsigned char)c) || c == '_';});
+}
+
+// %a prints inf and nan, which are not literals; caught here with the layer, not by
+// the compiler of the generated header
+static void check_finite(const Matrix &values, size_t layer, const char *what)
+{
+    for (size_t i = 0; i < values.getRow() * values.getCol(); i++) {
+        if (!std::isfinite(values.data[i])) {
+            throw std::runtime_error("export_header: layer " + std::to_string(layer) + " " + what
+                                     + " has a non-finite value");
+        }
+    }
+}
+
+// exact round trip
+static void write_values(std::ostringstream &out, const std::vector<double> &values)
+{
+    char text[32];
+    for (size_t i = 0; i < values.size(); i++) {
+        std::snprintf(text, sizeof(text), "%a", values[i]);
+        out << (i % 6 == 0 ? "\n    " : " ") << text << (i + 1 < values.size() ? "," : "");
+    }
+    out << "\n";
+}
+
+static std::vector<double> panel_layout(const Matrix &weight)
+{
+    size_t rows = weight.getRow(), cols = weight.getCol();
+    size_t panels = (cols + PANEL - 1) / PANEL;
+    std::vector<double> packed(panels * rows * PANEL, 0.0);
+    for (size_t q = 0; q < panels; q++) {
+        for (size_t k = 0; k < rows; k++) {
+            for (size_t j = 0; j < PANEL && q * PANEL + j < cols; j++) {
+                packed[(q * rows + k) * PANEL + j] = weight.data[k * cols + q * PANEL + j];
+            }
+        }
+    }
+    return packed;
+}
+
+std::string export_header(Network &network, const std::string &name)
+{
+    if (!is_identifier(name)) {
+        throw std::runtime_error("export_header: " + name + " is not a C++ identifier");
+    }
+    std::shared_lock<std::shared_mutex> lock(network.getMutex());
+    const std::vector<Layer*> &layers = network.get_layers();
+
+    // width entering every layer, from the Linear shapes
+    std::vector<size_t> widths(layers.size() + 1, 0);
+    size_t width = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (Linear *linear = dynamic_cast<Linear*>(layers[i])) {
+            if (width == 0) {
+                std::fill(widths.begin(), widths.begin() + i + 1, linear->getWeight().getRow());
+            }
+            else if (linear->getWeight().getRow() != width) {
+                throw std::runtime_error("export_header: Linear input size does not match the previous layer");
+            }
+            width = linear->getWeight().getCol();
+            check_finite(linear->getWeight(), i, "weight");
+            if (linear->getUseBias()) {
+                check_finite(linear->getBias(), i, "bias");
+            }
+        }
+        else if (!dynamic_cast<Sigmoid*>(layers[i]) && !dynamic_cast<ReLU*>(layers[i])) {
+            throw std::runtime_error(std::string("export_header: unsupported layer ") + layers[i]->getName());
+        }
+        widths[i + 1] = width;
+    }
+    if (width == 0) {
+        throw std::runtime_error("export_header: the network has no Linear layer");
+    }
+
+    std::ostringstream weights, body, summary;
+    size_t buffer_width = 0;
+    // x, y or one of two ping-pong stack buffers
+    std::string current = "x";
+    int next_buffer = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        Linear *linear = dynamic_cast<Linear*>(layers[i]);
+        // the last Linear writes y directly, activations after it run in place
+        bool writes_output = true;
+        for (size_t j = i + 1; j < layers.size(); j++) {
+            writes_output = writes_output && !dynamic_cast<Linear*>(layers[j]);
+        }
+        std::string output;
+        if (writes_output) {
+            output = "y";
+        }
+        else if (linear || current == "x") {
+            output = next_buffer == 0 ? "a0" : "a1";
+            next_buffer = 1 - next_buffer;
+            buffer_width = std::max(buffer_width, widths[i + 1]);
+        }
+        else {
+            output = current;
+        }
+        summary << (i ? ", " : "") << layers[i]->getName();
+        if (linear) {
+            const Matrix &weight = linear->getWeight();
+            bool bias = linear->getUseBias();
+            summary << " " << weight.getRow() << "x" << weight.getCol();
+            std::string prefix = "layer" + std::to_string(i);
+            std::vector<double> packed = panel_layout(weight);
+            weights << "alignas(64) inline constexpr double " << prefix << "_weight[" << packed.size() << "] = {";
+            write_values(weights, packed);
+            weights << "};\n";
+            if (bias) {
+                const Matrix &b = linear->getBias();
+                weights << "alignas(64) inline constexpr double " << prefix << "_bias[" << b.getCol() << "] = {";
+                write_values(weights, std::vector<double>(b.data, b.data + b.getCol()));
+                weights << "};\n";
+            }
+            body << "    detail::linear<" << weight.getRow() << ", " << weight.getCol() << ", "
+                 << (bias ? "true" : "false") << ">(" << current << ", detail::" << prefix << "_weight, "
+                 << (bias ? "detail::" + prefix + "_bias" : std::string("nullptr")) << ", " << output << ");\n";
+        }
+        else {
+            const char *kernel = dynamic_cast<Sigmoid*>(layers[i]) ? "sigmoid" : "relu";
+            body << "    detail::" << kernel << "<" << widths[i + 1] << ">(" << current << ", " << output << ");\n";
+        }
+        current = output;
+    }
+
+    std::ostringstream out;
+    out << "// generated by MOFramework export_header, do not edit\n"
+        << "// " << summary.str() << "\n"
+        << "#pragma once\n"
+        << "#include <array>\n"
+        << "#include <cmath>\n"
+        << "#include <cstddef>\n\n"
+        << "namespace " << name << " {\n\n"
+        << "constexpr std::size_t INPUT = " << widths.front() << ";\n"
+        << "constexpr std::size_t OUTPUT = " << widths.back() << ";\n"
+        << "constexpr std::size_t LAYERS = " << layers.size() << ";\n\n"
+        << KERNELS
+        << weights.str() << "\n"
+        << "} // namespace detail\n\n"
+        << "// one sample: x holds INPUT values, y receives OUTPUT; reentrant, nothing is allocated\n"
+        << "inline void predict(const double *__restrict x, double *__restrict y)\n{\n";
+    if (buffer_width > 0) {
+        out << "    alignas(64) double a0[" << buffer_width << "];\n";
+        if (body.str().find("a1") != std::string::npos) {
+            out << "    alignas(64) double a1[" << buffer_width << "];\n";
+        }
+    }
+    out << body.str() << "}\n\n"
+        << "// rows samples stored back to back\n"
+        << "inline void predict(const double *__restrict x, double *__restrict y, std::size_t rows)\n{\n"
+        << "    for (std::size_t i = 0; i < rows; i++) {\n"
+        << "        predict(x + i * INPUT, y + i * OUTPUT);\n"
+        << "    }\n}\n\n"
+        << "inline std::array<double, OUTPUT> predict(const std::array<double, INPUT> &x)\n{\n"
+        << "    std::array<double, OUTPUT> y;\n"
+        << "    predict(x.data(), y.data());\n"
+        << "    return y;\n}\n\n"
+        << "} // namespace " << name << "\n";
+    return out.str();
+}
+
+void export_header(Network &network, const std::string &name, const std::string &path)
+{
+    std::string header = export_header(network, name);
+    std::ofstream file(path);
+    if (!file || !(file << header)) {
+        throw std::runtime_error("export_header: cannot write " + path);
+    }
+}
@@ -0,0 +1,16 @@
+// ahead-of-time export of a trained network into a self-contained C++ header
+// constexpr dimensions, one template kernel per layer kind instantiated for its sizes,
+// the weights as 64-byte aligned constexpr arrays (exact hex literals), and a predict()
+// that runs on stack buffers: no virtual calls, no shape checks, no allocations
+// Linear, Sigmoid and ReLU layers are supported
+#include "network.h"
+#include <string>
+
+#ifndef __CODEGEN__
+#define __CODEGEN__
+
+// name becomes the namespace of the generated code and must be a C++ identifier
+std::string export_header(Network &network, const std::string &name);
+void export_header(Network &network, const std::string &name, const std::string &path);
+
+#endif
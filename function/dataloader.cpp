@@ -0,0 +1,144 @@
+#include "dataloader.h"
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+
+// back off from spinning to sleeping while the other side is busy
+static void wait_step(size_t &spins)
+{
+    spins++;
+    if (spins < 64) {
+        return;
+    }
+    else if (spins < 1024) {
+        std::this_thread::yield();
+    }
+    else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+DataLoader::DataLoader(const Matrix &data, const Matrix &labels, size_t batch_size,
+                       bool shuffle, size_t num_buffers, unsigned int seed)
+    : data(&data), labels(&labels), dataset(nullptr), numRows(data.getRow()),
+      dataCol(data.getCol()), labelCol(labels.getCol()), batchSize(batch_size), numBatches(0),
+      shuffle(shuffle), gen(seed), freeSlots(num_buffers), readySlots(num_buffers),
+      stopping(false), consumed(0), heldSlot(0), holding(false)
+{
+    if (data.getRow() != labels.getRow()) {
+        throw std::runtime_error("DataLoader: data and labels row count differ");
+    }
+    init(num_buffers);
+}
+
+DataLoader::DataLoader(const Dataset &dataset, size_t batch_size,
+                       bool shuffle, size_t num_buffers, unsigned int seed)
+    : data(nullptr), labels(nullptr), dataset(&dataset), numRows(dataset.size()),
+      dataCol(dataset.getFeatureCount()), labelCol(dataset.getClassCount()), batchSize(batch_size),
+      numBatches(0), shuffle(shuffle), gen(seed), freeSlots(num_buffers), readySlots(num_buffers),
+      stopping(false), consumed(0), heldSlot(0), holding(false)
+{
+    init(num_buffers);
+}
+
+void DataLoader::init(size_t num_buffers)
+{
+    if (batchSize == 0 || batchSize > numRows) {
+        throw std::runtime_error("DataLoader: invalid batch size");
+    }
+    if (num_buffers < 2) {
+        throw std::runtime_error("DataLoader: at least two buffers are required");
+    }
+    numBatches = numRows / batchSize;
+    buffers.resize(num_buffers);
+    for (Batch &batch : buffers) {
+        batch.data = Matrix(batchSize, dataCol);
+        batch.labels = Matrix(batchSize, labelCol);
+    }
+    order.resize(numRows);
+    std::iota(order.begin(), order.end(), 0);
+}
+
+DataLoader::~DataLoader()
+{
+    stop();
+}
+
+void DataLoader::stop()
+{
+    stopping.store(true, std::memory_order_release);
+    if (worker.joinable()) {
+        worker.join();
+    }
+    stopping.store(false, std::memory_order_relaxed);
+}
+
+void DataLoader::start()
+{
+    stop();
+    freeSlots.clear();
+    readySlots.clear();
+    for (size_t i = 0; i < buffers.size(); i++) {
+        freeSlots.push(i);
+    }
+    consumed = 0;
+    holding = false;
+    worker = std::thread(&DataLoader::produce, this);
+}
+
+void DataLoader::produce()
+{
+    // shuffling happens here too, off the training thread
+    if (shuffle) {
+        std::shuffle(order.begin(), order.end(), gen);
+    }
+    for (size_t b = 0; b < numBatches; b++) {
+        size_t slot;
+        size_t spins = 0;
+        while (!freeSlots.pop(slot)) {
+            if (stopping.load(std::memory_order_acquire)) {
+                return;
+            }
+            wait_step(spins);
+        }
+        Batch &batch = buffers[slot];
+        const size_t *rows = order.data() + b * batchSize;
+        if (dataset != nullptr) {
+            dataset->gather(rows, batchSize, batch.data.data, batch.labels.data);
+        }
+        else {
+            for (size_t i = 0; i < batchSize; i++) {
+                memcpy(batch.data.data + i * dataCol, data->data + rows[i] * dataCol, sizeof(double) * dataCol);
+                memcpy(batch.labels.data + i * labelCol, labels->data + rows[i] * labelCol, sizeof(double) * labelCol);
+            }
+        }
+        // capacity equals the number of slots, a filled slot always fits
+        readySlots.push(slot);
+    }
+}
+
+bool DataLoader::next(const Matrix *&batch_data, const Matrix *&batch_labels)
+{
+    if (!worker.joinable()) {
+        throw std::runtime_error("DataLoader: start() must be called before next()");
+    }
+    // the previous batch is done with, give its buffer back to the producer
+    if (holding) {
+        freeSlots.push(heldSlot);
+        holding = false;
+    }
+    if (consumed == numBatches) {
+        return false;
+    }
+    size_t spins = 0;
+    while (!readySlots.pop(heldSlot)) {
+        wait_step(spins);
+    }
+    holding = true;
+    consumed++;
+    batch_data = &buffers[heldSlot].data;
+    batch_labels = &buffers[heldSlot].labels;
+    return true;
+}
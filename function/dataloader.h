@@ -0,0 +1,118 @@
+// batch prefetcher: a background thread gathers (shuffled) rows into a ring
+// of preallocated batch buffers and hands them over through SPSC queues
+#include "matrix.h"
+#include "dataset.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <random>
+
+#ifndef __DATALOADER__
+#define __DATALOADER__
+
+// lock-free single producer / single consumer ring of fixed capacity
+template<typename Type>
+class SpscQueue {
+public:
+    SpscQueue(size_t capacity = 0) : slots(capacity + 1), head(0), tail(0) {}
+
+    bool push(const Type &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t next = (h + 1) % slots.size();
+        if (next == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[h] = item;
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(Type &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[t];
+        tail.store((t + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    // only safe while neither side is running
+    void clear() {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<Type> slots;
+    // producer and consumer indices live on separate cache lines
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+// source of (data, labels) batches consumed by the training / evaluation loops
+class BatchStream {
+public:
+    virtual ~BatchStream() {}
+    // begin a new pass over the data
+    virtual void start() = 0;
+    // block until the next batch is ready, false once the pass is exhausted
+    // the batch stays valid until the following next() or start()
+    virtual bool next(const Matrix *&batch_data, const Matrix *&batch_labels) = 0;
+    virtual void stop() = 0;
+    virtual size_t num_batches() const = 0;
+};
+
+class DataLoader : public BatchStream {
+public:
+    // the source is referenced, not copied, and must outlive the loader
+    // the last partial batch is dropped, as in the training loops
+    DataLoader(const Matrix &data, const Matrix &labels, size_t batch_size,
+               bool shuffle = true, size_t num_buffers = 2, unsigned int seed = 0);
+    // uint8 samples are normalized while the batch is assembled
+    DataLoader(const Dataset &dataset, size_t batch_size,
+               bool shuffle = true, size_t num_buffers = 2, unsigned int seed = 0);
+    ~DataLoader();
+
+    // begin a new epoch: reshuffle and start filling buffers in the background
+    void start() override;
+    bool next(const Matrix *&batch_data, const Matrix *&batch_labels) override;
+    void stop() override;
+
+    size_t num_batches() const override {return numBatches;}
+    size_t getBatchSize() const {return batchSize;}
+
+private:
+    struct Batch {
+        Matrix data;
+        Matrix labels;
+    };
+    void init(size_t num_buffers);
+    void produce();
+
+    // exactly one source: dense matrices or a uint8 dataset
+    const Matrix *data;
+    const Matrix *labels;
+    const Dataset *dataset;
+    size_t numRows;
+    size_t dataCol;
+    size_t labelCol;
+    size_t batchSize;
+    size_t numBatches;
+    bool shuffle;
+
+    std::vector<Batch> buffers;
+    std::vector<size_t> order;
+    std::mt19937 gen;
+
+    // slot indices: producer takes free ones and returns them filled
+    SpscQueue<size_t> freeSlots;
+    SpscQueue<size_t> readySlots;
+    std::thread worker;
+    std::atomic<bool> stopping;
+    size_t consumed;
+    size_t heldSlot;
+    bool holding;
+};
+
+#endif
@@ -0,0 +1,261 @@
+#include "dataset.h"
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile() : data(nullptr), size(0) {}
+
+MappedFile::MappedFile(const std::string &path, bool sequential)
+    : data(nullptr), size(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat file: " + path);
+    }
+    size = st.st_size;
+    if (size > 0) {
+        void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Cannot map file: " + path);
+        }
+        // let the kernel read ahead
+        if (sequential) {
+            madvise(ptr, size, MADV_SEQUENTIAL);
+        }
+        madvise(ptr, size, MADV_WILLNEED);
+        data = static_cast<const uint8_t *>(ptr);
+    }
+    // the mapping keeps the file referenced
+    ::close(fd);
+}
+
+MappedFile::MappedFile(MappedFile &&target)
+    : data(target.data), size(target.size)
+{
+    target.data = nullptr;
+    target.size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != nullptr) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&target)
+{
+    if (this != &target) {
+        if (data != nullptr) {
+            munmap(const_cast<uint8_t *>(data), size);
+        }
+        data = target.data;
+        size = target.size;
+        target.data = nullptr;
+        target.size = 0;
+    }
+    return *this;
+}
+
+static size_t idx_type_size(uint8_t type)
+{
+    switch (type) {
+        case IdxFile::UINT8:
+        case IdxFile::INT8:
+            return 1;
+        case IdxFile::INT16:
+            return 2;
+        case IdxFile::INT32:
+        case IdxFile::FLOAT32:
+            return 4;
+        case IdxFile::FLOAT64:
+            return 8;
+        default:
+            throw std::runtime_error("IdxFile: unknown data type");
+    }
+}
+
+IdxFile::IdxFile(const std::string &path)
+    : file(path), itemSize(1), type(0), payload(nullptr)
+{
+    const uint8_t *raw = file.getData();
+    if (file.getSize() < 4 || raw[0] != 0 || raw[1] != 0) {
+        throw std::runtime_error("IdxFile: invalid magic number in " + path);
+    }
+    type = raw[2];
+    size_t ndim = raw[3];
+    if (ndim == 0) {
+        throw std::runtime_error("IdxFile: no dimension in " + path);
+    }
+    size_t header = 4 + 4 * ndim;
+    if (file.getSize() < header) {
+        throw std::runtime_error("IdxFile: truncated header in " + path);
+    }
+    size_t count = 1;
+    for (size_t i = 0; i < ndim; i++) {
+        uint32_t dim;
+        memcpy(&dim, raw + 4 + 4 * i, sizeof(dim));
+        // dimensions are stored big-endian
+        dim = __builtin_bswap32(dim);
+        shape.push_back(dim);
+        // a crafted header must not wrap the product past the size check below
+        if (dim != 0 && count > SIZE_MAX / dim) {
+            throw std::runtime_error("IdxFile: header dimensions overflow in " + path);
+        }
+        count *= dim;
+        if (i > 0) {
+            itemSize *= dim;
+        }
+    }
+    if ((file.getSize() - header) / idx_type_size(type) < count) {
+        throw std::runtime_error("IdxFile: data shorter than header dimensions in " + path);
+    }
+    payload = raw + header;
+}
+
+Dataset::Dataset()
+    : features(nullptr), labels(nullptr), numSamples(0), numFeatures(0), numClasses(0),
+      scale(1.0), shift(0.0) {}
+
+Dataset::Dataset(std::shared_ptr<const void> owner, const uint8_t *features, const uint8_t *labels,
+                 size_t num_samples, size_t num_features, size_t num_classes,
+                 double scale, double shift)
+    : owner(owner), features(features), labels(labels), numSamples(num_samples),
+      numFeatures(num_features), numClasses(num_classes), scale(scale), shift(shift)
+{
+    if (num_classes == 0) {
+        throw std::runtime_error("Dataset: num_classes must be positive");
+    }
+    for (size_t i = 0; i < num_samples; i++) {
+        if (labels[i] >= num_classes) {
+            throw std::runtime_error("Dataset: label out of range");
+        }
+    }
+}
+
+Dataset::Dataset(std::vector<uint8_t> features, std::vector<uint8_t> labels,
+                 size_t num_samples, size_t num_features, size_t num_classes,
+                 double scale, double shift)
+{
+    if (features.size() != num_samples * num_features || labels.size() != num_samples) {
+        throw std::runtime_error("Dataset: buffer sizes do not match the shape");
+    }
+    auto storage = std::make_shared<std::pair<std::vector<uint8_t>, std::vector<uint8_t>>>(
+        std::move(features), std::move(labels));
+    *this = Dataset(storage, storage->first.data(), storage->second.data(),
+                    num_samples, num_features, num_classes, scale, shift);
+}
+
+void Dataset::gather(const size_t *rows, size_t count, double *x, double *y) const
+{
+    for (size_t i = 0; i < count; i++) {
+        if (rows[i] >= numSamples) {
+            throw std::runtime_error("Dataset: row out of range");
+        }
+        const uint8_t *src = features + rows[i] * numFeatures;
+        double *dst = x + i * numFeatures;
+        #pragma omp simd
+        for (size_t j = 0; j < numFeatures; j++) {
+            dst[j] = static_cast<double>(src[j]) * scale + shift;
+        }
+        double *target = y + i * numClasses;
+        std::fill(target, target + numClasses, 0.0);
+        target[labels[rows[i]]] = 1.0;
+    }
+}
+
+std::pair<Matrix, Matrix> Dataset::toMatrix(size_t start, size_t end) const
+{
+    if (start >= end || end > numSamples) {
+        throw std::runtime_error("Dataset: invalid row range");
+    }
+    size_t count = end - start;
+    Matrix x(count, numFeatures);
+    Matrix y(count, numClasses);
+    normalize_pixels(features + start * numFeatures, x.data, count * numFeatures, scale, shift);
+    one_hot(labels + start, y.data, count, numClasses);
+    return {std::move(x), std::move(y)};
+}
+
+void read_exact(int fd, void *dst, size_t size, size_t offset)
+{
+    uint8_t *ptr = static_cast<uint8_t *>(dst);
+    while (size > 0) {
+        ssize_t n = pread(fd, ptr, size, offset);
+        if (n <= 0) {
+            throw std::runtime_error("read_exact: unexpected end of file");
+        }
+        ptr += n;
+        size -= n;
+        offset += n;
+    }
+}
+
+void normalize_pixels(const uint8_t *src, double *dst, size_t n, double scale, double shift)
+{
+    #pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = static_cast<double>(src[i]) * scale + shift;
+    }
+}
+
+void one_hot(const uint8_t *labels, double *dst, size_t n, size_t num_classes)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (labels[i] >= num_classes) {
+            throw std::runtime_error("one_hot: label out of range");
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; i++) {
+        dst[i * num_classes + labels[i]] = 1.0;
+    }
+}
+
+Dataset load_idx_dataset(const std::string &images_path, const std::string &labels_path,
+                         int num_samples, size_t num_classes, double scale, double shift)
+{
+    auto files = std::make_shared<std::pair<IdxFile, IdxFile>>(IdxFile(images_path), IdxFile(labels_path));
+    const IdxFile &images_file = files->first;
+    const IdxFile &labels_file = files->second;
+
+    if (images_file.getType() != IdxFile::UINT8 || images_file.getShape().size() < 2) {
+        throw std::runtime_error("load_idx_dataset: images must be uint8 with at least 2 dimensions");
+    }
+    if (labels_file.getType() != IdxFile::UINT8 || labels_file.getShape().size() != 1) {
+        throw std::runtime_error("load_idx_dataset: labels must be a 1-d uint8 array");
+    }
+    if (images_file.getCount() != labels_file.getCount()) {
+        throw std::runtime_error("load_idx_dataset: image and label counts differ");
+    }
+    size_t samples = num_samples <= 0 ? images_file.getCount() : static_cast<size_t>(num_samples);
+    if (samples == 0 || samples > images_file.getCount()) {
+        throw std::runtime_error("load_idx_dataset: num_samples exceeds the samples in file");
+    }
+    const uint8_t *label_data = labels_file.getData();
+    // from the whole file, so a subset missing the top class keeps the full one-hot width
+    if (num_classes == 0) {
+        num_classes = *std::max_element(label_data, label_data + labels_file.getCount()) + 1;
+    }
+    // the dataset shares ownership of both mappings
+    return Dataset(files, images_file.getData(), label_data,
+                   samples, images_file.getItemSize(), num_classes, scale, shift);
+}
+
+std::pair<Matrix, Matrix> load_mnist_data(const std::string &images_path, const std::string &labels_path,
+                                          int num_samples, size_t num_classes)
+{
+    return load_idx_dataset(images_path, labels_path, num_samples, num_classes).toMatrix(); // [batch, features], [batch, classes]
+}
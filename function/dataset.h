@@ -0,0 +1,116 @@
+// dataset files (memory-mapped) and loaders
+// IDX: magic(0x0000 | type | ndim), ndim big-endian uint32 dims, raw data
+#include "matrix.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <memory>
+
+#ifndef __DATASET__
+#define __DATASET__
+
+// read-only mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    MappedFile();
+    // sequential: the file is consumed front to back once (read-ahead, early eviction)
+    MappedFile(const std::string &path, bool sequential = true);
+    MappedFile(MappedFile &&target);
+    MappedFile(const MappedFile &target) = delete;
+    ~MappedFile();
+
+    MappedFile &operator=(MappedFile &&target);
+    MappedFile &operator=(const MappedFile &target) = delete;
+
+    const uint8_t *getData() const {return data;}
+    size_t getSize() const {return size;}
+
+private:
+    const uint8_t *data;
+    size_t size;
+};
+
+class IdxFile {
+public:
+    IdxFile(const std::string &path);
+
+    uint8_t getType() const {return type;}
+    const std::vector<size_t> &getShape() const {return shape;}
+    // number of items (first dimension) and elements per item (the rest)
+    size_t getCount() const {return shape[0];}
+    size_t getItemSize() const {return itemSize;}
+    const uint8_t *getData() const {return payload;}
+
+    enum DataType {
+        UINT8 = 0x08,
+        INT8 = 0x09,
+        INT16 = 0x0B,
+        INT32 = 0x0C,
+        FLOAT32 = 0x0D,
+        FLOAT64 = 0x0E
+    };
+
+private:
+    MappedFile file;
+    std::vector<size_t> shape;
+    size_t itemSize;
+    uint8_t type;
+    const uint8_t *payload;
+};
+
+// samples kept in their stored uint8 form (8x smaller than double) and
+// converted to normalized double rows / one-hot labels only when gathered
+class Dataset {
+public:
+    Dataset();
+    // owner keeps features and labels alive (a mapped file, a vector, ...)
+    Dataset(std::shared_ptr<const void> owner, const uint8_t *features, const uint8_t *labels,
+            size_t num_samples, size_t num_features, size_t num_classes,
+            double scale = 1.0 / 255.0, double shift = -0.5);
+    Dataset(std::vector<uint8_t> features, std::vector<uint8_t> labels,
+            size_t num_samples, size_t num_features, size_t num_classes,
+            double scale = 1.0 / 255.0, double shift = -0.5);
+
+    size_t size() const {return numSamples;}
+    size_t getFeatureCount() const {return numFeatures;}
+    size_t getClassCount() const {return numClasses;}
+    double getScale() const {return scale;}
+    double getShift() const {return shift;}
+    const uint8_t *getFeatures() const {return features;}
+    const uint8_t *getLabels() const {return labels;}
+
+    // x: count x features, y: count x classes, rows in the given order
+    void gather(const size_t *rows, size_t count, double *x, double *y) const;
+    // rows [start, end) converted to dense matrices
+    std::pair<Matrix, Matrix> toMatrix(size_t start, size_t end) const;
+    std::pair<Matrix, Matrix> toMatrix() const {return toMatrix(0, numSamples);}
+
+private:
+    std::shared_ptr<const void> owner;
+    const uint8_t *features;
+    const uint8_t *labels;
+    size_t numSamples;
+    size_t numFeatures;
+    size_t numClasses;
+    double scale;
+    double shift;
+};
+
+// pread exactly size bytes at offset, throws on a short file
+void read_exact(int fd, void *dst, size_t size, size_t offset);
+
+// dst[i] = src[i] * scale + shift, parallel over n
+void normalize_pixels(const uint8_t *src, double *dst, size_t n, double scale, double shift);
+// dst is n x num_classes and zero-filled, dst[i][labels[i]] = 1
+void one_hot(const uint8_t *labels, double *dst, size_t n, size_t num_classes);
+
+// num_samples <= 0 loads every sample, num_classes == 0 infers max label + 1 over the
+// whole file (not just the loaded samples)
+std::pair<Matrix, Matrix> load_mnist_data(const std::string &images_path, const std::string &labels_path,
+                                          int num_samples, size_t num_classes = 0);
+// same checks as load_mnist_data, but the samples stay uint8 inside the mapping
+Dataset load_idx_dataset(const std::string &images_path, const std::string &labels_path,
+                         int num_samples = 0, size_t num_classes = 0,
+                         double scale = 1.0 / 255.0, double shift = -0.5);
+
+#endif
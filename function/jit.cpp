@@ -0,0 +1,414 @@
+#include "jit.h"
+#include "opstats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// accumulators xmm0-11 hold the 6 x 4 tile, xmm12-13 a row of b, xmm14 an a value, xmm15 a product
+static const int TILE_ROWS = 6;
+static const int TILE_COLS = 4;
+static const int K_UNROLL = 4;
+static const int XMM_B = 12;
+static const int XMM_A = 14;
+static const int XMM_T = 15;
+
+bool JitShape::operator<(const JitShape &other) const
+{
+    return std::tie(m, n, k, lda, ldb, ldc, transA, transB)
+        < std::tie(other.m, other.n, other.k, other.lda, other.ldb, other.ldc, other.transA, other.transB);
+}
+
+void X86Assembler::rex(bool wide, int reg, int base)
+{
+    uint8_t prefix = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+    if (prefix != 0x40) {
+        code.push_back(prefix);
+    }
+}
+
+void X86Assembler::imm32(int32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        code.push_back(uint8_t(uint32_t(value) >> (8 * i)));
+    }
+}
+
+// the mandatory prefix goes before REX
+void X86Assembler::sse(uint8_t prefix, uint8_t opcode, int reg, int rm)
+{
+    code.push_back(prefix);
+    rex(false, reg, rm);
+    code.insert(code.end(), {0x0F, opcode, uint8_t(0xC0 | (reg & 7) << 3 | (rm & 7))});
+}
+
+// always mod 10 (disp32); rsp and r12 as a base need a SIB byte
+void X86Assembler::sse_mem(uint8_t prefix, uint8_t opcode, int reg, int base, int32_t disp)
+{
+    code.push_back(prefix);
+    rex(false, reg, base);
+    code.insert(code.end(), {0x0F, opcode, uint8_t(0x80 | (reg & 7) << 3 | (base & 7))});
+    if ((base & 7) == RSP) {
+        code.push_back(0x24);
+    }
+    imm32(disp);
+}
+
+void X86Assembler::mov(int dst, int src)
+{
+    rex(true, src, dst);
+    code.insert(code.end(), {0x89, uint8_t(0xC0 | (src & 7) << 3 | (dst & 7))});
+}
+
+void X86Assembler::mov_imm(int dst, int32_t value)
+{
+    rex(true, 0, dst);
+    code.insert(code.end(), {0xC7, uint8_t(0xC0 | (dst & 7))});
+    imm32(value);
+}
+
+void X86Assembler::add_imm(int dst, int32_t value)
+{
+    rex(true, 0, dst);
+    code.insert(code.end(), {0x81, uint8_t(0xC0 | (dst & 7))});
+    imm32(value);
+}
+
+void X86Assembler::sub_imm(int dst, int32_t value)
+{
+    rex(true, 0, dst);
+    code.insert(code.end(), {0x81, uint8_t(0xE8 | (dst & 7))});
+    imm32(value);
+}
+
+void X86Assembler::dec(int reg)
+{
+    rex(true, 0, reg);
+    code.insert(code.end(), {0xFF, uint8_t(0xC8 | (reg & 7))});
+}
+
+void X86Assembler::jnz(size_t target)
+{
+    code.insert(code.end(), {0x0F, 0x85});
+    imm32(int32_t(int64_t(target) - int64_t(code.size() + 4)));
+}
+
+JitKernel::JitKernel(const std::vector<uint8_t> &code) : memory(nullptr), length(code.size()), function(nullptr)
+{
+#ifdef JIT_SUPPORTED
+    void *mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("JitKernel: cannot map memory");
+    }
+    std::memcpy(mapped, code.data(), length);
+    if (mprotect(mapped, length, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mapped, length);
+        throw std::runtime_error("JitKernel: cannot make the code executable");
+    }
+    memory = mapped;
+    function = reinterpret_cast<Function>(memory);
+#else
+    throw std::runtime_error("JitKernel: not supported on this platform");
+#endif
+}
+
+JitKernel::~JitKernel()
+{
+#ifdef JIT_SUPPORTED
+    munmap(memory, length);
+#endif
+}
+
+// byte offsets of the next row / k step / column in op(a), op(b) and c
+struct Strides {
+    int64_t aRow, aStep, bStep, bCol, cRow;
+};
+
+// one mr x w tile: rax walks op(a) down k from rdi, rcx walks op(b) from r9, rsi counts,
+// the sums go to r10; each sum adds its products in k order, as multiply() does
+static void emit_tile(X86Assembler &as, const Strides &s, int mr, int w, size_t k)
+{
+    int nv = (w + 1) / 2;
+    bool half = w % 2 == 1;
+    for (int r = 0; r < mr * nv; r++) {
+        as.xorpd(r, r);
+    }
+    as.mov(X86Assembler::RAX, X86Assembler::RDI);
+    as.mov(X86Assembler::RCX, X86Assembler::R9);
+    auto step = [&](int u) {
+        for (int v = 0; v < nv; v++) {
+            int32_t offset = int32_t(u * s.bStep + 2 * v * s.bCol);
+            if (half && v == nv - 1) {
+                as.movsd_load(XMM_B + v, X86Assembler::RCX, offset);
+            }
+            else if (s.bCol != 8) {
+                as.movsd_load(XMM_B + v, X86Assembler::RCX, offset);
+                as.movhpd_load(XMM_B + v, X86Assembler::RCX, int32_t(offset + s.bCol));
+            }
+            else {
+                as.movupd_load(XMM_B + v, X86Assembler::RCX, offset);
+            }
+        }
+        for (int i = 0; i < mr; i++) {
+            as.movsd_load(XMM_A, X86Assembler::RAX, int32_t(u * s.aStep + i * s.aRow));
+            if (!(nv == 1 && half)) {
+                as.unpcklpd(XMM_A, XMM_A);
+            }
+            for (int v = 0; v < nv; v++) {
+                as.movapd(XMM_T, XMM_B + v);
+                if (half && v == nv - 1) {
+                    as.mulsd(XMM_T, XMM_A);
+                    as.addsd(i * nv + v, XMM_T);
+                }
+                else {
+                    as.mulpd(XMM_T, XMM_A);
+                    as.addpd(i * nv + v, XMM_T);
+                }
+            }
+        }
+    };
+    size_t loops = k / K_UNROLL;
+    if (loops > 0) {
+        as.mov_imm(X86Assembler::RSI, int32_t(loops));
+        size_t top = as.label();
+        for (int u = 0; u < K_UNROLL; u++) {
+            step(u);
+        }
+        as.add_imm(X86Assembler::RAX, int32_t(K_UNROLL * s.aStep));
+        as.add_imm(X86Assembler::RCX, int32_t(K_UNROLL * s.bStep));
+        as.dec(X86Assembler::RSI);
+        as.jnz(top);
+    }
+    for (size_t u = 0; u < k % K_UNROLL; u++) {
+        step(int(u));
+    }
+    for (int i = 0; i < mr; i++) {
+        for (int v = 0; v < nv; v++) {
+            int32_t offset = int32_t(i * s.cRow + 16 * v);
+            if (half && v == nv - 1) {
+                as.movsd_store(X86Assembler::R10, offset, i * nv + v);
+            }
+            else {
+                as.movupd_store(X86Assembler::R10, offset, i * nv + v);
+            }
+        }
+    }
+}
+
+// every column of an mr-row block: r11 counts the full tiles, the edge tile follows inline
+static void emit_columns(X86Assembler &as, const Strides &s, int mr, size_t n, size_t k)
+{
+    size_t tiles = n / TILE_COLS;
+    as.mov(X86Assembler::R10, X86Assembler::RDX);
+    if (tiles > 0) {
+        as.mov_imm(X86Assembler::R11, int32_t(tiles));
+        size_t top = as.label();
+        emit_tile(as, s, mr, TILE_COLS, k);
+        as.add_imm(X86Assembler::R9, int32_t(TILE_COLS * s.bCol));
+        as.add_imm(X86Assembler::R10, TILE_COLS * 8);
+        as.dec(X86Assembler::R11);
+        as.jnz(top);
+    }
+    if (n % TILE_COLS) {
+        emit_tile(as, s, mr, int(n % TILE_COLS), k);
+    }
+    if (tiles > 0) {
+        as.sub_imm(X86Assembler::R9, int32_t(tiles * TILE_COLS * s.bCol));
+    }
+}
+
+std::vector<uint8_t> jit_gemm_code(const JitShape &shape)
+{
+    Strides s;
+    s.aRow = shape.transA ? 8 : int64_t(shape.lda) * 8;
+    s.aStep = shape.transA ? int64_t(shape.lda) * 8 : 8;
+    s.bStep = shape.transB ? 8 : int64_t(shape.ldb) * 8;
+    s.bCol = shape.transB ? int64_t(shape.ldb) * 8 : 8;
+    s.cRow = int64_t(shape.ldc) * 8;
+    // displacements and pointer steps stay within an operand plus a few rows, so operands
+    // under 1GB keep them all inside a disp32
+    const double limit = double(std::numeric_limits<int32_t>::max()) / 2;
+    double bytes[] = {8.0 * (shape.transA ? shape.k : shape.m) * shape.lda,
+                      8.0 * (shape.transB ? shape.n : shape.k) * shape.ldb,
+                      8.0 * shape.m * shape.ldc};
+    if (shape.m == 0 || shape.n == 0 || shape.k == 0
+        || std::any_of(std::begin(bytes), std::end(bytes), [&](double b) {return b > limit;})) {
+        return {};
+    }
+    X86Assembler as;
+    // rdi = a, rsi = b, rdx = c; only caller-saved registers are used, no stack frame
+    as.mov(X86Assembler::R9, X86Assembler::RSI);
+    size_t blocks = shape.m / TILE_ROWS;
+    if (blocks > 0) {
+        as.mov_imm(X86Assembler::R8, int32_t(blocks));
+        size_t top = as.label();
+        emit_columns(as, s, TILE_ROWS, shape.n, shape.k);
+        as.add_imm(X86Assembler::RDI, int32_t(TILE_ROWS * s.aRow));
+        as.add_imm(X86Assembler::RDX, int32_t(TILE_ROWS * s.cRow));
+        as.dec(X86Assembler::R8);
+        as.jnz(top);
+    }
+    if (shape.m % TILE_ROWS) {
+        emit_columns(as, s, int(shape.m % TILE_ROWS), shape.n, shape.k);
+    }
+    as.ret();
+    return as.bytes();
+}
+
+JitGemm &JitGemm::instance()
+{
+    static JitGemm cache;
+    return cache;
+}
+
+bool JitGemm::available()
+{
+#ifdef JIT_SUPPORTED
+    // some hardened systems refuse executable mappings
+    static const bool allowed = [] {
+        try {
+            X86Assembler as;
+            as.ret();
+            JitKernel probe(as.bytes());
+            probe(nullptr, nullptr, nullptr);
+            return true;
+        } catch (const std::runtime_error &) {
+            return false;
+        }
+    }();
+    return allowed;
+#else
+    return false;
+#endif
+}
+
+// op(x) as a plain row-major matrix
+static Matrix logical(const std::vector<double> &x, size_t rows, size_t cols, size_t ld, bool trans)
+{
+    Matrix result(rows, cols);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) {
+            result.data[i * cols + j] = trans ? x[j * ld + i] : x[i * ld + j];
+        }
+    }
+    return result;
+}
+
+std::shared_ptr<const JitKernel> JitGemm::compile(const JitShape &shape) const
+{
+    std::vector<uint8_t> code = jit_gemm_code(shape);
+    if (code.empty()) {
+        return nullptr;
+    }
+    auto kernel = std::make_shared<const JitKernel>(code);
+
+    // run it on fixed pseudo-random operands of the exact layout and check the first and
+    // the last row block, which between them execute every tile the kernel contains
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    auto fill = [&](size_t count) {
+        std::vector<double> values(count);
+        for (double &v : values) {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            v = double(state >> 11) / double(1ull << 53) * 2.0 - 1.0;
+        }
+        return values;
+    };
+    std::vector<double> a = fill((shape.transA ? shape.k : shape.m) * shape.lda);
+    std::vector<double> b = fill((shape.transB ? shape.n : shape.k) * shape.ldb);
+    std::vector<double> c(shape.m * shape.ldc, 0.0);
+    (*kernel)(a.data(), b.data(), c.data());
+
+    Matrix mat1 = logical(a, shape.m, shape.k, shape.lda, shape.transA);
+    Matrix mat2 = logical(b, shape.k, shape.n, shape.ldb, shape.transB);
+    size_t first = std::min<size_t>(shape.m, TILE_ROWS);
+    size_t last = shape.m % TILE_ROWS ? shape.m % TILE_ROWS : first;
+    for (size_t begin : {size_t(0), shape.m - last}) {
+        size_t end = begin == 0 ? first : shape.m;
+        Matrix reference = multiply(mat1.slice(begin, end), mat2);
+        for (size_t i = begin; i < end; i++) {
+            for (size_t j = 0; j < shape.n; j++) {
+                double expected = reference.data[(i - begin) * shape.n + j];
+                // NaN fails too
+                if (!(std::abs(c[i * shape.ldc + j] - expected) <= 1e-9 * (std::abs(expected) + 1.0))) {
+                    return nullptr;
+                }
+            }
+        }
+    }
+    return kernel;
+}
+
+std::shared_ptr<const JitKernel> JitGemm::kernel(const JitShape &shape)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = cache.find(shape);
+        if (it != cache.end()) {
+            return it->second;
+        }
+    }
+    if (!available()) {
+        return nullptr;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    // another thread may have compiled it while we waited
+    auto it = cache.find(shape);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    OpContext context("jit compile");
+    std::shared_ptr<const JitKernel> compiled = compile(shape);
+    cache[shape] = compiled;
+    return compiled;
+}
+
+size_t JitGemm::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return cache.size();
+}
+
+size_t JitGemm::codeBytes() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    size_t bytes = 0;
+    for (auto &entry : cache) {
+        bytes += entry.second ? entry.second->size() : 0;
+    }
+    return bytes;
+}
+
+void JitGemm::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    cache.clear();
+}
+
+Matrix multiply_jit(const Matrix &mat1, const Matrix &mat2, bool trans1, bool trans2)
+{
+    size_t row = trans1 ? mat1.getCol() : mat1.getRow();
+    size_t mid = trans1 ? mat1.getRow() : mat1.getCol();
+    size_t col = trans2 ? mat2.getRow() : mat2.getCol();
+    if (mid != (trans2 ? mat2.getCol() : mat2.getRow())) {
+        throw std::runtime_error("matrix dimension not match");
+    }
+    JitShape shape = {row, col, mid, mat1.getCol(), mat2.getCol(), col, trans1, trans2};
+    std::shared_ptr<const JitKernel> kernel = JitGemm::instance().kernel(shape);
+    if (!kernel) {
+        return multiply(trans1 ? mat1.T() : mat1, trans2 ? mat2.T() : mat2);
+    }
+    OpScope op_scope(OP_GEMM, "gemm jit", row, col, mid, 2.0 * row * col * mid,
+                     8.0 * (row * mid + mid * col), 8.0 * row * col);
+    Matrix temp(row, col);
+    (*kernel)(mat1.data, mat2.data, temp.data);
+    return temp;
+}
@@ -0,0 +1,114 @@
+// runtime-generated GEMM kernels for exact shapes (Matrix::JIT)
+// every (M, N, K), leading dimensions and transpose flags gets its own x86-64 SSE2 code
+// from a small in-tree assembler: a 6 x 4 register tile fully unrolled, k unrolled by 4
+// with the tail emitted inline, and the edge rows and columns emitted with their exact
+// sizes, so there are no remainder loops or masks; all strides are immediates
+// kernels are cached per shape and checked against multiply() before first use, a shape
+// that cannot be compiled or fails the check runs multiply() instead
+// x86-64 System V only (Linux, macOS), elsewhere every product falls back
+#include "matrix.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+#ifndef __JIT__
+#define __JIT__
+
+// c = op(a) op(b), all row-major as stored, op transposes when the flag is set
+struct JitShape {
+    size_t m, n, k;
+    size_t lda, ldb, ldc;
+    bool transA, transB;
+
+    bool operator<(const JitShape &other) const;
+};
+
+// the subset of x86-64 the kernels use: SSE2 double moves and arithmetic, loads and stores
+// at [base + disp32], 64-bit register moves and immediates, a backward jnz
+class X86Assembler {
+public:
+    enum Reg {RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15};
+
+    // xmm registers are numbered 0 to 15, memory operands are [base + disp]
+    void movupd_load(int xmm, int base, int32_t disp) {sse_mem(0x66, 0x10, xmm, base, disp);}
+    void movupd_store(int base, int32_t disp, int xmm) {sse_mem(0x66, 0x11, xmm, base, disp);}
+    void movsd_load(int xmm, int base, int32_t disp) {sse_mem(0xF2, 0x10, xmm, base, disp);}
+    void movsd_store(int base, int32_t disp, int xmm) {sse_mem(0xF2, 0x11, xmm, base, disp);}
+    void movhpd_load(int xmm, int base, int32_t disp) {sse_mem(0x66, 0x16, xmm, base, disp);}
+    void movapd(int dst, int src) {sse(0x66, 0x28, dst, src);}
+    void unpcklpd(int dst, int src) {sse(0x66, 0x14, dst, src);}
+    void xorpd(int dst, int src) {sse(0x66, 0x57, dst, src);}
+    void addpd(int dst, int src) {sse(0x66, 0x58, dst, src);}
+    void mulpd(int dst, int src) {sse(0x66, 0x59, dst, src);}
+    void addsd(int dst, int src) {sse(0xF2, 0x58, dst, src);}
+    void mulsd(int dst, int src) {sse(0xF2, 0x59, dst, src);}
+
+    void mov(int dst, int src);
+    void mov_imm(int dst, int32_t value);
+    void add_imm(int dst, int32_t value);
+    void sub_imm(int dst, int32_t value);
+    void dec(int reg);
+    // position of the next instruction, the target of a later jnz
+    size_t label() const {return code.size();}
+    void jnz(size_t target);
+    void ret() {code.push_back(0xC3);}
+
+    const std::vector<uint8_t> &bytes() const {return code;}
+
+private:
+    void rex(bool wide, int reg, int base);
+    void sse(uint8_t prefix, uint8_t opcode, int reg, int rm);
+    void sse_mem(uint8_t prefix, uint8_t opcode, int reg, int base, int32_t disp);
+    void imm32(int32_t value);
+
+    std::vector<uint8_t> code;
+};
+
+// machine code in its own read-only executable mapping
+class JitKernel {
+public:
+    typedef void (*Function)(const double *a, const double *b, double *c);
+
+    explicit JitKernel(const std::vector<uint8_t> &code);
+    ~JitKernel();
+    JitKernel(const JitKernel&) = delete;
+    JitKernel &operator=(const JitKernel&) = delete;
+
+    void operator()(const double *a, const double *b, double *c) const {function(a, b, c);}
+    size_t size() const {return length;}
+
+private:
+    void *memory;
+    size_t length;
+    Function function;
+};
+
+// the code for one shape, empty when a stride or an operand does not fit a disp32
+std::vector<uint8_t> jit_gemm_code(const JitShape &shape);
+
+class JitGemm {
+public:
+    // the process-wide cache behind Matrix::JIT
+    static JitGemm &instance();
+    // x86-64 System V and executable mappings allowed
+    static bool available();
+
+    // compiled and checked on first use, thread-safe; null when the shape falls back
+    std::shared_ptr<const JitKernel> kernel(const JitShape &shape);
+    // shapes seen, including the ones that fell back
+    size_t size() const;
+    // bytes of machine code held
+    size_t codeBytes() const;
+    void clear();
+
+private:
+    JitGemm() = default;
+    std::shared_ptr<const JitKernel> compile(const JitShape &shape) const;
+
+    std::map<JitShape, std::shared_ptr<const JitKernel>> cache;
+    mutable std::shared_mutex mutex;
+};
+
+#endif
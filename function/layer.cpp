@@ -1,4 +1,5 @@
 #include "layer.h"
+#include "opstats.h"
 
 Layer::Layer() {}
 Layer::Layer(bool trainable, bool hasTrainableVar) : trainableVar(trainable), hasTrainableVar(hasTrainableVar) {}
@@ -6,13 +7,15 @@ Layer::~Layer() {}
 
 Matrix Layer::operator()(Matrix &input_tensor)
 {
-    this->input = input_tensor;
+    {
+        OpContext context("Layer::operator()");
+        this->input = input_tensor;
+    }
     return this->forward(input_tensor);
 }
 
 Matrix Layer::forward(const Matrix &input_tensor)
 {
-    this->input = input_tensor;
     return input_tensor;
 }
 
@@ -10,17 +10,20 @@ class Layer {
 public:
     Layer();
     Layer(bool trainable, bool hasTrainableVar);
-    ~Layer();
+    virtual ~Layer();
     Matrix operator()(Matrix &input_tensor);
 
     bool getTrainableVar() const {return trainableVar;}
     bool getHasTrainableVar() const {return hasTrainableVar;}
 
+    // must not modify the layer, Network::predict calls it concurrently
     virtual Matrix forward(const Matrix &input_tensor);
     virtual std::pair<Matrix, std::vector<Matrix>> backward(Matrix &input_tensor);
     virtual void apply_gradient(std::vector<Matrix> gradients);
     virtual void set_weight(std::vector<Matrix> weight_list);
     virtual std::vector<Matrix> get_weight();
+    // static string, used by the profiler
+    virtual const char *getName() const {return "Layer";}
 
 protected:
     Matrix input;
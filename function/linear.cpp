@@ -1,5 +1,6 @@
 #include "linear.h"
 #include "matrix.h"
+#include "profiler.h"
 #include <random>
 
 Linear::Linear(int in_channel, int out_channel, bool useBias, bool trainable):
@@ -23,6 +24,15 @@ Linear::Linear(int in_channel, int out_channel, bool useBias, bool trainable):
     }
 }
 
+Linear::Linear(Matrix weight, Matrix bias, bool trainable):
+    Layer(trainable, true), inChannel(weight.getRow()), outChannel(weight.getCol()),
+    useBias(bias.getRow() > 0), weight(std::move(weight)), bias(std::move(bias))
+{
+    if (useBias && (this->bias.getRow() != 1 || this->bias.getCol() != outChannel)) {
+        throw std::runtime_error("Linear: Invalid bias matrix shape\n");
+    }
+}
+
 Linear::~Linear() {}
 // z = W^T * x + b
 Matrix Linear::forward(const Matrix &input_tensor) {
@@ -45,6 +55,15 @@ Matrix Linear::forward(const Matrix &input_tensor) {
     //         output(i, j) = sum;
     //     }
     // }
+    if (input_tensor.getRow() <= SMALL_GEMM_ROWS) {
+        ProfileScope scope("gemm", "small", input_tensor.getRow(), outChannel, inChannel);
+        std::shared_ptr<const PackedPanels> packed = std::atomic_load(&this->packedWeight);
+        if (!packed) {
+            packed = std::make_shared<const PackedPanels>(pack_panels(this->weight));
+            std::atomic_store(&this->packedWeight, packed);
+        }
+        return multiply_small(input_tensor, *packed, this->useBias ? &this->bias : nullptr);
+    }
     Matrix output = mat_multiply(input_tensor, this->weight);
     if (this->useBias) {
         output = output + this->bias;
@@ -52,6 +71,29 @@ Matrix Linear::forward(const Matrix &input_tensor) {
     return output;
 }
 
+std::vector<Matrix> Linear::forward_batch(const std::vector<Linear*> &layers, const std::vector<Matrix> &inputs)
+{
+    if (inputs.size() != layers.size() && inputs.size() != 1) {
+        throw std::runtime_error("Linear::forward_batch: one input per layer or one shared input\n");
+    }
+    std::vector<const Matrix*> left, right;
+    for (size_t i = 0; i < layers.size(); i++) {
+        const Matrix &input = inputs[inputs.size() == 1 ? 0 : i];
+        if (input.getCol() != layers[i]->inChannel) {
+            throw std::runtime_error("Input matrix column size does not match weight matrix row size\n");
+        }
+        left.push_back(&input);
+        right.push_back(&layers[i]->weight);
+    }
+    std::vector<Matrix> outputs = multiply_batch(left, right);
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i]->useBias) {
+            outputs[i] = outputs[i] + layers[i]->bias;
+        }
+    }
+    return outputs;
+}
+
 std::pair<Matrix, std::vector<Matrix>> Linear::backward(Matrix &gradient) {
     // gradient is dL/dz from next layer
     
@@ -67,8 +109,8 @@ std::pair<Matrix, std::vector<Matrix>> Linear::backward(Matrix &gradient) {
     // For bias: dL/db = sum(dL/dz) across batch dimension
     // Since forward: z = xW + b, backward sums the gradients
     if (useBias) {
-        Matrix ones = Matrix::fillwith(1, gradient.getRow(), 1.0);
-        this->biasGradient = mat_multiply(ones, gradient);
+        // column sum, no ones-vector GEMM (nor a device round trip in CUDA mode)
+        this->biasGradient = gradient.sum(0);
         return std::pair<Matrix, std::vector<Matrix>>(
             dzdx,
             {this->weightGradient, this->biasGradient}
@@ -85,6 +127,7 @@ void Linear::set_weight(std::vector<Matrix> weight_list) {
         throw std::runtime_error("Linear::set_weight: Invalid weight matrix shape\n");
     }
     this->weight = _weight;
+    std::atomic_store(&this->packedWeight, std::shared_ptr<const PackedPanels>());
 
     if (useBias) {
         Matrix &_bias = weight_list[1];
@@ -96,8 +139,13 @@ void Linear::set_weight(std::vector<Matrix> weight_list) {
 }
 
 void Linear::apply_gradient(std::vector<Matrix> gradients) {
+    // checked up front, the weight must not be updated without its bias
+    if (this->weight.isReadOnly() || this->bias.isReadOnly()) {
+        throw std::runtime_error("Linear::apply_gradient: parameters are read-only (mapped model)\n");
+    }
     Matrix &w_grad = gradients[0];
     this->weight -= w_grad;
+    std::atomic_store(&this->packedWeight, std::shared_ptr<const PackedPanels>());
     if (this->useBias) {
         Matrix &b_grad = gradients[1];
         this->bias -= b_grad;
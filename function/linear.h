@@ -2,6 +2,7 @@
 // in_channel, out_channel, use_bias -> (Matrix) weight, bias | (Matrix) weight_gradient, bias_gradient
 #include "layer.h"
 #include "matrix.h"
+#include <memory>
 
 #ifndef __LINEAR__
 #define __LINEAR__
@@ -10,9 +11,15 @@ class Linear : public Layer {
 public:
     using Layer::Layer;
     Linear(int in_channel, int out_channel, bool use_bias = false, bool trainable = true);
+    // layer over existing parameters, an empty bias means no bias
+    // views are kept as views (weights used in place, e.g. from a mapped model)
+    Linear(Matrix weight, Matrix bias, bool trainable = false);
     ~Linear();
 
     Matrix forward(const Matrix &input_tensor) override;
+    // forward of many layers in one batched GEMM, inputs[i] goes through layers[i]
+    // (a single input is shared by every layer); nothing is recorded for backward
+    static std::vector<Matrix> forward_batch(const std::vector<Linear*> &layers, const std::vector<Matrix> &inputs);
     std::pair<Matrix, std::vector<Matrix>> backward(Matrix &gradient);
     void apply_gradient(std::vector<Matrix> gradients);
     void set_weight(std::vector<Matrix> weight_list);
@@ -21,6 +28,8 @@ public:
     std::pair<size_t, size_t> getChannel();
     const Matrix& getWeight() const { return weight; }
     const Matrix& getBias() const { return bias; }
+    bool getUseBias() const { return useBias; }
+    const char *getName() const override { return "Linear"; }
     
 private:
     size_t inChannel;
@@ -29,6 +38,9 @@ private:
     // forward
     Matrix weight;
     Matrix bias;
+    // weight packed for single-sample forwards, built on first use and dropped when the
+    // weight changes; concurrent predicts may both pack, the results are identical
+    std::shared_ptr<const PackedPanels> packedWeight;
     // backward
     Matrix weightGradient;
     Matrix biasGradient;
@@ -1,7 +1,12 @@
 #include"loss.h"
+#include "profiler.h"
+#include "opstats.h"
 
 Matrix BaseLoss::operator()(const Matrix &prediction, const Matrix &ground_truth)
 {
+    std::lock_guard<std::mutex> lock(mutex);
+    ProfileScope scope("loss", getName(), prediction.getRow(), prediction.getCol());
+    OpContext context("loss");
     this->input = prediction;
     return this->forward(prediction, ground_truth);
 }
@@ -13,6 +18,7 @@ Matrix BaseLoss::forward(const Matrix &prediction, const Matrix &ground_truth)
 
 Matrix BaseLoss::backward()
 {
+    std::lock_guard<std::mutex> lock(mutex);
     return gradient;
 }
 
@@ -25,18 +31,15 @@ Matrix MSE::forward(const Matrix &prediction, const Matrix &ground_truth)
 
 Matrix MSE::backward()
 {
+    std::lock_guard<std::mutex> lock(mutex);
     return this->gradient;
 }
 
 Matrix CategoricalCrossentropy::forward(const Matrix &prediction, const Matrix &ground_truth)
 {
-    Matrix mat_exp = prediction.exp();
-    Matrix mat_exp_sum(prediction.getRow(), 1);
-    for(size_t i = 0; i < prediction.getRow(); i++) {
-        for(size_t j = 0; j < prediction.getCol(); j++) {
-            mat_exp_sum(i,0) += mat_exp(i,j); 
-        }
-    }
+    // softmax, shifted by the row maximum so exp cannot overflow
+    Matrix mat_exp = (prediction - prediction.max(1)).exp();
+    Matrix mat_exp_sum = mat_exp.sum(1);
     Matrix normalize = mat_exp / mat_exp_sum;
     this->gradient = normalize - ground_truth;
     return normalize.log() * ground_truth * -1.0;
@@ -44,6 +47,7 @@ Matrix CategoricalCrossentropy::forward(const Matrix &prediction, const Matrix &
 
 Matrix CategoricalCrossentropy::backward()
 {
+    std::lock_guard<std::mutex> lock(mutex);
     return this->gradient;
 }
 
@@ -1,4 +1,5 @@
 #include"matrix.h"
+#include <mutex>
 
 #ifndef __LOSS__
 #define __LOSS__
@@ -8,13 +9,17 @@ class BaseLoss
 public:
     BaseLoss() {};
     ~BaseLoss() {};
+    // forward and backward of one object are serialized, the gradient is per object
     Matrix operator() (const Matrix &prediction, const Matrix &ground_truth);
 
     virtual Matrix forward(const Matrix &prediction, const Matrix &ground_truth);
     virtual Matrix backward();
+    // static string, used by the profiler
+    virtual const char *getName() const {return "Loss";}
 protected:
     Matrix gradient;
     Matrix input;
+    std::mutex mutex;
 };
 
 class MSE: public BaseLoss
@@ -25,6 +30,7 @@ public:
     ~MSE() {};
     Matrix forward(const Matrix &prediction, const Matrix &ground_truth);
     Matrix backward();
+    const char *getName() const {return "MSE";}
 };
 
 class CategoricalCrossentropy: public BaseLoss
@@ -35,6 +41,7 @@ public:
     ~CategoricalCrossentropy() {};
     Matrix forward(const Matrix &prediction, const Matrix &ground_truth);
     Matrix backward();
+    const char *getName() const {return "CategoricalCrossentropy";}
 };
 
 #endif
\ No newline at end of file
@@ -1,28 +1,200 @@
 #include "matrix.h"
+#include "profiler.h"
+#include "opstats.h"
 #include <iostream>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
 #include <mkl.h>
 #include <omp.h>
 #include <pthread.h>
 #include <cuda_runtime.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
-int Matrix::mulMode = Matrix::CUDA;
+std::atomic<int> Matrix::mulMode(Matrix::AUTO);
 
-Matrix::Matrix() : row(0), col(0), data(nullptr) {}
+// op accounting: bytes are the compulsory traffic, every operand read and the result
+// written once; exp, log and pow count as one flop
+static const double WORD = sizeof(double);
+
+// allocation policy, read by every owned allocation
+static std::atomic<bool> touch_parallel(false);
+static std::atomic<bool> interleave_pages(false);
+static std::atomic<int> huge_pages(Matrix::HUGE_NONE);
+static std::atomic<size_t> policy_min_bytes(size_t(1) << 21);
+
+static const size_t HUGE_PAGE = size_t(1) << 21;
+// <numaif.h> comes with libnuma, the syscall needs only the mode
+static const int MPOL_INTERLEAVE_MODE = 3;
+
+// in front of every owned buffer, which keeps the data 64-byte aligned
+struct alignas(64) BufferHeader {
+    void *base;         // the heap block or the start of the mapping
+    size_t mapped;      // mapping length, 0 for the heap
+};
+
+void Matrix::setAllocPolicy(const AllocPolicy &policy)
+{
+    if (policy.hugePages < HUGE_NONE || policy.hugePages > HUGE_EXPLICIT) {
+        throw std::runtime_error("setAllocPolicy: invalid huge page mode");
+    }
+    touch_parallel = policy.parallelTouch;
+    interleave_pages = policy.interleave;
+    huge_pages = policy.hugePages;
+    policy_min_bytes = policy.minBytes;
+}
+
+Matrix::AllocPolicy Matrix::getAllocPolicy()
+{
+    return {touch_parallel, interleave_pages, HugePages(huge_pages.load()), policy_min_bytes};
+}
+
+bool Matrix::touchInParallel(size_t count)
+{
+    return touch_parallel.load(std::memory_order_relaxed) && count * sizeof(double) >= policy_min_bytes;
+}
+
+// "0-1,4" from sysfs as a bit mask, empty on single-node machines
+static std::vector<unsigned long> online_nodes()
+{
+    std::vector<unsigned long> mask;
+    std::ifstream file("/sys/devices/system/node/online");
+    std::string list, range;
+    size_t count = 0;
+    if (std::getline(file, list)) {
+        std::istringstream ranges(list);
+        while (std::getline(ranges, range, ',')) {
+            size_t first = 0, last = 0;
+            if (std::sscanf(range.c_str(), "%zu-%zu", &first, &last) < 2) {
+                last = first;
+            }
+            for (size_t node = first; node <= last && node < 1024; node++) {
+                mask.resize(std::max(mask.size(), node / (8 * sizeof(unsigned long)) + 1), 0);
+                mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+                count++;
+            }
+        }
+    }
+    return count > 1 ? mask : std::vector<unsigned long>();
+}
+
+// 2MB aligned, so transparent huge pages can back all of it
+static void *map_aligned(size_t length, size_t alignment)
+{
+    void *reserved = mmap(nullptr, length + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(reserved);
+    uintptr_t aligned = (start + alignment - 1) / alignment * alignment;
+    if (aligned > start) {
+        munmap(reserved, aligned - start);
+    }
+    if (start + alignment > aligned) {
+        munmap(reinterpret_cast<void *>(aligned + length), start + alignment - aligned);
+    }
+    return reinterpret_cast<void *>(aligned);
+}
+
+// small buffers, and every buffer with the policy off, come from the heap; large ones get
+// their own mapping, so its pages can be interleaved and huge, before anything touches them
+double *Matrix::allocate(size_t count)
+{
+    size_t bytes = count * sizeof(double);
+    int huge = huge_pages.load(std::memory_order_relaxed);
+    bool interleave = interleave_pages.load(std::memory_order_relaxed);
+    if (bytes < policy_min_bytes.load(std::memory_order_relaxed) || (!interleave && huge == HUGE_NONE)) {
+        void *base = ::operator new(sizeof(BufferHeader) + bytes, std::align_val_t(alignof(BufferHeader)));
+        BufferHeader *header = new (base) BufferHeader{base, 0};
+        return reinterpret_cast<double *>(header + 1);
+    }
+    size_t page = huge == HUGE_NONE ? size_t(sysconf(_SC_PAGESIZE)) : HUGE_PAGE;
+    size_t length = (sizeof(BufferHeader) + bytes + page - 1) / page * page;
+    void *base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge == HUGE_EXPLICIT) {
+        base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (base == MAP_FAILED) {
+        base = map_aligned(length, page);
+        if (base == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+#ifdef MADV_HUGEPAGE
+        if (huge != HUGE_NONE) {
+            madvise(base, length, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    if (interleave) {
+        // best effort, a refused policy leaves first-touch placement
+        static const std::vector<unsigned long> nodes = online_nodes();
+        if (!nodes.empty()) {
+            syscall(SYS_mbind, base, length, MPOL_INTERLEAVE_MODE, nodes.data(),
+                    nodes.size() * 8 * sizeof(unsigned long) + 1, 0);
+        }
+    }
+    // the header's page is the only one touched here
+    BufferHeader *header = new (base) BufferHeader{base, length};
+    return reinterpret_cast<double *>(header + 1);
+}
+
+void Matrix::release(double *data)
+{
+    if (data == nullptr) {
+        return;
+    }
+    BufferHeader *header = reinterpret_cast<BufferHeader *>(data) - 1;
+    if (header->mapped > 0) {
+        munmap(header->base, header->mapped);
+    }
+    else {
+        ::operator delete(header->base, std::align_val_t(alignof(BufferHeader)));
+    }
+}
+
+// zero (src null) or copy rows; with parallel touch the threads take static row blocks,
+// the split multiply_openmp and the row-wise reductions use with the same team size
+static void first_touch(double *data, const double *src, size_t rows, size_t cols, bool parallel)
+{
+    if (!parallel || rows < 2) {
+        if (src != nullptr) {
+            memcpy(data, src, rows * cols * sizeof(double));
+        }
+        else {
+            memset(data, 0, rows * cols * sizeof(double));
+        }
+        return;
+    }
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < rows; i++) {
+        if (src != nullptr) {
+            memcpy(data + i * cols, src + i * cols, cols * sizeof(double));
+        }
+        else {
+            memset(data + i * cols, 0, cols * sizeof(double));
+        }
+    }
+}
+
+Matrix::Matrix() : row(0), col(0), data(nullptr), ownsData(true), readOnly(false) {}
 
 Matrix::Matrix(size_t r, size_t c)
     : row(r), col(c),
-      data(nullptr)
+      data(nullptr), ownsData(true), readOnly(false)
 {   
     size_t element = row * col;
-    data = new double[element];
-    if (data != nullptr) {
-        memset(data, 0, element * sizeof(double));
-    }
-    else {
-        std::cout << "Out of memory" << std::endl;
-    }
+    data = allocate(element);
+    first_touch(data, nullptr, row, col, touchInParallel(element));
 }
 // template<typename Type>
 // Matrix::Matrix(Type* ptr, size_t r, size_t c)
@@ -42,22 +214,42 @@ Matrix::Matrix(size_t r, size_t c)
 // }
 
 Matrix::Matrix(const Matrix &target)
+    : ownsData(true), readOnly(false)
 {
     row = target.getRow();
     col = target.getCol();
     size_t element = row * col;
-    data = new double[element];
-    if (data != nullptr) {
-        memcpy(data, target.data, sizeof(double) * element);
-    }
-    else {
-        std::cout << "Out of memory" << std::endl;
-    }
+    OpScope op_scope(OP_COPY, "copy", row, col, -1, 0.0, WORD * element, WORD * element);
+    data = allocate(element);
+    first_touch(data, target.data, row, col, touchInParallel(element));
+}
+
+Matrix::Matrix(Matrix &&target)
+    : row(target.row), col(target.col), data(target.data), ownsData(target.ownsData),
+      readOnly(target.readOnly)
+{
+    target.row = target.col = 0;
+    target.data = nullptr;
+    target.ownsData = true;
+    target.readOnly = false;
+}
+
+Matrix Matrix::view(double *data, size_t r, size_t c, bool readOnly)
+{
+    Matrix result;
+    result.row = r;
+    result.col = c;
+    result.data = data;
+    result.ownsData = false;
+    result.readOnly = readOnly;
+    return result;
 }
 
 Matrix::~Matrix()
 {
-    delete[] data;
+    if (ownsData) {
+        release(data);
+    }
     row = col = 0;
     data = nullptr;
 }
@@ -97,14 +289,39 @@ bool Matrix::operator==(const Matrix &target) const
 
 void Matrix::operator=(const Matrix &target)
 {
-    if (data != nullptr) {
-        delete[] data;
+    if (this == &target) {
+        return;
+    }
+    if (ownsData) {
+        release(data);
     }
+    ownsData = true;
+    readOnly = false;
     row = target.getRow();
     col = target.getCol();
     size_t element = row * col;
-    data = new double[element];
-    memcpy(data, target.data, sizeof(double) * element);
+    OpScope op_scope(OP_COPY, "copy assign", row, col, -1, 0.0, WORD * element, WORD * element);
+    data = allocate(element);
+    first_touch(data, target.data, row, col, touchInParallel(element));
+}
+
+void Matrix::operator=(Matrix &&target)
+{
+    if (this == &target) {
+        return;
+    }
+    if (ownsData) {
+        release(data);
+    }
+    row = target.row;
+    col = target.col;
+    data = target.data;
+    ownsData = target.ownsData;
+    readOnly = target.readOnly;
+    target.row = target.col = 0;
+    target.data = nullptr;
+    target.ownsData = true;
+    target.readOnly = false;
 }
 
 // Matrix Matrix::operator+(const Matrix &mat) const
@@ -167,6 +384,8 @@ Matrix Matrix::FUNCNAME(const Matrix &mat) const \
     else if (this->col != mat.col && !(mat.col == 1 || this->col == 1)) { \
         throw std::runtime_error("shape is not broadcastable in col"); \
     } \
+    OpScope op_scope(OP_ELEMENTWISE, #OP, row, col, -1, double(row * col), \
+                     WORD * (this->row * this->col + mat.row * mat.col), WORD * row * col); \
     Matrix temp(row, col); \
     if (mat.row == this->row && mat.col == this->col) { \
         for (size_t i = 0; i < this->row * this->col; i++) { \
@@ -192,6 +411,10 @@ Matrix& Matrix::FUNCNAME(const Matrix &mat) \
     if (row != mat.row || col != mat.col) { \
         throw std::runtime_error("row or col not match"); \
     } \
+    if (readOnly) { \
+        throw std::runtime_error("in-place " #OP " on a read-only matrix"); \
+    } \
+    OpScope op_scope(OP_ELEMENTWISE, #OP, row, col, -1, double(row * col), 2 * WORD * row * col, WORD * row * col); \
     for (size_t i = 0; i < this->row; i++) { \
         for (size_t j = 0; j < this->col; j++) { \
             data[i * this->col + j] OP mat(i, j); \
@@ -204,6 +427,8 @@ Matrix& Matrix::FUNCNAME(const Matrix &mat) \
 #define MATRIX_OP_DOUBLE(FUNCNAME, OP) \
 Matrix Matrix::FUNCNAME(double num) const \
 { \
+    OpScope op_scope(OP_ELEMENTWISE, #OP " scalar", row, col, -1, double(row * col), WORD * row * col, \
+                     WORD * row * col); \
     Matrix temp(this->row, this->col); \
     for (size_t i = 0; i < this->row * this->col; i++) { \
         temp.data[i] = data[i] OP num; \
@@ -215,7 +440,9 @@ Matrix Matrix::FUNCNAME(double num) const \
 #define DOUBLE_OP_MATRIX(FUNCNAME, OP) \
 Matrix FUNCNAME(double num, const Matrix &mat) \
 { \
-    Matrix temp(mat); \
+    OpScope op_scope(OP_ELEMENTWISE, "scalar " #OP, mat.row, mat.col, -1, double(mat.row * mat.col), \
+                     WORD * mat.row * mat.col, WORD * mat.row * mat.col); \
+    Matrix temp(mat.row, mat.col); \
     for (size_t i = 0; i < mat.row * mat.col; i++) { \
         temp.data[i] = num OP mat.data[i]; \
     } \
@@ -226,6 +453,11 @@ Matrix FUNCNAME(double num, const Matrix &mat) \
 #define MATRIX_ASSIGN_OP_DOUBLE(FUNCNAME, OP) \
 Matrix& Matrix::FUNCNAME(double num) \
 { \
+    if (readOnly) { \
+        throw std::runtime_error("in-place " #OP " on a read-only matrix"); \
+    } \
+    OpScope op_scope(OP_ELEMENTWISE, #OP " scalar", row, col, -1, double(row * col), WORD * row * col, \
+                     WORD * row * col); \
     for (size_t i = 0; i < this->row * this->col; i++) { \
         data[i] OP num; \
     } \
@@ -262,6 +494,7 @@ MATRIX_ASSIGN_OP_DOUBLE(operator/=, /=)
 
 Matrix Matrix::power(double p) const
 {
+    OpScope op_scope(OP_ELEMENTWISE, "power", row, col, -1, 1.0 * row * col, WORD * row * col, WORD * row * col);
     Matrix temp(row, col);
     for (size_t i = 0; i < row * col; i++) {
         temp.data[i] = std::pow(data[i], p);
@@ -271,6 +504,7 @@ Matrix Matrix::power(double p) const
 
 Matrix Matrix::exp() const
 {
+    OpScope op_scope(OP_ELEMENTWISE, "exp", row, col, -1, 1.0 * row * col, WORD * row * col, WORD * row * col);
     Matrix temp(row, col);
     for (size_t i = 0; i < row * col; i++) {
         temp.data[i] = std::exp(data[i]);
@@ -280,6 +514,7 @@ Matrix Matrix::exp() const
 
 Matrix Matrix::log() const
 {
+    OpScope op_scope(OP_ELEMENTWISE, "log", row, col, -1, 1.0 * row * col, WORD * row * col, WORD * row * col);
     Matrix temp(row, col);
     for (size_t i = 0; i < row * col; i++) {
         temp.data[i] = std::log(data[i]);
@@ -289,6 +524,7 @@ Matrix Matrix::log() const
 
 Matrix Matrix::sigmoid() const
 {
+    OpScope op_scope(OP_ELEMENTWISE, "sigmoid", row, col, -1, 3.0 * row * col, WORD * row * col, WORD * row * col);
     Matrix temp(row, col);
     for (size_t i = 0; i < row * col; i++) {    
         temp.data[i] = 1.0 / (1.0 + std::exp(-data[i]));
@@ -298,6 +534,7 @@ Matrix Matrix::sigmoid() const
 
 Matrix Matrix::relu() const
 {
+    OpScope op_scope(OP_ELEMENTWISE, "relu", row, col, -1, 1.0 * row * col, WORD * row * col, WORD * row * col);
     Matrix temp(row, col);
     for (size_t i = 0; i < row * col; i++) {
         temp.data[i] = std::max(0.0, data[i]);
@@ -307,6 +544,7 @@ Matrix Matrix::relu() const
 
 Matrix Matrix::T() const
 {
+    OpScope op_scope(OP_TRANSPOSE, "transpose", row, col, -1, 0.0, WORD * row * col, WORD * row * col);
     Matrix temp(col, row);
     for (size_t i = 0; i < row * col; i++) {
         size_t col_idx = i / col;
@@ -318,6 +556,7 @@ Matrix Matrix::T() const
 
 Matrix Matrix::fillwith(size_t r, size_t c, double num)
 {
+    OpScope op_scope(OP_ELEMENTWISE, "fill", r, c, -1, 0.0, 0.0, WORD * r * c);
     Matrix temp(r, c);
     for (size_t i = 0; i < r * c; i++) {
         temp.data[i] = num;
@@ -340,15 +579,237 @@ Matrix Matrix::slice(size_t start_row, size_t end_row) const
     if (start_row < 0 || end_row > row || start_row >= end_row) {
         throw std::runtime_error("Invalid slice range");
     }
+    size_t element = (end_row - start_row) * col;
+    OpScope op_scope(OP_COPY, "slice", end_row - start_row, col, -1, 0.0, WORD * element, WORD * element);
     Matrix temp(end_row - start_row, col);
-    for (size_t i = 0; i < (end_row - start_row) * col; i++) {
+    for (size_t i = 0; i < element; i++) {
         temp.data[i] = data[start_row * col + i];
     }
     return temp;
 }
+// reductions
+// contiguous runs are split in halves down to PAIRWISE_BLOCK elements, which are
+// added with simd accumulators, so the rounding error grows with log(n)
+static const size_t PAIRWISE_BLOCK = 128;
+// fixed work split of the threaded reductions, results do not depend on the thread count
+static const size_t REDUCE_CHUNK = 1 << 14;
+// column reductions accumulate this many rows per block, the blocks are combined as a tree
+static const size_t COLUMN_BLOCK = 64;
+// below this many elements the reductions stay on the calling thread
+static const size_t REDUCE_PARALLEL = 1 << 15;
+
+static double pairwise_sum(const double *x, size_t n)
+{
+    if (n <= PAIRWISE_BLOCK) {
+        double total = 0.0;
+        #pragma omp simd reduction(+:total)
+        for (size_t i = 0; i < n; i++) {
+            total += x[i];
+        }
+        return total;
+    }
+    size_t half = n / 2;
+    return pairwise_sum(x, half) + pairwise_sum(x + half, n - half);
+}
+
+static double row_max(const double *x, size_t n)
+{
+    double best = x[0];
+    #pragma omp simd reduction(max:best)
+    for (size_t i = 1; i < n; i++) {
+        best = std::max(best, x[i]);
+    }
+    return best;
+}
+
+static void check_axis(int axis)
+{
+    if (axis != 0 && axis != 1) {
+        throw std::runtime_error("Matrix: axis must be 0 (over rows) or 1 (over columns)");
+    }
+}
+
+// reduces the rows of mat into one row: COLUMN_BLOCK rows at a time, then the block
+// results pairwise, every step vectorized across the columns
+template<typename Combine>
+static Matrix reduce_columns(const Matrix &mat, Combine combine)
+{
+    size_t rows = mat.row, cols = mat.col;
+    size_t blocks = (rows + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+    bool parallel = rows * cols > REDUCE_PARALLEL;
+    Matrix partial(blocks, cols);
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t b = 0; b < blocks; b++) {
+        double *acc = partial.data + b * cols;
+        size_t begin = b * COLUMN_BLOCK, end = std::min(rows, begin + COLUMN_BLOCK);
+        std::memcpy(acc, mat.data + begin * cols, cols * sizeof(double));
+        for (size_t i = begin + 1; i < end; i++) {
+            combine(acc, mat.data + i * cols, cols);
+        }
+    }
+    for (size_t stride = 1; stride < blocks; stride *= 2) {
+        #pragma omp parallel for schedule(static) if (parallel && blocks / stride > 2)
+        for (size_t b = 0; b < blocks - stride; b += 2 * stride) {
+            combine(partial.data + b * cols, partial.data + (b + stride) * cols, cols);
+        }
+    }
+    if (blocks == 1) {
+        return partial;
+    }
+    Matrix result(1, cols);
+    std::memcpy(result.data, partial.data, cols * sizeof(double));
+    return result;
+}
+
+double Matrix::sum() const
+{
+    size_t n = row * col;
+    OpScope op_scope(OP_REDUCTION, "sum", row, col, -1, double(n), WORD * n, WORD);
+    size_t chunks = (n + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+    std::vector<double> partial(chunks);
+    #pragma omp parallel for schedule(static) if (n > REDUCE_PARALLEL)
+    for (size_t c = 0; c < chunks; c++) {
+        size_t begin = c * REDUCE_CHUNK;
+        partial[c] = pairwise_sum(data + begin, std::min(REDUCE_CHUNK, n - begin));
+    }
+    return pairwise_sum(partial.data(), chunks);
+}
+
+double Matrix::max() const
+{
+    size_t n = row * col;
+    OpScope op_scope(OP_REDUCTION, "max", row, col, -1, double(n), WORD * n, WORD);
+    if (n == 0) {
+        throw std::runtime_error("Matrix::max: empty matrix");
+    }
+    size_t chunks = (n + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+    std::vector<double> partial(chunks);
+    #pragma omp parallel for schedule(static) if (n > REDUCE_PARALLEL)
+    for (size_t c = 0; c < chunks; c++) {
+        size_t begin = c * REDUCE_CHUNK;
+        partial[c] = row_max(data + begin, std::min(REDUCE_CHUNK, n - begin));
+    }
+    return row_max(partial.data(), chunks);
+}
+
+Matrix Matrix::sum(int axis) const
+{
+    check_axis(axis);
+    OpScope op_scope(OP_REDUCTION, axis == 0 ? "sum axis 0" : "sum axis 1", row, col, -1, double(row * col),
+                     WORD * row * col, WORD * (axis == 0 ? col : row));
+    if (axis == 1) {
+        Matrix result(row, 1);
+        #pragma omp parallel for schedule(static) if (row * col > REDUCE_PARALLEL)
+        for (size_t i = 0; i < row; i++) {
+            result.data[i] = pairwise_sum(data + i * col, col);
+        }
+        return result;
+    }
+    if (row == 0) {
+        return zeros(1, col);
+    }
+    return reduce_columns(*this, [](double *acc, const double *x, size_t n) {
+        #pragma omp simd
+        for (size_t j = 0; j < n; j++) {
+            acc[j] += x[j];
+        }
+    });
+}
+
+Matrix Matrix::mean(int axis) const
+{
+    Matrix result = sum(axis);
+    result /= double(axis == 0 ? row : col);
+    return result;
+}
+
+Matrix Matrix::max(int axis) const
+{
+    check_axis(axis);
+    if ((axis == 0 ? row : col) == 0) {
+        throw std::runtime_error("Matrix::max: empty axis");
+    }
+    OpScope op_scope(OP_REDUCTION, axis == 0 ? "max axis 0" : "max axis 1", row, col, -1, double(row * col),
+                     WORD * row * col, WORD * (axis == 0 ? col : row));
+    if (axis == 1) {
+        Matrix result(row, 1);
+        #pragma omp parallel for schedule(static) if (row * col > REDUCE_PARALLEL)
+        for (size_t i = 0; i < row; i++) {
+            result.data[i] = row_max(data + i * col, col);
+        }
+        return result;
+    }
+    return reduce_columns(*this, [](double *acc, const double *x, size_t n) {
+        #pragma omp simd
+        for (size_t j = 0; j < n; j++) {
+            acc[j] = std::max(acc[j], x[j]);
+        }
+    });
+}
+
+std::vector<size_t> Matrix::argmax(int axis) const
+{
+    // the maxima are found vectorized, then the first position holding each one
+    // (rows or columns containing NaN may not match and report 0)
+    Matrix best = max(axis);
+    // the search pass, the max above is recorded by itself
+    OpScope op_scope(OP_REDUCTION, axis == 0 ? "argmax axis 0" : "argmax axis 1", row, col, -1, 0.0,
+                     WORD * row * col, sizeof(size_t) * (axis == 0 ? col : row));
+    if (axis == 1) {
+        std::vector<size_t> result(row, 0);
+        #pragma omp parallel for schedule(static) if (row * col > REDUCE_PARALLEL)
+        for (size_t i = 0; i < row; i++) {
+            const double *x = data + i * col;
+            for (size_t j = 0; j < col; j++) {
+                if (x[j] == best.data[i]) {
+                    result[i] = j;
+                    break;
+                }
+            }
+        }
+        return result;
+    }
+    std::vector<size_t> result(col, 0);
+    std::vector<bool> found(col, false);
+    size_t remaining = col;
+    for (size_t i = 0; i < row && remaining > 0; i++) {
+        const double *x = data + i * col;
+        for (size_t j = 0; j < col; j++) {
+            if (!found[j] && x[j] == best.data[j]) {
+                found[j] = true;
+                result[j] = i;
+                remaining--;
+            }
+        }
+    }
+    return result;
+}
+
+// 2MNK flops
+static OpScope gemm_scope(const char *backend, size_t m, size_t n, size_t k)
+{
+    return OpScope(OP_GEMM, backend, m, n, k, 2.0 * m * n * k, WORD * (m * k + k * n), WORD * m * n);
+}
+
+const char *mul_mode_name(int mode)
+{
+    static const char *names[] = {"standard", "mkl", "tile", "openmp", "thread", "cuda", "auto", "jit", "strassen"};
+    return mode >= Matrix::STANDARD && mode <= Matrix::STRASSEN ? names[mode] : "invalid";
+}
+
 Matrix mat_multiply(const Matrix &mat1, const Matrix &mat2) {
     // std::cout << "Matrix::mulMode: " << Matrix::mulMode << std::endl;
-    switch (Matrix::mulMode) {
+    int mode = Matrix::mulMode;
+    if (mat1.getRow() <= SMALL_GEMM_ROWS) {
+        ProfileScope scope("gemm", "small", mat1.getRow(), mat2.getCol(), mat1.getCol());
+        return multiply_small(mat1, mat2);
+    }
+    if (mode == Matrix::AUTO) {
+        // profiled under the backend it picks
+        return multiply_auto(mat1, mat2);
+    }
+    ProfileScope scope("gemm", mul_mode_name(mode), mat1.getRow(), mat2.getCol(), mat1.getCol());
+    switch (mode) {
         case 0:
             return multiply(mat1, mat2);
         case 1:
@@ -361,6 +822,10 @@ Matrix mat_multiply(const Matrix &mat1, const Matrix &mat2) {
             return multiply_thread(mat1, mat2, 16);
         case 5:
             return multiply_cuda(mat1, mat2);
+        case 7:
+            return multiply_jit(mat1, mat2);
+        case 8:
+            return multiply_strassen(mat1, mat2);
         default:
             throw std::runtime_error("Invalid multiplication mode");
     }
@@ -373,6 +838,7 @@ Matrix multiply(const Matrix &mat1, const Matrix &mat2)
     if (mid != mat2.getRow()) {
         throw std::runtime_error("matrix dimension not match");
     }
+    OpScope op_scope = gemm_scope("gemm standard", row, col, mid);
     Matrix temp(row, col);
     for (size_t i = 0; i < row; i++) {
         for (size_t j = 0; j < col; j++) {
@@ -393,6 +859,7 @@ Matrix multiply_mkl(const Matrix &mat1, const Matrix &mat2) {
     if (mid != mat2.getRow()) {
         throw std::runtime_error("matrix dimension not match");
     }
+    OpScope op_scope = gemm_scope("gemm mkl", row, col, mid);
     Matrix temp(row, col);
     cblas_dgemm(
         CblasRowMajor,
@@ -420,6 +887,7 @@ Matrix multiply_tile(const Matrix &mat1, const Matrix &mat2, size_t tile_size) {
     if (col1 != mat2.getRow()) {
         throw std::runtime_error("matrix dimension not match");
     }
+    OpScope op_scope = gemm_scope("gemm tile", row1, col2, col1);
 
     Matrix temp(row1, col2);
     // Process each tile
@@ -445,20 +913,26 @@ Matrix multiply_tile(const Matrix &mat1, const Matrix &mat2, size_t tile_size) {
     return temp;
 }
 
-Matrix multiply_openmp(const Matrix &mat1, const Matrix &mat2) {
+Matrix multiply_openmp(const Matrix &mat1, const Matrix &mat2, int numThreads) {
     size_t row = mat1.getRow();
     size_t col = mat2.getCol();
     size_t mid = mat1.getCol();
     if (mid != mat2.getRow()) {
         throw std::runtime_error("matrix dimension not match");
     }
+    OpScope op_scope = gemm_scope("gemm openmp", row, col, mid);
     Matrix temp(row, col);
     // #pragma omp parallel
     // {
     //     #pragma omp single
     //     int num_threads = omp_get_num_threads();
     // }
-    #pragma omp parallel for schedule(dynamic)
+    if (numThreads <= 0) {
+        numThreads = omp_get_max_threads();
+    }
+    // static row blocks: every row costs the same, and each thread writes the rows whose
+    // pages it touched first under AllocPolicy::parallelTouch
+    #pragma omp parallel for schedule(static) num_threads(numThreads)
     for (size_t i = 0; i < row; i++) {
         for (size_t j = 0; j < col; j++) {
             double sum = 0.0;
@@ -524,8 +998,12 @@ Matrix multiply_thread(const Matrix &mat1, const Matrix &mat2, int numThreads) {
     if (mid != mat2.getRow()) {
         throw std::runtime_error("matrix dimension not match");
     }
-    Matrix temp(row, col);
+    OpScope op_scope = gemm_scope("gemm thread", row, col, mid);
     constexpr const int MAX_THREADS = 16;
+    if (numThreads < 1 || numThreads > MAX_THREADS) {
+        throw std::runtime_error("multiply_thread: numThreads must be between 1 and 16");
+    }
+    Matrix temp(row, col);
     pthread_t threads[MAX_THREADS];
     threadArgs args[MAX_THREADS];
     pthread_attr_t attr;
@@ -556,6 +1034,7 @@ Matrix multiply_cuda(const Matrix &mat1, const Matrix &mat2) {
     if (mid != mat2.getRow()) {
         throw std::runtime_error("matrix dimension not match");
     }
+    OpScope op_scope = gemm_scope("gemm cuda", row, col, mid);
 
     Matrix temp(row, col);
 
@@ -577,3 +1056,313 @@ Matrix multiply_cuda(const Matrix &mat1, const Matrix &mat2) {
     cudaFree(d_temp);
     return temp;
 }
+
+
+// small-M products
+// every panel of 8 columns is accumulated in registers for all M rows while the panel
+// streams through once, the sums run over k in order like multiply()
+static const size_t SMALL_PANEL = 8;
+// weights at least this large (2 MB) are split across threads by panel
+static const size_t SMALL_PARALLEL = 1 << 18;
+
+// M rows times P adjacent panels; row p of panel b starts at w + b * panel_stride + p * stride
+template<int M, int P>
+static void small_kernel(const double *a, size_t lda, const double *w, size_t stride, size_t panel_stride,
+                         size_t k, double *c, size_t ldc, size_t width)
+{
+    // fully unrolled so the accumulators stay in registers
+    double acc[M][P * SMALL_PANEL] = {};
+    for (size_t p = 0; p < k; p++) {
+        #pragma GCC unroll 8
+        for (int i = 0; i < M; i++) {
+            double x = a[i * lda + p];
+            #pragma GCC unroll 2
+            for (int b = 0; b < P; b++) {
+                const double *row = w + b * panel_stride + p * stride;
+                #pragma GCC unroll 8
+                for (size_t j = 0; j < SMALL_PANEL; j++) {
+                    acc[i][b * SMALL_PANEL + j] += x * row[j];
+                }
+            }
+        }
+    }
+    for (int i = 0; i < M; i++) {
+        for (size_t j = 0; j < width; j++) {
+            c[i * ldc + j] = acc[i][j];
+        }
+    }
+}
+
+typedef void (*SmallKernel)(const double*, size_t, const double*, size_t, size_t, size_t, double*, size_t, size_t);
+static const SmallKernel SMALL_KERNELS[SMALL_GEMM_ROWS + 1] = {
+    nullptr, small_kernel<1, 1>, small_kernel<2, 1>, small_kernel<3, 1>, small_kernel<4, 1>,
+    small_kernel<5, 1>, small_kernel<6, 1>, small_kernel<7, 1>, small_kernel<8, 1>
+};
+
+// a single-sample product is over in microseconds, even an idle parallel region costs more
+template<typename Body>
+static void for_each_panel(size_t panels, bool parallel, Body body)
+{
+    if (!parallel) {
+        for (size_t q = 0; q < panels; q++) {
+            body(q);
+        }
+        return;
+    }
+    #pragma omp parallel for schedule(static)
+    for (size_t q = 0; q < panels; q++) {
+        body(q);
+    }
+}
+
+// c (m x n) = a (m x k) times the panels, the last one may be ragged
+static void small_panels(size_t m, const double *a, size_t k, const double *w, size_t stride, size_t panel_stride,
+                         size_t panels, double *c, size_t n, bool parallel)
+{
+    // a single row waits on its accumulators, two panels at a time keep twice as many adds in flight
+    size_t group = m == 1 ? 2 : 1;
+    SmallKernel kernel = m == 1 ? small_kernel<1, 2> : SMALL_KERNELS[m];
+    for_each_panel(panels / group, parallel, [&](size_t g) {
+        size_t first = g * group * SMALL_PANEL;
+        kernel(a, k, w + g * group * panel_stride, stride, panel_stride, k, c + first, n,
+               std::min(group * SMALL_PANEL, n - first));
+    });
+    for (size_t q = panels / group * group; q < panels; q++) {
+        size_t first = q * SMALL_PANEL;
+        SMALL_KERNELS[m](a, k, w + q * panel_stride, stride, panel_stride, k, c + first, n,
+                         std::min(SMALL_PANEL, n - first));
+    }
+}
+
+static void check_small(const Matrix &mat1, size_t rows)
+{
+    if (mat1.getRow() > SMALL_GEMM_ROWS) {
+        throw std::runtime_error("multiply_small: at most 8 rows");
+    }
+    if (mat1.getCol() != rows) {
+        throw std::runtime_error("matrix dimension not match");
+    }
+}
+
+// columns first.. of a row-major rows x cols operand, zero padded to a full panel
+static void copy_panel(const double *data, size_t rows, size_t cols, size_t first, double *panel)
+{
+    size_t width = std::min(SMALL_PANEL, cols - first);
+    for (size_t p = 0; p < rows; p++) {
+        for (size_t j = 0; j < SMALL_PANEL; j++) {
+            panel[p * SMALL_PANEL + j] = j < width ? data[p * cols + first + j] : 0.0;
+        }
+    }
+}
+
+PackedPanels pack_panels(const Matrix &mat)
+{
+    size_t panels = (mat.col + SMALL_PANEL - 1) / SMALL_PANEL;
+    PackedPanels packed = {mat.row, mat.col, std::vector<double>(panels * mat.row * SMALL_PANEL)};
+    for (size_t q = 0; q < panels; q++) {
+        copy_panel(mat.data, mat.row, mat.col, q * SMALL_PANEL, packed.data.data() + q * mat.row * SMALL_PANEL);
+    }
+    return packed;
+}
+
+// row-major a (m x k) times b (k x n) into c, m at most SMALL_GEMM_ROWS
+static void small_product(const double *a, const double *b, double *c, size_t m, size_t n, size_t k,
+                          bool parallel)
+{
+    if (m == 0) {
+        return;
+    }
+    // full panels straight from the row-major operand, the ragged edge through a padded copy
+    size_t full = n / SMALL_PANEL;
+    small_panels(m, a, k, b, n, SMALL_PANEL, full, c, n, parallel);
+    if (n % SMALL_PANEL != 0) {
+        std::vector<double> edge(k * SMALL_PANEL);
+        copy_panel(b, k, n, full * SMALL_PANEL, edge.data());
+        SMALL_KERNELS[m](a, k, edge.data(), SMALL_PANEL, 0, k, c + full * SMALL_PANEL, n, n % SMALL_PANEL);
+    }
+}
+
+Matrix multiply_small(const Matrix &mat1, const Matrix &mat2)
+{
+    check_small(mat1, mat2.row);
+    size_t m = mat1.row, n = mat2.col, k = mat1.col;
+    OpScope op_scope = gemm_scope("gemm small", m, n, k);
+    Matrix temp(m, n);
+    small_product(mat1.data, mat2.data, temp.data, m, n, k, k * n >= SMALL_PARALLEL);
+    return temp;
+}
+
+Matrix multiply_small(const Matrix &mat1, const PackedPanels &mat2, const Matrix *bias)
+{
+    check_small(mat1, mat2.rows);
+    size_t m = mat1.row, n = mat2.cols, k = mat1.col;
+    if (bias && (bias->row != 1 || bias->col != n)) {
+        throw std::runtime_error("multiply_small: bias must be 1 x cols");
+    }
+    OpScope op_scope = gemm_scope("gemm small", m, n, k);
+    Matrix temp(m, n);
+    if (m == 0) {
+        return temp;
+    }
+    size_t panels = (n + SMALL_PANEL - 1) / SMALL_PANEL;
+    small_panels(m, mat1.data, k, mat2.data.data(), SMALL_PANEL, k * SMALL_PANEL, panels, temp.data, n,
+                 k * n >= SMALL_PARALLEL);
+    if (bias) {
+        // after the sums, as in output + bias
+        for (size_t i = 0; i < m; i++) {
+            #pragma omp simd
+            for (size_t j = 0; j < n; j++) {
+                temp.data[i * n + j] += bias->data[j];
+            }
+        }
+    }
+    return temp;
+}
+
+// batched products
+// products below this many flops in total run on the calling thread
+static const double BATCH_PARALLEL = 1 << 20;
+
+// one product on the calling thread, summed over k in order like multiply()
+static void gemm_serial(const double *a, const double *b, double *c, size_t m, size_t n, size_t k)
+{
+    if (m <= SMALL_GEMM_ROWS) {
+        small_product(a, b, c, m, n, k, false);
+        return;
+    }
+    for (size_t i = 0; i < m; i++) {
+        double *row = c + i * n;
+        std::memset(row, 0, n * sizeof(double));
+        for (size_t p = 0; p < k; p++) {
+            double x = a[i * k + p];
+            const double *brow = b + p * n;
+            #pragma omp simd
+            for (size_t j = 0; j < n; j++) {
+                row[j] += x * brow[j];
+            }
+        }
+    }
+}
+
+// MKL batches runs of identical shapes as groups; the fallback spreads whole products
+// over the OpenMP threads
+static void gemm_batch(size_t count, const size_t *m, const size_t *n, const size_t *k,
+                       const double **a, const double **b, double **c)
+{
+    double flops = 0.0, read = 0.0, written = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        flops += 2.0 * m[i] * n[i] * k[i];
+        read += WORD * (m[i] * k[i] + k[i] * n[i]);
+        written += WORD * m[i] * n[i];
+    }
+    int mode = Matrix::mulMode;
+    bool mkl = mode == Matrix::MKL || mode == Matrix::AUTO;
+    ProfileScope scope("gemm", mkl ? "mkl batch" : "batch", count);
+    OpScope op_scope(OP_GEMM, mkl ? "gemm mkl batch" : "gemm batch", count, -1, -1, flops, read, written);
+    if (mkl) {
+        std::vector<MKL_INT> ms, ns, ks, sizes;
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0 && m[i] == m[i - 1] && n[i] == n[i - 1] && k[i] == k[i - 1]) {
+                sizes.back()++;
+                continue;
+            }
+            ms.push_back(MKL_INT(m[i]));
+            ns.push_back(MKL_INT(n[i]));
+            ks.push_back(MKL_INT(k[i]));
+            sizes.push_back(1);
+        }
+        size_t groups = sizes.size();
+        std::vector<CBLAS_TRANSPOSE> trans(groups, CblasNoTrans);
+        std::vector<double> alpha(groups, 1.0), beta(groups, 0.0);
+        cblas_dgemm_batch(CblasRowMajor, trans.data(), trans.data(), ms.data(), ns.data(), ks.data(),
+                          alpha.data(), a, ks.data(), b, ns.data(), beta.data(), c, ns.data(),
+                          MKL_INT(groups), sizes.data());
+        return;
+    }
+    #pragma omp parallel for schedule(dynamic) if (count > 1 && flops >= BATCH_PARALLEL)
+    for (size_t i = 0; i < count; i++) {
+        gemm_serial(a[i], b[i], c[i], m[i], n[i], k[i]);
+    }
+}
+
+std::vector<Matrix> multiply_batch(const std::vector<const Matrix*> &mat1, const std::vector<const Matrix*> &mat2)
+{
+    size_t count = std::max(mat1.size(), mat2.size());
+    if ((mat1.size() != count && mat1.size() != 1) || (mat2.size() != count && mat2.size() != 1)) {
+        throw std::runtime_error("multiply_batch: operand lists must have the same length or one entry");
+    }
+    std::vector<Matrix> results;
+    results.reserve(count);
+    std::vector<size_t> m(count), n(count), k(count);
+    std::vector<const double*> a(count), b(count);
+    std::vector<double*> c(count);
+    for (size_t i = 0; i < count; i++) {
+        const Matrix &left = *mat1[mat1.size() == 1 ? 0 : i];
+        const Matrix &right = *mat2[mat2.size() == 1 ? 0 : i];
+        if (left.col != right.row) {
+            throw std::runtime_error("matrix dimension not match");
+        }
+        m[i] = left.row;
+        n[i] = right.col;
+        k[i] = left.col;
+        a[i] = left.data;
+        b[i] = right.data;
+        results.emplace_back(m[i], n[i]);
+        c[i] = results.back().data;
+    }
+    // empty products have nothing to run and may carry null data
+    size_t live = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (m[i] && n[i] && k[i]) {
+            m[live] = m[i]; n[live] = n[i]; k[live] = k[i];
+            a[live] = a[i]; b[live] = b[i]; c[live] = c[i];
+            live++;
+        }
+    }
+    if (live > 0) {
+        gemm_batch(live, m.data(), n.data(), k.data(), a.data(), b.data(), c.data());
+    }
+    return results;
+}
+
+std::vector<Matrix> multiply_batch(const std::vector<Matrix> &mat1, const std::vector<Matrix> &mat2)
+{
+    std::vector<const Matrix*> left, right;
+    for (const Matrix &mat : mat1) {
+        left.push_back(&mat);
+    }
+    for (const Matrix &mat : mat2) {
+        right.push_back(&mat);
+    }
+    return multiply_batch(left, right);
+}
+
+Matrix multiply_batch_strided(const Matrix &mat1, const Matrix &mat2, size_t batch, bool shared1, bool shared2)
+{
+    if (batch == 0) {
+        throw std::runtime_error("multiply_batch_strided: batch must be positive");
+    }
+    if ((!shared1 && mat1.row % batch != 0) || (!shared2 && mat2.row % batch != 0)) {
+        throw std::runtime_error("multiply_batch_strided: rows must be a multiple of the batch");
+    }
+    size_t m = shared1 ? mat1.row : mat1.row / batch;
+    size_t k = mat1.col;
+    size_t n = mat2.col;
+    if ((shared2 ? mat2.row : mat2.row / batch) != k) {
+        throw std::runtime_error("matrix dimension not match");
+    }
+    Matrix temp(batch * m, n);
+    if (m == 0 || n == 0 || k == 0) {
+        return temp;
+    }
+    std::vector<size_t> ms(batch, m), ns(batch, n), ks(batch, k);
+    std::vector<const double*> a(batch), b(batch);
+    std::vector<double*> c(batch);
+    for (size_t i = 0; i < batch; i++) {
+        a[i] = mat1.data + (shared1 ? 0 : i * m * k);
+        b[i] = mat2.data + (shared2 ? 0 : i * k * n);
+        c[i] = temp.data + i * m * n;
+    }
+    gemm_batch(batch, ms.data(), ns.data(), ks.data(), a.data(), b.data(), c.data());
+    return temp;
+}
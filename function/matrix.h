@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <cmath>
+#include <atomic>
+#include <vector>
 
 #ifndef __MATRIX__
 #define __MATRIX__
@@ -15,18 +17,26 @@ public:
     // Matrix(Type* ptr, size_t r, size_t c);
     template<typename Type>
     Matrix(Type* ptr, size_t r, size_t c)
-        :row(r), col(c), data(NULL)
+        :row(r), col(c), data(NULL), ownsData(true), readOnly(false)
     {
 
         size_t nelement = r * c;
-        data = new double[nelement];
+        data = allocate(nelement);
+        // the conversion is the first touch
+        #pragma omp parallel for schedule(static) if (touchInParallel(nelement))
         for(size_t i =0; i < nelement; i++) 
         {
             data[i] = (double)ptr[i];
         }
     }
     Matrix(const Matrix &target);
+    Matrix(Matrix &&target);
     ~Matrix();
+    // non-owning matrix over existing memory (a mapping, a numpy buffer, ...)
+    // the memory must outlive the view, copies of a view own their data
+    // read-only views (PROT_READ mappings) refuse the in-place operators and are exported
+    // to Python as non-writeable arrays
+    static Matrix view(double *data, size_t r, size_t c, bool readOnly = false);
 
     // operator
     double operator() (size_t r, size_t c) const;
@@ -34,6 +44,7 @@ public:
 
     bool operator==(const Matrix &mat) const;
     void operator=(const Matrix &mat);
+    void operator=(Matrix &&mat);
 
     Matrix operator+(const Matrix &mat) const;
     Matrix &operator+=(const Matrix &mat);
@@ -70,6 +81,8 @@ public:
     size_t getRow() const {return row;}
     size_t getCol() const {return col;}
     double *getData() const {return data;}
+    bool isView() const {return !ownsData;}
+    bool isReadOnly() const {return readOnly;}
     void printShape() const {
         std::cout << "row: " << row << " col: " << col << std::endl;
     }
@@ -80,22 +93,35 @@ public:
 
     Matrix slice(size_t start_row, size_t end_row) const;
 
-    double sum() const {
-        double total = 0.0;
-        for (size_t i = 0; i < row * col; i++) {
-            total += data[i];
-        }
-        return total;
-    }
+    // pairwise summation over fixed blocks, the result does not depend on the thread count
+    double sum() const;
     double mean() const {
         return sum() / (row * col);
     }
+    double max() const;
+
+    // reductions along an axis, vectorized and threaded
+    // axis 0 reduces over rows (1 x col), axis 1 reduces over columns (row x 1)
+    Matrix sum(int axis) const;
+    Matrix mean(int axis) const;
+    Matrix max(int axis) const;
+    // index of the first largest entry of every column (axis 0) or row (axis 1)
+    std::vector<size_t> argmax(int axis) const;
 
 public:
     size_t row;
     size_t col;
     double *data;
 
+private:
+    bool ownsData;
+    bool readOnly;
+
+    // every owned buffer comes from allocate and goes back through release
+    static double *allocate(size_t count);
+    static void release(double *data);
+    static bool touchInParallel(size_t count);
+
 public:
     enum MulMode {
         STANDARD = 0,
@@ -103,20 +129,87 @@ public:
         TILE,
         OPENMP,
         THREAD,
-        CUDA
+        CUDA,
+        // fastest of the backends per shape class, see autotune.h
+        AUTO,
+        // new modes go after AUTO, the values are stored (autotune cache, Python ints)
+        // runtime-generated kernel per exact shape, see jit.h
+        JIT,
+        // Strassen-Winograd above a cutoff, see strassen.h for its error
+        STRASSEN
     };
     static void setMulMode(int mode) {
         mulMode = mode;
     }
-    static int mulMode;
+    // read by every mat_multiply, possibly from several threads
+    static std::atomic<int> mulMode;
+
+    // where owned buffers of minBytes and more come from; the default is all off, plain heap
+    // memory zeroed by the constructing thread
+    enum HugePages {
+        HUGE_NONE = 0,
+        // 2MB aligned mapping with MADV_HUGEPAGE, promoted by the kernel when it can
+        HUGE_TRANSPARENT,
+        // MAP_HUGETLB from the reserved pool, transparent when the pool is empty
+        HUGE_EXPLICIT
+    };
+    struct AllocPolicy {
+        // zero or copy in parallel over static OpenMP row blocks, so each page is first
+        // touched (and placed) on the node of the thread that owns those rows in the
+        // OPENMP GEMM and the row-wise reductions (same team size); the element-wise
+        // operators are serial and the THREAD kernel splits rows by its own thread count
+        bool parallelTouch;
+        // spread the pages round-robin over the online NUMA nodes (mbind MPOL_INTERLEAVE)
+        bool interleave;
+        HugePages hugePages;
+        size_t minBytes;
+    };
+    static void setAllocPolicy(const AllocPolicy &policy);
+    static AllocPolicy getAllocPolicy();
+};
+
+// products with at most this many rows (single samples, tiny batches) take the small-M
+// path in every mul mode: no device round trip, no tuning, and threads only for weights
+// of 2 MB and more (split by panel)
+const size_t SMALL_GEMM_ROWS = 8;
+
+// right operand of small-M products packed into column panels of 8, each panel stored
+// k-major and contiguous (zero padded), so the kernel streams it exactly once
+struct PackedPanels {
+    size_t rows;
+    size_t cols;
+    std::vector<double> data;
 };
+PackedPanels pack_panels(const Matrix &mat);
 
+// "standard", "mkl", ..., "auto"
+const char *mul_mode_name(int mode);
+// dispatches on Matrix::mulMode, except that products with at most SMALL_GEMM_ROWS rows
+// always go to multiply_small, even with CUDA, THREAD or any other mode selected
 Matrix mat_multiply(const Matrix &mat1, const Matrix &mat2);
 Matrix multiply(const Matrix &mat1, const Matrix &mat2);
 Matrix multiply_mkl(const Matrix &mat1, const Matrix &mat2);
 Matrix multiply_tile(const Matrix &mat1, const Matrix &mat2, size_t tile_size);
-Matrix multiply_openmp(const Matrix &mat1, const Matrix &mat2);
+// numThreads 0 uses the OpenMP default
+Matrix multiply_openmp(const Matrix &mat1, const Matrix &mat2, int numThreads = 0);
 Matrix multiply_thread(const Matrix &mat1, const Matrix &mat2, int numThreads);
 Matrix multiply_cuda(const Matrix &mat1, const Matrix &mat2);
+Matrix multiply_auto(const Matrix &mat1, const Matrix &mat2);
+// trans1 / trans2 multiply by the transpose without forming it
+Matrix multiply_jit(const Matrix &mat1, const Matrix &mat2, bool trans1 = false, bool trans2 = false);
+Matrix multiply_strassen(const Matrix &mat1, const Matrix &mat2);
+// mat1 has at most SMALL_GEMM_ROWS rows; the packed form adds a 1 x cols bias when given
+Matrix multiply_small(const Matrix &mat1, const Matrix &mat2);
+Matrix multiply_small(const Matrix &mat1, const PackedPanels &mat2, const Matrix *bias = nullptr);
+
+// many independent products in one call: results[i] = mat1[i] x mat2[i], shapes may differ
+// and a list of one entry is shared by every product; MKL and AUTO mode use MKL batch
+// GEMM, the other modes run whole products in parallel on the CPU
+std::vector<Matrix> multiply_batch(const std::vector<const Matrix*> &mat1, const std::vector<const Matrix*> &mat2);
+std::vector<Matrix> multiply_batch(const std::vector<Matrix> &mat1, const std::vector<Matrix> &mat2);
+// strided form over operands stacked by rows: mat1 holds batch (m x k) blocks, mat2 batch
+// (k x n) blocks, the result batch (m x n) blocks; a shared operand is a single block
+Matrix multiply_batch_strided(const Matrix &mat1, const Matrix &mat2, size_t batch,
+                              bool shared1 = false, bool shared2 = false);
 
 #endif
@@ -0,0 +1,131 @@
+#include "metrics.h"
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+
+// below this many elements the kernels stay on the calling thread
+static const size_t PARALLEL_THRESHOLD = 1 << 15;
+
+// true class of every row: the stored index, or the argmax of a one-hot row
+static std::vector<size_t> true_classes(const Matrix &labels, size_t num_classes)
+{
+    if (labels.col == 1 && num_classes > 1) {
+        std::vector<size_t> classes(labels.row);
+        for (size_t i = 0; i < labels.row; i++) {
+            double value = labels.data[i];
+            if (!(value >= 0 && value < num_classes)) {
+                throw std::runtime_error("metrics: label index out of range");
+            }
+            classes[i] = static_cast<size_t>(value);
+        }
+        return classes;
+    }
+    return argmax_rows(labels);
+}
+
+static void check_shapes(const Matrix &predictions, const Matrix &labels)
+{
+    if (predictions.row != labels.row || predictions.col == 0
+        || (labels.col != predictions.col && labels.col != 1)) {
+        throw std::runtime_error("metrics: predictions and labels do not match");
+    }
+}
+
+std::vector<size_t> argmax_rows(const Matrix &mat)
+{
+    if (mat.col == 0) {
+        return std::vector<size_t>(mat.row, 0);
+    }
+    return mat.argmax(1);
+}
+
+size_t count_correct(const Matrix &predictions, const Matrix &labels)
+{
+    check_shapes(predictions, labels);
+    std::vector<size_t> predicted = argmax_rows(predictions);
+    std::vector<size_t> truth = true_classes(labels, predictions.col);
+    size_t correct = 0;
+    #pragma omp parallel for schedule(static) reduction(+:correct) if (predictions.row > PARALLEL_THRESHOLD)
+    for (size_t i = 0; i < predictions.row; i++) {
+        correct += predicted[i] == truth[i];
+    }
+    return correct;
+}
+
+double compute_accuracy(const Matrix &predictions, const Matrix &labels)
+{
+    size_t correct = count_correct(predictions, labels);
+    return predictions.row > 0 ? double(correct) / predictions.row : 0.0;
+}
+
+double top_k_accuracy(const Matrix &predictions, const Matrix &labels, size_t k)
+{
+    check_shapes(predictions, labels);
+    if (k == 0) {
+        throw std::runtime_error("top_k_accuracy: k must be positive");
+    }
+    if (predictions.row == 0) {
+        return 0.0;
+    }
+    size_t cols = predictions.col;
+    std::vector<size_t> truth = true_classes(labels, cols);
+    size_t correct = 0;
+    #pragma omp parallel for schedule(static) reduction(+:correct) if (predictions.row * cols > PARALLEL_THRESHOLD)
+    for (size_t i = 0; i < predictions.row; i++) {
+        const double *row = predictions.data + i * cols;
+        size_t target = truth[i];
+        double score = row[target];
+        // rank of the true class, ties ordered by index like argmax
+        size_t rank = 0;
+        #pragma omp simd reduction(+:rank)
+        for (size_t j = 0; j < cols; j++) {
+            rank += (row[j] > score) | ((row[j] == score) & (j < target));
+        }
+        correct += rank < k;
+    }
+    return double(correct) / predictions.row;
+}
+
+Matrix confusion_matrix(const Matrix &predictions, const Matrix &labels)
+{
+    check_shapes(predictions, labels);
+    size_t classes = predictions.col;
+    std::vector<size_t> predicted = argmax_rows(predictions);
+    std::vector<size_t> truth = true_classes(labels, classes);
+
+    // per-thread histograms, merged at the end
+    int threads = predictions.row * classes > PARALLEL_THRESHOLD ? omp_get_max_threads() : 1;
+    std::vector<size_t> counts(size_t(threads) * classes * classes, 0);
+    #pragma omp parallel num_threads(threads)
+    {
+        size_t *local = counts.data() + size_t(omp_get_thread_num()) * classes * classes;
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < predictions.row; i++) {
+            local[truth[i] * classes + predicted[i]]++;
+        }
+    }
+    Matrix result(classes, classes);
+    for (int t = 0; t < threads; t++) {
+        const size_t *local = counts.data() + size_t(t) * classes * classes;
+        for (size_t j = 0; j < classes * classes; j++) {
+            result.data[j] += local[j];
+        }
+    }
+    return result;
+}
+
+double reduce_loss(const Matrix &loss, Reduction reduction)
+{
+    size_t n = loss.row * loss.col;
+    double total = loss.sum();
+    switch (reduction) {
+        case Reduction::SUM:
+            return total;
+        case Reduction::MEAN:
+            return n > 0 ? total / n : 0.0;
+        case Reduction::SAMPLE_MEAN:
+            return loss.row > 0 ? total / loss.row : 0.0;
+        default:
+            throw std::runtime_error("reduce_loss: invalid reduction");
+    }
+}
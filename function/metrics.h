@@ -0,0 +1,29 @@
+// evaluation metrics over prediction rows
+// labels are one-hot rows (same width as predictions) or a column of class indices
+// rows are processed in parallel, the per-row scans are vectorized; predicted classes
+// (and one-hot labels) go through Matrix::argmax, the first largest entry wins
+#include "matrix.h"
+#include <vector>
+
+#ifndef __METRICS__
+#define __METRICS__
+
+// index of the largest entry of every row (the first one on ties)
+std::vector<size_t> argmax_rows(const Matrix &mat);
+// rows whose predicted class is the true class
+size_t count_correct(const Matrix &predictions, const Matrix &labels);
+// fraction of rows whose predicted class is the true class
+double compute_accuracy(const Matrix &predictions, const Matrix &labels);
+// fraction of rows whose true class is among the k highest scores
+double top_k_accuracy(const Matrix &predictions, const Matrix &labels, size_t k);
+// counts, row = true class, column = predicted class
+Matrix confusion_matrix(const Matrix &predictions, const Matrix &labels);
+
+enum class Reduction {
+    SUM,         // sum of every element
+    MEAN,        // mean of every element (Matrix::mean)
+    SAMPLE_MEAN  // sum over classes, mean over rows
+};
+double reduce_loss(const Matrix &loss, Reduction reduction = Reduction::SAMPLE_MEAN);
+
+#endif
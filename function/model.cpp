@@ -0,0 +1,55 @@
+#include "model.h"
+#include <stdexcept>
+
+MappedModel::MappedModel(const std::string &path)
+    : file(path, false), checkpoint(file.getData(), file.getSize()), network(build_layers())
+{
+}
+
+MappedModel::~MappedModel()
+{
+    for (Layer *layer : network.get_layers()) {
+        delete layer;
+    }
+}
+
+std::vector<Layer*> MappedModel::build_layers() const
+{
+    // the mapping is PROT_READ, the layers are not trainable so nothing writes to it
+    auto tensor_view = [this](const TensorRecord *tensor) {
+        const double *values = reinterpret_cast<const double *>(file.getData() + tensor->offset);
+        return Matrix::view(const_cast<double *>(values), tensor->rows, tensor->cols, true);
+    };
+    std::vector<Layer*> layers;
+    try {
+        for (size_t i = 0; i < checkpoint.layers.size(); i++) {
+            const LayerRecord &record = checkpoint.layers[i];
+            if (record.type == Checkpoint::LINEAR) {
+                const TensorRecord *weight = checkpoint.find(i, Checkpoint::WEIGHT);
+                const TensorRecord *bias = checkpoint.find(i, Checkpoint::BIAS);
+                bool use_bias = record.flags & Checkpoint::HAS_BIAS;
+                if (weight == nullptr || (use_bias && bias == nullptr)) {
+                    throw std::runtime_error("MappedModel: missing parameters of layer " + std::to_string(i));
+                }
+                layers.push_back(new Linear(tensor_view(weight),
+                                            use_bias ? tensor_view(bias) : Matrix(), false));
+            }
+            else if (record.type == Checkpoint::SIGMOID) {
+                layers.push_back(new Sigmoid());
+            }
+            else if (record.type == Checkpoint::RELU) {
+                layers.push_back(new ReLU());
+            }
+            else {
+                throw std::runtime_error("MappedModel: unknown layer type");
+            }
+        }
+    }
+    catch (...) {
+        for (Layer *layer : layers) {
+            delete layer;
+        }
+        throw;
+    }
+    return layers;
+}
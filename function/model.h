@@ -0,0 +1,33 @@
+// inference on a checkpoint mapped read-only: the Linear layers use the
+// weights in place, processes mapping the same file share them in the page cache
+// (save_checkpoint without an optimizer writes a weights-only model)
+#include "checkpoint.h"
+#include "dataset.h"
+
+#ifndef __MODEL__
+#define __MODEL__
+
+class MappedModel {
+public:
+    MappedModel(const std::string &path);
+    MappedModel(const MappedModel &target) = delete;
+    ~MappedModel();
+
+    MappedModel &operator=(const MappedModel &target) = delete;
+
+    // safe to call from several threads at once
+    Matrix forward(const Matrix &input_tensor) const {return network.predict(input_tensor);}
+    Network &getNetwork() {return network;}
+    uint64_t getStep() const {return checkpoint.header.step;}
+    // bytes of the mapping, shared by every process serving the model
+    size_t getMappedSize() const {return file.getSize();}
+
+private:
+    std::vector<Layer*> build_layers() const;
+
+    MappedFile file;
+    Checkpoint checkpoint;
+    Network network;
+};
+
+#endif
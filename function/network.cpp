@@ -1,5 +1,9 @@
 #include "network.h"
+#include "profiler.h"
+#include "opstats.h"
+#include "linear.h"
 #include <algorithm>
+#include <set>
 
 Network::Network(std::vector<Layer*> layers) {
     this->layers = layers;
@@ -9,16 +13,86 @@ Network::~Network() {}
 
 Matrix Network::forward(Matrix input_tensor)
 {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    ProfileScope scope("network", "forward", input_tensor.getRow());
+    OpContext context("forward");
     for (size_t i = 0; i < layers.size(); i++) {
+        ProfileScope layer_scope("forward", layers[i]->getName(), i);
         input_tensor = (*layers[i])(input_tensor);
     }
     return input_tensor;
 }
 
+Matrix Network::predict(const Matrix &input_tensor) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    ProfileScope scope("network", "predict", input_tensor.getRow());
+    OpContext context("predict");
+    Matrix output = input_tensor;
+    for (size_t i = 0; i < layers.size(); i++) {
+        ProfileScope layer_scope("forward", layers[i]->getName(), i);
+        output = layers[i]->forward(output);
+    }
+    return output;
+}
+
+std::vector<Matrix> Network::predict_batch(const std::vector<const Network*> &networks,
+                                           const std::vector<Matrix> &inputs)
+{
+    if (inputs.size() != networks.size() && inputs.size() != 1) {
+        throw std::runtime_error("Network::predict_batch: one input per network or one shared input\n");
+    }
+    // each distinct network once, a shared_mutex must not be locked twice by one thread
+    std::set<const Network*> distinct(networks.begin(), networks.end());
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    for (const Network *network : distinct) {
+        locks.emplace_back(network->mutex);
+    }
+    ProfileScope scope("network", "predict batch", networks.size());
+    OpContext context("predict");
+    size_t depth = networks.empty() ? 0 : networks[0]->layers.size();
+    for (const Network *network : networks) {
+        if (network->layers.size() != depth) {
+            throw std::runtime_error("Network::predict_batch: networks must have the same depth\n");
+        }
+    }
+    std::vector<Matrix> outputs = inputs;
+    for (size_t d = 0; d < depth; d++) {
+        std::vector<Linear*> linears;
+        for (const Network *network : networks) {
+            Linear *linear = dynamic_cast<Linear*>(network->layers[d]);
+            if (!linear) {
+                break;
+            }
+            linears.push_back(linear);
+        }
+        if (linears.size() == networks.size()) {
+            ProfileScope layer_scope("forward", "Linear batch", d);
+            outputs = Linear::forward_batch(linears, outputs);
+            continue;
+        }
+        ProfileScope layer_scope("forward", networks[0]->layers[d]->getName(), d);
+        std::vector<Matrix> next;
+        for (size_t i = 0; i < networks.size(); i++) {
+            next.push_back(networks[i]->layers[d]->forward(outputs[outputs.size() == 1 ? 0 : i]));
+        }
+        outputs = std::move(next);
+    }
+    if (outputs.size() != networks.size()) {
+        // no layer ran, every network returns the shared input
+        outputs.assign(networks.size(), inputs.empty() ? Matrix() : inputs[0]);
+    }
+    return outputs;
+}
+
 std::vector<std::vector<Matrix>> Network::backward(Matrix Gradients)
 {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    ProfileScope scope("network", "backward", Gradients.getRow());
+    OpContext context("backward");
     std::vector<std::vector<Matrix>> gradients;
     for (int i = layers.size() - 1; i >= 0; i--) {
+        ProfileScope layer_scope("backward", layers[i]->getName(), i);
         std::pair<Matrix, std::vector<Matrix>> return_data = layers[i]->backward(Gradients);
         Gradients = return_data.first;
         if (!layers[i]->getHasTrainableVar() && !return_data.second.empty()) {
@@ -31,6 +105,7 @@ std::vector<std::vector<Matrix>> Network::backward(Matrix Gradients)
 }
 
 void Network::apply_gradients(std::vector<std::vector<Matrix>> gradients) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
     for (size_t i = 0; i < layers.size(); i++) {
         Layer *layer = layers[i];
         if (layer->getTrainableVar()) {
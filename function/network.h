@@ -1,4 +1,6 @@
 #include "layer.h"
+#include <shared_mutex>
+#include <mutex>
 
 #ifndef __NETWORK__
 #define __NETWORK__
@@ -8,13 +10,24 @@ public:
     Network(std::vector<Layer*> layers);
     ~Network();
 
+    // training path: layers record their inputs for backward, calls are serialized
     Matrix forward(Matrix input_tensor);
     std::vector<std::vector<Matrix>> backward(Matrix Gradients);
+    // inference only, nothing is recorded, concurrent callers run in parallel
+    Matrix predict(const Matrix &input_tensor) const;
+    // predict of many networks of the same depth side by side (ensembles): depths where every
+    // network has a Linear run as one batched GEMM; inputs[i] feeds networks[i], a single
+    // input is shared by all
+    static std::vector<Matrix> predict_batch(const std::vector<const Network*> &networks,
+                                             const std::vector<Matrix> &inputs);
     std::vector<Layer*>& get_layers() {return layers;}
     void apply_gradients(std::vector<std::vector<Matrix>> gradients);
+    // shared: reading parameters, exclusive: training calls
+    std::shared_mutex &getMutex() const {return mutex;}
     
 private:
     std::vector<Layer*> layers;
+    mutable std::shared_mutex mutex;
     
 };
 
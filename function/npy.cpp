@@ -0,0 +1,309 @@
+#include "npy.h"
+#include "dataset.h"
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+size_t NpyHeader::count() const
+{
+    // zero-sized axes are skipped for the check, so no product of the other axes
+    // (getItemSize) can wrap either
+    size_t total = 1;
+    bool empty = false;
+    for (size_t dim : shape) {
+        if (dim == 0) {
+            empty = true;
+            continue;
+        }
+        if (total > SIZE_MAX / dim) {
+            throw std::runtime_error("npy: shape overflows");
+        }
+        total *= dim;
+    }
+    return empty ? 0 : total;
+}
+
+// value text following 'key': in the header dict
+static std::string npy_field(const std::string &dict, const std::string &key)
+{
+    size_t pos = dict.find("'" + key + "'");
+    if (pos == std::string::npos) {
+        throw std::runtime_error("npy: header has no " + key);
+    }
+    pos = dict.find(':', pos);
+    if (pos == std::string::npos) {
+        throw std::runtime_error("npy: malformed header");
+    }
+    pos = dict.find_first_not_of(' ', pos + 1);
+    if (pos == std::string::npos) {
+        throw std::runtime_error("npy: malformed header");
+    }
+    size_t end;
+    if (dict[pos] == '\'') {
+        end = dict.find('\'', pos + 1);
+        return dict.substr(pos + 1, end - pos - 1);
+    }
+    else if (dict[pos] == '(') {
+        end = dict.find(')', pos);
+        return dict.substr(pos + 1, end - pos - 1);
+    }
+    end = dict.find_first_of(",}", pos);
+    return dict.substr(pos, end - pos);
+}
+
+NpyHeader parse_npy_header(const uint8_t *data, size_t size)
+{
+    if (size < 10 || memcmp(data, "\x93NUMPY", 6) != 0) {
+        throw std::runtime_error("npy: invalid magic string");
+    }
+    uint8_t major = data[6];
+    size_t header_len, start;
+    if (major == 1) {
+        header_len = data[8] | (data[9] << 8);
+        start = 10;
+    }
+    else if (major == 2 || major == 3) {
+        if (size < 12) {
+            throw std::runtime_error("npy: truncated header");
+        }
+        header_len = data[8] | (data[9] << 8) | (data[10] << 16) | (size_t(data[11]) << 24);
+        start = 12;
+    }
+    else {
+        throw std::runtime_error("npy: unsupported version");
+    }
+    if (size < start + header_len) {
+        throw std::runtime_error("npy: truncated header");
+    }
+    std::string dict(reinterpret_cast<const char *>(data + start), header_len);
+
+    NpyHeader header;
+    std::string descr = npy_field(dict, "descr");
+    if (descr.size() < 3) {
+        throw std::runtime_error("npy: unsupported dtype " + descr);
+    }
+    header.kind = descr[1];
+    header.itemSize = std::stoul(descr.substr(2));
+    if (header.itemSize == 0) {
+        throw std::runtime_error("npy: unsupported dtype " + descr);
+    }
+    if (descr[0] == '>' && header.itemSize > 1) {
+        throw std::runtime_error("npy: big-endian data is not supported");
+    }
+    if (header.kind != 'u' && header.kind != 'i' && header.kind != 'f' && header.kind != 'b') {
+        throw std::runtime_error("npy: unsupported dtype " + descr);
+    }
+    header.fortranOrder = npy_field(dict, "fortran_order") == "True";
+
+    std::string shape = npy_field(dict, "shape");
+    size_t pos = 0;
+    while (pos < shape.size()) {
+        size_t digit = shape.find_first_of("0123456789", pos);
+        if (digit == std::string::npos) {
+            break;
+        }
+        size_t end = shape.find_first_not_of("0123456789", digit);
+        header.shape.push_back(std::stoul(shape.substr(digit, end - digit)));
+        pos = end;
+    }
+    header.dataOffset = start + header_len;
+    return header;
+}
+
+NpyHeader read_npy_header(int fd)
+{
+    uint8_t prefix[12];
+    read_exact(fd, prefix, sizeof(prefix), 0);
+    size_t total = prefix[6] == 1
+        ? 10 + (prefix[8] | (prefix[9] << 8))
+        : 12 + (prefix[8] | (prefix[9] << 8) | (prefix[10] << 16) | (size_t(prefix[11]) << 24));
+    std::vector<uint8_t> buffer(total);
+    read_exact(fd, buffer.data(), total, 0);
+    return parse_npy_header(buffer.data(), total);
+}
+
+template<typename Type>
+static void narrow_to_uint8(const uint8_t *src, uint8_t *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        Type value;
+        memcpy(&value, src + i * sizeof(Type), sizeof(Type));
+        // written so NaN fails too, converting it would be undefined
+        if (!(value >= 0 && value <= 255)) {
+            throw std::runtime_error("npy: value does not fit in uint8");
+        }
+        uint8_t narrowed = static_cast<uint8_t>(value);
+        // float and double only, 0.5 must not become 0
+        if (Type(narrowed) != value) {
+            throw std::runtime_error("npy: non-integral value cannot be read as uint8");
+        }
+        dst[i] = narrowed;
+    }
+}
+
+void npy_to_uint8(const uint8_t *src, const NpyHeader &header, uint8_t *dst, size_t n)
+{
+    char kind = header.kind;
+    size_t item = header.itemSize;
+    if ((kind == 'u' || kind == 'b') && item == 1) {
+        memcpy(dst, src, n);
+    }
+    else if (kind == 'u' && item == 2) narrow_to_uint8<uint16_t>(src, dst, n);
+    else if (kind == 'u' && item == 4) narrow_to_uint8<uint32_t>(src, dst, n);
+    else if (kind == 'u' && item == 8) narrow_to_uint8<uint64_t>(src, dst, n);
+    else if (kind == 'i' && item == 1) narrow_to_uint8<int8_t>(src, dst, n);
+    else if (kind == 'i' && item == 2) narrow_to_uint8<int16_t>(src, dst, n);
+    else if (kind == 'i' && item == 4) narrow_to_uint8<int32_t>(src, dst, n);
+    else if (kind == 'i' && item == 8) narrow_to_uint8<int64_t>(src, dst, n);
+    else if (kind == 'f' && item == 4) narrow_to_uint8<float>(src, dst, n);
+    else if (kind == 'f' && item == 8) narrow_to_uint8<double>(src, dst, n);
+    else {
+        throw std::runtime_error("npy: unsupported dtype for uint8 conversion");
+    }
+}
+
+template<typename Type>
+static void widen_to_double(const uint8_t *src, double *dst, size_t n, double scale, double shift)
+{
+    const Type *values = reinterpret_cast<const Type *>(src);
+    #pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = static_cast<double>(values[i]) * scale + shift;
+    }
+}
+
+void npy_to_double(const uint8_t *src, const NpyHeader &header, double *dst, size_t n,
+                   double scale, double shift)
+{
+    char kind = header.kind;
+    size_t item = header.itemSize;
+    // numpy pads the header so the data offset is aligned for the dtype
+    if ((kind == 'u' || kind == 'b') && item == 1) widen_to_double<uint8_t>(src, dst, n, scale, shift);
+    else if (kind == 'u' && item == 2) widen_to_double<uint16_t>(src, dst, n, scale, shift);
+    else if (kind == 'u' && item == 4) widen_to_double<uint32_t>(src, dst, n, scale, shift);
+    else if (kind == 'u' && item == 8) widen_to_double<uint64_t>(src, dst, n, scale, shift);
+    else if (kind == 'i' && item == 1) widen_to_double<int8_t>(src, dst, n, scale, shift);
+    else if (kind == 'i' && item == 2) widen_to_double<int16_t>(src, dst, n, scale, shift);
+    else if (kind == 'i' && item == 4) widen_to_double<int32_t>(src, dst, n, scale, shift);
+    else if (kind == 'i' && item == 8) widen_to_double<int64_t>(src, dst, n, scale, shift);
+    else if (kind == 'f' && item == 4) widen_to_double<float>(src, dst, n, scale, shift);
+    else if (kind == 'f' && item == 8) widen_to_double<double>(src, dst, n, scale, shift);
+    else {
+        throw std::runtime_error("npy: unsupported dtype for double conversion");
+    }
+}
+
+// npy_to_uint8 split in blocks over the OpenMP threads
+static void npy_to_uint8_parallel(const uint8_t *src, const NpyHeader &header, uint8_t *dst, size_t n)
+{
+    const size_t block = 1 << 16;
+    size_t blocks = (n + block - 1) / block;
+    std::string error;
+    #pragma omp parallel for schedule(static)
+    for (size_t b = 0; b < blocks; b++) {
+        size_t start = b * block;
+        try {
+            npy_to_uint8(src + start * header.itemSize, header, dst + start, std::min(block, n - start));
+        }
+        catch (const std::runtime_error &e) {
+            // exceptions must not leave the parallel region, the first message is kept
+            #pragma omp critical(npy_error)
+            if (error.empty()) {
+                error = e.what();
+            }
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+NpyFile::NpyFile(const std::string &path)
+    : file(path)
+{
+    header = parse_npy_header(file.getData(), file.getSize());
+    if (header.fortranOrder && header.shape.size() > 1) {
+        throw std::runtime_error("NpyFile: fortran order is not supported in " + path);
+    }
+    if ((file.getSize() - header.dataOffset) / header.itemSize < header.count()) {
+        throw std::runtime_error("NpyFile: data shorter than header shape in " + path);
+    }
+}
+
+size_t NpyFile::getItemSize() const
+{
+    size_t total = 1;
+    for (size_t i = 1; i < header.shape.size(); i++) {
+        total *= header.shape[i];
+    }
+    return total;
+}
+
+static bool is_uint8(const NpyHeader &header)
+{
+    return (header.kind == 'u' || header.kind == 'b') && header.itemSize == 1;
+}
+
+Dataset load_npy_dataset(const std::string &features_path, const std::string &labels_path,
+                         int num_samples, size_t num_classes, double scale, double shift)
+{
+    // mappings plus the narrowed copies of non-uint8 arrays
+    struct Storage {
+        NpyFile features;
+        NpyFile labels;
+        std::vector<uint8_t> featureData;
+        std::vector<uint8_t> labelData;
+    };
+    auto storage = std::make_shared<Storage>(Storage{NpyFile(features_path), NpyFile(labels_path), {}, {}});
+    const NpyFile &features_file = storage->features;
+    const NpyFile &labels_file = storage->labels;
+
+    if (features_file.getShape().size() < 2) {
+        throw std::runtime_error("load_npy_dataset: features must have at least 2 dimensions");
+    }
+    if (labels_file.getShape().size() != 1 || labels_file.getHeader().kind == 'f') {
+        throw std::runtime_error("load_npy_dataset: labels must be a 1-d integer array");
+    }
+    if (features_file.getCount() != labels_file.getCount()) {
+        throw std::runtime_error("load_npy_dataset: feature and label counts differ");
+    }
+    size_t samples = num_samples <= 0 ? features_file.getCount() : static_cast<size_t>(num_samples);
+    if (samples == 0 || samples > features_file.getCount()) {
+        throw std::runtime_error("load_npy_dataset: num_samples exceeds the samples in file");
+    }
+    size_t num_features = features_file.getItemSize();
+
+    const uint8_t *feature_data = features_file.getData();
+    if (!is_uint8(features_file.getHeader())) {
+        storage->featureData.resize(samples * num_features);
+        npy_to_uint8_parallel(feature_data, features_file.getHeader(),
+                              storage->featureData.data(), samples * num_features);
+        feature_data = storage->featureData.data();
+    }
+    // all labels are read, the class count comes from the whole file
+    const uint8_t *label_data = labels_file.getData();
+    size_t label_count = labels_file.getCount();
+    if (!is_uint8(labels_file.getHeader())) {
+        storage->labelData.resize(label_count);
+        npy_to_uint8_parallel(label_data, labels_file.getHeader(), storage->labelData.data(), label_count);
+        label_data = storage->labelData.data();
+    }
+    if (num_classes == 0) {
+        num_classes = *std::max_element(label_data, label_data + label_count) + 1;
+    }
+    return Dataset(storage, feature_data, label_data, samples, num_features, num_classes, scale, shift);
+}
+
+std::pair<Matrix, Matrix> load_npy_data(const std::string &features_path, const std::string &labels_path,
+                                        int num_samples, size_t num_classes, double scale, double shift)
+{
+    return load_npy_dataset(features_path, labels_path, num_samples, num_classes, scale, shift).toMatrix();
+}
+
+Matrix load_npy_matrix(const std::string &path, double scale, double shift)
+{
+    NpyFile file(path);
+    Matrix result(file.getCount(), file.getItemSize());
+    npy_to_double(file.getData(), file.getHeader(), result.data, file.getHeader().count(), scale, shift);
+    return result;
+}
@@ -0,0 +1,64 @@
+// NumPy .npy files
+// magic "\x93NUMPY", version, header length, python dict header, raw data
+// {'descr': '<f8', 'fortran_order': False, 'shape': (60000, 784), }
+#include "dataset.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#ifndef __NPY__
+#define __NPY__
+
+struct NpyHeader {
+    char kind;         // 'u', 'i', 'f' or 'b'
+    size_t itemSize;   // bytes per element
+    bool fortranOrder;
+    std::vector<size_t> shape;
+    size_t dataOffset; // start of the raw data in the file
+
+    // elements in the shape, throws when the product overflows
+    size_t count() const;
+};
+
+// data holds (at least) the start of the file, size its length
+NpyHeader parse_npy_header(const uint8_t *data, size_t size);
+NpyHeader read_npy_header(int fd);
+
+// convert n elements of a little-endian integer dtype to uint8, range checked
+void npy_to_uint8(const uint8_t *src, const NpyHeader &header, uint8_t *dst, size_t n);
+// dst[i] = src[i] * scale + shift for any numeric dtype, parallel over n
+void npy_to_double(const uint8_t *src, const NpyHeader &header, double *dst, size_t n,
+                   double scale = 1.0, double shift = 0.0);
+
+// memory-mapped .npy file, the data is read in place
+class NpyFile {
+public:
+    NpyFile(const std::string &path);
+
+    const NpyHeader &getHeader() const {return header;}
+    const std::vector<size_t> &getShape() const {return header.shape;}
+    // number of rows (first dimension, 1 for a scalar) and elements per row
+    size_t getCount() const {return header.shape.empty() ? 1 : header.shape[0];}
+    size_t getItemSize() const;
+    const uint8_t *getData() const {return file.getData() + header.dataOffset;}
+
+private:
+    MappedFile file;
+    NpyHeader header;
+};
+
+// features [N, ...] and labels [N] of any integer dtype (values must fit uint8)
+// uint8 files are used in place, other dtypes are narrowed once in parallel
+// num_samples <= 0 loads every sample, num_classes == 0 infers max label + 1 over the
+// whole file (not just the loaded samples)
+Dataset load_npy_dataset(const std::string &features_path, const std::string &labels_path,
+                         int num_samples = 0, size_t num_classes = 0,
+                         double scale = 1.0 / 255.0, double shift = -0.5);
+// normalized features and one-hot labels, same arguments as load_npy_dataset
+std::pair<Matrix, Matrix> load_npy_data(const std::string &features_path, const std::string &labels_path,
+                                        int num_samples = 0, size_t num_classes = 0,
+                                        double scale = 1.0 / 255.0, double shift = -0.5);
+// any numeric array as a dense matrix: [N] -> N x 1, [N, ...] -> N x rest
+Matrix load_npy_matrix(const std::string &path, double scale = 1.0, double shift = 0.0);
+
+#endif
@@ -0,0 +1,220 @@
+#include "opstats.h"
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+
+std::atomic<bool> OpStats::active(false);
+
+double OpTotals::intensity() const
+{
+    double bytes = bytesRead + bytesWritten;
+    return bytes > 0.0 ? flops / bytes : 0.0;
+}
+
+// keyed by the static strings themselves, merged by content when collected
+typedef std::tuple<const char*, const char*, int64_t, int64_t, int64_t> LocalKey;
+
+struct ThreadTotals {
+    std::mutex mutex;
+    std::map<LocalKey, OpTotals> totals;
+};
+
+static std::mutex registry_mutex;
+static std::vector<std::shared_ptr<ThreadTotals>> registry;
+// tables of exited threads, totals kept, reused by the next thread that records
+static std::vector<std::shared_ptr<ThreadTotals>> idle;
+static thread_local const char *current_context = "";
+
+// a thread's claim on a table, bounded by the threads alive at once rather than ever started
+struct TotalsLease {
+    std::shared_ptr<ThreadTotals> totals;
+
+    TotalsLease() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (!idle.empty()) {
+            totals = idle.back();
+            idle.pop_back();
+            return;
+        }
+        totals = std::make_shared<ThreadTotals>();
+        registry.push_back(totals);
+    }
+    ~TotalsLease() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        idle.push_back(totals);
+    }
+};
+
+static ThreadTotals &local_totals()
+{
+    thread_local TotalsLease lease;
+    return *lease.totals;
+}
+
+void OpStats::enable(bool on)
+{
+    active.store(on, std::memory_order_relaxed);
+}
+
+size_t OpStats::tables()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    return registry.size();
+}
+
+void OpStats::clear()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto &totals : registry) {
+        std::lock_guard<std::mutex> totals_lock(totals->mutex);
+        totals->totals.clear();
+    }
+}
+
+const char *OpStats::getContext()
+{
+    return current_context;
+}
+
+void OpStats::setContext(const char *context)
+{
+    current_context = context ? context : "";
+}
+
+uint64_t OpStats::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void OpStats::record(int opClass, const char *op, int64_t d0, int64_t d1, int64_t d2,
+                     double flops, double bytesRead, double bytesWritten, double seconds)
+{
+    ThreadTotals &local = local_totals();
+    std::lock_guard<std::mutex> lock(local.mutex);
+    OpTotals &entry = local.totals[LocalKey(current_context, op, d0, d1, d2)];
+    if (entry.calls == 0) {
+        entry.context = current_context;
+        entry.op = op;
+        entry.opClass = opClass;
+        entry.dims[0] = d0;
+        entry.dims[1] = d1;
+        entry.dims[2] = d2;
+    }
+    entry.calls++;
+    entry.flops += flops;
+    entry.bytesRead += bytesRead;
+    entry.bytesWritten += bytesWritten;
+    entry.seconds += seconds;
+}
+
+static void accumulate(OpTotals &into, const OpTotals &from)
+{
+    into.calls += from.calls;
+    into.flops += from.flops;
+    into.bytesRead += from.bytesRead;
+    into.bytesWritten += from.bytesWritten;
+    into.seconds += from.seconds;
+}
+
+std::vector<OpTotals> OpStats::totals()
+{
+    typedef std::tuple<std::string, std::string, int64_t, int64_t, int64_t> Key;
+    std::map<Key, OpTotals> merged;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto &totals : registry) {
+            std::lock_guard<std::mutex> totals_lock(totals->mutex);
+            for (auto &entry : totals->totals) {
+                const OpTotals &t = entry.second;
+                Key key(t.context, t.op, t.dims[0], t.dims[1], t.dims[2]);
+                auto it = merged.find(key);
+                if (it == merged.end()) {
+                    merged[key] = t;
+                }
+                else {
+                    accumulate(it->second, t);
+                }
+            }
+        }
+    }
+    std::vector<OpTotals> result;
+    for (auto &entry : merged) {
+        result.push_back(entry.second);
+    }
+    std::sort(result.begin(), result.end(), [](const OpTotals &a, const OpTotals &b) {
+        return a.seconds > b.seconds;
+    });
+    return result;
+}
+
+std::vector<OpTotals> OpStats::classes()
+{
+    std::vector<OpTotals> result(OP_CLASS_COUNT);
+    for (int c = 0; c < OP_CLASS_COUNT; c++) {
+        result[c] = {"", className(c), c, {-1, -1, -1}, 0, 0.0, 0.0, 0.0, 0.0};
+    }
+    for (const OpTotals &t : totals()) {
+        if (t.opClass >= 0 && t.opClass < OP_CLASS_COUNT) {
+            accumulate(result[t.opClass], t);
+        }
+    }
+    return result;
+}
+
+const char *OpStats::className(int opClass)
+{
+    static const char *names[OP_CLASS_COUNT] = {"gemm", "elementwise", "transpose", "reduction", "copy"};
+    return opClass >= 0 && opClass < OP_CLASS_COUNT ? names[opClass] : "invalid";
+}
+
+static void print_row(std::ostringstream &out, const OpTotals &t, double steps)
+{
+    out << std::right << std::setw(10) << std::setprecision(1) << t.calls / steps
+        << std::setw(12) << std::setprecision(3) << t.seconds / steps * 1e3
+        << std::setw(12) << t.flops / steps * 1e-6 << std::setw(12) << (t.bytesRead + t.bytesWritten) / steps * 1e-6
+        << std::setw(10) << std::setprecision(2) << t.gflops() << std::setw(10) << t.gbps()
+        << std::setw(10) << t.intensity() << "\n";
+}
+
+static void print_header(std::ostringstream &out)
+{
+    out << std::right << std::setw(10) << "Calls" << std::setw(12) << "Time (ms)" << std::setw(12) << "MFLOP"
+        << std::setw(12) << "MB" << std::setw(10) << "GFLOPS" << std::setw(10) << "GB/s"
+        << std::setw(10) << "FLOP/B" << "\n";
+}
+
+std::string OpStats::report(size_t steps, size_t maxRows)
+{
+    double divisor = double(std::max<size_t>(steps, 1));
+    std::ostringstream out;
+    out << std::fixed;
+    if (steps > 1) {
+        out << "per step, averaged over " << steps << " steps\n";
+    }
+    out << std::left << std::setw(54) << "Class";
+    print_header(out);
+    for (const OpTotals &t : classes()) {
+        out << std::left << std::setw(54) << t.op;
+        print_row(out, t, divisor);
+    }
+    out << "\n" << std::left << std::setw(24) << "Context" << std::setw(14) << "Op" << std::setw(16) << "Dims";
+    print_header(out);
+    std::vector<OpTotals> all = totals();
+    for (size_t i = 0; i < all.size() && i < maxRows; i++) {
+        const OpTotals &t = all[i];
+        out << std::left << std::setw(24) << (t.context.empty() ? "-" : t.context) << std::setw(14) << t.op
+            << std::setw(16) << dims_text(t.dims);
+        print_row(out, t, divisor);
+    }
+    if (all.size() > maxRows) {
+        out << all.size() - maxRows << " more groups\n";
+    }
+    return out.str();
+}
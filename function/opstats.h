@@ -0,0 +1,110 @@
+// FLOP and byte accounting of Matrix operations
+// every GEMM backend, element-wise operator, transpose, reduction and copy records its
+// nominal work (flops, compulsory bytes read and written) and its time, grouped by the
+// calling context (forward, backward, optimizer, ...), the op and the shape
+// off by default; when on, each op adds two clock reads and a table update under its
+// thread's (uncontended) lock, so per-op overhead matters for small element-wise ops
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef __OPSTATS__
+#define __OPSTATS__
+
+enum OpClass {
+    OP_GEMM = 0,
+    OP_ELEMENTWISE,
+    OP_TRANSPOSE,
+    OP_REDUCTION,
+    OP_COPY,
+    OP_CLASS_COUNT
+};
+
+struct OpTotals {
+    std::string context;    // innermost OpContext, "" outside any
+    std::string op;         // "gemm:mkl", "add", "copy", "sum", ...
+    int opClass;
+    int64_t dims[3];        // gemm: M, N, K; others: rows, cols; -1 unused
+    uint64_t calls;
+    double flops;
+    double bytesRead;
+    double bytesWritten;
+    double seconds;
+
+    double gflops() const {return seconds > 0.0 ? flops / seconds * 1e-9 : 0.0;}
+    double gbps() const {return seconds > 0.0 ? (bytesRead + bytesWritten) / seconds * 1e-9 : 0.0;}
+    // flops per byte moved
+    double intensity() const;
+};
+
+class OpStats {
+public:
+    static bool enabled() {return active.load(std::memory_order_relaxed);}
+    static void enable(bool on = true);
+    static void disable() {enable(false);}
+    static void clear();
+    // per-thread tables allocated, at most the peak number of threads recording at once
+    static size_t tables();
+
+    static void record(int opClass, const char *op, int64_t d0, int64_t d1, int64_t d2,
+                       double flops, double bytesRead, double bytesWritten, double seconds);
+    // static strings, per thread
+    static const char *getContext();
+    static void setContext(const char *context);
+    // ns, steady clock
+    static uint64_t now();
+
+    // grouped by context, op and shape, largest time first
+    static std::vector<OpTotals> totals();
+    // one entry per op class, in OpClass order
+    static std::vector<OpTotals> classes();
+    static const char *className(int opClass);
+    // per class and per op tables; with steps > 1 calls, work and time are per step
+    static std::string report(size_t steps = 1, size_t maxRows = 40);
+
+private:
+    static std::atomic<bool> active;
+};
+
+// times one op and records it on destruction
+class OpScope {
+public:
+    OpScope(int opClass, const char *op, int64_t d0, int64_t d1, int64_t d2,
+            double flops, double bytesRead, double bytesWritten)
+        : recording(OpStats::enabled()), opClass(opClass), op(op), dims{d0, d1, d2},
+          flops(flops), bytesRead(bytesRead), bytesWritten(bytesWritten),
+          begin(recording ? OpStats::now() : 0) {}
+    ~OpScope() {
+        if (recording) {
+            OpStats::record(opClass, op, dims[0], dims[1], dims[2], flops, bytesRead, bytesWritten,
+                            (OpStats::now() - begin) * 1e-9);
+        }
+    }
+    OpScope(const OpScope&) = delete;
+    OpScope &operator=(const OpScope&) = delete;
+
+private:
+    bool recording;
+    int opClass;
+    const char *op;
+    int64_t dims[3];
+    double flops;
+    double bytesRead;
+    double bytesWritten;
+    uint64_t begin;
+};
+
+// labels the ops of its lifetime on this thread, restores the outer label on exit
+class OpContext {
+public:
+    explicit OpContext(const char *context) : previous(OpStats::getContext()) {OpStats::setContext(context);}
+    ~OpContext() {OpStats::setContext(previous);}
+    OpContext(const OpContext&) = delete;
+    OpContext &operator=(const OpContext&) = delete;
+
+private:
+    const char *previous;
+};
+
+#endif
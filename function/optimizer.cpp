@@ -1,15 +1,22 @@
 #include "optimizer.h"
+#include "profiler.h"
+#include "opstats.h"
 #include <cmath>
 
 // vt = momentum * vt-1 + learning_rate * gradient
 void SGD::apply_gradient(Network &network, std::vector<std::vector<Matrix>> gradients)
 {
+    // velocity update and parameter update form one step
+    std::lock_guard<std::mutex> lock(mutex);
+    ProfileScope scope("optimizer", "SGD");
+    OpContext context("SGD::apply_gradient");
     std::vector<std::vector<Matrix>> processed_grad = this->process_gradient(gradients);
     network.apply_gradients(processed_grad);
 }
 
 std::vector<std::vector<Matrix>> SGD::process_gradient(std::vector<std::vector<Matrix>> gradient)
 {   
+    OpContext context("SGD::process_gradient");
     std::vector<std::vector<Matrix>> new_gradient = gradient;
     for (size_t i = 0; i < new_gradient.size(); i++) {
         for (size_t j = 0; j < new_gradient[i].size(); j++) {
@@ -1,4 +1,5 @@
 #include "network.h"
+#include <mutex>
 
 #ifndef __OPTIMIZER__
 #define __OPTIMIZER__
@@ -9,12 +10,20 @@ public:
     SGD(double learning_rate, double momentum):
         learning_rate(learning_rate), momentum(momentum) {}
     void apply_gradient(Network &network, std::vector<std::vector<Matrix>> gradients);
+    double getLearningRate() const {return learning_rate;}
+    double getMomentum() const {return momentum;}
+    void setLearningRate(double value) {learning_rate = value;}
+    void setMomentum(double value) {momentum = value;}
+    // velocity per layer (empty for layers without variables), empty before the first step
+    const std::vector<std::vector<Matrix>> &getVelocity() const {return previous_grad;}
+    void setVelocity(std::vector<std::vector<Matrix>> velocity) {previous_grad = std::move(velocity);}
     
 private:
     std::vector<std::vector<Matrix>> process_gradient(std::vector<std::vector<Matrix>> gradient);
     std::vector<std::vector<Matrix>> previous_grad;
     double learning_rate;
     double momentum;
+    std::mutex mutex;
 };
 
 // class Adam
@@ -0,0 +1,149 @@
+#include "perfcounters.h"
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+PerfSample::PerfSample()
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        values[i] = 0;
+        valid[i] = false;
+    }
+}
+
+PerfSample &PerfSample::operator+=(const PerfSample &other)
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        values[i] += other.values[i];
+        valid[i] = valid[i] || other.valid[i];
+    }
+    return *this;
+}
+
+double PerfSample::ipc() const
+{
+    if (!valid[PERF_CYCLES] || !valid[PERF_INSTRUCTIONS] || values[PERF_CYCLES] == 0) {
+        return 0.0;
+    }
+    return double(values[PERF_INSTRUCTIONS]) / values[PERF_CYCLES];
+}
+
+double PerfSample::per_kilo_instruction(int event) const
+{
+    if (!valid[event] || !valid[PERF_INSTRUCTIONS] || values[PERF_INSTRUCTIONS] == 0) {
+        return 0.0;
+    }
+    return 1000.0 * values[event] / values[PERF_INSTRUCTIONS];
+}
+
+static uint64_t cache_event(uint64_t cache)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+static int open_counter(uint32_t type, uint64_t config)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    // threads started later are counted too
+    attr.inherit = 1;
+    // user space only, allowed up to perf_event_paranoid 2
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+static bool read_counter(int fd, uint64_t *values)
+{
+    return read(fd, values, 3 * sizeof(uint64_t)) == ssize_t(3 * sizeof(uint64_t));
+}
+
+PerfCounters::PerfCounters()
+{
+    const uint32_t types[PERF_EVENT_COUNT] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE
+    };
+    const uint64_t configs[PERF_EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        cache_event(PERF_COUNT_HW_CACHE_L1D),
+        cache_event(PERF_COUNT_HW_CACHE_LL),
+        cache_event(PERF_COUNT_HW_CACHE_DTLB)
+    };
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        fds[i] = open_counter(types[i], configs[i]);
+        if (fds[i] < 0 && error.empty()) {
+            error = std::string(name(i)) + ": " + std::strerror(errno);
+        }
+    }
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    begin = read();
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+}
+
+bool PerfCounters::available() const
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (fds[i] >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *PerfCounters::name(int event)
+{
+    static const char *names[PERF_EVENT_COUNT] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses"
+    };
+    return event >= 0 && event < PERF_EVENT_COUNT ? names[event] : "invalid";
+}
+
+PerfReading PerfCounters::read() const
+{
+    PerfReading reading;
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        reading.ok[i] = fds[i] >= 0 && read_counter(fds[i], reading.raw[i]);
+    }
+    return reading;
+}
+
+PerfSample PerfCounters::between(const PerfReading &begin, const PerfReading &end)
+{
+    PerfSample sample;
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (!begin.ok[i] || !end.ok[i]) {
+            continue;
+        }
+        uint64_t value = end.raw[i][0] - begin.raw[i][0];
+        uint64_t enabled = end.raw[i][1] - begin.raw[i][1];
+        uint64_t running = end.raw[i][2] - begin.raw[i][2];
+        // a counter that never got scheduled, e.g. an event the PMU lacks
+        if (running == 0) {
+            continue;
+        }
+        sample.values[i] = running < enabled ? uint64_t(double(value) * enabled / running) : value;
+        sample.valid[i] = true;
+    }
+    return sample;
+}
@@ -0,0 +1,82 @@
+// hardware performance counters (perf_event_open) around kernels and network phases
+// counts user-space events of the calling thread and of threads it starts after the
+// counters were opened; a pool started earlier (OpenMP) is not included
+// counters the kernel refuses (containers, perf_event_paranoid, VMs) are reported as
+// unavailable and read as zero, nothing throws
+#include <cstdint>
+#include <string>
+
+#ifndef __PERFCOUNTERS__
+#define __PERFCOUNTERS__
+
+enum PerfEvent {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,      // L1 data read misses
+    PERF_LLC_MISSES,      // last level cache read misses
+    PERF_DTLB_MISSES,     // data TLB read misses
+    PERF_EVENT_COUNT
+};
+
+struct PerfSample {
+    uint64_t values[PERF_EVENT_COUNT];
+    bool valid[PERF_EVENT_COUNT];
+
+    PerfSample();
+    PerfSample &operator+=(const PerfSample &other);
+    // 0 when either counter is unavailable
+    double ipc() const;
+    // events per 1000 instructions
+    double per_kilo_instruction(int event) const;
+};
+
+// raw counter values: value, time enabled, time running
+struct PerfReading {
+    uint64_t raw[PERF_EVENT_COUNT][3];
+    bool ok[PERF_EVENT_COUNT];
+};
+
+// the counters run from construction, measurements are differences of readings,
+// so scopes can nest and repeat without reprogramming the PMU
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters &operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    bool available(int event) const {return fds[event] >= 0;}
+    // the first error, empty when every counter opened
+    const std::string &getError() const {return error;}
+    static const char *name(int event);
+
+    PerfReading read() const;
+    // counts between two readings, scaled up when the kernel multiplexed the counters
+    static PerfSample between(const PerfReading &begin, const PerfReading &end);
+    PerfSample since(const PerfReading &reading) const {return between(reading, read());}
+    void start() {begin = read();}
+    PerfSample stop() const {return since(begin);}
+
+private:
+    int fds[PERF_EVENT_COUNT];
+    PerfReading begin;
+    std::string error;
+};
+
+// adds the counts of its lifetime to a sample
+class PerfScope {
+public:
+    PerfScope(const PerfCounters &counters, PerfSample &sample)
+        : counters(counters), sample(sample), reading(counters.read()) {}
+    ~PerfScope() {sample += counters.since(reading);}
+    PerfScope(const PerfScope&) = delete;
+    PerfScope &operator=(const PerfScope&) = delete;
+
+private:
+    const PerfCounters &counters;
+    PerfSample &sample;
+    PerfReading reading;
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+std::atomic<bool> Profiler::active(false);
+
+// the mutex is uncontended except while events are collected
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<ProfileEvent> ring;
+    size_t written;
+    uint32_t thread;
+};
+
+static std::mutex registry_mutex;
+static std::vector<std::shared_ptr<ThreadBuffer>> registry;
+// buffers of exited threads, events kept, handed to the next thread that records
+static std::vector<std::shared_ptr<ThreadBuffer>> idle;
+static size_t buffer_size = 1 << 16;
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// a thread's claim on a buffer, so pools and thread-per-request servers allocate no more
+// buffers than threads alive at once
+struct BufferLease {
+    std::shared_ptr<ThreadBuffer> buffer;
+
+    BufferLease() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (!idle.empty()) {
+            buffer = idle.back();
+            idle.pop_back();
+            return;
+        }
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->ring.resize(buffer_size);
+        buffer->written = 0;
+        buffer->thread = uint32_t(registry.size());
+        registry.push_back(buffer);
+    }
+    ~BufferLease() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        idle.push_back(buffer);
+    }
+};
+
+static ThreadBuffer &local_buffer()
+{
+    thread_local BufferLease lease;
+    return *lease.buffer;
+}
+
+void Profiler::enable(bool on)
+{
+    active.store(on, std::memory_order_relaxed);
+}
+
+void Profiler::setBufferSize(size_t events)
+{
+    if (events == 0) {
+        throw std::runtime_error("Profiler: buffer size must be positive");
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffer_size = events;
+    for (auto &buffer : registry) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->ring.assign(events, ProfileEvent());
+        buffer->written = 0;
+    }
+}
+
+size_t Profiler::getBufferSize()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    return buffer_size;
+}
+
+void Profiler::clear()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto &buffer : registry) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->written = 0;
+    }
+}
+
+size_t Profiler::dropped()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    size_t total = 0;
+    for (auto &buffer : registry) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        total += buffer->written > buffer->ring.size() ? buffer->written - buffer->ring.size() : 0;
+    }
+    return total;
+}
+
+uint64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::record(const ProfileEvent &event)
+{
+    ThreadBuffer &buffer = local_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    ProfileEvent &slot = buffer.ring[buffer.written % buffer.ring.size()];
+    slot = event;
+    slot.thread = buffer.thread;
+    buffer.written++;
+}
+
+std::vector<ProfileEvent> Profiler::events()
+{
+    std::vector<ProfileEvent> all;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto &buffer : registry) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            size_t size = buffer->ring.size();
+            size_t count = std::min(buffer->written, size);
+            // oldest first
+            for (size_t i = buffer->written - count; i < buffer->written; i++) {
+                all.push_back(buffer->ring[i % size]);
+            }
+        }
+    }
+    std::stable_sort(all.begin(), all.end(), [](const ProfileEvent &a, const ProfileEvent &b) {
+        return a.begin < b.begin;
+    });
+    return all;
+}
+
+std::vector<ProfileSummary> Profiler::summary()
+{
+    typedef std::tuple<std::string, std::string, int64_t, int64_t, int64_t> Key;
+    std::map<Key, ProfileSummary> groups;
+    for (const ProfileEvent &event : events()) {
+        Key key(event.category, event.name, event.dims[0], event.dims[1], event.dims[2]);
+        double seconds = event.duration * 1e-9;
+        auto it = groups.find(key);
+        if (it == groups.end()) {
+            groups[key] = {event.category, event.name, {event.dims[0], event.dims[1], event.dims[2]},
+                           1, seconds, seconds, seconds};
+            continue;
+        }
+        ProfileSummary &group = it->second;
+        group.calls++;
+        group.total += seconds;
+        group.min = std::min(group.min, seconds);
+        group.max = std::max(group.max, seconds);
+    }
+    std::vector<ProfileSummary> result;
+    for (auto &group : groups) {
+        result.push_back(group.second);
+    }
+    std::sort(result.begin(), result.end(), [](const ProfileSummary &a, const ProfileSummary &b) {
+        return a.total > b.total;
+    });
+    return result;
+}
+
+std::string dims_text(const int64_t *dims)
+{
+    std::string text;
+    for (int i = 0; i < 3 && dims[i] >= 0; i++) {
+        text += (i ? "x" : "") + std::to_string(dims[i]);
+    }
+    return text;
+}
+
+std::string Profiler::report()
+{
+    std::ostringstream out;
+    out << std::left << std::setw(12) << "Category" << std::setw(24) << "Name" << std::setw(18) << "Dims"
+        << std::right << std::setw(10) << "Calls" << std::setw(14) << "Total (ms)" << std::setw(12) << "Mean (ms)"
+        << std::setw(12) << "Min (ms)" << std::setw(12) << "Max (ms)" << "\n";
+    out << std::fixed << std::setprecision(3);
+    for (const ProfileSummary &group : summary()) {
+        out << std::left << std::setw(12) << group.category << std::setw(24) << group.name
+            << std::setw(18) << dims_text(group.dims) << std::right << std::setw(10) << group.calls
+            << std::setw(14) << group.total * 1e3 << std::setw(12) << group.total / group.calls * 1e3
+            << std::setw(12) << group.min * 1e3 << std::setw(12) << group.max * 1e3 << "\n";
+    }
+    size_t lost = dropped();
+    if (lost > 0) {
+        out << lost << " events overwritten, raise the buffer size for complete totals\n";
+    }
+    return out.str();
+}
+
+// complete ("X") events, timestamps in microseconds
+std::string Profiler::chrome_trace()
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\": [";
+    bool first = true;
+    for (const ProfileEvent &event : events()) {
+        out << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category
+            << "\", \"ph\": \"X\", \"ts\": " << event.begin * 1e-3 << ", \"dur\": " << event.duration * 1e-3
+            << ", \"pid\": 1, \"tid\": " << event.thread;
+        if (event.dims[0] >= 0) {
+            out << ", \"args\": {\"dims\": \"" << dims_text(event.dims) << "\"}";
+        }
+        out << "}";
+        first = false;
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    return out.str();
+}
+
+void Profiler::write_chrome_trace(const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file || !(file << chrome_trace())) {
+        throw std::runtime_error("Profiler: cannot write " + path);
+    }
+}
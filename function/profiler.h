@@ -0,0 +1,86 @@
+// scoped timers around layers, GEMMs, losses and optimizer steps
+// events go to a ring buffer per thread (the oldest are overwritten when full) and are
+// exported as Chrome trace-event JSON (chrome://tracing, Perfetto) or an aggregated table
+// the buffer of an exited thread keeps its events and is reused by the next new thread
+// disabled, a scope costs one relaxed atomic load
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef __PROFILER__
+#define __PROFILER__
+
+struct ProfileEvent {
+    const char *category;   // static strings: "forward", "backward", "gemm", "loss", ...
+    const char *name;
+    uint64_t begin;         // ns since the profiler epoch
+    uint64_t duration;      // ns
+    uint32_t thread;        // buffer id, in order of creation; shared by threads that did not overlap
+    int64_t dims[3];        // gemm: M, N, K; layer: index; loss: rows, cols; -1 unused
+};
+
+struct ProfileSummary {
+    std::string category;
+    std::string name;
+    int64_t dims[3];
+    size_t calls;
+    double total;           // seconds
+    double min;
+    double max;
+};
+
+class Profiler {
+public:
+    static bool enabled() {return active.load(std::memory_order_relaxed);}
+    static void enable(bool on = true);
+    static void disable() {enable(false);}
+    // events kept per thread, existing buffers are cleared
+    static void setBufferSize(size_t events);
+    static size_t getBufferSize();
+    static void clear();
+    // events overwritten since the last clear
+    static size_t dropped();
+
+    static uint64_t now();
+    static void record(const ProfileEvent &event);
+
+    // every buffered event ordered by start time
+    static std::vector<ProfileEvent> events();
+    // grouped by category, name and dims, largest total first
+    static std::vector<ProfileSummary> summary();
+    static std::string report();
+    static std::string chrome_trace();
+    static void write_chrome_trace(const std::string &path);
+
+private:
+    static std::atomic<bool> active;
+};
+
+// the set dims joined by 'x' ("128x784x10"), for the profiler and op accounting tables
+std::string dims_text(const int64_t *dims);
+
+class ProfileScope {
+public:
+    ProfileScope(const char *category, const char *name, int64_t d0 = -1, int64_t d1 = -1, int64_t d2 = -1)
+        : recording(Profiler::enabled())
+    {
+        if (recording) {
+            event = {category, name, Profiler::now(), 0, 0, {d0, d1, d2}};
+        }
+    }
+    ~ProfileScope() {
+        if (recording) {
+            event.duration = Profiler::now() - event.begin;
+            Profiler::record(event);
+        }
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope &operator=(const ProfileScope&) = delete;
+
+private:
+    bool recording;
+    ProfileEvent event;
+};
+
+#endif
@@ -0,0 +1,427 @@
+#include "quantize.h"
+#include "linear.h"
+#include "activation.h"
+#include "metrics.h"
+#include "opstats.h"
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// output channels per panel and rows per kernel block
+static const size_t PANEL = 16;
+static const size_t ROWS = 4;
+// below this many multiply-adds the forward stays on the calling thread
+static const size_t PARALLEL_THRESHOLD = 1 << 18;
+
+static std::atomic<int> selected(-1);
+
+const char *quant_kernel_name(int kernel)
+{
+    static const char *names[] = {"scalar", "avx2", "vnni"};
+    return kernel >= QUANT_SCALAR && kernel <= QUANT_VNNI ? names[kernel] : "invalid";
+}
+
+bool quant_kernel_available(int kernel)
+{
+#if defined(__x86_64__)
+    if (kernel == QUANT_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (kernel == QUANT_VNNI) {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+               && __builtin_cpu_supports("avx512vnni");
+    }
+#endif
+    return kernel == QUANT_SCALAR;
+}
+
+int get_quant_kernel()
+{
+    int kernel = selected.load(std::memory_order_relaxed);
+    if (kernel < 0) {
+        kernel = quant_kernel_available(QUANT_VNNI) ? QUANT_VNNI
+                 : quant_kernel_available(QUANT_AVX2) ? QUANT_AVX2 : QUANT_SCALAR;
+        selected.store(kernel, std::memory_order_relaxed);
+    }
+    return kernel;
+}
+
+void set_quant_kernel(int kernel)
+{
+    if (!quant_kernel_available(kernel)) {
+        throw std::runtime_error(std::string("set_quant_kernel: ") + quant_kernel_name(kernel)
+                                 + " is not supported on this CPU");
+    }
+    selected.store(kernel, std::memory_order_relaxed);
+}
+
+// symmetric, the scale maps the largest magnitude to 127; zero rows keep scale 1
+static double quantize_values(const double *values, size_t n, size_t stride, int8_t *out, size_t outStride)
+{
+    double largest = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        largest = std::max(largest, std::fabs(values[i * stride]));
+    }
+    double scale = largest > 0.0 ? largest / 127.0 : 1.0;
+    double inverse = 1.0 / scale;
+    for (size_t i = 0; i < n; i++) {
+        double q = std::nearbyint(values[i * stride] * inverse);
+        out[i * outStride] = int8_t(std::min(127.0, std::max(-127.0, q)));
+    }
+    return scale;
+}
+
+// acc[r * channels + c] = sum_k x[r][k] w[k][c] for rows x depth activations and the
+// panel layout of QuantizedLinear; the three kernels give the same sums
+typedef void (*QuantGemm)(const int8_t *x, size_t rows, size_t depth, const int8_t *w, size_t panels,
+                          const int32_t *columnSum, int32_t *acc);
+
+static void gemm_scalar(const int8_t *x, size_t rows, size_t depth, const int8_t *w, size_t panels,
+                        const int32_t *, int32_t *acc)
+{
+    size_t groups = depth / 4;
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t p = 0; p < panels; p++) {
+            const int8_t *panel = w + p * groups * PANEL * 4;
+            int32_t sum[PANEL] = {};
+            for (size_t g = 0; g < groups; g++) {
+                const int8_t *xg = x + r * depth + g * 4;
+                const int8_t *wg = panel + g * PANEL * 4;
+                for (size_t c = 0; c < PANEL; c++) {
+                    sum[c] += xg[0] * wg[c * 4] + xg[1] * wg[c * 4 + 1] + xg[2] * wg[c * 4 + 2]
+                              + xg[3] * wg[c * 4 + 3];
+                }
+            }
+            std::memcpy(acc + r * panels * PANEL + p * PANEL, sum, sizeof(sum));
+        }
+    }
+}
+
+#if defined(__x86_64__)
+// four activations as one int32
+static inline int32_t load_group(const int8_t *x)
+{
+    int32_t value;
+    std::memcpy(&value, x, 4);
+    return value;
+}
+
+// |x| (unsigned, at most 127) times sign(x) w, so the pair sums of vpmaddubsw stay below
+// 2 * 127 * 127 and never saturate; vpmaddwd by ones adds the pairs to int32
+template<size_t R>
+__attribute__((target("avx2")))
+static void block_avx2(const int8_t *x, size_t depth, const int8_t *w, size_t panels, int32_t *acc)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    size_t groups = depth / 4;
+    for (size_t p = 0; p < panels; p++) {
+        const int8_t *panel = w + p * groups * PANEL * 4;
+        __m256i lo[R], hi[R];
+        for (size_t r = 0; r < R; r++) {
+            lo[r] = _mm256_setzero_si256();
+            hi[r] = _mm256_setzero_si256();
+        }
+        for (size_t g = 0; g < groups; g++) {
+            __m256i w0 = _mm256_loadu_si256((const __m256i *)(panel + g * PANEL * 4));
+            __m256i w1 = _mm256_loadu_si256((const __m256i *)(panel + g * PANEL * 4 + 32));
+            for (size_t r = 0; r < R; r++) {
+                __m256i xg = _mm256_set1_epi32(load_group(x + r * depth + g * 4));
+                __m256i magnitude = _mm256_sign_epi8(xg, xg);
+                __m256i p0 = _mm256_maddubs_epi16(magnitude, _mm256_sign_epi8(w0, xg));
+                __m256i p1 = _mm256_maddubs_epi16(magnitude, _mm256_sign_epi8(w1, xg));
+                lo[r] = _mm256_add_epi32(lo[r], _mm256_madd_epi16(p0, ones));
+                hi[r] = _mm256_add_epi32(hi[r], _mm256_madd_epi16(p1, ones));
+            }
+        }
+        for (size_t r = 0; r < R; r++) {
+            int32_t *out = acc + r * panels * PANEL + p * PANEL;
+            _mm256_storeu_si256((__m256i *)out, lo[r]);
+            _mm256_storeu_si256((__m256i *)(out + 8), hi[r]);
+        }
+    }
+}
+
+static void gemm_avx2(const int8_t *x, size_t rows, size_t depth, const int8_t *w, size_t panels,
+                      const int32_t *, int32_t *acc)
+{
+    size_t r = 0;
+    for (; r + ROWS <= rows; r += ROWS) {
+        block_avx2<ROWS>(x + r * depth, depth, w, panels, acc + r * panels * PANEL);
+    }
+    for (; r < rows; r++) {
+        block_avx2<1>(x + r * depth, depth, w, panels, acc + r * panels * PANEL);
+    }
+}
+
+// vpdpbusd multiplies unsigned by signed bytes: the activations go in offset by 128
+// (x ^ 0x80) and columnSum, 128 times the channel sums, comes off at the end
+template<size_t R>
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void block_vnni(const int8_t *x, size_t depth, const int8_t *w, size_t panels,
+                       const int32_t *columnSum, int32_t *acc)
+{
+    const __m512i offset = _mm512_set1_epi8(int8_t(0x80));
+    size_t groups = depth / 4;
+    for (size_t p = 0; p < panels; p++) {
+        const int8_t *panel = w + p * groups * PANEL * 4;
+        __m512i sum[R];
+        for (size_t r = 0; r < R; r++) {
+            sum[r] = _mm512_setzero_si512();
+        }
+        for (size_t g = 0; g < groups; g++) {
+            __m512i wg = _mm512_loadu_si512(panel + g * PANEL * 4);
+            for (size_t r = 0; r < R; r++) {
+                __m512i xg = _mm512_xor_si512(_mm512_set1_epi32(load_group(x + r * depth + g * 4)), offset);
+                sum[r] = _mm512_dpbusd_epi32(sum[r], xg, wg);
+            }
+        }
+        __m512i correction = _mm512_loadu_si512(columnSum + p * PANEL);
+        for (size_t r = 0; r < R; r++) {
+            _mm512_storeu_si512(acc + r * panels * PANEL + p * PANEL, _mm512_sub_epi32(sum[r], correction));
+        }
+    }
+}
+
+static void gemm_vnni(const int8_t *x, size_t rows, size_t depth, const int8_t *w, size_t panels,
+                      const int32_t *columnSum, int32_t *acc)
+{
+    size_t r = 0;
+    for (; r + ROWS <= rows; r += ROWS) {
+        block_vnni<ROWS>(x + r * depth, depth, w, panels, columnSum, acc + r * panels * PANEL);
+    }
+    for (; r < rows; r++) {
+        block_vnni<1>(x + r * depth, depth, w, panels, columnSum, acc + r * panels * PANEL);
+    }
+}
+#endif
+
+static QuantGemm quant_gemm(int kernel)
+{
+#if defined(__x86_64__)
+    if (kernel == QUANT_VNNI) {
+        return gemm_vnni;
+    }
+    if (kernel == QUANT_AVX2) {
+        return gemm_avx2;
+    }
+#endif
+    return gemm_scalar;
+}
+
+QuantizedLinear::QuantizedLinear(const Linear &linear):
+    Layer(false, false), inChannel(linear.getWeight().getRow()), outChannel(linear.getWeight().getCol()),
+    depth((inChannel + 3) / 4 * 4), useBias(linear.getUseBias()), bias(linear.getBias())
+{
+    const Matrix &source = linear.getWeight();
+    size_t panels = (outChannel + PANEL - 1) / PANEL;
+    weight.assign(panels * depth * PANEL, 0);
+    columnSum.assign(panels * PANEL, 0);
+    scale.resize(outChannel);
+    std::vector<int8_t> column(inChannel);
+    for (size_t j = 0; j < outChannel; j++) {
+        scale[j] = quantize_values(source.data + j, inChannel, outChannel, column.data(), 1);
+        int8_t *panel = weight.data() + (j / PANEL) * depth * PANEL;
+        for (size_t k = 0; k < inChannel; k++) {
+            panel[(k / 4) * PANEL * 4 + (j % PANEL) * 4 + k % 4] = column[k];
+            columnSum[j] += 128 * column[k];
+        }
+    }
+}
+
+Matrix QuantizedLinear::forward(const Matrix &input_tensor)
+{
+    if (input_tensor.getCol() != inChannel) {
+        throw std::runtime_error("QuantizedLinear: input columns do not match the weight rows\n");
+    }
+    size_t rows = input_tensor.getRow();
+    size_t panels = (outChannel + PANEL - 1) / PANEL;
+    ProfileScope scope("gemm", "int8", rows, outChannel, inChannel);
+    OpScope op_scope(OP_GEMM, "gemm int8", rows, outChannel, inChannel, 2.0 * rows * outChannel * inChannel,
+                     sizeof(double) * rows * inChannel + weight.size() + sizeof(double) * outChannel,
+                     sizeof(double) * rows * outChannel);
+    QuantGemm gemm = quant_gemm(get_quant_kernel());
+    Matrix output(rows, outChannel);
+    size_t blocks = (rows + ROWS - 1) / ROWS;
+    #pragma omp parallel for schedule(static) if (rows * inChannel * outChannel > PARALLEL_THRESHOLD)
+    for (size_t b = 0; b < blocks; b++) {
+        size_t first = b * ROWS, count = std::min(ROWS, rows - first);
+        // per thread, reused by every block and call
+        thread_local std::vector<int8_t> quantized;
+        thread_local std::vector<int32_t> sums;
+        quantized.assign(ROWS * depth, 0);
+        sums.resize(ROWS * panels * PANEL);
+        int8_t *x = quantized.data();
+        int32_t *acc = sums.data();
+        double rowScale[ROWS];
+        for (size_t r = 0; r < count; r++) {
+            rowScale[r] = quantize_values(input_tensor.data + (first + r) * inChannel, inChannel, 1, x + r * depth, 1);
+        }
+        gemm(x, count, depth, weight.data(), panels, columnSum.data(), acc);
+        for (size_t r = 0; r < count; r++) {
+            double *out = output.data + (first + r) * outChannel;
+            const int32_t *sum = acc + r * panels * PANEL;
+            for (size_t j = 0; j < outChannel; j++) {
+                out[j] = sum[j] * (rowScale[r] * scale[j]);
+            }
+            if (useBias) {
+                for (size_t j = 0; j < outChannel; j++) {
+                    out[j] += bias.data[j];
+                }
+            }
+        }
+    }
+    return output;
+}
+
+std::pair<Matrix, std::vector<Matrix>> QuantizedLinear::backward(Matrix &)
+{
+    throw std::runtime_error("QuantizedLinear: inference only, train the fp64 Linear instead\n");
+}
+
+Matrix QuantizedLinear::dequantized_weight() const
+{
+    Matrix result(inChannel, outChannel);
+    for (size_t j = 0; j < outChannel; j++) {
+        const int8_t *panel = weight.data() + (j / PANEL) * depth * PANEL;
+        for (size_t k = 0; k < inChannel; k++) {
+            result(k, j) = panel[(k / 4) * PANEL * 4 + (j % PANEL) * 4 + k % 4] * scale[j];
+        }
+    }
+    return result;
+}
+
+size_t QuantizedLinear::getBytes() const
+{
+    return inChannel * outChannel + sizeof(double) * outChannel * (useBias ? 2 : 1);
+}
+
+QuantizedModel::QuantizedModel(Network &network) : network(build_layers(network))
+{
+}
+
+QuantizedModel::~QuantizedModel()
+{
+    for (Layer *layer : network.get_layers()) {
+        delete layer;
+    }
+}
+
+std::vector<Layer*> QuantizedModel::build_layers(Network &network)
+{
+    std::shared_lock<std::shared_mutex> lock(network.getMutex());
+    std::vector<Layer*> layers;
+    try {
+        for (Layer *layer : network.get_layers()) {
+            if (Linear *linear = dynamic_cast<Linear*>(layer)) {
+                layers.push_back(new QuantizedLinear(*linear));
+            }
+            else if (dynamic_cast<Sigmoid*>(layer)) {
+                layers.push_back(new Sigmoid());
+            }
+            else if (dynamic_cast<ReLU*>(layer)) {
+                layers.push_back(new ReLU());
+            }
+            else {
+                throw std::runtime_error(std::string("QuantizedModel: unsupported layer ") + layer->getName() + "\n");
+            }
+        }
+    }
+    catch (...) {
+        for (Layer *layer : layers) {
+            delete layer;
+        }
+        throw;
+    }
+    return layers;
+}
+
+size_t QuantizedModel::getBytes() const
+{
+    size_t bytes = 0;
+    for (Layer *layer : const_cast<Network&>(network).get_layers()) {
+        if (QuantizedLinear *linear = dynamic_cast<QuantizedLinear*>(layer)) {
+            bytes += linear->getBytes();
+        }
+    }
+    return bytes;
+}
+
+size_t parameter_bytes(Network &network)
+{
+    size_t bytes = 0;
+    for (Layer *layer : network.get_layers()) {
+        if (Linear *linear = dynamic_cast<Linear*>(layer)) {
+            const Matrix &weight = linear->getWeight();
+            bytes += sizeof(double) * weight.getRow() * weight.getCol();
+            if (linear->getUseBias()) {
+                bytes += sizeof(double) * weight.getCol();
+            }
+        }
+    }
+    return bytes;
+}
+
+QuantReport quantization_report(Network &reference, QuantizedModel &model, const Matrix &inputs,
+                                const Matrix &labels)
+{
+    QuantReport report = {};
+    report.samples = inputs.getRow();
+    auto start = std::chrono::steady_clock::now();
+    Matrix expected = reference.predict(inputs);
+    auto middle = std::chrono::steady_clock::now();
+    Matrix actual = model.forward(inputs);
+    auto end = std::chrono::steady_clock::now();
+    report.referenceSeconds = std::chrono::duration<double>(middle - start).count();
+    report.quantizedSeconds = std::chrono::duration<double>(end - middle).count();
+    report.referenceAccuracy = compute_accuracy(expected, labels);
+    report.quantizedAccuracy = compute_accuracy(actual, labels);
+
+    std::vector<size_t> expectedClass = argmax_rows(expected), actualClass = argmax_rows(actual);
+    size_t same = 0;
+    for (size_t i = 0; i < expectedClass.size(); i++) {
+        same += expectedClass[i] == actualClass[i];
+    }
+    report.agreement = report.samples ? double(same) / report.samples : 0.0;
+
+    size_t count = expected.getRow() * expected.getCol();
+    double errorSquares = 0.0, referenceSquares = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double error = std::fabs(actual.data[i] - expected.data[i]);
+        report.maxError = std::max(report.maxError, error);
+        report.meanError += error;
+        errorSquares += error * error;
+        referenceSquares += expected.data[i] * expected.data[i];
+    }
+    report.meanError = count ? report.meanError / count : 0.0;
+    report.relativeError = referenceSquares > 0.0 ? std::sqrt(errorSquares / referenceSquares) : 0.0;
+    report.referenceBytes = parameter_bytes(reference);
+    report.quantizedBytes = model.getBytes();
+    return report;
+}
+
+std::string QuantReport::str() const
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(4)
+        << "samples " << samples << ", kernel " << quant_kernel_name(get_quant_kernel()) << "\n"
+        << "accuracy: fp64 " << referenceAccuracy << ", int8 " << quantizedAccuracy
+        << " (" << std::showpos << quantizedAccuracy - referenceAccuracy << std::noshowpos << ")\n"
+        << "top-1 agreement " << agreement << "\n"
+        << std::scientific << std::setprecision(3)
+        << "output error: max " << maxError << ", mean " << meanError << ", relative " << relativeError << "\n"
+        << std::fixed << std::setprecision(2)
+        << "parameters: fp64 " << referenceBytes / 1024.0 << " KiB, int8 " << quantizedBytes / 1024.0
+        << " KiB (" << (quantizedBytes ? double(referenceBytes) / quantizedBytes : 0.0) << "x smaller)\n"
+        << "predict: fp64 " << referenceSeconds * 1e3 << " ms, int8 " << quantizedSeconds * 1e3
+        << " ms (" << (quantizedSeconds > 0.0 ? referenceSeconds / quantizedSeconds : 0.0) << "x)\n";
+    return out.str();
+}
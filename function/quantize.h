@@ -0,0 +1,104 @@
+// post-training int8 quantization of the Linear layers for inference
+// weights: symmetric, one scale per output channel, rounded to [-127, 127] once
+// activations: symmetric, one scale per input row, quantized on every forward (dynamic)
+// the products accumulate exactly in int32 and are scaled back to double with the bias
+// after, so the kernels (scalar, AVX2, AVX-512 VNNI) give bit-identical results; the only
+// error is the rounding of weights and activations, see quantization_report
+// weights are a quarter of a float32 model and an eighth of the double one
+#include "network.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef __QUANTIZE__
+#define __QUANTIZE__
+
+class Linear;
+
+enum QuantKernel {
+    QUANT_SCALAR = 0,
+    QUANT_AVX2,         // vpsignb + vpmaddubsw + vpmaddwd
+    QUANT_VNNI          // vpdpbusd (AVX-512 VNNI)
+};
+
+const char *quant_kernel_name(int kernel);
+bool quant_kernel_available(int kernel);
+// the fastest available one unless set
+int get_quant_kernel();
+void set_quant_kernel(int kernel);
+
+// inference only, forward is safe to call concurrently
+class QuantizedLinear : public Layer {
+public:
+    explicit QuantizedLinear(const Linear &linear);
+
+    Matrix forward(const Matrix &input_tensor) override;
+    std::pair<Matrix, std::vector<Matrix>> backward(Matrix &gradient) override;
+    const char *getName() const override {return "QuantizedLinear";}
+
+    // the int8 weight times its scales, in_channel x out_channel like Linear's
+    Matrix dequantized_weight() const;
+    const std::vector<double> &getScales() const {return scale;}
+    std::pair<size_t, size_t> getChannel() const {return {inChannel, outChannel};}
+    // weights, scales and bias as stored
+    size_t getBytes() const;
+
+private:
+    size_t inChannel;
+    size_t outChannel;
+    // in_channel rounded up to 4, the int8 products go 4 at a time
+    size_t depth;
+    bool useBias;
+    // panels of 16 output channels, each depth / 4 groups of 16 channels x 4 inputs,
+    // zero padded: the 64 bytes of a group are one VNNI (or two AVX2) register loads
+    std::vector<int8_t> weight;
+    // 128 times the per channel sums of the weight, VNNI takes the activations offset by 128
+    std::vector<int32_t> columnSum;
+    std::vector<double> scale;
+    Matrix bias;
+};
+
+// a network with every Linear replaced by a QuantizedLinear and the activations copied;
+// owns its layers, Linear, Sigmoid and ReLU layers are supported
+class QuantizedModel {
+public:
+    explicit QuantizedModel(Network &network);
+    QuantizedModel(const QuantizedModel &target) = delete;
+    ~QuantizedModel();
+
+    QuantizedModel &operator=(const QuantizedModel &target) = delete;
+
+    Matrix forward(const Matrix &input_tensor) const {return network.predict(input_tensor);}
+    Network &getNetwork() {return network;}
+    size_t getBytes() const;
+
+private:
+    static std::vector<Layer*> build_layers(Network &network);
+
+    Network network;
+};
+
+// parameters of the fp64 network, in bytes
+size_t parameter_bytes(Network &network);
+
+// the int8 model against the fp64 one on a held-out set
+struct QuantReport {
+    size_t samples;
+    double referenceAccuracy;   // fp64 top-1 accuracy
+    double quantizedAccuracy;
+    double agreement;           // rows where both predict the same class
+    double maxError;            // largest |int8 - fp64| over the outputs
+    double meanError;
+    double relativeError;       // ||int8 - fp64|| / ||fp64||, Frobenius
+    size_t referenceBytes;
+    size_t quantizedBytes;
+    double referenceSeconds;    // one predict over the whole set
+    double quantizedSeconds;
+
+    std::string str() const;
+};
+
+QuantReport quantization_report(Network &reference, QuantizedModel &model, const Matrix &inputs,
+                                const Matrix &labels);
+
+#endif
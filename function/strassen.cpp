@@ -0,0 +1,308 @@
+#include "strassen.h"
+#include "jit.h"
+#include "opstats.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <mkl.h>
+#include <omp.h>
+
+static std::mutex config_mutex;
+static bool configured = false;
+static StrassenConfig current = {0, Matrix::MKL};
+
+// recursion shape of one product, dims already padded to multiples of 2^depth
+struct Plan {
+    int depth;
+    // levels whose 7 products run as tasks
+    int parallelDepth;
+    int base;
+};
+
+int strassen_depth(size_t m, size_t k, size_t n, size_t cutoff)
+{
+    int depth = 0;
+    while (std::min(m, std::min(k, n)) > cutoff && cutoff > 0) {
+        m = (m + 1) / 2;
+        k = (k + 1) / 2;
+        n = (n + 1) / 2;
+        depth++;
+    }
+    return depth;
+}
+
+// doubles a level needs: parallel levels keep all their operands and one workspace per
+// child, serial levels reuse two operand pairs and one child workspace
+static size_t workspace_size(size_t m, size_t k, size_t n, int level, const Plan &plan)
+{
+    if (level == plan.depth) {
+        return 0;
+    }
+    size_t hm = m / 2, hk = k / 2, hn = n / 2;
+    size_t child = workspace_size(hm, hk, hn, level + 1, plan);
+    if (level < plan.parallelDepth) {
+        return 4 * hm * hk + 4 * hk * hn + 3 * hm * hn + 7 * child;
+    }
+    return 2 * hm * hk + 2 * hk * hn + 3 * hm * hn + child;
+}
+
+// out = x + sign * y, out may be x or y
+static void combine(double *out, size_t ldo, const double *x, size_t ldx, const double *y, size_t ldy,
+                    size_t rows, size_t cols, double sign)
+{
+    for (size_t i = 0; i < rows; i++) {
+        double *o = out + i * ldo;
+        const double *xi = x + i * ldx;
+        const double *yi = y + i * ldy;
+        #pragma omp simd
+        for (size_t j = 0; j < cols; j++) {
+            o[j] = xi[j] + sign * yi[j];
+        }
+    }
+}
+
+static void base_product(const double *a, size_t lda, const double *b, size_t ldb, double *c, size_t ldc,
+                         size_t m, size_t k, size_t n, int base)
+{
+    if (base == Matrix::JIT) {
+        std::shared_ptr<const JitKernel> kernel = JitGemm::instance().kernel({m, n, k, lda, ldb, ldc, false, false});
+        if (kernel) {
+            (*kernel)(a, b, c);
+            return;
+        }
+    }
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, 1.0, a, lda, b, ldb, 0.0, c, ldc);
+}
+
+// c = a b, Winograd's schedule:
+//   S1 = A21 + A22  S2 = S1 - A11  S3 = A11 - A21  S4 = A12 - S2
+//   T1 = B12 - B11  T2 = B22 - T1  T3 = B22 - B12  T4 = T2 - B21
+//   P1 = A11 B11  P2 = A12 B21  P3 = S4 B22  P4 = A22 T4  P5 = S1 T1  P6 = S2 T2  P7 = S3 T3
+//   C11 = P1 + P2  C12 = P1 + P6 + P5 + P3  C21 = P1 + P6 + P7 - P4  C22 = P1 + P6 + P7 + P5
+// P2 to P5 land in the C quadrants, P1, P6 and P7 in the workspace
+static void strassen(const double *a, size_t lda, const double *b, size_t ldb, double *c, size_t ldc,
+                     size_t m, size_t k, size_t n, int level, const Plan &plan, double *ws)
+{
+    if (level == plan.depth) {
+        base_product(a, lda, b, ldb, c, ldc, m, k, n, plan.base);
+        return;
+    }
+    size_t hm = m / 2, hk = k / 2, hn = n / 2;
+    const double *a11 = a, *a12 = a + hk, *a21 = a + hm * lda, *a22 = a21 + hk;
+    const double *b11 = b, *b12 = b + hn, *b21 = b + hk * ldb, *b22 = b21 + hn;
+    double *c11 = c, *c12 = c + hn, *c21 = c + hm * ldc, *c22 = c21 + hn;
+    size_t child = workspace_size(hm, hk, hn, level + 1, plan);
+
+    double *x1 = ws, *x6 = x1 + hm * hn, *x7 = x6 + hm * hn;
+    ws = x7 + hm * hn;
+    if (level < plan.parallelDepth) {
+        double *s[4], *t[4];
+        for (int i = 0; i < 4; i++) {
+            s[i] = ws + i * hm * hk;
+            t[i] = ws + 4 * hm * hk + i * hk * hn;
+        }
+        double *children = ws + 4 * hm * hk + 4 * hk * hn;
+        combine(s[0], hk, a21, lda, a22, lda, hm, hk, 1.0);
+        combine(s[1], hk, s[0], hk, a11, lda, hm, hk, -1.0);
+        combine(s[2], hk, a11, lda, a21, lda, hm, hk, -1.0);
+        combine(s[3], hk, a12, lda, s[1], hk, hm, hk, -1.0);
+        combine(t[0], hn, b12, ldb, b11, ldb, hk, hn, -1.0);
+        combine(t[1], hn, b22, ldb, t[0], hn, hk, hn, -1.0);
+        combine(t[2], hn, b22, ldb, b12, ldb, hk, hn, -1.0);
+        combine(t[3], hn, t[1], hn, b21, ldb, hk, hn, -1.0);
+        struct Product {const double *a; size_t lda; const double *b; size_t ldb; double *c; size_t ldc;};
+        Product products[7] = {
+            {a11, lda, b11, ldb, x1, hn}, {a12, lda, b21, ldb, c11, ldc}, {s[3], hk, b22, ldb, c12, ldc},
+            {a22, lda, t[3], hn, c21, ldc}, {s[0], hk, t[0], hn, c22, ldc}, {s[1], hk, t[1], hn, x6, hn},
+            {s[2], hk, t[2], hn, x7, hn}
+        };
+        for (int i = 0; i < 7; i++) {
+            #pragma omp task firstprivate(i) shared(products)
+            {
+                const Product &p = products[i];
+                strassen(p.a, p.lda, p.b, p.ldb, p.c, p.ldc, hm, hk, hn, level + 1, plan, children + i * child);
+            }
+        }
+        #pragma omp taskwait
+    }
+    else {
+        double *sa = ws, *sb = sa + hm * hk, *ta = sb + hm * hk, *tb = ta + hk * hn;
+        double *children = tb + hk * hn;
+        combine(sa, hk, a21, lda, a22, lda, hm, hk, 1.0);
+        combine(ta, hn, b12, ldb, b11, ldb, hk, hn, -1.0);
+        strassen(sa, hk, ta, hn, c22, ldc, hm, hk, hn, level + 1, plan, children);
+        combine(sb, hk, sa, hk, a11, lda, hm, hk, -1.0);
+        combine(tb, hn, b22, ldb, ta, hn, hk, hn, -1.0);
+        strassen(sb, hk, tb, hn, x6, hn, hm, hk, hn, level + 1, plan, children);
+        combine(sa, hk, a12, lda, sb, hk, hm, hk, -1.0);
+        strassen(sa, hk, b22, ldb, c12, ldc, hm, hk, hn, level + 1, plan, children);
+        combine(ta, hn, tb, hn, b21, ldb, hk, hn, -1.0);
+        strassen(a22, lda, ta, hn, c21, ldc, hm, hk, hn, level + 1, plan, children);
+        combine(sa, hk, a11, lda, a21, lda, hm, hk, -1.0);
+        combine(ta, hn, b22, ldb, b12, ldb, hk, hn, -1.0);
+        strassen(sa, hk, ta, hn, x7, hn, hm, hk, hn, level + 1, plan, children);
+        strassen(a11, lda, b11, ldb, x1, hn, hm, hk, hn, level + 1, plan, children);
+        strassen(a12, lda, b21, ldb, c11, ldc, hm, hk, hn, level + 1, plan, children);
+    }
+    // U2 = P1 + P6, U3 = U2 + P7, U4 = U2 + P5
+    combine(x6, hn, x6, hn, x1, hn, hm, hn, 1.0);
+    combine(x7, hn, x7, hn, x6, hn, hm, hn, 1.0);
+    combine(x6, hn, x6, hn, c22, ldc, hm, hn, 1.0);
+    combine(c11, ldc, c11, ldc, x1, hn, hm, hn, 1.0);
+    combine(c12, ldc, c12, ldc, x6, hn, hm, hn, 1.0);
+    combine(c21, ldc, x7, hn, c21, ldc, hm, hn, -1.0);
+    combine(c22, ldc, c22, ldc, x7, hn, hm, hn, 1.0);
+}
+
+static Matrix strassen_product(const Matrix &mat1, const Matrix &mat2, const StrassenConfig &config)
+{
+    size_t m = mat1.getRow(), k = mat1.getCol(), n = mat2.getCol();
+    Plan plan;
+    plan.depth = strassen_depth(m, k, n, config.cutoff);
+    plan.base = config.base;
+    if (plan.depth == 0) {
+        Matrix result(m, n);
+        if (m > 0 && n > 0) {
+            base_product(mat1.data, k, mat2.data, n, result.data, n, m, k, n, plan.base);
+        }
+        return result;
+    }
+    // one task level feeds 7 threads, two feed 49
+    int threads = omp_in_parallel() ? 1 : omp_get_max_threads();
+    plan.parallelDepth = std::min(plan.depth, threads <= 1 ? 0 : threads <= 7 ? 1 : 2);
+
+    size_t unit = size_t(1) << plan.depth;
+    size_t pm = (m + unit - 1) / unit * unit, pk = (k + unit - 1) / unit * unit, pn = (n + unit - 1) / unit * unit;
+    bool padded = pm != m || pk != k || pn != n;
+    size_t total = workspace_size(pm, pk, pn, 0, plan) + (padded ? pm * pk + pk * pn + pm * pn : 0);
+    // grows to the largest product seen on this thread, then stays
+    thread_local std::vector<double> workspace;
+    if (workspace.size() < total) {
+        workspace.assign(total, 0.0);
+    }
+    double *ws = workspace.data();
+
+    Matrix result(m, n);
+    const double *a = mat1.data, *b = mat2.data;
+    double *c = result.data;
+    if (padded) {
+        double *pa = ws, *pb = pa + pm * pk, *pc = pb + pk * pn;
+        ws = pc + pm * pn;
+        std::fill(pa, pc, 0.0);
+        for (size_t i = 0; i < m; i++) {
+            std::copy(mat1.data + i * k, mat1.data + (i + 1) * k, pa + i * pk);
+        }
+        for (size_t i = 0; i < k; i++) {
+            std::copy(mat2.data + i * n, mat2.data + (i + 1) * n, pb + i * pn);
+        }
+        a = pa;
+        b = pb;
+        c = pc;
+    }
+    if (plan.parallelDepth > 0) {
+        #pragma omp parallel
+        #pragma omp single
+        strassen(a, padded ? pk : k, b, padded ? pn : n, c, padded ? pn : n, pm, pk, pn, 0, plan, ws);
+    }
+    else {
+        strassen(a, padded ? pk : k, b, padded ? pn : n, c, padded ? pn : n, pm, pk, pn, 0, plan, ws);
+    }
+    if (padded) {
+        for (size_t i = 0; i < m; i++) {
+            std::copy(c + i * pn, c + i * pn + n, result.data + i * n);
+        }
+    }
+    return result;
+}
+
+static double time_product(const Matrix &mat1, const Matrix &mat2, const StrassenConfig &config)
+{
+    double best = INFINITY;
+    // the first run pages in the workspace and compiles the JIT kernels
+    for (int r = 0; r < 3; r++) {
+        auto begin = std::chrono::steady_clock::now();
+        Matrix result = strassen_product(mat1, mat2, config);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        if (r > 0) {
+            best = std::min(best, elapsed.count());
+        }
+    }
+    return best;
+}
+
+StrassenConfig tune_strassen(size_t largest)
+{
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    auto random = [&](size_t size) {
+        Matrix mat(size, size);
+        for (size_t i = 0; i < size * size; i++) {
+            mat.data[i] = dist(gen);
+        }
+        return mat;
+    };
+    OpContext context("strassen tune");
+    // cutoff 0 never recurses, so these time the base kernels alone
+    StrassenConfig config = {0, Matrix::MKL};
+    if (JitGemm::available()) {
+        Matrix a = random(256), b = random(256);
+        if (time_product(a, b, {0, Matrix::JIT}) < time_product(a, b, {0, Matrix::MKL})) {
+            config.base = Matrix::JIT;
+        }
+    }
+    // without a measured win, only products beyond the sizes tried recurse
+    config.cutoff = std::max<size_t>(largest, 1);
+    for (size_t size = 64; 2 * size <= largest; size *= 2) {
+        Matrix a = random(2 * size), b = random(2 * size);
+        if (time_product(a, b, {size, config.base}) < time_product(a, b, {0, config.base})) {
+            config.cutoff = size;
+            break;
+        }
+    }
+    set_strassen_config(config);
+    return config;
+}
+
+StrassenConfig strassen_config()
+{
+    {
+        std::lock_guard<std::mutex> lock(config_mutex);
+        if (configured) {
+            return current;
+        }
+    }
+    // two threads tuning at once only repeat the measurement
+    return tune_strassen();
+}
+
+void set_strassen_config(const StrassenConfig &config)
+{
+    if (config.base != Matrix::MKL && config.base != Matrix::JIT) {
+        throw std::runtime_error("set_strassen_config: the base kernel must be MKL or JIT");
+    }
+    std::lock_guard<std::mutex> lock(config_mutex);
+    current = config;
+    configured = true;
+}
+
+Matrix multiply_strassen(const Matrix &mat1, const Matrix &mat2)
+{
+    return multiply_strassen(mat1, mat2, strassen_config());
+}
+
+Matrix multiply_strassen(const Matrix &mat1, const Matrix &mat2, const StrassenConfig &config)
+{
+    size_t row = mat1.getRow(), mid = mat1.getCol(), col = mat2.getCol();
+    if (mid != mat2.getRow()) {
+        throw std::runtime_error("matrix dimension not match");
+    }
+    // nominal 2MNK, so GFLOPS compare with the other backends
+    OpScope op_scope(OP_GEMM, "gemm strassen", row, col, mid, 2.0 * row * col * mid,
+                     8.0 * (row * mid + mid * col), 8.0 * row * col);
+    return strassen_product(mat1, mat2, config);
+}
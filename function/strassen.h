@@ -0,0 +1,39 @@
+// Strassen-Winograd multiplication for large products (Matrix::STRASSEN)
+// every level replaces the 8 half-size products by 7 and 15 block additions; levels recurse
+// while the smallest of M, K and N is above the cutoff, then the base kernel (MKL, or the
+// JIT kernels when faster) finishes; odd sizes are zero padded once at the top, and the
+// top one or two levels run their 7 products as parallel OpenMP tasks
+// the workspace of the whole recursion is computed up front and kept per thread, so
+// repeated products of a size allocate nothing
+//
+// error: the bound is norm-wise, not per entry as for the standard algorithm; with u the
+// unit roundoff, standard GEMM gives |C - C'| <= K u |A||B| entry by entry, while the
+// Winograd variant gives max|C - C'| <= c (K/n0)^log2(18) n0^2 u max|A| max|B| with n0 the
+// cutoff, log2(18) ~ 4.17 (Higham, Accuracy and Stability of Numerical Algorithms, 23.2)
+// measured on random [-1, 1] 256^3 products the largest error is 1.9x the standard kernel's
+// with one level, 2.5x with two, 4.8x with three and 15x with four (testStrassen); small
+// entries of C next to large ones can lose most of their relative accuracy, so keep it to
+// products where a norm-wise bound is enough
+#include "matrix.h"
+
+#ifndef __STRASSEN__
+#define __STRASSEN__
+
+struct StrassenConfig {
+    size_t cutoff;      // products with min(M, K, N) at most this run on the base kernel
+    int base;           // Matrix::MKL or Matrix::JIT
+};
+
+// measures the base kernels and one level of recursion on square products up to largest
+// and returns (and installs) the smallest cutoff at which a level pays off
+StrassenConfig tune_strassen(size_t largest = 1024);
+// tuned on the first STRASSEN product unless set before
+StrassenConfig strassen_config();
+void set_strassen_config(const StrassenConfig &config);
+
+// with an explicit configuration, the one-argument form is in matrix.h
+Matrix multiply_strassen(const Matrix &mat1, const Matrix &mat2, const StrassenConfig &config);
+// the levels a product of this shape gets with the given cutoff
+int strassen_depth(size_t m, size_t k, size_t n, size_t cutoff);
+
+#endif
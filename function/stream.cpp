@@ -0,0 +1,465 @@
+#include "stream.h"
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int open_read(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    return fd;
+}
+
+static size_t file_size(int fd, const std::string &path)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        throw std::runtime_error("Cannot stat file: " + path);
+    }
+    return info.st_size;
+}
+
+// rows x features bytes must be present after offset; a short or crafted file fails here
+// rather than mid-epoch in a reader thread
+static void check_payload(size_t size, size_t offset, size_t rows, size_t features, const std::string &path)
+{
+    if (features != 0 && rows > SIZE_MAX / features) {
+        throw std::runtime_error("SampleFile: header dimensions overflow in " + path);
+    }
+    if (size < offset || (features != 0 && (size - offset) / features < rows)) {
+        throw std::runtime_error("SampleFile: data shorter than header dimensions in " + path);
+    }
+}
+
+// IDX header through pread: returns the dims, checks for uint8 data
+static std::vector<size_t> read_idx_header(int fd, const std::string &path, size_t &offset)
+{
+    uint8_t magic[4];
+    read_exact(fd, magic, 4, 0);
+    if (magic[0] != 0 || magic[1] != 0 || magic[2] != 0x08 || magic[3] == 0) {
+        throw std::runtime_error("IdxSampleFile: expected uint8 IDX data in " + path);
+    }
+    std::vector<uint32_t> dims(magic[3]);
+    read_exact(fd, dims.data(), 4 * dims.size(), 4);
+    offset = 4 + 4 * dims.size();
+    std::vector<size_t> shape;
+    for (uint32_t dim : dims) {
+        shape.push_back(__builtin_bswap32(dim));
+    }
+    return shape;
+}
+
+IdxSampleFile::IdxSampleFile(const std::string &images_path, const std::string &labels_path)
+    : imagesFd(open_read(images_path)), labelsFd(-1)
+{
+    try {
+        labelsFd = open_read(labels_path);
+        std::vector<size_t> images = read_idx_header(imagesFd, images_path, imagesOffset);
+        std::vector<size_t> labels = read_idx_header(labelsFd, labels_path, labelsOffset);
+        if (images.size() < 2 || labels.size() != 1 || images[0] != labels[0]) {
+            throw std::runtime_error("IdxSampleFile: image and label dimensions do not match");
+        }
+        numSamples = images[0];
+        numFeatures = 1;
+        for (size_t i = 1; i < images.size(); i++) {
+            if (images[i] != 0 && numFeatures > SIZE_MAX / images[i]) {
+                throw std::runtime_error("IdxSampleFile: header dimensions overflow in " + images_path);
+            }
+            numFeatures *= images[i];
+        }
+        check_payload(file_size(imagesFd, images_path), imagesOffset, numSamples, numFeatures, images_path);
+        check_payload(file_size(labelsFd, labels_path), labelsOffset, numSamples, 1, labels_path);
+    }
+    catch (...) {
+        ::close(imagesFd);
+        if (labelsFd >= 0) ::close(labelsFd);
+        throw;
+    }
+}
+
+IdxSampleFile::~IdxSampleFile()
+{
+    ::close(imagesFd);
+    ::close(labelsFd);
+}
+
+void IdxSampleFile::read(size_t start, size_t count, uint8_t *features, uint8_t *labels) const
+{
+    read_exact(imagesFd, features, count * numFeatures, imagesOffset + start * numFeatures);
+    read_exact(labelsFd, labels, count, labelsOffset + start);
+}
+
+NpySampleFile::NpySampleFile(const std::string &features_path, const std::string &labels_path)
+    : featuresFd(open_read(features_path)), labelsFd(-1)
+{
+    try {
+        labelsFd = open_read(labels_path);
+        featuresHeader = read_npy_header(featuresFd);
+        labelsHeader = read_npy_header(labelsFd);
+        if (featuresHeader.kind != 'u' || featuresHeader.itemSize != 1 || featuresHeader.fortranOrder) {
+            throw std::runtime_error("NpySampleFile: features must be C-ordered uint8 in " + features_path);
+        }
+        if (featuresHeader.shape.size() < 2 || labelsHeader.shape.size() != 1 ||
+            featuresHeader.shape[0] != labelsHeader.shape[0]) {
+            throw std::runtime_error("NpySampleFile: expected features [N, ...] and labels [N]");
+        }
+        numSamples = featuresHeader.shape[0];
+        numFeatures = featuresHeader.count() / std::max<size_t>(numSamples, 1);
+        check_payload(file_size(featuresFd, features_path), featuresHeader.dataOffset, numSamples, numFeatures,
+                      features_path);
+        check_payload(file_size(labelsFd, labels_path), labelsHeader.dataOffset, numSamples, labelsHeader.itemSize,
+                      labels_path);
+    }
+    catch (...) {
+        ::close(featuresFd);
+        if (labelsFd >= 0) ::close(labelsFd);
+        throw;
+    }
+}
+
+NpySampleFile::~NpySampleFile()
+{
+    ::close(featuresFd);
+    ::close(labelsFd);
+}
+
+void NpySampleFile::read(size_t start, size_t count, uint8_t *features, uint8_t *labels) const
+{
+    read_exact(featuresFd, features, count * numFeatures, featuresHeader.dataOffset + start * numFeatures);
+    // labels are decoded from their stored integer width
+    size_t item = labelsHeader.itemSize;
+    std::vector<uint8_t> raw(count * item);
+    read_exact(labelsFd, raw.data(), raw.size(), labelsHeader.dataOffset + start * item);
+    npy_to_uint8(raw.data(), labelsHeader, labels, count);
+}
+
+BinarySampleFile::BinarySampleFile(const std::string &path)
+    : fd(open_read(path))
+{
+    try {
+        char magic[8];
+        uint64_t dims[3];
+        read_exact(fd, magic, 8, 0);
+        read_exact(fd, dims, sizeof(dims), 8);
+        if (memcmp(magic, "MOFDSET1", 8) != 0) {
+            throw std::runtime_error("BinarySampleFile: invalid magic in " + path);
+        }
+        numSamples = dims[0];
+        numFeatures = dims[1];
+        numClasses = dims[2];
+        if (numFeatures == 0 || numClasses == 0) {
+            throw std::runtime_error("BinarySampleFile: no features or classes in " + path);
+        }
+        // labels (one byte per sample) come before the features
+        size_t size = file_size(fd, path);
+        check_payload(size, HEADER_SIZE, numSamples, 1, path);
+        check_payload(size, HEADER_SIZE + numSamples, numSamples, numFeatures, path);
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+BinarySampleFile::~BinarySampleFile()
+{
+    ::close(fd);
+}
+
+void BinarySampleFile::read(size_t start, size_t count, uint8_t *features, uint8_t *labels) const
+{
+    read_exact(fd, labels, count, HEADER_SIZE + start);
+    read_exact(fd, features, count * numFeatures, HEADER_SIZE + numSamples + start * numFeatures);
+}
+
+void write_binary_dataset(const Dataset &dataset, const std::string &path, size_t start, size_t end)
+{
+    if (end == 0) {
+        end = dataset.size();
+    }
+    if (start >= end || end > dataset.size()) {
+        throw std::runtime_error("write_binary_dataset: invalid row range");
+    }
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    size_t features = dataset.getFeatureCount();
+    uint64_t dims[3] = {end - start, features, dataset.getClassCount()};
+    file.write("MOFDSET1", 8);
+    file.write(reinterpret_cast<const char *>(dims), sizeof(dims));
+    file.write(reinterpret_cast<const char *>(dataset.getLabels() + start), end - start);
+    file.write(reinterpret_cast<const char *>(dataset.getFeatures() + start * features), (end - start) * features);
+    if (!file) {
+        throw std::runtime_error("write_binary_dataset: write failed for " + path);
+    }
+}
+
+StreamingDataset::StreamingDataset(std::vector<std::shared_ptr<SampleFile>> shards, size_t num_classes,
+                                   size_t batch_size, size_t chunk_rows, size_t readahead,
+                                   size_t num_workers, bool shuffle, bool drop_last,
+                                   unsigned int seed, double scale, double shift)
+    : shards(shards), numClasses(num_classes), numFeatures(0), numSamples(0), batchSize(batch_size),
+      numBatches(0), numWorkers(num_workers), shuffle(shuffle), dropLast(drop_last),
+      scale(scale), shift(shift), gen(seed), nextClaim(0), nextBatch(0), released(0), epochSeed(0),
+      stopping(false), started(false), produced(0), consumed(0), holding(false)
+{
+    if (shards.empty() || num_classes == 0 || chunk_rows == 0 || readahead == 0 || num_workers == 0) {
+        throw std::runtime_error("StreamingDataset: invalid configuration");
+    }
+    numFeatures = shards[0]->getFeatureCount();
+    for (size_t s = 0; s < shards.size(); s++) {
+        if (shards[s]->getFeatureCount() != numFeatures) {
+            throw std::runtime_error("StreamingDataset: shards have different feature counts");
+        }
+        for (size_t row = 0; row < shards[s]->size(); row += chunk_rows) {
+            plan.push_back({s, row, std::min(chunk_rows, shards[s]->size() - row)});
+        }
+        numSamples += shards[s]->size();
+    }
+    if (batch_size == 0 || (drop_last && batch_size > numSamples)) {
+        throw std::runtime_error("StreamingDataset: invalid batch size");
+    }
+    numBatches = drop_last ? numSamples / batch_size : (numSamples + batch_size - 1) / batch_size;
+
+    chunks.resize(std::min(readahead, plan.size()));
+    for (Chunk &chunk : chunks) {
+        chunk.features.resize(chunk_rows * numFeatures);
+        chunk.labels.resize(chunk_rows);
+        chunk.order.resize(chunk_rows);
+        chunk.rows = 0;
+        chunk.used = 0;
+        chunk.seq = 0;
+        chunk.ready = false;
+    }
+    batches.resize(num_workers + 1);
+    for (Batch &batch : batches) {
+        batch.data = Matrix(batch_size, numFeatures);
+        batch.labels = Matrix(batch_size, numClasses);
+    }
+    size_t tail_rows = numSamples % batch_size;
+    if (!drop_last && tail_rows != 0) {
+        tail.data = Matrix(tail_rows, numFeatures);
+        tail.labels = Matrix(tail_rows, numClasses);
+    }
+}
+
+StreamingDataset::~StreamingDataset()
+{
+    stop();
+}
+
+void StreamingDataset::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    stopping = false;
+    started = false;
+}
+
+void StreamingDataset::start()
+{
+    stop();
+    if (shuffle) {
+        std::shuffle(plan.begin(), plan.end(), gen);
+    }
+    epochSeed = gen();
+    chunkStart.resize(plan.size());
+    for (size_t seq = 0, row = 0; seq < plan.size(); row += plan[seq].count, seq++) {
+        chunkStart[seq] = row;
+    }
+    for (Chunk &chunk : chunks) {
+        chunk.ready = false;
+    }
+    for (Batch &batch : batches) {
+        batch.ready = false;
+    }
+    tail.ready = false;
+    nextClaim.store(0);
+    nextBatch.store(0);
+    released = 0;
+    error = nullptr;
+    produced = 0;
+    consumed = 0;
+    holding = false;
+    started = true;
+    for (size_t i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&StreamingDataset::read_chunks, this);
+    }
+    for (size_t i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&StreamingDataset::assemble_batches, this);
+    }
+}
+
+void StreamingDataset::read_chunks()
+{
+    while (true) {
+        size_t seq = nextClaim.fetch_add(1);
+        if (seq >= plan.size()) {
+            return;
+        }
+        Chunk &chunk = chunks[seq % chunks.size()];
+        {
+            // wait until the consumer has released the chunk this slot held before
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] {return stopping || seq < released + chunks.size();});
+            if (stopping) {
+                return;
+            }
+        }
+        const ChunkRef &ref = plan[seq];
+        try {
+            shards[ref.shard]->read(ref.start, ref.count, chunk.features.data(), chunk.labels.data());
+            for (size_t i = 0; i < ref.count; i++) {
+                if (chunk.labels[i] >= numClasses) {
+                    throw std::runtime_error("StreamingDataset: label out of range");
+                }
+            }
+            std::iota(chunk.order.begin(), chunk.order.begin() + ref.count, 0);
+            if (shuffle) {
+                std::mt19937 chunk_gen(epochSeed + seq);
+                std::shuffle(chunk.order.begin(), chunk.order.begin() + ref.count, chunk_gen);
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            stopping = true;
+            cv.notify_all();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            chunk.rows = ref.count;
+            chunk.used = 0;
+            chunk.seq = seq;
+            chunk.ready = true;
+        }
+        cv.notify_all();
+    }
+}
+
+StreamingDataset::Batch &StreamingDataset::batch_buffer(size_t seq)
+{
+    bool is_tail = seq == numBatches - 1 && tail.data.getRow() != 0;
+    return is_tail ? tail : batches[seq % batches.size()];
+}
+
+// chunks go back to the readers in plan order, the assemblers may finish them out of order
+// called with the mutex held
+void StreamingDataset::release_chunks()
+{
+    while (released < plan.size()) {
+        Chunk &chunk = chunks[released % chunks.size()];
+        if (!chunk.ready || chunk.seq != released || chunk.used != chunk.rows) {
+            break;
+        }
+        chunk.ready = false;
+        released++;
+    }
+}
+
+void StreamingDataset::assemble_batches()
+{
+    while (true) {
+        size_t seq = nextBatch.fetch_add(1);
+        if (seq >= numBatches) {
+            return;
+        }
+        Batch &batch = batch_buffer(seq);
+        {
+            // wait until the consumer has handed back the batch this buffer held before
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] {return stopping || seq < consumed + batches.size();});
+            if (stopping) {
+                return;
+            }
+        }
+        size_t rows = batch.data.getRow();
+        size_t row = seq * batchSize;
+        std::fill(batch.labels.data, batch.labels.data + rows * numClasses, 0.0);
+        size_t c = std::upper_bound(chunkStart.begin(), chunkStart.end(), row) - chunkStart.begin() - 1;
+        for (size_t i = 0; i < rows; c++) {
+            Chunk &chunk = chunks[c % chunks.size()];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] {return stopping || (chunk.ready && chunk.seq == c);});
+                if (stopping) {
+                    return;
+                }
+            }
+            size_t begin = row + i - chunkStart[c];
+            size_t take = std::min(rows - i, chunk.rows - begin);
+            for (size_t t = 0; t < take; t++) {
+                size_t r = chunk.order[begin + t];
+                const uint8_t *src = chunk.features.data() + r * numFeatures;
+                double *dst = batch.data.data + (i + t) * numFeatures;
+                #pragma omp simd
+                for (size_t j = 0; j < numFeatures; j++) {
+                    dst[j] = static_cast<double>(src[j]) * scale + shift;
+                }
+                batch.labels.data[(i + t) * numClasses + chunk.labels[r]] = 1.0;
+            }
+            i += take;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                chunk.used += take;
+                release_chunks();
+            }
+            cv.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.seq = seq;
+            batch.ready = true;
+        }
+        cv.notify_all();
+    }
+}
+
+bool StreamingDataset::next(const Matrix *&batch_data, const Matrix *&batch_labels)
+{
+    if (!started) {
+        throw std::runtime_error("StreamingDataset: start() must be called before next()");
+    }
+    // the previous batch is done with, give its buffer back to the assemblers
+    if (holding) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch_buffer(produced - 1).ready = false;
+            consumed++;
+        }
+        cv.notify_all();
+        holding = false;
+    }
+    if (produced == numBatches) {
+        return false;
+    }
+    Batch &batch = batch_buffer(produced);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] {return error || (batch.ready && batch.seq == produced);});
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    holding = true;
+    produced++;
+    batch_data = &batch.data;
+    batch_labels = &batch.labels;
+    return true;
+}
@@ -0,0 +1,167 @@
+// out-of-core datasets: sample files are read chunk by chunk with pread,
+// a bounded number of chunks is held in memory at any time
+#include "matrix.h"
+#include "dataset.h"
+#include "dataloader.h"
+#include "npy.h"
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#ifndef __STREAM__
+#define __STREAM__
+
+// uint8 samples and labels stored on disk, read by row range
+class SampleFile {
+public:
+    virtual ~SampleFile() {}
+    virtual size_t size() const = 0;
+    virtual size_t getFeatureCount() const = 0;
+    // rows [start, start + count): count x features and count labels
+    // called concurrently by reader threads
+    virtual void read(size_t start, size_t count, uint8_t *features, uint8_t *labels) const = 0;
+};
+
+// images / labels IDX pair
+class IdxSampleFile : public SampleFile {
+public:
+    IdxSampleFile(const std::string &images_path, const std::string &labels_path);
+    ~IdxSampleFile();
+    size_t size() const override {return numSamples;}
+    size_t getFeatureCount() const override {return numFeatures;}
+    void read(size_t start, size_t count, uint8_t *features, uint8_t *labels) const override;
+
+private:
+    int imagesFd;
+    int labelsFd;
+    size_t imagesOffset;
+    size_t labelsOffset;
+    size_t numSamples;
+    size_t numFeatures;
+};
+
+// features [N, ...] uint8 .npy with labels [N] .npy of any integer dtype
+class NpySampleFile : public SampleFile {
+public:
+    NpySampleFile(const std::string &features_path, const std::string &labels_path);
+    ~NpySampleFile();
+    size_t size() const override {return numSamples;}
+    size_t getFeatureCount() const override {return numFeatures;}
+    void read(size_t start, size_t count, uint8_t *features, uint8_t *labels) const override;
+
+private:
+    int featuresFd;
+    int labelsFd;
+    NpyHeader featuresHeader;
+    NpyHeader labelsHeader;
+    size_t numSamples;
+    size_t numFeatures;
+};
+
+// native format, one file per shard:
+// "MOFDSET1", uint64 samples, uint64 features, uint64 classes,
+// labels (samples bytes), features (samples x features bytes)
+class BinarySampleFile : public SampleFile {
+public:
+    BinarySampleFile(const std::string &path);
+    ~BinarySampleFile();
+    size_t size() const override {return numSamples;}
+    size_t getFeatureCount() const override {return numFeatures;}
+    size_t getClassCount() const {return numClasses;}
+    void read(size_t start, size_t count, uint8_t *features, uint8_t *labels) const override;
+
+    static const size_t HEADER_SIZE = 32;
+
+private:
+    int fd;
+    size_t numSamples;
+    size_t numFeatures;
+    size_t numClasses;
+};
+
+// rows [start, end) of a dataset written as one native shard
+void write_binary_dataset(const Dataset &dataset, const std::string &path, size_t start = 0, size_t end = 0);
+
+class StreamingDataset : public BatchStream {
+public:
+    // shards are split into chunks of chunk_rows, at most readahead chunks are
+    // buffered, num_workers threads read chunks in parallel and as many assemble
+    // normalized batches from them into num_workers + 1 reusable buffers, so next()
+    // only hands out a ready batch
+    // with shuffle, chunk order and row order inside a chunk are permuted
+    StreamingDataset(std::vector<std::shared_ptr<SampleFile>> shards, size_t num_classes,
+                     size_t batch_size, size_t chunk_rows = 8192, size_t readahead = 4,
+                     size_t num_workers = 2, bool shuffle = true, bool drop_last = true,
+                     unsigned int seed = 0, double scale = 1.0 / 255.0, double shift = -0.5);
+    ~StreamingDataset();
+
+    void start() override;
+    bool next(const Matrix *&batch_data, const Matrix *&batch_labels) override;
+    void stop() override;
+    size_t num_batches() const override {return numBatches;}
+    size_t size() const {return numSamples;}
+
+private:
+    struct ChunkRef {
+        size_t shard;
+        size_t start;
+        size_t count;
+    };
+    struct Chunk {
+        std::vector<uint8_t> features;
+        std::vector<uint8_t> labels;
+        std::vector<size_t> order;
+        size_t rows;
+        size_t used;        // rows already copied into batches
+        size_t seq;
+        bool ready;
+    };
+    struct Batch {
+        Matrix data;
+        Matrix labels;
+        size_t seq;
+        bool ready;
+    };
+    void read_chunks();
+    void assemble_batches();
+    Batch &batch_buffer(size_t seq);
+    void release_chunks();
+
+    std::vector<std::shared_ptr<SampleFile>> shards;
+    size_t numClasses;
+    size_t numFeatures;
+    size_t numSamples;
+    size_t batchSize;
+    size_t numBatches;
+    size_t numWorkers;
+    bool shuffle;
+    bool dropLast;
+    double scale;
+    double shift;
+    std::mt19937 gen;
+
+    std::vector<ChunkRef> plan;
+    // first epoch row of each planned chunk, batch b covers rows [b * batchSize, ...)
+    std::vector<size_t> chunkStart;
+    std::vector<Chunk> chunks;
+    std::vector<Batch> batches;
+    Batch tail;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextClaim;
+    std::atomic<size_t> nextBatch;
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t released;
+    std::exception_ptr error;
+    unsigned int epochSeed;
+    bool stopping;
+    bool started;
+
+    // consumer position: batches handed out and handed back
+    size_t produced;
+    size_t consumed;
+    bool holding;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "trainer.h"
+#include "metrics.h"
+#include "profiler.h"
+#include <chrono>
+#include <stdexcept>
+
+Trainer::Trainer(Network &network, BaseLoss &loss, SGD &optimizer)
+    : network(network), loss(loss), optimizer(optimizer), progressInterval(100), step(0), epoch(0)
+{
+}
+
+void Trainer::setProgressCallback(std::function<void(const TrainProgress&)> callback, size_t interval)
+{
+    if (interval == 0) {
+        throw std::runtime_error("Trainer: progress interval must be positive");
+    }
+    progressCallback = std::move(callback);
+    progressInterval = interval;
+}
+
+void Trainer::setEpochCallback(std::function<void(const EpochStats&)> callback)
+{
+    epochCallback = std::move(callback);
+}
+
+EpochStats Trainer::train_epoch(BatchStream &data)
+{
+    auto begin = std::chrono::steady_clock::now();
+    EpochStats stats = {epoch, 0, 0, 0.0, 0.0, 0.0};
+    size_t num_batches = data.num_batches();
+    const Matrix *batch_data, *batch_labels;
+    data.start();
+    try {
+        while (data.next(batch_data, batch_labels)) {
+            ProfileScope scope("trainer", "step", step);
+            Matrix predictions = network.forward(*batch_data);
+            double batch_loss = loss(predictions, *batch_labels).mean();
+            // gradients are moved into the optimizer, never copied
+            optimizer.apply_gradient(network, network.backward(loss.backward()));
+            step++;
+
+            stats.loss += batch_loss;
+            stats.samples += batch_data->getRow();
+            if (progressCallback && stats.batches % progressInterval == 0) {
+                progressCallback({epoch, stats.batches, num_batches, step,
+                                  batch_loss, stats.loss / (stats.batches + 1)});
+            }
+            stats.batches++;
+        }
+    }
+    catch (...) {
+        // leave the stream restartable, e.g. after an interrupt in a callback
+        data.stop();
+        throw;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    if (stats.batches > 0) {
+        stats.loss /= stats.batches;
+    }
+    stats.seconds = elapsed.count();
+    stats.samplesPerSecond = stats.seconds > 0.0 ? stats.samples / stats.seconds : 0.0;
+    epoch++;
+    return stats;
+}
+
+std::vector<EpochStats> Trainer::fit(BatchStream &data, size_t epochs)
+{
+    std::vector<EpochStats> history;
+    for (size_t i = 0; i < epochs; i++) {
+        history.push_back(train_epoch(data));
+        if (epochCallback) {
+            epochCallback(history.back());
+        }
+    }
+    return history;
+}
+
+EvalStats Trainer::evaluate(BatchStream &data)
+{
+    EvalStats stats = {0, 0.0, 0.0};
+    size_t correct = 0;
+    const Matrix *batch_data, *batch_labels;
+    data.start();
+    while (data.next(batch_data, batch_labels)) {
+        Matrix predictions = network.predict(*batch_data);
+        size_t rows = predictions.getRow();
+        // per-sample loss summed over classes
+        stats.loss += reduce_loss(loss(predictions, *batch_labels), Reduction::SUM);
+        correct += count_correct(predictions, *batch_labels);
+        stats.samples += rows;
+    }
+    if (stats.samples > 0) {
+        stats.loss /= stats.samples;
+        stats.accuracy = double(correct) / stats.samples;
+    }
+    return stats;
+}
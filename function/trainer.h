@@ -0,0 +1,66 @@
+// native training loop: whole epochs over a BatchStream without leaving C++
+// forward, loss, backward and the optimizer step per batch, progress reported
+// through callbacks every N batches
+#include "network.h"
+#include "loss.h"
+#include "optimizer.h"
+#include "dataloader.h"
+#include <functional>
+
+#ifndef __TRAINER__
+#define __TRAINER__
+
+struct TrainProgress {
+    size_t epoch;          // 0-based
+    size_t batch;          // 0-based, within the epoch
+    size_t numBatches;
+    size_t step;           // optimizer steps since construction
+    double loss;           // mean loss of this batch
+    double averageLoss;    // mean batch loss so far in the epoch
+};
+
+struct EpochStats {
+    size_t epoch;
+    size_t batches;
+    size_t samples;
+    double loss;           // mean batch loss
+    double seconds;
+    double samplesPerSecond;
+};
+
+struct EvalStats {
+    size_t samples;
+    double loss;           // mean loss per sample
+    double accuracy;       // argmax(prediction) == argmax(label)
+};
+
+class Trainer {
+public:
+    // the objects are referenced and must outlive the trainer
+    Trainer(Network &network, BaseLoss &loss, SGD &optimizer);
+
+    // called after every interval-th batch of an epoch (batch % interval == 0)
+    void setProgressCallback(std::function<void(const TrainProgress&)> callback, size_t interval = 100);
+    // called at the end of every epoch of fit()
+    void setEpochCallback(std::function<void(const EpochStats&)> callback);
+
+    EpochStats train_epoch(BatchStream &data);
+    std::vector<EpochStats> fit(BatchStream &data, size_t epochs);
+    // inference over a stream, nothing is recorded for backward
+    EvalStats evaluate(BatchStream &data);
+
+    size_t getStep() const {return step;}
+    size_t getEpoch() const {return epoch;}
+
+private:
+    Network &network;
+    BaseLoss &loss;
+    SGD &optimizer;
+    std::function<void(const TrainProgress&)> progressCallback;
+    std::function<void(const EpochStats&)> epochCallback;
+    size_t progressInterval;
+    size_t step;
+    size_t epoch;
+};
+
+#endif
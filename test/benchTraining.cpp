@@ -0,0 +1,368 @@
+// end-to-end training benchmark on synthetic data: full SGD steps of a configurable
+// MLP for every mul mode and thread count, samples/s, step latency percentiles and a
+// forward / loss / backward / optimizer breakdown
+//
+// ./benchtraining [--layers 784,128,10 | --input 784 --width 128 --depth 1 --classes 10]
+//                 [--batch 256] [--activation sigmoid|relu] [--loss crossentropy|mse]
+//                 [--modes standard,mkl,tile,openmp,thread,cuda,auto,jit,strassen] [--threads 1,2,4]
+//                 [--warmup 5] [--steps 50] [--batches 8] [--lr 0.003] [--momentum 0.9]
+//                 [--counters] [--ops] [--alloc touch,interleave,thp|hugetlb] [--alloc-min 2097152]
+//                 [--json out.json] [--csv out.csv]
+// --counters reads the hardware counters at every phase boundary (a few us per phase)
+// --ops prints the per step FLOP / byte accounting of the timed steps (see opstats.h)
+// --alloc sets the Matrix allocation policy before the data is built (see Matrix::AllocPolicy)
+#include "../function/network.h"
+#include "../function/linear.h"
+#include "../function/activation.h"
+#include "../function/optimizer.h"
+#include "../function/loss.h"
+#include "../function/matrix.h"
+#include "../function/autotune.h"
+#include "../function/jit.h"
+#include "../function/opstats.h"
+#include "benchmark.h"
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <vector>
+#include <cuda_runtime.h>
+
+struct TrainResult {
+    std::string mode;
+    int threads;
+    std::string status;       // ok, unavailable or the error message
+    double samplesPerSecond;
+    TimingStats step;
+    TimingStats forward;
+    TimingStats loss;
+    TimingStats backward;
+    TimingStats optimizer;
+    double finalLoss;
+    PerfSample counters[4];   // forward, loss, backward, optimizer, summed over the timed steps
+    std::string ops;          // OpStats report, --ops only
+};
+
+static const std::vector<std::pair<std::string, int>> MUL_MODES = {
+    {"standard", Matrix::STANDARD}, {"mkl", Matrix::MKL}, {"tile", Matrix::TILE},
+    {"openmp", Matrix::OPENMP}, {"thread", Matrix::THREAD}, {"cuda", Matrix::CUDA},
+    {"auto", Matrix::AUTO}, {"jit", Matrix::JIT}, {"strassen", Matrix::STRASSEN}
+};
+
+static std::vector<size_t> layer_widths(const BenchOptions &options) {
+    std::vector<size_t> widths;
+    if (options.has("layers")) {
+        for (const std::string &width : options.getList("layers", "")) {
+            widths.push_back(std::stoul(width));
+        }
+    }
+    else {
+        widths.push_back(options.getInt("input", 784));
+        for (long i = 0; i < options.getInt("depth", 1); i++) {
+            widths.push_back(options.getInt("width", 128));
+        }
+        widths.push_back(options.getInt("classes", 10));
+    }
+    if (widths.size() < 2) {
+        throw std::runtime_error("the network needs at least an input and an output width");
+    }
+    return widths;
+}
+
+// Linear layers with the activation between them, none after the output
+static std::vector<Layer*> build_layers(const std::vector<size_t> &widths, const std::string &activation) {
+    if (activation != "sigmoid" && activation != "relu") {
+        throw std::runtime_error("unknown activation " + activation);
+    }
+    std::vector<Layer*> layers;
+    for (size_t i = 0; i + 1 < widths.size(); i++) {
+        layers.push_back(new Linear(widths[i], widths[i + 1], true, true));
+        if (i + 2 < widths.size()) {
+            if (activation == "relu") {
+                layers.push_back(new ReLU());
+            }
+            else {
+                layers.push_back(new Sigmoid());
+            }
+        }
+    }
+    return layers;
+}
+
+static std::unique_ptr<BaseLoss> build_loss(const std::string &name) {
+    if (name == "crossentropy") {
+        return std::unique_ptr<BaseLoss>(new CategoricalCrossentropy());
+    }
+    if (name == "mse") {
+        return std::unique_ptr<BaseLoss>(new MSE());
+    }
+    throw std::runtime_error("unknown loss " + name);
+}
+
+// uniform features in [-0.5, 0.5) and one-hot labels
+static void synthetic_batches(size_t count, size_t batch, size_t features, size_t classes,
+                              std::vector<Matrix> &data, std::vector<Matrix> &labels) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> value(-0.5, 0.5);
+    std::uniform_int_distribution<size_t> label(0, classes - 1);
+    for (size_t b = 0; b < count; b++) {
+        Matrix x(batch, features);
+        Matrix y = Matrix::zeros(batch, classes);
+        for (size_t i = 0; i < batch * features; i++) {
+            x.data[i] = value(gen);
+        }
+        for (size_t i = 0; i < batch; i++) {
+            y(i, label(gen)) = 1.0;
+        }
+        data.push_back(std::move(x));
+        labels.push_back(std::move(y));
+    }
+}
+
+static TrainResult bench_config(const std::string &mode_name, int mode, int threads,
+                                const std::vector<size_t> &widths, const std::vector<Matrix> &data,
+                                const std::vector<Matrix> &labels, const BenchOptions &options,
+                                const PerfCounters *counters) {
+    TrainResult result = {mode_name, threads, "ok", 0.0, timing_stats({}), timing_stats({}),
+                          timing_stats({}), timing_stats({}), timing_stats({}), 0.0, {}, ""};
+    int device_count = 0;
+    if ((mode == Matrix::CUDA && !(cudaGetDeviceCount(&device_count) == cudaSuccess && device_count > 0))
+        || (mode == Matrix::JIT && !JitGemm::available())) {
+        result.status = "unavailable";
+        return result;
+    }
+    Matrix::setMulMode(mode);
+    // OpenMP kernels and AUTO candidates follow this, THREAD mode always uses 16 threads
+    omp_set_num_threads(threads);
+    // AUTO tunes again for this thread count during the warm-up steps
+    GemmAutotuner::instance().clear();
+    try {
+        Network network(build_layers(widths, options.get("activation", "sigmoid")));
+        std::unique_ptr<BaseLoss> loss = build_loss(options.get("loss", "crossentropy"));
+        SGD optimizer(options.getDouble("lr", 0.003), options.getDouble("momentum", 0.9));
+        long warmup = options.getInt("warmup", 5);
+        long steps = options.getInt("steps", 50);
+        // forward, loss, backward, optimizer
+        std::vector<double> phases[4];
+        std::vector<double> step_times;
+        double total = 0.0;
+        bool ops = options.has("ops");
+        for (long s = 0; s < warmup + steps; s++) {
+            if (ops && s == warmup) {
+                OpStats::clear();
+                OpStats::enable();
+            }
+            const Matrix &x = data[s % data.size()];
+            const Matrix &y = labels[s % labels.size()];
+            // phase boundaries
+            PerfReading marks[5];
+            auto begin = std::chrono::steady_clock::now();
+            if (counters) marks[0] = counters->read();
+            Matrix predictions = network.forward(x);
+            if (counters) marks[1] = counters->read();
+            double forward = elapsed_seconds(begin);
+            result.finalLoss = (*loss)(predictions, y).mean();
+            if (counters) marks[2] = counters->read();
+            double loss_done = elapsed_seconds(begin);
+            std::vector<std::vector<Matrix>> gradients = network.backward(loss->backward());
+            if (counters) marks[3] = counters->read();
+            double backward = elapsed_seconds(begin);
+            optimizer.apply_gradient(network, std::move(gradients));
+            if (counters) marks[4] = counters->read();
+            double step = elapsed_seconds(begin);
+            if (s < warmup) {
+                continue;
+            }
+            for (int p = 0; counters && p < 4; p++) {
+                result.counters[p] += PerfCounters::between(marks[p], marks[p + 1]);
+            }
+            phases[0].push_back(forward);
+            phases[1].push_back(loss_done - forward);
+            phases[2].push_back(backward - loss_done);
+            phases[3].push_back(step - backward);
+            step_times.push_back(step);
+            total += step;
+        }
+        if (ops) {
+            OpStats::disable();
+            result.ops = OpStats::report(steps);
+        }
+        result.step = timing_stats(step_times);
+        result.forward = timing_stats(phases[0]);
+        result.loss = timing_stats(phases[1]);
+        result.backward = timing_stats(phases[2]);
+        result.optimizer = timing_stats(phases[3]);
+        result.samplesPerSecond = total > 0.0 ? double(steps) * data[0].row / total : 0.0;
+    }
+    catch (const std::exception &e) {
+        result.status = std::string("error: ") + e.what();
+    }
+    OpStats::disable();
+    return result;
+}
+
+static std::string results_json(const std::vector<TrainResult> &results, const std::vector<size_t> &widths,
+                                const MachineInfo &machine, const BenchOptions &options) {
+    std::ostringstream out;
+    out.precision(9);
+    out << "{\n  \"benchmark\": \"training\",\n  \"timestamp\": " << json_string(timestamp())
+        << ",\n  \"machine\": " << machine_json(machine) << ",\n  \"layers\": [";
+    for (size_t i = 0; i < widths.size(); i++) {
+        out << (i ? ", " : "") << widths[i];
+    }
+    out << "],\n  \"batch\": " << options.getInt("batch", 256)
+        << ",\n  \"activation\": " << json_string(options.get("activation", "sigmoid"))
+        << ",\n  \"loss\": " << json_string(options.get("loss", "crossentropy"))
+        << ",\n  \"warmup\": " << options.getInt("warmup", 5)
+        << ",\n  \"steps\": " << options.getInt("steps", 50)
+        << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const TrainResult &r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"mode\": " << json_string(r.mode) << ", \"threads\": " << r.threads
+            << ", \"status\": " << json_string(r.status) << ", \"samples_per_second\": " << r.samplesPerSecond
+            << ", \"step\": " << stats_json(r.step) << ", \"forward\": " << stats_json(r.forward)
+            << ", \"loss\": " << stats_json(r.loss) << ", \"backward\": " << stats_json(r.backward)
+            << ", \"optimizer\": " << stats_json(r.optimizer) << ", \"final_loss\": " << r.finalLoss
+            << ", \"counters\": {\"forward\": " << perf_json(r.counters[0], r.step.runs)
+            << ", \"loss\": " << perf_json(r.counters[1], r.step.runs)
+            << ", \"backward\": " << perf_json(r.counters[2], r.step.runs)
+            << ", \"optimizer\": " << perf_json(r.counters[3], r.step.runs) << "}}";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+static std::string results_csv(const std::vector<TrainResult> &results) {
+    std::ostringstream out;
+    out.precision(9);
+    out << "mode,threads,status,samples_per_second,step_p50_s,step_p90_s,step_p99_s,"
+        << "forward_s,loss_s,backward_s,optimizer_s,final_loss";
+    // counters per step of the whole step
+    out << perf_csv_header() << "\n";
+    for (const TrainResult &r : results) {
+        out << r.mode << "," << r.threads << "," << r.status << "," << r.samplesPerSecond << ","
+            << r.step.median << "," << r.step.p90 << "," << r.step.p99 << "," << r.forward.median << ","
+            << r.loss.median << "," << r.backward.median << "," << r.optimizer.median << ","
+            << r.finalLoss;
+        PerfSample step;
+        for (const PerfSample &phase : r.counters) {
+            step += phase;
+        }
+        out << perf_csv(step, r.step.runs) << "\n";
+    }
+    return out.str();
+}
+
+static void print_result(const TrainResult &r, bool counters) {
+    std::cout << std::setw(10) << r.mode << std::setw(9) << r.threads;
+    if (r.status != "ok") {
+        std::cout << "  " << r.status << std::endl;
+        return;
+    }
+    // per phase medians in ms
+    std::cout << std::fixed << std::setprecision(1) << std::setw(12) << r.samplesPerSecond
+              << std::setprecision(3) << std::setw(10) << r.step.median * 1e3 << std::setw(10) << r.step.p90 * 1e3
+              << std::setw(10) << r.step.p99 * 1e3 << std::setw(10) << r.forward.median * 1e3
+              << std::setw(10) << r.loss.median * 1e3 << std::setw(10) << r.backward.median * 1e3
+              << std::setw(10) << r.optimizer.median * 1e3;
+    if (counters) {
+        PerfSample step;
+        for (const PerfSample &phase : r.counters) {
+            step += phase;
+        }
+        std::cout << std::setprecision(2) << std::setw(9) << r.counters[0].ipc() << std::setw(9)
+                  << r.counters[2].ipc() << std::setw(10) << step.per_kilo_instruction(PERF_LLC_MISSES);
+    }
+    std::cout << std::defaultfloat << std::endl;
+}
+
+static Matrix::AllocPolicy alloc_policy(const BenchOptions &options) {
+    Matrix::AllocPolicy policy = Matrix::getAllocPolicy();
+    for (const std::string &option : options.getList("alloc", "")) {
+        if (option == "touch") {
+            policy.parallelTouch = true;
+        }
+        else if (option == "interleave") {
+            policy.interleave = true;
+        }
+        else if (option == "thp") {
+            policy.hugePages = Matrix::HUGE_TRANSPARENT;
+        }
+        else if (option == "hugetlb") {
+            policy.hugePages = Matrix::HUGE_EXPLICIT;
+        }
+        else {
+            throw std::runtime_error("unknown --alloc option " + option);
+        }
+    }
+    policy.minBytes = options.getInt("alloc-min", long(policy.minBytes));
+    return policy;
+}
+
+int main(int argc, char **argv) {
+    try {
+        BenchOptions options(argc, argv);
+        MachineInfo machine = machine_info(options.getDouble("peak", 0.0));
+        Matrix::setAllocPolicy(alloc_policy(options));
+        std::vector<size_t> widths = layer_widths(options);
+        size_t batch = options.getInt("batch", 256);
+        std::vector<Matrix> data, labels;
+        synthetic_batches(std::max(1L, options.getInt("batches", 8)), batch, widths.front(), widths.back(),
+                          data, labels);
+
+        std::vector<int> thread_counts;
+        for (const std::string &count : options.getList("threads", std::to_string(machine.ompThreads))) {
+            thread_counts.push_back(std::stoi(count));
+        }
+        std::vector<std::string> selected = options.getList("modes", "mkl,tile,openmp,thread,cuda,auto,jit,strassen");
+
+        std::unique_ptr<PerfCounters> counters(open_counters(options));
+        std::cout << "Training Benchmark" << std::endl;
+        std::cout << "layers";
+        for (size_t width : widths) {
+            std::cout << " " << width;
+        }
+        std::cout << ", batch " << batch << ", " << options.get("activation", "sigmoid") << ", "
+                  << options.get("loss", "crossentropy") << ", cores " << machine.cores << std::endl;
+        std::cout << std::setw(10) << "Mode" << std::setw(9) << "Threads" << std::setw(12) << "Samples/s"
+                  << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms"
+                  << std::setw(10) << "fwd ms" << std::setw(10) << "loss ms" << std::setw(10) << "bwd ms"
+                  << std::setw(10) << "opt ms";
+        if (counters) {
+            std::cout << std::setw(9) << "fwd IPC" << std::setw(9) << "bwd IPC" << std::setw(10) << "LLC MPKI";
+        }
+        std::cout << std::endl;
+
+        std::vector<TrainResult> results;
+        bool failed = false;
+        for (const std::string &name : selected) {
+            auto mode = std::find_if(MUL_MODES.begin(), MUL_MODES.end(),
+                                     [&](const std::pair<std::string, int> &m) {return m.first == name;});
+            if (mode == MUL_MODES.end()) {
+                throw std::runtime_error("unknown mode " + name);
+            }
+            for (int threads : thread_counts) {
+                results.push_back(bench_config(mode->first, mode->second, threads, widths, data, labels, options,
+                                               counters.get()));
+                print_result(results.back(), counters != nullptr);
+                std::cout << results.back().ops;
+                failed = failed || results.back().status.rfind("error", 0) == 0;
+            }
+        }
+
+        if (options.has("json")) {
+            write_output(options.get("json", "-"), results_json(results, widths, machine, options));
+        }
+        if (options.has("csv")) {
+            write_output(options.get("csv", "-"), results_csv(results));
+        }
+        if (failed) {
+            return 1;
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
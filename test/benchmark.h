@@ -0,0 +1,311 @@
+// helpers shared by the benchmark programs: command line options, timing
+// statistics, a machine peak estimate, hardware counters and JSON/CSV formatting
+#include "../function/perfcounters.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <omp.h>
+
+#ifndef __BENCHMARK__
+#define __BENCHMARK__
+
+// "--name value" pairs and bare "--flag"s
+class BenchOptions {
+public:
+    BenchOptions(int argc, char **argv) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) {
+                throw std::runtime_error("unexpected argument: " + arg);
+            }
+            std::string name = arg.substr(2);
+            if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+                values[name] = argv[++i];
+            }
+            else {
+                values[name] = "";
+            }
+        }
+    }
+    bool has(const std::string &name) const {return values.count(name) > 0;}
+    std::string get(const std::string &name, const std::string &fallback) const {
+        auto it = values.find(name);
+        return it == values.end() ? fallback : it->second;
+    }
+    long getInt(const std::string &name, long fallback) const {
+        return has(name) ? std::stol(get(name, "")) : fallback;
+    }
+    double getDouble(const std::string &name, double fallback) const {
+        return has(name) ? std::stod(get(name, "")) : fallback;
+    }
+    // comma separated
+    std::vector<std::string> getList(const std::string &name, const std::string &fallback) const {
+        std::vector<std::string> items;
+        std::stringstream stream(get(name, fallback));
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+
+private:
+    std::map<std::string, std::string> values;
+};
+
+inline double elapsed_seconds(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+struct TimingStats {
+    size_t runs;
+    double min;
+    double median;
+    double mean;
+    double max;
+    double p25;
+    double p75;
+    double p90;
+    double p99;
+};
+
+// linear interpolation between the closest ranks
+inline double percentile(const std::vector<double> &sorted, double q) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    double pos = q * (sorted.size() - 1);
+    size_t lower = size_t(pos);
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+    return sorted[lower] + (pos - lower) * (sorted[upper] - sorted[lower]);
+}
+
+inline TimingStats timing_stats(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    double total = 0.0;
+    for (double s : samples) {
+        total += s;
+    }
+    TimingStats stats = {samples.size(), 0, 0, 0, 0, 0, 0, 0, 0};
+    if (samples.empty()) {
+        return stats;
+    }
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.mean = total / samples.size();
+    stats.median = percentile(samples, 0.5);
+    stats.p25 = percentile(samples, 0.25);
+    stats.p75 = percentile(samples, 0.75);
+    stats.p90 = percentile(samples, 0.9);
+    stats.p99 = percentile(samples, 0.99);
+    return stats;
+}
+
+// theoretical double precision peak: cores x clock x FMA lanes x 2 units x 2 flops,
+// an estimate from cpuinfo, pass the real figure with --peak when it is known
+struct MachineInfo {
+    int cores;              // physical cores, SMT siblings share their FMA units
+    int logicalCpus;
+    int ompThreads;
+    double ghz;
+    std::string clockSource;
+    int flopsPerCycle;
+    std::string isa;
+    double peakGflops;
+};
+
+// nominal clock in GHz: the cpufreq base frequency, else the rated speed in the model
+// name ("... @ 2.40GHz"), else the current cpu MHz of /proc/cpuinfo
+inline double nominal_ghz(const std::string &model_name, double current_ghz, std::string &source) {
+    std::ifstream base("/sys/devices/system/cpu/cpu0/cpufreq/base_frequency");
+    double khz = 0.0;
+    if (base >> khz && khz > 0.0) {
+        source = "cpufreq base_frequency";
+        return khz / 1e6;
+    }
+    size_t at = model_name.rfind('@');
+    if (at != std::string::npos) {
+        double rated = std::atof(model_name.c_str() + at + 1);
+        if (rated > 0.0 && model_name.find("GHz", at) != std::string::npos) {
+            source = "model name";
+            return rated;
+        }
+    }
+    source = current_ghz > 0.0 ? "cpu MHz (current)" : "unknown";
+    return current_ghz;
+}
+
+inline MachineInfo machine_info(double peak_override = 0.0) {
+    MachineInfo info;
+    info.logicalCpus = std::max(1, int(std::thread::hardware_concurrency()));
+    info.ompThreads = omp_get_max_threads();
+    double current_ghz = 0.0;
+    std::string model_name;
+    // distinct (physical id, core id) pairs
+    std::set<std::pair<int, int>> cores;
+    int physical = 0;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        std::string value = line.find(':') == std::string::npos ? "" : line.substr(line.find(':') + 1);
+        if (line.rfind("cpu MHz", 0) == 0 && current_ghz == 0.0) {
+            current_ghz = std::stod(value) / 1000.0;
+        }
+        else if (line.rfind("model name", 0) == 0 && model_name.empty()) {
+            model_name = value;
+        }
+        else if (line.rfind("physical id", 0) == 0) {
+            physical = std::stoi(value);
+        }
+        else if (line.rfind("core id", 0) == 0) {
+            cores.insert({physical, std::stoi(value)});
+        }
+    }
+    info.cores = cores.empty() ? info.logicalCpus : int(cores.size());
+    info.ghz = nominal_ghz(model_name, current_ghz, info.clockSource);
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx512f")) {
+        info.isa = "avx512";
+        info.flopsPerCycle = 32;
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        info.isa = "avx2";
+        info.flopsPerCycle = 16;
+    }
+    else {
+        info.isa = "sse2";
+        info.flopsPerCycle = 4;
+    }
+#else
+    info.isa = "generic";
+    info.flopsPerCycle = 2;
+#endif
+    info.peakGflops = peak_override > 0.0 ? peak_override : info.cores * info.ghz * info.flopsPerCycle;
+    return info;
+}
+
+inline std::string json_string(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+inline std::string timestamp() {
+    char buffer[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return buffer;
+}
+
+inline std::string machine_json(const MachineInfo &info) {
+    std::ostringstream out;
+    out << "{\"cores\": " << info.cores << ", \"logical_cpus\": " << info.logicalCpus
+        << ", \"omp_threads\": " << info.ompThreads << ", \"ghz\": " << info.ghz
+        << ", \"clock_source\": " << json_string(info.clockSource) << ", \"isa\": " << json_string(info.isa)
+        << ", \"flops_per_cycle\": " << info.flopsPerCycle
+        << ", \"peak_gflops\": " << info.peakGflops << "}";
+    return out.str();
+}
+
+inline std::string stats_json(const TimingStats &stats) {
+    std::ostringstream out;
+    out.precision(9);
+    out << "{\"runs\": " << stats.runs << ", \"min\": " << stats.min << ", \"median\": " << stats.median
+        << ", \"mean\": " << stats.mean << ", \"max\": " << stats.max << ", \"p25\": " << stats.p25
+        << ", \"p75\": " << stats.p75 << ", \"p90\": " << stats.p90 << ", \"p99\": " << stats.p99 << "}";
+    return out.str();
+}
+
+// per-run averages of the counters read, null when none was
+inline std::string perf_json(const PerfSample &sample, size_t runs) {
+    bool any = false;
+    std::ostringstream out;
+    out.precision(9);
+    out << "{";
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (sample.valid[i]) {
+            out << (any ? ", " : "") << json_string(PerfCounters::name(i)) << ": "
+                << double(sample.values[i]) / std::max<size_t>(runs, 1);
+            any = true;
+        }
+    }
+    if (sample.valid[PERF_CYCLES] && sample.valid[PERF_INSTRUCTIONS]) {
+        out << ", \"ipc\": " << sample.ipc();
+    }
+    out << "}";
+    return any ? out.str() : "null";
+}
+
+inline std::string perf_csv_header() {
+    std::string header;
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        header += std::string(",") + PerfCounters::name(i);
+    }
+    return header + ",ipc";
+}
+
+// per-run averages, empty fields for counters that were not read
+inline std::string perf_csv(const PerfSample &sample, size_t runs) {
+    std::ostringstream out;
+    out.precision(9);
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        out << ",";
+        if (sample.valid[i]) {
+            out << double(sample.values[i]) / std::max<size_t>(runs, 1);
+        }
+    }
+    out << ",";
+    if (sample.valid[PERF_CYCLES] && sample.valid[PERF_INSTRUCTIONS]) {
+        out << sample.ipc();
+    }
+    return out.str();
+}
+
+// opens the counters for --counters, reports and returns null when the kernel refuses them
+inline PerfCounters *open_counters(const BenchOptions &options) {
+    if (!options.has("counters")) {
+        return nullptr;
+    }
+    PerfCounters *counters = new PerfCounters();
+    if (!counters->available()) {
+        std::cout << "hardware counters unavailable (" << counters->getError() << "), timing only" << std::endl;
+        delete counters;
+        return nullptr;
+    }
+    if (!counters->getError().empty()) {
+        std::cout << "some hardware counters unavailable (" << counters->getError() << ")" << std::endl;
+    }
+    return counters;
+}
+
+// writes to the path, "-" or an empty path is stdout
+inline void write_output(const std::string &path, const std::string &content) {
+    if (path == "-" || path.empty()) {
+        std::cout << content;
+        return;
+    }
+    std::ofstream file(path);
+    if (!file || !(file << content)) {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+#endif
@@ -0,0 +1,43 @@
+// input fixtures shared by the test programs: random matrices and hand-written .npy files
+#include "../function/matrix.h"
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+
+#ifndef __FIXTURES__
+#define __FIXTURES__
+
+// entries uniform in [-1, 1)
+inline Matrix random_matrix(size_t rows, size_t cols, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    Matrix mat(rows, cols);
+    for (size_t i = 0; i < rows * cols; i++) {
+        mat.data[i] = dist(gen);
+    }
+    return mat;
+}
+
+inline Matrix random_matrix(size_t rows, size_t cols, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    return random_matrix(rows, cols, gen);
+}
+
+// version 1 .npy file with the given descr and shape, bytes of raw data after the header
+inline void write_npy(const std::string &path, const std::string &descr, const std::string &shape,
+                      const void *data, size_t bytes)
+{
+    std::string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': " + shape + ", }";
+    while ((10 + dict.size() + 1) % 64 != 0) dict += ' ';
+    dict += '\n';
+    std::ofstream file(path, std::ios::binary);
+    file.write("\x93NUMPY\x01\x00", 8);
+    uint16_t len = dict.size();
+    file.write(reinterpret_cast<char*>(&len), 2);
+    file.write(dict.data(), dict.size());
+    file.write(reinterpret_cast<const char*>(data), bytes);
+}
+
+#endif
@@ -1,35 +1,7 @@
 #include <iostream>
 #include <cassert>
-#include "../function/matrix.h"
-
-// Function to test
-float compute_accuracy(const Matrix& predictions, const Matrix& labels) {
-    int correct = 0;
-    int total = predictions.getRow();
-    
-    for(int i = 0; i < total; i++) {
-        int pred_idx = 0;
-        float max_val = predictions(i,0);
-        for(int j = 1; j < 10; j++) {
-            if(predictions(i,j) > max_val) {
-                max_val = predictions(i,j);
-                pred_idx = j;
-            }
-        }
-        
-        int true_idx = 0;
-        for(int j = 0; j < 10; j++) {
-            if(labels(i,j) > 0.5) {
-                true_idx = j;
-                break;
-            }
-        }
-        
-        if(pred_idx == true_idx) correct++;
-    }
-    
-    return float(correct) / total;
-}
+#include <cmath>
+#include "../function/metrics.h"
 
 void test_compute_accuracy() {
     // Test case 1: Perfect predictions (100% accuracy)
@@ -92,9 +64,69 @@ void test_compute_accuracy() {
     }
 }
 
+void test_metrics() {
+    // 12 classes, one-hot and index labels give the same answers
+    Matrix predictions(4, 12), onehot(4, 12), index(4, 1);
+    size_t truth[4] = {11, 3, 7, 0};
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 12; j++) predictions(i, j) = 0.01 * j;
+        onehot(i, truth[i]) = 1.0;
+        index(i, 0) = truth[i];
+    }
+    predictions(1, 3) = 5.0;             // correct
+    predictions(2, 7) = 0.105;           // second highest after class 11
+    predictions(3, 0) = 0.095;           // fourth highest (11, 10, 9 above it)
+    std::vector<size_t> argmax = argmax_rows(predictions);
+    assert(argmax[0] == 11 && argmax[1] == 3 && argmax[2] == 11 && argmax[3] == 11);
+
+    assert(std::abs(compute_accuracy(predictions, onehot) - 0.5) < 1e-12);
+    assert(std::abs(compute_accuracy(predictions, index) - 0.5) < 1e-12);
+    assert(count_correct(predictions, onehot) == 2 && count_correct(predictions, index) == 2);
+    assert(std::abs(top_k_accuracy(predictions, onehot, 2) - 0.75) < 1e-12);
+    assert(std::abs(top_k_accuracy(predictions, index, 4) - 1.0) < 1e-12);
+
+    Matrix confusion = confusion_matrix(predictions, index);
+    assert(confusion.getRow() == 12 && confusion.sum() == 4);
+    assert(confusion(11, 11) == 1 && confusion(3, 3) == 1 && confusion(7, 11) == 1 && confusion(0, 11) == 1);
+
+    Matrix loss = Matrix::fillwith(4, 12, 0.5);
+    assert(reduce_loss(loss, Reduction::SUM) == 24.0);
+    assert(reduce_loss(loss, Reduction::MEAN) == 0.5);
+    assert(reduce_loss(loss, Reduction::SAMPLE_MEAN) == 6.0);
+
+    index(2, 0) = 12;
+    try {
+        compute_accuracy(predictions, index);
+        assert(false && "Should throw exception for label out of range");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Metrics test passed!" << std::endl;
+}
+
+// large enough for the parallel path, compared against a serial count
+void test_large() {
+    size_t rows = 200000, classes = 10;
+    Matrix predictions(rows, classes), labels(rows, 1);
+    size_t expected = 0;
+    for (size_t i = 0; i < rows; i++) {
+        size_t predicted = (i * 7) % classes;
+        predictions(i, predicted) = 1.0;
+        labels(i, 0) = (i * 3) % classes;
+        expected += predicted == (i * 3) % classes;
+    }
+    assert(std::abs(compute_accuracy(predictions, labels) - double(expected) / rows) < 1e-12);
+    assert(count_correct(predictions, labels) == expected);
+    Matrix confusion = confusion_matrix(predictions, labels);
+    double diagonal = 0.0;
+    for (size_t c = 0; c < classes; c++) diagonal += confusion(c, c);
+    assert(confusion.sum() == rows && diagonal == expected);
+    std::cout << "Large metrics test passed!" << std::endl;
+}
+
 int main() {
     try {
         test_compute_accuracy();
+        test_metrics();
+        test_large();
         std::cout << "All accuracy tests passed!" << std::endl;
     } catch (const std::exception& e) {
         std::cerr << "Test failed: " << e.what() << std::endl;
@@ -0,0 +1,159 @@
+#include "matrix.h"
+#include "autotune.h"
+#include "fixtures.h"
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+
+static void assert_close(const Matrix &a, const Matrix &b)
+{
+    assert(a.row == b.row && a.col == b.col);
+    for (size_t i = 0; i < a.row * a.col; i++) {
+        assert(std::abs(a.data[i] - b.data[i]) < 1e-9);
+    }
+}
+
+void test_auto_dispatch() {
+    GemmAutotuner &tuner = GemmAutotuner::instance();
+    tuner.clear();
+    tuner.setRepeats(1);
+    Matrix::setMulMode(Matrix::MulMode::AUTO);
+
+    // the shapes of a 784-128-10 network at batch 64
+    std::vector<std::vector<size_t>> shapes = {{64, 784, 128}, {64, 128, 10}, {784, 64, 128}, {64, 10, 128}};
+    for (const auto &shape : shapes) {
+        Matrix a = random_matrix(shape[0], shape[1], 1);
+        Matrix b = random_matrix(shape[1], shape[2], 2);
+        Matrix expected = multiply(a, b);
+        // the tuning call returns the winner's result, later calls reuse the winner
+        assert_close(mat_multiply(a, b), expected);
+        assert_close(mat_multiply(a, b), expected);
+        GemmConfig config;
+        assert(tuner.lookup(shape[0], shape[2], shape[1], config));
+        assert((config.mode >= Matrix::STANDARD && config.mode <= Matrix::CUDA) || config.mode == Matrix::JIT);
+        assert(config.seconds > 0.0);
+        std::cout << shape[0] << "x" << shape[1] << "x" << shape[2] << " -> mode " << config.mode
+                  << " tile " << config.tileSize << " threads " << config.numThreads << std::endl;
+    }
+    assert(tuner.entries().size() == shapes.size());
+
+    // a partial batch falls into the class of the full one
+    Matrix a = random_matrix(60, 784, 3);
+    Matrix b = random_matrix(784, 128, 4);
+    assert_close(mat_multiply(a, b), multiply(a, b));
+    assert(tuner.entries().size() == shapes.size());
+    assert(GemmAutotuner::shape_class(60, 128, 784) == GemmAutotuner::shape_class(64, 128, 1024));
+
+    // explicit retuning replaces the entry
+    GemmConfig retuned = tuner.tune(a, b);
+    GemmConfig cached;
+    assert(tuner.lookup(64, 128, 784, cached));
+    assert(cached.mode == retuned.mode && cached.seconds == retuned.seconds);
+
+    // mismatched and empty operands
+    try {
+        mat_multiply(random_matrix(3, 4, 5), random_matrix(5, 3, 6));
+        assert(false && "Should throw exception for mismatched dimensions");
+    } catch (const std::runtime_error&) {}
+    Matrix empty = mat_multiply(Matrix(0, 4), random_matrix(4, 3, 7));
+    assert(empty.row == 0 && empty.col == 3);
+    std::cout << "Auto dispatch test passed!" << std::endl;
+}
+
+void test_cache_file() {
+    GemmAutotuner &tuner = GemmAutotuner::instance();
+    const std::string path = "test_autotune.cache";
+    std::remove(path.c_str());
+    tuner.clear();
+    tuner.setCachePath(path);
+    Matrix a = random_matrix(32, 48, 8);
+    Matrix b = random_matrix(48, 16, 9);
+    GemmAutotuner::instance().multiply(a, b);
+    GemmConfig tuned;
+    assert(tuner.lookup(32, 16, 48, tuned));
+
+    // a fresh process would start from the file
+    tuner.clear();
+    tuner.setCachePath("");
+    GemmConfig loaded;
+    assert(!tuner.lookup(32, 16, 48, loaded));
+    tuner.load(path);
+    assert(tuner.lookup(32, 16, 48, loaded));
+    assert(loaded.mode == tuned.mode && loaded.tileSize == tuned.tileSize
+           && loaded.numThreads == tuned.numThreads);
+
+    // a file from another machine configuration is ignored, a broken one rejected
+    {
+        std::ofstream other(path);
+        other << "# MOFramework GEMM autotune cache v1\n# threads 100000\n32 16 64 1 0 0 0.001\n";
+    }
+    tuner.clear();
+    tuner.load(path);
+    assert(tuner.entries().empty());
+    {
+        std::ofstream broken(path);
+        broken << "not a cache\n";
+    }
+    try {
+        tuner.load(path);
+        assert(false && "Should throw exception for a malformed cache");
+    } catch (const std::runtime_error&) {}
+    std::remove(path.c_str());
+
+    // an unwritable cache path loses the file, never the product
+    tuner.clear();
+    tuner.setCachePath("no_such_directory/autotune.cache");
+    assert_close(tuner.multiply(a, b), multiply(a, b));
+    assert(tuner.lookup(32, 16, 48, loaded));
+    tuner.setCachePath("");
+    std::cout << "Cache file test passed!" << std::endl;
+}
+
+void test_concurrent_tuning() {
+    GemmAutotuner &tuner = GemmAutotuner::instance();
+    tuner.clear();
+    Matrix::setMulMode(Matrix::MulMode::AUTO);
+    Matrix a = random_matrix(40, 30, 10);
+    Matrix b = random_matrix(30, 20, 11);
+    Matrix expected = multiply(a, b);
+    std::vector<std::thread> threads;
+    std::vector<int> ok(4, 0);
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 5; i++) {
+                Matrix result = mat_multiply(a, b);
+                bool same = true;
+                for (size_t j = 0; j < result.row * result.col; j++) {
+                    same = same && std::abs(result.data[j] - expected.data[j]) < 1e-9;
+                }
+                ok[t] += same;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (int t = 0; t < 4; t++) {
+        assert(ok[t] == 5);
+    }
+    assert(tuner.entries().size() == 1);
+    std::cout << "Concurrent tuning test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_auto_dispatch();
+        test_cache_file();
+        test_concurrent_tuning();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "All autotune tests passed!" << std::endl;
+    return 0;
+}
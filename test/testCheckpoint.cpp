@@ -0,0 +1,184 @@
+#include <iostream>
+#include <cassert>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include "../function/checkpoint.h"
+#include "../function/loss.h"
+
+// one SGD step on a fixed batch so the optimizer holds velocity
+void train_step(Network &network, SGD &optimizer) {
+    Matrix x(4, 6), y(4, 3);
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 6; j++) x(i, j) = 0.1 * (i + j);
+        y(i, i % 3) = 1.0;
+    }
+    CategoricalCrossentropy loss_fn;
+    Matrix predictions = network.forward(x);
+    loss_fn(predictions, y);
+    optimizer.apply_gradient(network, network.backward(loss_fn.backward()));
+}
+
+bool same_weights(Network &a, Network &b) {
+    for (size_t i = 0; i < a.get_layers().size(); i++) {
+        std::vector<Matrix> wa = a.get_layers()[i]->get_weight();
+        std::vector<Matrix> wb = b.get_layers()[i]->get_weight();
+        if (wa.size() != wb.size()) return false;
+        for (size_t j = 0; j < wa.size(); j++) {
+            if (!(wa[j] == wb[j])) return false;
+        }
+    }
+    return true;
+}
+
+void test_save_load() {
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    Network network({new Linear(6, 5, true, true), new ReLU(), new Linear(5, 3, false, true), new Sigmoid()});
+    SGD optimizer(0.01, 0.9);
+    train_step(network, optimizer);
+    save_checkpoint("/tmp/test-model.ckpt", network, &optimizer, 7);
+
+    // restore into a fresh network of the same topology
+    Network restored({new Linear(6, 5, true, true), new ReLU(), new Linear(5, 3, false, true), new Sigmoid()});
+    SGD restored_optimizer(0.01, 0.9);
+    assert(load_checkpoint("/tmp/test-model.ckpt", restored, &restored_optimizer) == 7);
+    assert(same_weights(network, restored));
+    assert(restored_optimizer.getVelocity().size() == 4);
+    assert(restored_optimizer.getVelocity()[0][1] == optimizer.getVelocity()[0][1]);
+
+    // both continue identically from the checkpoint
+    train_step(network, optimizer);
+    train_step(restored, restored_optimizer);
+    assert(same_weights(network, restored));
+
+    // topology rebuilt from the file alone
+    Network rebuilt(load_checkpoint_layers("/tmp/test-model.ckpt"));
+    assert(rebuilt.get_layers().size() == 4);
+    assert(dynamic_cast<ReLU*>(rebuilt.get_layers()[1]) != nullptr);
+    assert(dynamic_cast<Linear*>(rebuilt.get_layers()[2])->getUseBias() == false);
+
+    Network mismatch({new Linear(6, 4, true, true), new ReLU(), new Linear(4, 3, false, true), new Sigmoid()});
+    try {
+        load_checkpoint("/tmp/test-model.ckpt", mismatch);
+        assert(false && "Should throw exception for topology mismatch");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Checkpoint save/load test passed!" << std::endl;
+}
+
+void test_background_writer() {
+    Network network({new Linear(6, 5, true, true), new Sigmoid(), new Linear(5, 3, true, true)});
+    SGD optimizer(0.01, 0.9);
+    CheckpointWriter writer;
+    for (int step = 1; step <= 20; step++) {
+        train_step(network, optimizer);
+        writer.snapshot("/tmp/test-async.ckpt", network, &optimizer, step);
+    }
+    writer.wait();
+    // queued snapshots may be superseded, the last one always lands
+    assert(writer.getWritten() >= 1 && writer.getWritten() <= 20);
+
+    Network restored({new Linear(6, 5, true, true), new Sigmoid(), new Linear(5, 3, true, true)});
+    assert(load_checkpoint("/tmp/test-async.ckpt", restored) == 20);
+    assert(same_weights(network, restored));
+
+    writer.snapshot("/nonexistent-dir/test.ckpt", network, &optimizer, 21);
+    try {
+        writer.wait();
+        assert(false && "Should throw exception for unwritable path");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Background checkpoint test passed!" << std::endl;
+}
+
+// the checkpoint image with the record of one tensor rewritten, as a file
+void write_patched(const std::string &path, Network &network, const SGD *optimizer, uint32_t layer, uint32_t kind,
+                   void (*patch)(TensorRecord &)) {
+    CheckpointImage image;
+    image.capture(network, optimizer, 0);
+    std::vector<uint8_t> bytes(image.getData(), image.getData() + image.getSize());
+    Checkpoint checkpoint(bytes.data(), bytes.size());
+    size_t at = sizeof(CheckpointHeader) + checkpoint.layers.size() * sizeof(LayerRecord);
+    for (size_t i = 0; i < checkpoint.tensors.size(); i++, at += sizeof(TensorRecord)) {
+        TensorRecord record = checkpoint.tensors[i];
+        if (record.layer == layer && record.kind == kind) {
+            patch(record);
+            memcpy(bytes.data() + at, &record, sizeof(record));
+        }
+    }
+    FILE *file = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+}
+
+// velocity is installed only when SGD can index it like the gradients
+void test_velocity_checks() {
+    Network network({new Linear(6, 5, true, true), new ReLU(), new Linear(5, 3, true, true)});
+    SGD optimizer(0.05, 0.8);
+    train_step(network, optimizer);
+
+    // hyperparameters come back with the velocity
+    save_checkpoint("/tmp/test-velocity.ckpt", network, &optimizer, 3);
+    Network restored({new Linear(6, 5, true, true), new ReLU(), new Linear(5, 3, true, true)});
+    SGD restored_optimizer(0.5, 0.0);
+    load_checkpoint("/tmp/test-velocity.ckpt", restored, &restored_optimizer);
+    assert(restored_optimizer.getLearningRate() == 0.05 && restored_optimizer.getMomentum() == 0.8);
+    // saved without an optimizer: the caller's values are kept
+    save_checkpoint("/tmp/test-velocity.ckpt", network);
+    load_checkpoint("/tmp/test-velocity.ckpt", restored, &restored_optimizer);
+    assert(restored_optimizer.getLearningRate() == 0.05 && restored_optimizer.getVelocity().empty());
+
+    // bias velocity dropped, velocity on one Linear only, weight velocity transposed; the files
+    // hold newer weights than restored
+    train_step(network, optimizer);
+    write_patched("/tmp/test-velocity.ckpt", network, &optimizer, 0, Checkpoint::BIAS_VELOCITY,
+                  [](TensorRecord &record) {record.kind = 99;});
+    write_patched("/tmp/test-velocity-2.ckpt", network, &optimizer, 2, Checkpoint::WEIGHT_VELOCITY,
+                  [](TensorRecord &record) {record.kind = 99;});
+    write_patched("/tmp/test-velocity-3.ckpt", network, &optimizer, 2, Checkpoint::WEIGHT_VELOCITY,
+                  [](TensorRecord &record) {std::swap(record.rows, record.cols);});
+    for (const char *path : {"/tmp/test-velocity.ckpt", "/tmp/test-velocity-2.ckpt", "/tmp/test-velocity-3.ckpt"}) {
+        Matrix before = restored.get_layers()[0]->get_weight()[0];
+        try {
+            load_checkpoint(path, restored, &restored_optimizer);
+            assert(false && "Should throw exception for inconsistent velocity");
+        } catch (const std::runtime_error&) {}
+        // nothing is installed from a rejected file
+        assert(restored.get_layers()[0]->get_weight()[0] == before);
+    }
+    std::cout << "Velocity checks test passed!" << std::endl;
+}
+
+// a tensor record whose size wraps to 0 must not pass the bounds check
+void test_corrupt_record() {
+    Network network({new Linear(6, 5, true, true), new Sigmoid()});
+    CheckpointImage image;
+    image.capture(network, nullptr, 0);
+    std::vector<uint8_t> bytes(image.getData(), image.getData() + image.getSize());
+    Checkpoint valid(bytes.data(), bytes.size());
+    assert(valid.tensors.size() == 2);
+
+    TensorRecord record;
+    size_t at = sizeof(CheckpointHeader) + valid.layers.size() * sizeof(LayerRecord);
+    memcpy(&record, bytes.data() + at, sizeof(record));
+    record.rows = uint64_t(1) << 61;
+    record.cols = 8;
+    memcpy(bytes.data() + at, &record, sizeof(record));
+    try {
+        Checkpoint corrupt(bytes.data(), bytes.size());
+        assert(false && "Should throw exception for an overflowing tensor size");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Corrupt record test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_save_load();
+        test_background_writer();
+        test_corrupt_record();
+        test_velocity_checks();
+        std::cout << "All checkpoint tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "codegen.h"
+#include "network.h"
+#include "linear.h"
+#include "activation.h"
+#include "layer.h"
+#include "matrix.h"
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static bool contains(const std::string &text, const std::string &part) {
+    return text.find(part) != std::string::npos;
+}
+
+void test_header_content() {
+    // 13 outputs leave a padded, odd panel
+    std::vector<Layer*> layers = {new Linear(6, 13, true, true), new ReLU(), new Linear(13, 3, false, true), new Sigmoid()};
+    Network network(layers);
+    std::string header = export_header(network, "tiny");
+
+    assert(contains(header, "namespace tiny {"));
+    assert(contains(header, "constexpr std::size_t INPUT = 6;"));
+    assert(contains(header, "constexpr std::size_t OUTPUT = 3;"));
+    assert(contains(header, "alignas(64) inline constexpr double layer0_weight[96]"));
+    assert(contains(header, "layer0_bias[13]"));
+    assert(!contains(header, "layer2_bias"));
+    assert(contains(header, "detail::linear<6, 13, true>(x, detail::layer0_weight, detail::layer0_bias, a0);"));
+    assert(contains(header, "detail::relu<13>(a0, a0);"));
+    assert(contains(header, "detail::linear<13, 3, false>(a0, detail::layer2_weight, nullptr, y);"));
+    assert(contains(header, "detail::sigmoid<3>(y, y);"));
+    assert(!contains(header, "new ") && !contains(header, "std::vector"));
+    std::cout << "Header content test passed!" << std::endl;
+}
+
+void test_rejects() {
+    std::vector<Layer*> layers = {new Linear(4, 4, true, true)};
+    Network network(layers);
+    bool threw = false;
+    try {
+        export_header(network, "1model");
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    assert(threw);
+    threw = false;
+    try {
+        export_header(network, "namespace");
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    assert(threw);
+
+    // a diverged weight would print as nan, not a literal
+    std::vector<Layer*> diverged = {new ReLU(), new Linear(Matrix(4, 4), Matrix::fillwith(1, 4, NAN))};
+    Network broken(diverged);
+    threw = false;
+    try {
+        export_header(broken, "model");
+    } catch (const std::runtime_error &e) {
+        threw = contains(e.what(), "layer 1 bias");
+    }
+    assert(threw);
+
+    std::vector<Layer*> activations = {new ReLU()};
+    Network empty(activations);
+    threw = false;
+    try {
+        export_header(empty, "model");
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    assert(threw);
+    std::cout << "Rejects test passed!" << std::endl;
+}
+
+// compiles the header into a driver and compares it with Network::predict
+void test_compiled_predict() {
+    if (std::system("c++ --version > /dev/null 2>&1") != 0) {
+        std::cout << "Compiled predict test skipped, no c++ compiler" << std::endl;
+        return;
+    }
+    std::vector<Layer*> layers = {new Linear(20, 17, true, true), new Sigmoid(), new Linear(17, 9, true, true),
+                                  new ReLU(), new Linear(9, 4, true, true)};
+    Network network(layers);
+    const size_t rows = 5;
+    Matrix x(rows, 20);
+    for (size_t i = 0; i < rows * 20; i++) {
+        x.data[i] = std::sin(0.37 * i);
+    }
+    Matrix expected = network.predict(x);
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string header = (dir / "testCodegen_model.h").string();
+    std::string driver = (dir / "testCodegen_driver.cpp").string();
+    std::string binary = (dir / "testCodegen_driver").string();
+    std::string output = (dir / "testCodegen_output.txt").string();
+    export_header(network, "model", header);
+
+    std::ofstream source(driver);
+    source << "#include \"" << header << "\"\n#include <cstdio>\nint main() {\n"
+           << "    static const double x[" << rows * 20 << "] = {";
+    char text[32];
+    for (size_t i = 0; i < rows * 20; i++) {
+        std::snprintf(text, sizeof(text), "%a", x.data[i]);
+        source << (i ? ", " : "") << text;
+    }
+    source << "};\n    double y[" << rows << " * model::OUTPUT];\n"
+           << "    model::predict(x, y, " << rows << ");\n"
+           << "    for (double v : y) std::printf(\"%a\\n\", v);\n}\n";
+    source.close();
+
+    std::string command = "c++ -std=c++17 -O2 -o " + binary + " " + driver + " && " + binary + " > " + output;
+    assert(std::system(command.c_str()) == 0);
+    std::ifstream results(output);
+    std::string line;
+    size_t count = 0;
+    while (std::getline(results, line)) {
+        double value = std::strtod(line.c_str(), nullptr);
+        assert(count < rows * 4);
+        assert(std::fabs(value - expected.data[count]) <= 1e-12 * std::max(1.0, std::fabs(value)));
+        count++;
+    }
+    assert(count == rows * 4);
+    for (const std::string &path : {header, driver, binary, output}) {
+        std::remove(path.c_str());
+    }
+    std::cout << "Compiled predict test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_header_content();
+        test_rejects();
+        test_compiled_predict();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "All codegen tests passed!" << std::endl;
+    return 0;
+}
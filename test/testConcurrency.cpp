@@ -0,0 +1,138 @@
+#include <iostream>
+#include <cmath>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "../function/network.h"
+#include "../function/linear.h"
+#include "../function/activation.h"
+#include "../function/loss.h"
+#include "../function/optimizer.h"
+
+Matrix make_input(size_t rows, size_t cols, double offset) {
+    Matrix x(rows, cols);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) x(i, j) = 0.01 * (i + j) + offset;
+    }
+    return x;
+}
+
+// several threads run inference on one network at the same time
+void test_parallel_predict() {
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    Network network({new Linear(16, 12, true, true), new ReLU(), new Linear(12, 4, true, true), new Sigmoid()});
+    std::vector<Matrix> inputs, expected;
+    for (int t = 0; t < 4; t++) {
+        inputs.push_back(make_input(8, 16, 0.1 * t));
+        expected.push_back(network.forward(inputs[t]));
+    }
+    std::vector<std::thread> threads;
+    std::vector<int> matches(4, 0);
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 50; i++) {
+                matches[t] += network.predict(inputs[t]) == expected[t];
+            }
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+    for (int count : matches) assert(count == 50);
+    std::cout << "Parallel predict test passed!" << std::endl;
+}
+
+// inference threads run while another thread trains the same network
+void test_predict_while_training() {
+    Network network({new Linear(16, 12, true, true), new Sigmoid(), new Linear(12, 4, true, true)});
+    SGD optimizer(0.01, 0.9);
+    CategoricalCrossentropy loss_fn;
+    Matrix x = make_input(8, 16, 0.0);
+    Matrix y(8, 4);
+    for (size_t i = 0; i < 8; i++) y(i, i % 4) = 1.0;
+
+    std::thread trainer([&] {
+        for (int step = 0; step < 50; step++) {
+            Matrix predictions = network.forward(x);
+            loss_fn(predictions, y);
+            optimizer.apply_gradient(network, network.backward(loss_fn.backward()));
+        }
+    });
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&] {
+            for (int i = 0; i < 50; i++) {
+                Matrix out = network.predict(x);
+                assert(out.getRow() == 8 && out.getCol() == 4);
+            }
+        });
+    }
+    trainer.join();
+    for (std::thread &reader : readers) reader.join();
+    assert(optimizer.getVelocity().size() == 3);
+    std::cout << "Predict while training test passed!" << std::endl;
+}
+
+// an ensemble runs side by side, Linear depths as one batched GEMM, while one member trains
+void test_ensemble_predict_batch() {
+    std::vector<Network*> members;
+    for (int i = 0; i < 16; i++) {
+        members.push_back(new Network({new Linear(16, 12, true, true), new ReLU(), new Linear(12, 4, true, true)}));
+    }
+    std::vector<const Network*> ensemble(members.begin(), members.end());
+    Matrix x = make_input(8, 16, 0.0);
+    for (int mode : {Matrix::STANDARD, Matrix::MKL, Matrix::OPENMP}) {
+        Matrix::setMulMode(mode);
+        std::vector<Matrix> shared = Network::predict_batch(ensemble, {x});
+        assert(shared.size() == 16);
+        std::vector<Matrix> inputs;
+        for (int i = 0; i < 16; i++) {
+            inputs.push_back(make_input(3, 16, 0.1 * i));
+        }
+        std::vector<Matrix> separate = Network::predict_batch(ensemble, inputs);
+        for (int i = 0; i < 16; i++) {
+            Matrix expected = members[i]->predict(x);
+            assert(shared[i].getRow() == 8 && shared[i].getCol() == 4);
+            for (size_t j = 0; j < 32; j++) {
+                assert(std::abs(shared[i].data[j] - expected.data[j]) < 1e-12);
+            }
+            Matrix own = members[i]->predict(inputs[i]);
+            for (size_t j = 0; j < 12; j++) {
+                assert(std::abs(separate[i].data[j] - own.data[j]) < 1e-12);
+            }
+        }
+    }
+
+    SGD optimizer(0.01, 0.9);
+    CategoricalCrossentropy loss_fn;
+    Matrix y(8, 4);
+    for (size_t i = 0; i < 8; i++) y(i, i % 4) = 1.0;
+    std::thread trainer([&] {
+        for (int step = 0; step < 20; step++) {
+            Matrix predictions = members[3]->forward(x);
+            loss_fn(predictions, y);
+            optimizer.apply_gradient(*members[3], members[3]->backward(loss_fn.backward()));
+        }
+    });
+    // the same network twice is fine
+    ensemble.push_back(members[0]);
+    for (int i = 0; i < 20; i++) {
+        assert(Network::predict_batch(ensemble, {x}).size() == 17);
+    }
+    trainer.join();
+    for (Network *member : members) {
+        delete member;
+    }
+    std::cout << "Ensemble predict batch test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_parallel_predict();
+        test_predict_while_training();
+        test_ensemble_predict_batch();
+        std::cout << "All concurrency tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
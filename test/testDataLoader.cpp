@@ -0,0 +1,108 @@
+#include <iostream>
+#include <cassert>
+#include <vector>
+#include "../function/dataloader.h"
+
+void test_dataloader_epoch() {
+    // row i holds i in every column, label row holds -i
+    size_t rows = 103, batch_size = 10;
+    Matrix data(rows, 4);
+    Matrix labels(rows, 2);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < 4; j++) data(i, j) = i;
+        for (size_t j = 0; j < 2; j++) labels(i, j) = -double(i);
+    }
+
+    DataLoader loader(data, labels, batch_size, true, 3, 7);
+    assert(loader.num_batches() == 10);
+
+    for (int epoch = 0; epoch < 3; epoch++) {
+        std::vector<int> seen(rows, 0);
+        size_t batches = 0;
+        const Matrix *x, *y;
+        loader.start();
+        while (loader.next(x, y)) {
+            assert(x->getRow() == batch_size && x->getCol() == 4);
+            assert(y->getRow() == batch_size && y->getCol() == 2);
+            for (size_t i = 0; i < batch_size; i++) {
+                size_t idx = (*x)(i, 0);
+                assert((*x)(i, 3) == idx);
+                assert((*y)(i, 1) == -double(idx));
+                seen[idx]++;
+            }
+            batches++;
+        }
+        assert(batches == 10);
+        // every row at most once, the 3 dropped rows never
+        size_t total = 0;
+        for (int count : seen) {
+            assert(count <= 1);
+            total += count;
+        }
+        assert(total == 100);
+    }
+    std::cout << "DataLoader epoch test passed!" << std::endl;
+}
+
+void test_dataloader_restart() {
+    Matrix data = Matrix::fillwith(64, 3, 1.0);
+    Matrix labels = Matrix::fillwith(64, 1, 0.0);
+
+    // sequential order without shuffling
+    for (size_t i = 0; i < 64; i++) data(i, 0) = i;
+    DataLoader loader(data, labels, 8, false);
+    const Matrix *x, *y;
+    loader.start();
+    assert(loader.next(x, y));
+    assert((*x)(0, 0) == 0.0 && (*x)(7, 0) == 7.0);
+    assert(loader.next(x, y));
+    assert((*x)(0, 0) == 8.0);
+
+    // abandon the epoch halfway and restart
+    loader.start();
+    assert(loader.next(x, y));
+    assert((*x)(0, 0) == 0.0);
+
+    try {
+        DataLoader invalid(data, labels, 65);
+        assert(false && "Should throw exception for batch larger than data");
+    } catch (const std::runtime_error&) {}
+    std::cout << "DataLoader restart test passed!" << std::endl;
+}
+
+void test_dataloader_dataset() {
+    // uint8 rows holding their own index, label = index % 4
+    size_t rows = 40;
+    std::vector<uint8_t> features(rows * 3), classes(rows);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < 3; j++) features[i * 3 + j] = i;
+        classes[i] = i % 4;
+    }
+    Dataset dataset(features, classes, rows, 3, 4, 1.0, 0.0);
+    DataLoader loader(dataset, 16, true, 2, 3);
+    assert(loader.num_batches() == 2);
+
+    const Matrix *x, *y;
+    loader.start();
+    while (loader.next(x, y)) {
+        for (size_t i = 0; i < 16; i++) {
+            size_t idx = (*x)(i, 2);
+            assert((*y)(i, idx % 4) == 1.0);
+            assert((*y).slice(i, i + 1).sum() == 1.0);
+        }
+    }
+    std::cout << "DataLoader dataset test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_dataloader_epoch();
+        test_dataloader_restart();
+        test_dataloader_dataset();
+        std::cout << "All dataloader tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include "../function/dataset.h"
+
+// write an IDX file: magic (0, 0, type, ndim), big-endian dims, payload
+void write_idx(const std::string &path, const std::vector<uint32_t> &dims, const std::vector<uint8_t> &payload) {
+    std::ofstream file(path, std::ios::binary);
+    uint8_t magic[4] = {0, 0, 0x08, static_cast<uint8_t>(dims.size())};
+    file.write(reinterpret_cast<char*>(magic), 4);
+    for (uint32_t dim : dims) {
+        uint32_t big = __builtin_bswap32(dim);
+        file.write(reinterpret_cast<char*>(&big), 4);
+    }
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+}
+
+void test_load_idx() {
+    // 3 images of 2x2 pixels, labels 0..2
+    std::vector<uint8_t> pixels = {0, 255, 51, 102,
+                                   255, 255, 0, 0,
+                                   10, 20, 30, 40};
+    write_idx("/tmp/test-images-idx3-ubyte", {3, 2, 2}, pixels);
+    write_idx("/tmp/test-labels-idx1-ubyte", {3}, {2, 0, 1});
+
+    IdxFile images("/tmp/test-images-idx3-ubyte");
+    assert(images.getType() == IdxFile::UINT8);
+    assert(images.getCount() == 3);
+    assert(images.getItemSize() == 4);
+
+    auto [x, y] = load_mnist_data("/tmp/test-images-idx3-ubyte", "/tmp/test-labels-idx1-ubyte", 0);
+    assert(x.getRow() == 3 && x.getCol() == 4);
+    assert(y.getRow() == 3 && y.getCol() == 3);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        assert(std::abs(x.data[i] - (pixels[i] / 255.0 - 0.5)) < 1e-12);
+    }
+    assert(y(0, 2) == 1.0 && y(1, 0) == 1.0 && y(2, 1) == 1.0);
+    assert(y.sum() == 3.0);
+
+    // explicit sample and class count
+    auto [x2, y2] = load_mnist_data("/tmp/test-images-idx3-ubyte", "/tmp/test-labels-idx1-ubyte", 2, 10);
+    assert(x2.getRow() == 2 && y2.getCol() == 10);
+
+    // a subset without the top class keeps the width of the whole file
+    write_idx("/tmp/test-labels-last-idx1-ubyte", {3}, {1, 0, 2});
+    auto [x3, y3] = load_mnist_data("/tmp/test-images-idx3-ubyte", "/tmp/test-labels-last-idx1-ubyte", 2);
+    assert(y3.getRow() == 2 && y3.getCol() == 3);
+    std::cout << "IDX loading test passed!" << std::endl;
+}
+
+void test_invalid_idx() {
+    // more samples than stored
+    try {
+        load_mnist_data("/tmp/test-images-idx3-ubyte", "/tmp/test-labels-idx1-ubyte", 4);
+        assert(false && "Should throw exception for too many samples");
+    } catch (const std::runtime_error&) {}
+
+    // payload shorter than the header claims
+    write_idx("/tmp/test-short-idx3-ubyte", {3, 2, 2}, {1, 2, 3});
+    try {
+        IdxFile images("/tmp/test-short-idx3-ubyte");
+        assert(false && "Should throw exception for truncated data");
+    } catch (const std::runtime_error&) {}
+
+    // dimensions whose product wraps to 0 in 64 bits
+    write_idx("/tmp/test-wrap-idx3-ubyte", {65536, 65536, 65536, 65536, 65536}, {});
+    try {
+        IdxFile images("/tmp/test-wrap-idx3-ubyte");
+        assert(false && "Should throw exception for overflowing dimensions");
+    } catch (const std::runtime_error&) {}
+
+    // label larger than the requested class count
+    try {
+        load_mnist_data("/tmp/test-images-idx3-ubyte", "/tmp/test-labels-idx1-ubyte", 0, 2);
+        assert(false && "Should throw exception for label out of range");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Invalid IDX test passed!" << std::endl;
+}
+
+void test_uint8_dataset() {
+    Dataset data = load_idx_dataset("/tmp/test-images-idx3-ubyte", "/tmp/test-labels-idx1-ubyte");
+    assert(data.size() == 3 && data.getFeatureCount() == 4 && data.getClassCount() == 3);
+
+    // gather rows out of order, converted on the fly
+    size_t rows[2] = {2, 0};
+    double x[8], y[6];
+    data.gather(rows, 2, x, y);
+    assert(std::abs(x[0] - (10 / 255.0 - 0.5)) < 1e-12);
+    assert(std::abs(x[5] - (255 / 255.0 - 0.5)) < 1e-12);
+    assert(y[0] == 0.0 && y[1] == 1.0 && y[2] == 0.0);
+    assert(y[3] == 0.0 && y[4] == 0.0 && y[5] == 1.0);
+
+    // a dense range matches the eager loader
+    auto [x_all, y_all] = data.toMatrix();
+    auto [x_ref, y_ref] = load_mnist_data("/tmp/test-images-idx3-ubyte", "/tmp/test-labels-idx1-ubyte", 0);
+    assert(x_all == x_ref && y_all == y_ref);
+
+    // owned storage with a custom scale and shift
+    Dataset owned(std::vector<uint8_t>{0, 2, 4, 6}, std::vector<uint8_t>{1, 0}, 2, 2, 2, 0.5, 1.0);
+    auto [x_owned, y_owned] = owned.toMatrix(1, 2);
+    assert(x_owned(0, 0) == 3.0 && x_owned(0, 1) == 4.0);
+    assert(y_owned(0, 0) == 1.0);
+    std::cout << "uint8 dataset test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_load_idx();
+        test_invalid_idx();
+        test_uint8_dataset();
+        std::cout << "All dataset tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
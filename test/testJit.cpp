@@ -0,0 +1,129 @@
+#include "jit.h"
+#include "matrix.h"
+#include "fixtures.h"
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+static bool close(const Matrix &a, const Matrix &b) {
+    if (a.row != b.row || a.col != b.col) {
+        return false;
+    }
+    for (size_t i = 0; i < a.row * a.col; i++) {
+        if (std::abs(a.data[i] - b.data[i]) > 1e-12 * (std::abs(b.data[i]) + 1.0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_encoding() {
+    X86Assembler as;
+    as.addpd(0, 1);
+    as.mulsd(15, 8);
+    as.movupd_load(12, X86Assembler::RCX, 16);
+    as.movsd_store(X86Assembler::R10, -8, 3);
+    as.mov(X86Assembler::R9, X86Assembler::RSI);
+    as.add_imm(X86Assembler::RDI, 48);
+    as.dec(X86Assembler::R11);
+    size_t top = as.label();
+    as.jnz(top);
+    as.ret();
+    std::vector<uint8_t> expected = {
+        0x66, 0x0F, 0x58, 0xC1,                                 // addpd xmm0, xmm1
+        0xF2, 0x45, 0x0F, 0x59, 0xF8,                           // mulsd xmm15, xmm8
+        0x66, 0x44, 0x0F, 0x10, 0xA1, 0x10, 0x00, 0x00, 0x00,   // movupd xmm12, [rcx + 16]
+        0xF2, 0x41, 0x0F, 0x11, 0x9A, 0xF8, 0xFF, 0xFF, 0xFF,   // movsd [r10 - 8], xmm3
+        0x49, 0x89, 0xF1,                                       // mov r9, rsi
+        0x48, 0x81, 0xC7, 0x30, 0x00, 0x00, 0x00,               // add rdi, 48
+        0x49, 0xFF, 0xCB,                                       // dec r11
+        0x0F, 0x85, 0xFA, 0xFF, 0xFF, 0xFF,                     // jnz to itself
+        0xC3                                                    // ret
+    };
+    assert(as.bytes() == expected);
+    std::cout << "Encoding test passed!" << std::endl;
+}
+
+void test_shapes() {
+    if (!JitGemm::available()) {
+        std::cout << "Shapes test skipped, no executable memory" << std::endl;
+        return;
+    }
+    std::mt19937 gen(11);
+    // full and edge tiles in both dimensions, k below, at and off the unroll factor,
+    // and the output layer shapes
+    size_t shapes[][3] = {{1, 1, 1}, {6, 4, 4}, {7, 5, 3}, {13, 9, 17}, {64, 784, 128},
+                          {100, 128, 10}, {5, 10, 1}, {37, 2, 63}};
+    for (auto &shape : shapes) {
+        Matrix a = random_matrix(shape[0], shape[1], gen);
+        Matrix b = random_matrix(shape[1], shape[2], gen);
+        Matrix reference = multiply(a, b);
+        assert(close(multiply_jit(a, b), reference));
+        // compiled and accepted, not the fallback
+        assert(JitGemm::instance().kernel({shape[0], shape[2], shape[1], shape[1], shape[2], shape[2], false, false}));
+        // the transposed operands give the same product
+        Matrix at = a.T(), bt = b.T();
+        assert(close(multiply_jit(at, b, true, false), reference));
+        assert(close(multiply_jit(a, bt, false, true), reference));
+        assert(close(multiply_jit(at, bt, true, true), reference));
+    }
+    try {
+        multiply_jit(Matrix(3, 4), Matrix(5, 2));
+        assert(false && "Should throw exception for mismatched dimensions");
+    } catch (const std::runtime_error&) {}
+    // an empty product falls back
+    Matrix empty = multiply_jit(Matrix(0, 3), Matrix(3, 2));
+    assert(empty.row == 0 && empty.col == 2);
+    std::cout << "Shapes test passed!" << std::endl;
+}
+
+void test_cache() {
+    if (!JitGemm::available()) {
+        return;
+    }
+    JitGemm &jit = JitGemm::instance();
+    jit.clear();
+    JitShape shape = {20, 10, 30, 30, 10, 10, false, false};
+    std::shared_ptr<const JitKernel> first = jit.kernel(shape);
+    assert(first && jit.kernel(shape) == first && jit.size() == 1);
+    // another leading dimension is another kernel
+    JitShape strided = shape;
+    strided.lda = 32;
+    assert(jit.kernel(strided) != first && jit.size() == 2);
+    assert(jit.codeBytes() > 0);
+
+    // mat_multiply in JIT mode, from several threads at once
+    std::mt19937 gen(3);
+    Matrix a = random_matrix(50, 33, gen), b = random_matrix(33, 10, gen);
+    Matrix reference = multiply(a, b);
+    int saved = Matrix::mulMode;
+    Matrix::setMulMode(Matrix::JIT);
+    std::vector<std::thread> threads;
+    bool ok[4];
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {ok[t] = close(mat_multiply(a, b), reference);});
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    Matrix::setMulMode(saved);
+    assert(ok[0] && ok[1] && ok[2] && ok[3]);
+    assert(std::string(mul_mode_name(Matrix::JIT)) == "jit");
+    std::cout << "Cache test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_encoding();
+        test_shapes();
+        test_cache();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "All JIT tests passed!" << std::endl;
+    return 0;
+}
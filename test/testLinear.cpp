@@ -198,9 +198,30 @@ void test_linear_layer() {
     std::cout << "Difference: " << std::abs(numerical_grad - analytical_grad) << std::endl;
 }
 
+void test_linear_small_batch() {
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    Linear layer(20, 13, true);
+    Matrix batch(16, 20);
+    for (size_t i = 0; i < batch.getRow() * batch.getCol(); i++) {
+        batch.data[i] = 0.01 * (i % 37) - 0.2;
+    }
+    // rows of one and a few go through the packed small-M kernel, 16 through mat_multiply
+    for (int update = 0; update < 2; update++) {
+        Matrix full = layer.forward(batch);
+        for (size_t rows : {1, 3, 8}) {
+            Matrix part = layer.forward(batch.slice(0, rows));
+            assert(part == full.slice(0, rows));
+        }
+        // the packed weight follows the update
+        layer.apply_gradient({Matrix::fillwith(20, 13, 0.05), Matrix::fillwith(1, 13, 0.1)});
+    }
+    std::cout << "Linear small batch test passed!" << std::endl;
+}
+
 int main() {
     try {
         test_linear_initialization();
+        test_linear_small_batch();
         verify_linear_layer_correctness();
         test_linear_layer();
         std::cout << "All tests passed!" << std::endl;
@@ -2,6 +2,9 @@
 #include <iostream>
 #include <cassert>
 #include <cmath>
+#include <vector>
+#include <random>
+#include <cstdint>
 
 void test_matrix() {
     // Test Constructor
@@ -225,6 +228,226 @@ void test_matrix_edge_cases() {
     // } catch (const std::runtime_error&) {}
 }
 
+void test_matrix_reductions() {
+    // 2 x 3: [1 5 3; 4 2 6]
+    Matrix mat(2, 3);
+    mat(0, 0) = 1.0; mat(0, 1) = 5.0; mat(0, 2) = 3.0;
+    mat(1, 0) = 4.0; mat(1, 1) = 2.0; mat(1, 2) = 6.0;
+    assert(mat.sum() == 21.0);
+    assert(mat.mean() == 3.5);
+    assert(mat.max() == 6.0);
+
+    Matrix col_sum = mat.sum(0);
+    assert(col_sum.row == 1 && col_sum.col == 3);
+    assert(col_sum(0, 0) == 5.0 && col_sum(0, 1) == 7.0 && col_sum(0, 2) == 9.0);
+    Matrix row_sum = mat.sum(1);
+    assert(row_sum.row == 2 && row_sum.col == 1);
+    assert(row_sum(0, 0) == 9.0 && row_sum(1, 0) == 12.0);
+    Matrix col_mean = mat.mean(0);
+    assert(col_mean(0, 0) == 2.5 && col_mean(0, 2) == 4.5);
+    Matrix row_mean = mat.mean(1);
+    assert(row_mean(0, 0) == 3.0 && row_mean(1, 0) == 4.0);
+    Matrix col_max = mat.max(0);
+    assert(col_max(0, 0) == 4.0 && col_max(0, 1) == 5.0 && col_max(0, 2) == 6.0);
+    Matrix row_max = mat.max(1);
+    assert(row_max(0, 0) == 5.0 && row_max(1, 0) == 6.0);
+    assert((mat.argmax(0) == std::vector<size_t>{1, 0, 1}));
+    assert((mat.argmax(1) == std::vector<size_t>{1, 2}));
+
+    // ties resolve to the first index
+    Matrix ties = Matrix::fillwith(3, 4, 7.0);
+    assert((ties.argmax(0) == std::vector<size_t>(4, 0)));
+    assert((ties.argmax(1) == std::vector<size_t>(3, 0)));
+
+    // large shapes take the blocked and threaded paths, checked against a long double reference
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    size_t rows = 1000, cols = 300;
+    Matrix big(rows, cols);
+    for (size_t i = 0; i < rows * cols; i++) {
+        big.data[i] = dist(gen);
+    }
+    big(617, 123) = 5.0;
+    long double total = 0;
+    std::vector<long double> cols_ref(cols, 0), rows_ref(rows, 0);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) {
+            total += big(i, j);
+            cols_ref[j] += big(i, j);
+            rows_ref[i] += big(i, j);
+        }
+    }
+    assert(std::abs(big.sum() - (double)total) < 1e-10);
+    Matrix big_cols = big.sum(0), big_rows = big.sum(1);
+    for (size_t j = 0; j < cols; j++) {
+        assert(std::abs(big_cols(0, j) - (double)cols_ref[j]) < 1e-12);
+    }
+    for (size_t i = 0; i < rows; i++) {
+        assert(std::abs(big_rows(i, 0) - (double)rows_ref[i]) < 1e-12);
+    }
+    assert(big.max() == 5.0);
+    assert(big.max(0)(0, 123) == 5.0 && big.argmax(0)[123] == 617);
+    assert(big.max(1)(617, 0) == 5.0 && big.argmax(1)[617] == 123);
+
+    // summing many equal values stays exact where a running sum drifts
+    Matrix tenths = Matrix::fillwith(1 << 20, 1, 0.1);
+    assert(std::abs(tenths.sum() - 0.1 * (1 << 20)) < 1e-9);
+    assert(std::abs(tenths.sum(0)(0, 0) - 0.1 * (1 << 20)) < 1e-9);
+
+    // invalid axes and empty reductions
+    try {
+        mat.sum(2);
+        assert(false && "Should throw exception for invalid axis");
+    } catch (const std::runtime_error&) {}
+    try {
+        Matrix(0, 3).max(0);
+        assert(false && "Should throw exception for empty axis");
+    } catch (const std::runtime_error&) {}
+    Matrix empty_sum = Matrix(0, 3).sum(0);
+    assert(empty_sum.row == 1 && empty_sum.col == 3 && empty_sum(0, 1) == 0.0);
+    std::cout << "Matrix reductions test passed!" << std::endl;
+}
+
+void test_small_multiply() {
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    // every row count of the small path, panel-aligned and ragged widths
+    for (size_t m = 1; m <= SMALL_GEMM_ROWS; m++) {
+        for (size_t n : {1, 8, 13, 40}) {
+            size_t k = 37;
+            Matrix a(m, k), b(k, n), bias(1, n);
+            for (size_t i = 0; i < m * k; i++) a.data[i] = dist(gen);
+            for (size_t i = 0; i < k * n; i++) b.data[i] = dist(gen);
+            for (size_t i = 0; i < n; i++) bias.data[i] = dist(gen);
+            Matrix reference = multiply(a, b);
+            // same order of summation as the naive kernel
+            assert(multiply_small(a, b) == reference);
+            PackedPanels packed = pack_panels(b);
+            assert(multiply_small(a, packed) == reference);
+            assert(multiply_small(a, packed, &bias) == reference + bias);
+        }
+    }
+    // mat_multiply picks the small path in every mode
+    Matrix row = Matrix::fillwith(1, 300, 0.5);
+    Matrix weight = Matrix::fillwith(300, 20, 2.0);
+    int saved = Matrix::mulMode;
+    for (int mode : {Matrix::STANDARD, Matrix::TILE, Matrix::THREAD, Matrix::CUDA}) {
+        Matrix::setMulMode(mode);
+        Matrix result = mat_multiply(row, weight);
+        assert(result.row == 1 && result.col == 20 && result(0, 7) == 300.0);
+    }
+    Matrix::setMulMode(saved);
+    try {
+        multiply_small(Matrix(9, 3), Matrix(3, 3));
+        assert(false && "Should throw exception for more than 8 rows");
+    } catch (const std::runtime_error&) {}
+    try {
+        multiply_small(Matrix(2, 3), Matrix(4, 3));
+        assert(false && "Should throw exception for mismatched dimensions");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Small multiply test passed!" << std::endl;
+}
+
+void test_batch_multiply() {
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    auto random = [&](size_t r, size_t c) {
+        Matrix mat(r, c);
+        for (size_t i = 0; i < r * c; i++) mat.data[i] = dist(gen);
+        return mat;
+    };
+    // varying shapes, runs of equal shapes form MKL groups, one empty product
+    std::vector<Matrix> left, right;
+    size_t shapes[][3] = {{3, 4, 5}, {3, 4, 5}, {20, 7, 9}, {1, 30, 2}, {0, 3, 4}, {12, 12, 12}};
+    for (auto &shape : shapes) {
+        left.push_back(random(shape[0], shape[1]));
+        right.push_back(random(shape[1], shape[2]));
+    }
+    int saved = Matrix::mulMode;
+    for (int mode : {Matrix::STANDARD, Matrix::MKL, Matrix::OPENMP, Matrix::AUTO}) {
+        Matrix::setMulMode(mode);
+        std::vector<Matrix> results = multiply_batch(left, right);
+        assert(results.size() == left.size());
+        for (size_t i = 0; i < left.size(); i++) {
+            Matrix reference = multiply(left[i], right[i]);
+            assert(results[i].row == reference.row && results[i].col == reference.col);
+            for (size_t j = 0; j < reference.row * reference.col; j++) {
+                assert(std::abs(results[i].data[j] - reference.data[j]) < 1e-12);
+            }
+        }
+        // one input shared by 64 small models
+        Matrix x = random(4, 10);
+        std::vector<Matrix> weights;
+        for (int i = 0; i < 64; i++) weights.push_back(random(10, 3));
+        std::vector<Matrix> heads = multiply_batch({x}, weights);
+        assert(heads.size() == 64 && std::abs(heads[63](3, 2) - multiply(x, weights[63])(3, 2)) < 1e-12);
+
+        // strided: 5 blocks of 2 x 6 times 5 blocks of 6 x 3, and a shared right operand
+        Matrix a = random(10, 6), b = random(30, 3), shared = random(6, 3);
+        Matrix stacked = multiply_batch_strided(a, b, 5);
+        Matrix stacked_shared = multiply_batch_strided(a, shared, 5, false, true);
+        assert(stacked.row == 10 && stacked.col == 3);
+        for (size_t block = 0; block < 5; block++) {
+            Matrix expected = multiply(a.slice(2 * block, 2 * block + 2), b.slice(6 * block, 6 * block + 6));
+            Matrix expected_shared = multiply(a.slice(2 * block, 2 * block + 2), shared);
+            for (size_t j = 0; j < 6; j++) {
+                assert(std::abs(stacked.data[6 * block + j] - expected.data[j]) < 1e-12);
+                assert(std::abs(stacked_shared.data[6 * block + j] - expected_shared.data[j]) < 1e-12);
+            }
+        }
+    }
+    Matrix::setMulMode(saved);
+    try {
+        multiply_batch({Matrix(2, 3), Matrix(2, 3)}, {Matrix(3, 2), Matrix(4, 2)});
+        assert(false && "Should throw exception for mismatched dimensions");
+    } catch (const std::runtime_error&) {}
+    try {
+        multiply_batch({Matrix(2, 3), Matrix(2, 3)}, {Matrix(3, 2), Matrix(3, 2), Matrix(3, 2)});
+        assert(false && "Should throw exception for mismatched list lengths");
+    } catch (const std::runtime_error&) {}
+    try {
+        multiply_batch_strided(Matrix(10, 6), Matrix(18, 3), 4);
+        assert(false && "Should throw exception for rows not divisible by the batch");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Batch multiply test passed!" << std::endl;
+}
+
+void test_alloc_policy() {
+    Matrix::AllocPolicy saved = Matrix::getAllocPolicy();
+    assert(!saved.parallelTouch && !saved.interleave && saved.hugePages == Matrix::HUGE_NONE);
+    for (Matrix::HugePages huge : {Matrix::HUGE_NONE, Matrix::HUGE_TRANSPARENT, Matrix::HUGE_EXPLICIT}) {
+        // everything from 4KB on takes the mapped path
+        Matrix::setAllocPolicy({true, true, huge, 4096});
+        Matrix big(300, 200);
+        Matrix small(3, 4);
+        assert(reinterpret_cast<uintptr_t>(big.data) % 64 == 0 && reinterpret_cast<uintptr_t>(small.data) % 64 == 0);
+        // transparent huge pages start on a 2MB boundary, the header comes first
+        if (huge == Matrix::HUGE_TRANSPARENT) {
+            assert((reinterpret_cast<uintptr_t>(big.data) - 64) % (1 << 21) == 0);
+        }
+        assert(big.sum() == 0.0 && big(299, 199) == 0.0);
+        for (size_t i = 0; i < 300 * 200; i++) {
+            big.data[i] = double(i);
+        }
+        Matrix copy(big);
+        Matrix assigned;
+        assigned = big;
+        Matrix moved(std::move(copy));
+        assert(moved == big && assigned == big && moved(299, 199) == 59999.0);
+        std::vector<float> values(100 * 100, 1.5f);
+        Matrix converted(values.data(), 100, 100);
+        assert(converted.sum() == 15000.0);
+        Matrix product = big + big;
+        assert(product(1, 2) == 404.0);
+    }
+    Matrix::setAllocPolicy(saved);
+    try {
+        Matrix::setAllocPolicy({false, false, Matrix::HugePages(3), 0});
+        assert(false && "Should throw exception for an invalid huge page mode");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Allocation policy test passed!" << std::endl;
+}
+
 int main() {
     try {
         test_matrix();
@@ -238,5 +461,29 @@ int main() {
         std::cerr << "Test failed: " << e.what() << std::endl;
         return 1;
     }
+    try {
+        test_matrix_reductions();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    try {
+        test_small_multiply();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    try {
+        test_batch_multiply();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    try {
+        test_alloc_policy();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <cassert>
+#include <vector>
+#include "../function/model.h"
+
+void test_mapped_model() {
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    Network network({new Linear(8, 6, true, true), new ReLU(), new Linear(6, 4, false, true), new Sigmoid()});
+    save_checkpoint("/tmp/test-serving.model", network);
+
+    MappedModel model("/tmp/test-serving.model");
+    assert(model.getNetwork().get_layers().size() == 4);
+
+    // parameters are views into the mapping, not copies
+    Linear *first = dynamic_cast<Linear*>(model.getNetwork().get_layers()[0]);
+    const uint8_t *begin = reinterpret_cast<const uint8_t*>(first->getWeight().getData());
+    assert(first->getWeight().isView() && first->getBias().isView());
+    assert(!first->getTrainableVar());
+    assert(reinterpret_cast<uintptr_t>(begin) % 64 == 0);
+    assert(first->getWeight() == dynamic_cast<Linear*>(network.get_layers()[0])->getWeight());
+
+    Matrix input(5, 8);
+    for (size_t i = 0; i < 5; i++) {
+        for (size_t j = 0; j < 8; j++) input(i, j) = 0.05 * i - 0.02 * j;
+    }
+    assert(model.forward(input) == network.forward(input));
+
+    // a copy of a view owns its memory
+    Matrix copy = first->getWeight();
+    assert(!copy.isView());
+    copy(0, 0) += 1.0;
+    assert(!(copy == first->getWeight()));
+    assert(first->getWeight().isReadOnly() && !copy.isReadOnly());
+
+    // the mapping is PROT_READ, in-place updates are refused instead of faulting
+    Matrix gradient(8, 6);
+    try {
+        first->apply_gradient({gradient, Matrix(1, 6)});
+        assert(false && "Should throw exception for a read-only weight");
+    } catch (const std::runtime_error&) {}
+    try {
+        Matrix weight = Matrix::view(first->getWeight().getData(), 8, 6, true);
+        weight -= gradient;
+        assert(false && "Should throw exception for an in-place op on a read-only view");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Mapped model test passed!" << std::endl;
+}
+
+void test_invalid_model() {
+    Network network({new Linear(3, 2, true, true)});
+    SGD optimizer(0.1, 0.9);
+    save_checkpoint("/tmp/test-serving.model", network, &optimizer);
+    // a training checkpoint also serves, the velocity is ignored
+    MappedModel model("/tmp/test-serving.model");
+    assert(model.getNetwork().get_layers().size() == 1);
+    try {
+        MappedModel missing("/tmp/does-not-exist.model");
+        assert(false && "Should throw exception for a missing file");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Invalid model test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_mapped_model();
+        test_invalid_model();
+        std::cout << "All model tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
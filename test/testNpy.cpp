@@ -0,0 +1,103 @@
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include "../function/npy.h"
+#include "fixtures.h"
+
+void test_npy_file() {
+    std::vector<float> values = {0.5f, -1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+    write_npy("/tmp/test-matrix.npy", "<f4", "(2, 3)", values.data(), values.size() * sizeof(float));
+
+    NpyFile file("/tmp/test-matrix.npy");
+    assert(file.getCount() == 2 && file.getItemSize() == 3);
+    assert(file.getHeader().kind == 'f' && file.getHeader().itemSize == 4);
+
+    Matrix m = load_npy_matrix("/tmp/test-matrix.npy", 2.0, 1.0);
+    assert(m.getRow() == 2 && m.getCol() == 3);
+    for (size_t i = 0; i < values.size(); i++) {
+        assert(std::abs(m.data[i] - (values[i] * 2.0 + 1.0)) < 1e-12);
+    }
+
+    // data shorter than the shape
+    write_npy("/tmp/test-short.npy", "<f8", "(4, 4)", values.data(), values.size() * sizeof(float));
+    try {
+        NpyFile short_file("/tmp/test-short.npy");
+        assert(false && "Should throw exception for truncated data");
+    } catch (const std::runtime_error&) {}
+
+    // a shape whose product wraps to 0 in 64 bits
+    write_npy("/tmp/test-wrap.npy", "|u1", "(65536, 65536, 65536, 65536)", values.data(), 4);
+    try {
+        NpyFile wrap_file("/tmp/test-wrap.npy");
+        assert(false && "Should throw exception for an overflowing shape");
+    } catch (const std::runtime_error&) {}
+    std::cout << "NpyFile test passed!" << std::endl;
+}
+
+void test_npy_dataset() {
+    std::vector<uint8_t> x(30 * 4);
+    std::vector<uint8_t> y8(30);
+    std::vector<int64_t> y64(30);
+    for (size_t i = 0; i < 30; i++) {
+        for (size_t j = 0; j < 4; j++) x[i * 4 + j] = i * 8 + j;
+        y8[i] = y64[i] = i % 5;
+    }
+    write_npy("/tmp/test-x.npy", "|u1", "(30, 2, 2)", x.data(), x.size());
+    write_npy("/tmp/test-y8.npy", "|u1", "(30,)", y8.data(), y8.size());
+    write_npy("/tmp/test-y64.npy", "<i8", "(30,)", y64.data(), y64.size() * sizeof(int64_t));
+
+    // uint8 features and labels are used inside the mapping
+    Dataset mapped = load_npy_dataset("/tmp/test-x.npy", "/tmp/test-y8.npy");
+    assert(mapped.size() == 30 && mapped.getFeatureCount() == 4 && mapped.getClassCount() == 5);
+    assert(mapped.getFeatures()[4 * 7 + 3] == 7 * 8 + 3);
+
+    // int64 labels are narrowed, num_samples and num_classes honoured
+    Dataset narrowed = load_npy_dataset("/tmp/test-x.npy", "/tmp/test-y64.npy", 20, 6);
+    assert(narrowed.size() == 20 && narrowed.getClassCount() == 6);
+    for (size_t i = 0; i < 20; i++) assert(narrowed.getLabels()[i] == i % 5);
+
+    // a subset without the top class keeps the class count of the whole file
+    assert(load_npy_dataset("/tmp/test-x.npy", "/tmp/test-y8.npy", 4).getClassCount() == 5);
+    assert(load_npy_dataset("/tmp/test-x.npy", "/tmp/test-y64.npy", 4).getClassCount() == 5);
+
+    auto [data, labels] = load_npy_data("/tmp/test-x.npy", "/tmp/test-y64.npy", 0, 5);
+    assert(data.getRow() == 30 && data.getCol() == 4 && labels.getCol() == 5);
+    assert(std::abs(data(3, 1) - ((3 * 8 + 1) / 255.0 - 0.5)) < 1e-12);
+    assert(labels(3, 3) == 1.0 && labels(3, 0) == 0.0);
+
+    // labels that do not fit uint8
+    y64[2] = 300;
+    write_npy("/tmp/test-y64.npy", "<i8", "(30,)", y64.data(), y64.size() * sizeof(int64_t));
+    try {
+        load_npy_dataset("/tmp/test-x.npy", "/tmp/test-y64.npy");
+        assert(false && "Should throw exception for label out of range");
+    } catch (const std::runtime_error&) {}
+
+    // float features: whole values are narrowed, NaN and fractions refused
+    std::vector<double> xf(x.begin(), x.end());
+    write_npy("/tmp/test-xf.npy", "<f8", "(30, 4)", xf.data(), xf.size() * sizeof(double));
+    assert(load_npy_dataset("/tmp/test-xf.npy", "/tmp/test-y8.npy").getFeatures()[4 * 7 + 3] == 7 * 8 + 3);
+    for (double bad : {0.5, std::nan("")}) {
+        xf[9] = bad;
+        write_npy("/tmp/test-xf.npy", "<f8", "(30, 4)", xf.data(), xf.size() * sizeof(double));
+        try {
+            load_npy_dataset("/tmp/test-xf.npy", "/tmp/test-y8.npy");
+            assert(false && "Should throw exception for a non-integral feature");
+        } catch (const std::runtime_error&) {}
+    }
+    std::cout << "npy dataset test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_npy_file();
+        test_npy_dataset();
+        std::cout << "All npy tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
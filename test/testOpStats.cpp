@@ -0,0 +1,163 @@
+#include "opstats.h"
+#include "network.h"
+#include "linear.h"
+#include "activation.h"
+#include "loss.h"
+#include "optimizer.h"
+#include "matrix.h"
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const OpTotals *find(const std::vector<OpTotals> &totals, const std::string &context,
+                            const std::string &op, int64_t d0, int64_t d1, int64_t d2 = -1) {
+    for (const OpTotals &t : totals) {
+        if (t.context == context && t.op == op && t.dims[0] == d0 && t.dims[1] == d1 && t.dims[2] == d2) {
+            return &t;
+        }
+    }
+    return nullptr;
+}
+
+void test_disabled() {
+    OpStats::disable();
+    OpStats::clear();
+    Matrix a = Matrix::fillwith(4, 4, 1.0);
+    Matrix b = a + a;
+    assert(OpStats::totals().empty());
+    std::cout << "Disabled test passed!" << std::endl;
+}
+
+void test_counts() {
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    Matrix a = Matrix::fillwith(8, 4, 1.0);
+    Matrix b = Matrix::fillwith(4, 3, 2.0);
+    OpStats::clear();
+    OpStats::enable();
+    Matrix c = mat_multiply(a, b);
+    Matrix d = c + c;
+    d += 1.0;
+    Matrix e = d.T();
+    Matrix f(e);
+    double total = f.sum();
+    Matrix columns = d.sum(0);
+    OpStats::disable();
+    assert(total == 8 * 3 * 17.0 && columns(0, 0) == 8 * 17.0);
+
+    std::vector<OpTotals> totals = OpStats::totals();
+    const OpTotals *gemm = find(totals, "", "gemm small", 8, 3, 4);
+    assert(gemm && gemm->calls == 1 && gemm->flops == 2.0 * 8 * 3 * 4);
+    assert(gemm->bytesRead == 8.0 * (8 * 4 + 4 * 3) && gemm->bytesWritten == 8.0 * 8 * 3);
+    const OpTotals *add = find(totals, "", "+", 8, 3);
+    assert(add && add->flops == 24 && add->bytesRead == 8.0 * 48 && add->opClass == OP_ELEMENTWISE);
+    assert(find(totals, "", "+= scalar", 8, 3));
+    const OpTotals *transpose = find(totals, "", "transpose", 8, 3);
+    assert(transpose && transpose->opClass == OP_TRANSPOSE && transpose->flops == 0);
+    const OpTotals *copy = find(totals, "", "copy", 3, 8);
+    assert(copy && copy->opClass == OP_COPY && copy->bytesWritten == 8.0 * 24);
+    assert(find(totals, "", "sum", 3, 8) && find(totals, "", "sum axis 0", 8, 3));
+
+    std::vector<OpTotals> classes = OpStats::classes();
+    assert(classes.size() == OP_CLASS_COUNT);
+    assert(classes[OP_GEMM].flops == 2.0 * 8 * 3 * 4);
+    assert(classes[OP_REDUCTION].calls == 2);
+    std::cout << "Count test passed!" << std::endl;
+}
+
+void test_training_contexts() {
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    std::vector<Layer*> layers = {new Linear(4, 5, true, true), new ReLU(), new Linear(5, 3, true, true)};
+    Network network(layers);
+    CategoricalCrossentropy loss;
+    SGD optimizer(0.01, 0.9);
+    Matrix x = Matrix::fillwith(8, 4, 0.5);
+    Matrix y = Matrix::zeros(8, 3);
+    for (size_t i = 0; i < 8; i++) {
+        y(i, i % 3) = 1.0;
+    }
+
+    OpStats::clear();
+    OpStats::enable();
+    for (int step = 0; step < 2; step++) {
+        Matrix predictions = network.forward(x);
+        loss(predictions, y);
+        optimizer.apply_gradient(network, network.backward(loss.backward()));
+    }
+    OpStats::disable();
+
+    std::vector<OpTotals> totals = OpStats::totals();
+    // every layer copies its input, twice
+    const OpTotals *input_copy = find(totals, "Layer::operator()", "copy assign", 8, 4);
+    assert(input_copy && input_copy->calls == 2);
+    assert(find(totals, "forward", "gemm small", 8, 5, 4));
+    assert(find(totals, "backward", "gemm small", 4, 5, 8));
+    // the velocity is copied from the gradients, the weights are the largest tensors
+    assert(find(totals, "SGD::process_gradient", "* scalar", 4, 5));
+    assert(find(totals, "SGD::process_gradient", "copy", 4, 5));
+    bool loss_ops = false;
+    for (const OpTotals &t : totals) {
+        loss_ops = loss_ops || t.context == "loss";
+    }
+    assert(loss_ops);
+
+    std::string report = OpStats::report(2);
+    assert(report.find("per step") != std::string::npos);
+    assert(report.find("SGD::process_gradient") != std::string::npos);
+    assert(report.find("elementwise") != std::string::npos);
+    std::cout << report;
+    std::cout << "Training contexts test passed!" << std::endl;
+}
+
+void test_threads() {
+    OpStats::clear();
+    OpStats::enable();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([] {
+            OpContext context("worker");
+            Matrix a = Matrix::ones(2, 2);
+            for (int i = 0; i < 100; i++) {
+                a += a;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    OpStats::disable();
+    const OpTotals *add = find(OpStats::totals(), "worker", "+=", 2, 2);
+    assert(add && add->calls == 400 && add->flops == 1600);
+    // the context is per thread
+    assert(std::string(OpStats::getContext()).empty());
+
+    // tables of exited threads are reused, their totals kept
+    size_t tables = OpStats::tables();
+    OpStats::enable();
+    for (int t = 0; t < 20; t++) {
+        std::thread([] {
+            OpContext context("churn");
+            Matrix a = Matrix::ones(2, 2);
+            a += a;
+        }).join();
+    }
+    OpStats::disable();
+    add = find(OpStats::totals(), "churn", "+=", 2, 2);
+    assert(add && add->calls == 20 && OpStats::tables() == tables);
+    std::cout << "Threads test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_disabled();
+        test_counts();
+        test_training_contexts();
+        test_threads();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "All op accounting tests passed!" << std::endl;
+    return 0;
+}
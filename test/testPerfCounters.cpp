@@ -0,0 +1,74 @@
+#include "perfcounters.h"
+#include "matrix.h"
+#include <iostream>
+#include <cassert>
+#include <cstring>
+
+void test_sample() {
+    PerfSample empty;
+    assert(empty.ipc() == 0.0);
+    assert(empty.per_kilo_instruction(PERF_LLC_MISSES) == 0.0);
+
+    PerfSample sample;
+    sample.values[PERF_CYCLES] = 200;
+    sample.values[PERF_INSTRUCTIONS] = 400;
+    sample.values[PERF_LLC_MISSES] = 2;
+    sample.valid[PERF_CYCLES] = sample.valid[PERF_INSTRUCTIONS] = sample.valid[PERF_LLC_MISSES] = true;
+    assert(sample.ipc() == 2.0);
+    assert(sample.per_kilo_instruction(PERF_LLC_MISSES) == 5.0);
+    // an unavailable counter is not a zero count
+    assert(sample.per_kilo_instruction(PERF_DTLB_MISSES) == 0.0);
+
+    empty += sample;
+    assert(empty.values[PERF_INSTRUCTIONS] == 400 && empty.valid[PERF_INSTRUCTIONS]);
+    assert(!empty.valid[PERF_L1D_MISSES]);
+    assert(std::strcmp(PerfCounters::name(PERF_DTLB_MISSES), "dtlb_misses") == 0);
+    std::cout << "Sample test passed!" << std::endl;
+}
+
+void test_counters() {
+    PerfCounters counters;
+    if (!counters.available()) {
+        std::cout << "counters unavailable (" << counters.getError() << ")" << std::endl;
+    }
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    Matrix a = Matrix::fillwith(64, 64, 1.0);
+    PerfSample outer;
+    PerfSample inner;
+    {
+        PerfScope scope(counters, outer);
+        Matrix b = mat_multiply(a, a);
+        {
+            PerfScope nested(counters, inner);
+            b = mat_multiply(b, a);
+        }
+        assert(b(0, 0) == 64.0 * 64.0);
+    }
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        // unavailable counters read as invalid zeros, available ones nest
+        assert(outer.valid[i] == counters.available(i) || !outer.valid[i]);
+        if (!outer.valid[i]) {
+            assert(outer.values[i] == 0);
+            continue;
+        }
+        std::cout << PerfCounters::name(i) << ": " << outer.values[i] << std::endl;
+        assert(!inner.valid[i] || inner.values[i] <= outer.values[i]);
+    }
+    if (outer.valid[PERF_INSTRUCTIONS]) {
+        // two 64^3 products at least
+        assert(outer.values[PERF_INSTRUCTIONS] > inner.values[PERF_INSTRUCTIONS]);
+    }
+    std::cout << "Counters test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_sample();
+        test_counters();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "All perf counter tests passed!" << std::endl;
+    return 0;
+}
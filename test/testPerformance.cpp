@@ -1,146 +1,310 @@
+// GEMM benchmark: every backend on a sweep of shapes, including the ones our Linear
+// layers produce, with warm-up, repeated runs, a correctness check against the naive
+// kernel, GFLOPS and percent of the estimated machine peak (physical cores x nominal
+// clock x FMA flops per cycle, the clock source is in the JSON); --counters adds IPC and
+// cache / TLB misses per 1000 instructions from the hardware counters when available
+//
+// ./testperformance [--shapes 64x64x64,...] [--layers 784,128,10] [--batch 256] [--no-linear]
+//                   [--backends standard,mkl,tile16,...] [--warmup 2] [--repeats 10]
+//                   [--threads N] [--tolerance 1e-9] [--standard-limit 2] [--peak GFLOPS]
+//                   [--counters] [--json out.json] [--csv out.csv]
+// shapes are MxKxN: (M x K) * (K x N), "-" writes JSON or CSV to stdout
 #include "../function/matrix.h"
+#include "fixtures.h"
+#include "../function/autotune.h"
+#include "../function/jit.h"
+#include "benchmark.h"
 #include <iostream>
 #include <chrono>
 #include <vector>
+#include <tuple>
+#include <random>
+#include <cstdio>
 #include <iomanip>
+#include <memory>
+#include <cuda_runtime.h>
 
-template<typename Func>
-double measureTime(Func&& func) {
-    auto start = std::chrono::high_resolution_clock::now();
-    func();
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> duration = end - start;
-    return duration.count();
+struct Shape {
+    std::string label;
+    size_t m;
+    size_t k;
+    size_t n;
+};
+
+struct Backend {
+    std::string name;
+    GemmConfig config;      // mode AUTO goes through the autotuner
+    bool available;
+};
+
+struct GemmResult {
+    Shape shape;
+    std::string backend;
+    std::string status;     // ok, wrong, skipped, unavailable or the error message
+    TimingStats stats;
+    double gflops;
+    double peakPercent;
+    double error;           // max abs difference relative to the largest reference entry
+    PerfSample counters;    // summed over the timed runs
+};
+
+static double relative_error(const Matrix &result, const Matrix &reference) {
+    if (result.row != reference.row || result.col != reference.col) {
+        return INFINITY;
+    }
+    double scale = 1.0, error = 0.0;
+    for (size_t i = 0; i < reference.row * reference.col; i++) {
+        scale = std::max(scale, std::abs(reference.data[i]));
+        double diff = std::abs(result.data[i] - reference.data[i]);
+        // NaN compares false
+        error = diff <= error ? error : diff;
+    }
+    return error / scale;
 }
 
-Matrix createRandomMatrix(size_t rows, size_t cols) {
-    Matrix m(rows, cols);
-    for (size_t i = 0; i < rows; i++) {
-        for (size_t j = 0; j < cols; j++) {
-            m(i, j) = static_cast<double>(rand()) / RAND_MAX;
-        }
+static Shape parse_shape(const std::string &text) {
+    Shape shape = {text, 0, 0, 0};
+    if (std::sscanf(text.c_str(), "%zux%zux%zu", &shape.m, &shape.k, &shape.n) != 3
+        || shape.m == 0 || shape.k == 0 || shape.n == 0) {
+        throw std::runtime_error("invalid shape " + text + ", expected MxKxN");
     }
-    return m;
+    return shape;
 }
 
-bool matricesEqual(const Matrix& a, const Matrix& b, double tolerance = 1e-6) {
-    if (a.getRow() != b.getRow() || a.getCol() != b.getCol()) {
-        return false;
+// the three GEMMs of every Linear layer: forward, weight gradient, input gradient
+static std::vector<Shape> linear_shapes(const std::vector<size_t> &widths, size_t batch) {
+    std::vector<Shape> shapes;
+    for (size_t i = 0; i + 1 < widths.size(); i++) {
+        size_t in = widths[i], out = widths[i + 1];
+        std::string layer = "linear" + std::to_string(in) + "-" + std::to_string(out);
+        shapes.push_back({layer + " fwd", batch, in, out});
+        shapes.push_back({layer + " dW", in, batch, out});
+        shapes.push_back({layer + " dX", batch, out, in});
+    }
+    return shapes;
+}
+
+static std::vector<Backend> all_backends(int threads) {
+    int device_count = 0;
+    bool cuda = cudaGetDeviceCount(&device_count) == cudaSuccess && device_count > 0;
+    int pthreads = std::min(threads, 16);
+    return {
+        {"standard", {Matrix::STANDARD, 0, 0, 0.0}, true},
+        {"mkl", {Matrix::MKL, 0, 0, 0.0}, true},
+        {"tile16", {Matrix::TILE, 16, 0, 0.0}, true},
+        {"tile32", {Matrix::TILE, 32, 0, 0.0}, true},
+        {"tile64", {Matrix::TILE, 64, 0, 0.0}, true},
+        {"openmp", {Matrix::OPENMP, 0, threads, 0.0}, true},
+        {"thread", {Matrix::THREAD, 0, pthreads, 0.0}, true},
+        {"cuda", {Matrix::CUDA, 0, 0, 0.0}, cuda},
+        {"jit", {Matrix::JIT, 0, 0, 0.0}, JitGemm::available()},
+        {"strassen", {Matrix::STRASSEN, 0, 0, 0.0}, true},
+        {"auto", {Matrix::AUTO, 0, 0, 0.0}, true},
+        // what mat_multiply runs for at most SMALL_GEMM_ROWS rows, e.g. --batch 1
+        {"small", {Matrix::STANDARD, 0, 0, 0.0}, true},
+    };
+}
+
+static Matrix run_backend(const Backend &backend, const Matrix &a, const Matrix &b) {
+    if (backend.config.mode == Matrix::AUTO) {
+        return multiply_auto(a, b);
+    }
+    if (backend.name == "small") {
+        return multiply_small(a, b);
     }
-    
-    for (size_t i = 0; i < a.getRow(); i++) {
-        for (size_t j = 0; j < a.getCol(); j++) {
-            if (std::abs(a(i, j) - b(i, j)) > tolerance) {
-                return false;
+    return multiply_config(a, b, backend.config);
+}
+
+static GemmResult bench_backend(const Backend &backend, const Shape &shape, const Matrix &a,
+                                const Matrix &b, const Matrix &reference, const BenchOptions &options,
+                                const MachineInfo &machine, const PerfCounters *counters) {
+    GemmResult result = {shape, backend.name, "ok", timing_stats({}), 0.0, 0.0, 0.0, PerfSample()};
+    double flops = 2.0 * shape.m * shape.n * shape.k;
+    if (!backend.available) {
+        result.status = "unavailable";
+        return result;
+    }
+    if (backend.name == "small" && shape.m > SMALL_GEMM_ROWS) {
+        result.status = "skipped";
+        return result;
+    }
+    if (backend.name == "standard" && flops > options.getDouble("standard-limit", 2.0) * 1e9) {
+        result.status = "skipped";
+        return result;
+    }
+    long warmup = options.getInt("warmup", 2);
+    long repeats = options.getInt("repeats", 10);
+    try {
+        Matrix output;
+        // warm-up runs also let AUTO finish tuning the shape
+        for (long r = 0; r < warmup; r++) {
+            output = run_backend(backend, a, b);
+        }
+        std::vector<double> samples;
+        for (long r = 0; r < repeats; r++) {
+            // counters are read outside the timed region
+            PerfReading reading;
+            if (counters) {
+                reading = counters->read();
             }
+            auto begin = std::chrono::steady_clock::now();
+            output = run_backend(backend, a, b);
+            samples.push_back(elapsed_seconds(begin));
+            if (counters) {
+                result.counters += counters->since(reading);
+            }
+        }
+        result.stats = timing_stats(samples);
+        result.error = relative_error(output, reference);
+        if (!(result.error <= options.getDouble("tolerance", 1e-9))) {
+            result.status = "wrong";
+        }
+        if (result.stats.median > 0.0) {
+            result.gflops = flops / result.stats.median / 1e9;
+            result.peakPercent = machine.peakGflops > 0.0 ? 100.0 * result.gflops / machine.peakGflops : 0.0;
         }
     }
-    return true;
+    catch (const std::exception &e) {
+        result.status = std::string("error: ") + e.what();
+    }
+    return result;
 }
 
-void testPerformance(size_t m, size_t n, size_t k) {
-    std::cout << "\nTesting matrices of size: " << m << "x" << k << " * " << k << "x" << n << std::endl;
-    std::cout << "------------------------------------------------------" << std::endl;
-    
-    Matrix A = createRandomMatrix(m, k);
-    Matrix B = createRandomMatrix(k, n);
-    
-    Matrix C = multiply(A, B);
-    // Multiply using standard algorithm for reference
-    double standardTime = measureTime([&]() {
-        multiply(A, B);
-    });
-    
-    std::vector<std::pair<std::string, double>> results; // {method name, cost time}
-    results.push_back({"Standard", standardTime});
-    
-    // Test MKL implementation
-    Matrix C_mkl;
-    bool correct_mkl = matricesEqual(C, C_mkl);
-    double mklTime = measureTime([&]() {
-        C_mkl = multiply_mkl(A, B);
-    });
-    results.push_back({"MKL", mklTime});
-    if (!correct_mkl) {
-        std::cout << "Warning: MKL implementation produced incorrect results!" << std::endl;
-    }
-    // Test tiled implementation with different tile sizes
-    // std::vector<int> tileSizes = {8, 16, 32, 64};
-    std::vector<int> tileSizes = {64};
-    for (int tileSize : tileSizes) {
-        Matrix C_tile;
-        double tileTime = measureTime([&]() {
-            C_tile = multiply_tile(A, B, tileSize);
-        });
-        
-        // Verify result matches the standard implementation
-        // bool correct = matricesEqual(C, C_tile);
-        
-        results.push_back({"Tiled (" + std::to_string(tileSize) + ")", tileTime});
-        // if (!correct) {
-        //     std::cout << "Warning: Tiled implementation with size " << tileSize << " produced incorrect results!" << std::endl;
-        // }
-    }
-    
-    // Test openmp implementation
-    Matrix C_openmp;
-    // bool correct_openmp = matricesEqual(C, C_openmp);
-    double openmpTime = measureTime([&]() {
-        C_openmp = multiply_openmp(A, B);
-    });
-    results.push_back({"OpenMP", openmpTime});
-    // if (!correct_openmp) {
-    //     std::cout << "Warning: OpenMP implementation produced incorrect results!" << std::endl;
-    // }
-    // Test thread implementation
-    Matrix C_thread;
-    double threadTime = measureTime([&]() {
-        C_thread = multiply_thread(A, B, 16);
-    });
-    // bool correct_thread = matricesEqual(C, C_thread);
-    results.push_back({"Thread", threadTime});
-    // if (!correct_thread) {
-    //     std::cout << "Warning: Thread implementation produced incorrect results!" << std::endl;
-    // }
-
-    // Test CUDA implementation
-    Matrix C_cuda;
-    double cudaTime = measureTime([&]() {
-        C_cuda = multiply_cuda(A, B);
-    });
-    results.push_back({"CUDA", cudaTime});
-    
-    // Print results
-    std::cout << std::setw(15) << "Method" << std::setw(15) << "Time (ms)" << std::setw(15) << "Speedup" << std::endl;
-    std::cout << "------------------------------------------------------" << std::endl;
-    
-    for (const auto& result : results) {
-        std::cout << std::setw(15) << result.first 
-                  << std::setw(15) << std::fixed << std::setprecision(3) << result.second 
-                  << std::setw(15) << std::fixed << std::setprecision(2) << (standardTime / result.second)
-                  << std::endl;
+static std::string results_json(const std::vector<GemmResult> &results, const MachineInfo &machine,
+                                const BenchOptions &options) {
+    std::ostringstream out;
+    out.precision(9);
+    out << "{\n  \"benchmark\": \"gemm\",\n  \"timestamp\": " << json_string(timestamp())
+        << ",\n  \"machine\": " << machine_json(machine)
+        << ",\n  \"warmup\": " << options.getInt("warmup", 2)
+        << ",\n  \"repeats\": " << options.getInt("repeats", 10)
+        << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const GemmResult &r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"shape\": " << json_string(r.shape.label)
+            << ", \"m\": " << r.shape.m << ", \"k\": " << r.shape.k << ", \"n\": " << r.shape.n
+            << ", \"backend\": " << json_string(r.backend) << ", \"status\": " << json_string(r.status)
+            << ", \"seconds\": " << stats_json(r.stats) << ", \"gflops\": " << r.gflops
+            << ", \"peak_percent\": " << r.peakPercent << ", \"error\": " << r.error
+            << ", \"counters\": " << perf_json(r.counters, r.stats.runs) << "}";
     }
+    out << "\n  ]\n}\n";
+    return out.str();
 }
 
-int main() {
-    // Seed random number generator
-    srand(42);
-    
-    std::cout << "Matrix Multiplication Performance Test" << std::endl;
-    std::cout << "=====================================" << std::endl;
-    // Test different matrix sizes
-    std::vector<std::tuple<size_t, size_t, size_t>> testSizes = {
-        {64, 64, 64},        // Small
-        {128, 128, 128},     // Medium
-        {512, 512, 512},     // Large
-        {1024, 1024, 1024},  // Very large
-        {1000, 100, 1000},
-        {2000, 500, 50}
-    };
+static std::string results_csv(const std::vector<GemmResult> &results) {
+    std::ostringstream out;
+    out.precision(9);
+    out << "shape,m,k,n,backend,status,runs,min_s,median_s,p25_s,p75_s,max_s,gflops,peak_percent,error"
+        << perf_csv_header() << "\n";
+    for (const GemmResult &r : results) {
+        out << r.shape.label << "," << r.shape.m << "," << r.shape.k << "," << r.shape.n << ","
+            << r.backend << "," << r.status << "," << r.stats.runs << "," << r.stats.min << ","
+            << r.stats.median << "," << r.stats.p25 << "," << r.stats.p75 << "," << r.stats.max << ","
+            << r.gflops << "," << r.peakPercent << "," << r.error << perf_csv(r.counters, r.stats.runs) << "\n";
+    }
+    return out.str();
+}
 
-    for (const auto& [m, k, n] : testSizes) {
-        testPerformance(m, n, k);
+static void print_shape(const Shape &shape, const std::vector<GemmResult> &results, bool counters) {
+    std::cout << "\n" << shape.label << ": " << shape.m << "x" << shape.k << " * "
+              << shape.k << "x" << shape.n << std::endl;
+    std::cout << std::setw(10) << "Backend" << std::setw(14) << "Median (ms)" << std::setw(14) << "IQR (ms)"
+              << std::setw(12) << "GFLOPS" << std::setw(10) << "% peak" << std::setw(12) << "Error";
+    if (counters) {
+        // misses per 1000 instructions
+        std::cout << std::setw(8) << "IPC" << std::setw(10) << "L1 MPKI" << std::setw(10) << "LLC MPKI"
+                  << std::setw(11) << "dTLB MPKI";
     }
+    std::cout << "  Status" << std::endl;
+    for (const GemmResult &r : results) {
+        std::cout << std::setw(10) << r.backend;
+        if (r.stats.runs > 0) {
+            std::cout << std::fixed << std::setprecision(3)
+                      << std::setw(14) << r.stats.median * 1e3 << std::setw(14) << (r.stats.p75 - r.stats.p25) * 1e3
+                      << std::setw(12) << std::setprecision(2) << r.gflops << std::setw(10) << r.peakPercent
+                      << std::scientific << std::setprecision(1) << std::setw(12) << r.error << std::defaultfloat;
+            if (counters) {
+                std::cout << std::fixed << std::setprecision(2) << std::setw(8) << r.counters.ipc()
+                          << std::setw(10) << r.counters.per_kilo_instruction(PERF_L1D_MISSES)
+                          << std::setw(10) << r.counters.per_kilo_instruction(PERF_LLC_MISSES)
+                          << std::setw(11) << r.counters.per_kilo_instruction(PERF_DTLB_MISSES) << std::defaultfloat;
+            }
+        }
+        else {
+            std::cout << std::setw(counters ? 111 : 72) << "";
+        }
+        std::cout << "  " << r.status << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    try {
+        BenchOptions options(argc, argv);
+        MachineInfo machine = machine_info(options.getDouble("peak", 0.0));
+        int threads = int(options.getInt("threads", machine.ompThreads));
 
+        std::vector<Shape> shapes;
+        for (const std::string &text : options.getList("shapes",
+                 "64x64x64,128x128x128,512x512x512,1024x1024x1024,1000x100x1000,2000x500x50")) {
+            shapes.push_back(parse_shape(text));
+        }
+        if (!options.has("no-linear")) {
+            std::vector<size_t> widths;
+            for (const std::string &width : options.getList("layers", "784,128,10")) {
+                widths.push_back(std::stoul(width));
+            }
+            std::vector<Shape> linear = linear_shapes(widths, options.getInt("batch", 256));
+            shapes.insert(shapes.end(), linear.begin(), linear.end());
+        }
+
+        std::vector<Backend> backends;
+        std::vector<std::string> selected = options.getList("backends", "");
+        for (const Backend &backend : all_backends(threads)) {
+            if (selected.empty() || std::find(selected.begin(), selected.end(), backend.name) != selected.end()) {
+                backends.push_back(backend);
+            }
+        }
+
+        std::cout << "Matrix Multiplication Benchmark" << std::endl;
+        std::cout << "cores " << machine.cores << " (" << machine.logicalCpus << " logical), " << machine.ghz
+                  << " GHz (" << machine.clockSource << "), " << machine.isa
+                  << ", estimated peak " << machine.peakGflops << " GFLOPS" << std::endl;
+
+        std::unique_ptr<PerfCounters> counters(open_counters(options));
+
+        std::mt19937 gen(42);
+        std::vector<GemmResult> results;
+        bool all_correct = true;
+        for (const Shape &shape : shapes) {
+            Matrix a = random_matrix(shape.m, shape.k, gen);
+            Matrix b = random_matrix(shape.k, shape.n, gen);
+            Matrix reference = multiply(a, b);
+            std::vector<GemmResult> shape_results;
+            for (const Backend &backend : backends) {
+                shape_results.push_back(bench_backend(backend, shape, a, b, reference, options, machine,
+                                                      counters.get()));
+                all_correct = all_correct && shape_results.back().status.rfind("error", 0) != 0
+                              && shape_results.back().status != "wrong";
+            }
+            print_shape(shape, shape_results, counters != nullptr);
+            results.insert(results.end(), shape_results.begin(), shape_results.end());
+        }
+
+        if (options.has("json")) {
+            write_output(options.get("json", "-"), results_json(results, machine, options));
+        }
+        if (options.has("csv")) {
+            write_output(options.get("csv", "-"), results_csv(results));
+        }
+        if (!all_correct) {
+            std::cerr << "Some backends produced wrong results or failed" << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
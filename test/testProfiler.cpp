@@ -0,0 +1,198 @@
+#include "profiler.h"
+#include "network.h"
+#include "linear.h"
+#include "activation.h"
+#include "loss.h"
+#include "optimizer.h"
+#include "matrix.h"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static size_t count_events(const char *category, const char *name) {
+    size_t count = 0;
+    for (const ProfileEvent &event : Profiler::events()) {
+        count += std::strcmp(event.category, category) == 0 && std::strcmp(event.name, name) == 0;
+    }
+    return count;
+}
+
+static void train_step(Network &network, BaseLoss &loss, SGD &optimizer) {
+    Matrix x = Matrix::fillwith(8, 4, 0.5);
+    Matrix y = Matrix::zeros(8, 3);
+    for (size_t i = 0; i < 8; i++) {
+        y(i, i % 3) = 1.0;
+    }
+    Matrix predictions = network.forward(x);
+    loss(predictions, y);
+    optimizer.apply_gradient(network, network.backward(loss.backward()));
+}
+
+void test_disabled() {
+    Profiler::disable();
+    Profiler::clear();
+    {
+        ProfileScope scope("test", "disabled");
+    }
+    assert(Profiler::events().empty());
+    std::cout << "Disabled profiler test passed!" << std::endl;
+}
+
+void test_training_events() {
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    std::vector<Layer*> layers = {new Linear(4, 5, true, true), new ReLU(), new Linear(5, 3, true, true)};
+    Network network(layers);
+    CategoricalCrossentropy loss;
+    SGD optimizer(0.01, 0.9);
+
+    Profiler::clear();
+    Profiler::enable();
+    train_step(network, loss, optimizer);
+    train_step(network, loss, optimizer);
+    Profiler::disable();
+    // not recorded
+    train_step(network, loss, optimizer);
+
+    assert(count_events("network", "forward") == 2);
+    assert(count_events("network", "backward") == 2);
+    assert(count_events("forward", "Linear") == 4);
+    assert(count_events("forward", "ReLU") == 2);
+    assert(count_events("backward", "Linear") == 4);
+    assert(count_events("loss", "CategoricalCrossentropy") == 2);
+    assert(count_events("optimizer", "SGD") == 2);
+    // forward: 2 GEMMs, backward: 2 per Linear, all at most 8 rows
+    assert(count_events("gemm", "small") == 12);
+
+    // GEMMs carry their shape and nest inside their layer
+    std::vector<ProfileEvent> events = Profiler::events();
+    const ProfileEvent *layer = nullptr;
+    for (const ProfileEvent &event : events) {
+        if (std::strcmp(event.category, "forward") == 0 && event.dims[0] == 0) {
+            layer = &event;
+            break;
+        }
+    }
+    assert(layer != nullptr);
+    bool found = false;
+    for (const ProfileEvent &event : events) {
+        if (std::strcmp(event.category, "gemm") == 0 && event.dims[0] == 8 && event.dims[1] == 5 && event.dims[2] == 4) {
+            assert(event.begin >= layer->begin && event.begin + event.duration <= layer->begin + layer->duration);
+            found = true;
+            break;
+        }
+    }
+    assert(found);
+    for (size_t i = 1; i < events.size(); i++) {
+        assert(events[i - 1].begin <= events[i].begin);
+    }
+
+    // aggregation
+    std::vector<ProfileSummary> summary = Profiler::summary();
+    size_t gemm_calls = 0;
+    for (const ProfileSummary &group : summary) {
+        if (group.category == "gemm") {
+            gemm_calls += group.calls;
+            assert(group.min <= group.total / group.calls && group.total / group.calls <= group.max);
+        }
+    }
+    assert(gemm_calls == 12);
+    for (size_t i = 1; i < summary.size(); i++) {
+        assert(summary[i - 1].total >= summary[i].total);
+    }
+    std::string report = Profiler::report();
+    assert(report.find("CategoricalCrossentropy") != std::string::npos);
+    assert(report.find("8x5x4") != std::string::npos);
+    std::cout << report;
+
+    // Chrome trace
+    const std::string path = "test_profile.json";
+    Profiler::write_chrome_trace(path);
+    std::ifstream file(path);
+    std::stringstream content;
+    content << file.rdbuf();
+    std::string trace = content.str();
+    assert(trace.find("\"traceEvents\"") == 0 || trace.find("{\"traceEvents\"") == 0);
+    assert(trace.find("\"ph\": \"X\"") != std::string::npos);
+    assert(trace.find("\"cat\": \"optimizer\"") != std::string::npos);
+    assert(trace.find("\"dims\": \"8x5x4\"") != std::string::npos);
+    std::remove(path.c_str());
+    std::cout << "Training events test passed!" << std::endl;
+}
+
+void test_threads_and_ring() {
+    Profiler::clear();
+    Profiler::enable();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 100; i++) {
+                ProfileScope scope("test", "worker", i);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    // buffers of finished threads are kept
+    assert(count_events("test", "worker") == 400);
+
+    // threads started one after another share one buffer, their events all kept
+    for (int t = 0; t < 20; t++) {
+        std::thread([] {ProfileScope scope("test", "churn");}).join();
+    }
+    std::set<uint32_t> buffers;
+    for (const ProfileEvent &event : Profiler::events()) {
+        if (std::string(event.name) == "churn") {
+            buffers.insert(event.thread);
+        }
+    }
+    assert(count_events("test", "churn") == 20 && buffers.size() == 1);
+
+    // a full ring keeps the newest events
+    Profiler::setBufferSize(16);
+    for (int i = 0; i < 40; i++) {
+        ProfileScope scope("test", "ring", i);
+    }
+    Profiler::disable();
+    std::vector<ProfileEvent> events = Profiler::events();
+    assert(events.size() == 16);
+    assert(events.front().dims[0] == 24 && events.back().dims[0] == 39);
+    assert(Profiler::dropped() == 24);
+    assert(Profiler::report().find("overwritten") != std::string::npos);
+    Profiler::setBufferSize(1 << 16);
+    std::cout << "Threads and ring buffer test passed!" << std::endl;
+}
+
+void test_overhead() {
+    Profiler::disable();
+    const int n = 10000000;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        ProfileScope scope("test", "overhead", i);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << "Disabled scope: " << seconds / n * 1e9 << " ns" << std::endl;
+    assert(seconds / n < 50e-9);
+    std::cout << "Overhead test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_disabled();
+        test_training_events();
+        test_threads_and_ring();
+        test_overhead();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "All profiler tests passed!" << std::endl;
+    return 0;
+}
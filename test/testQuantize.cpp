@@ -0,0 +1,141 @@
+#include "quantize.h"
+#include "network.h"
+#include "linear.h"
+#include "activation.h"
+#include "metrics.h"
+#include "matrix.h"
+#include "fixtures.h"
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <vector>
+
+static std::vector<int> available_kernels() {
+    std::vector<int> kernels;
+    for (int kernel : {QUANT_SCALAR, QUANT_AVX2, QUANT_VNNI}) {
+        if (quant_kernel_available(kernel)) {
+            kernels.push_back(kernel);
+        }
+    }
+    return kernels;
+}
+
+void test_weights() {
+    std::mt19937 gen(5);
+    Matrix weight = random_matrix(10, 6, gen);
+    for (size_t k = 0; k < 10; k++) {
+        weight(k, 2) = 0.0;
+    }
+    Linear linear(weight, Matrix(), false);
+    QuantizedLinear quantized(linear);
+    Matrix restored = quantized.dequantized_weight();
+    for (size_t j = 0; j < 6; j++) {
+        double largest = 0.0;
+        for (size_t k = 0; k < 10; k++) {
+            largest = std::max(largest, std::abs(weight(k, j)));
+        }
+        double scale = quantized.getScales()[j];
+        assert(j == 2 ? scale == 1.0 : std::abs(scale - largest / 127.0) < 1e-15);
+        for (size_t k = 0; k < 10; k++) {
+            assert(std::abs(restored(k, j) - weight(k, j)) <= 0.5 * scale + 1e-15);
+        }
+    }
+    assert(quantized.getBytes() == 60 + 6 * sizeof(double));
+    std::cout << "Weights test passed!" << std::endl;
+}
+
+// the int32 sums are exact, so every kernel gives the same bits
+void test_kernels() {
+    std::mt19937 gen(8);
+    int saved = get_quant_kernel();
+    // depth off the group of 4, a padded second panel, row blocks with a remainder
+    Linear linear(random_matrix(37, 21, gen), random_matrix(1, 21, gen), false);
+    QuantizedLinear quantized(linear);
+    for (size_t rows : {1, 4, 9, 130}) {
+        Matrix input = random_matrix(rows, 37, gen);
+        Matrix expected = linear.forward(input);
+        std::vector<Matrix> outputs;
+        for (int kernel : available_kernels()) {
+            set_quant_kernel(kernel);
+            outputs.push_back(quantized.forward(input));
+        }
+        for (const Matrix &output : outputs) {
+            assert(output == outputs[0]);
+        }
+        double error = 0.0, norm = 0.0;
+        for (size_t i = 0; i < rows * 21; i++) {
+            error += std::pow(outputs[0].data[i] - expected.data[i], 2);
+            norm += expected.data[i] * expected.data[i];
+        }
+        assert(std::sqrt(error / norm) < 0.02);
+    }
+    set_quant_kernel(saved);
+    std::cout << "Kernels test passed (" << available_kernels().size() << " kernels)!" << std::endl;
+}
+
+void test_errors() {
+    std::mt19937 gen(2);
+    Linear linear(random_matrix(8, 4, gen), Matrix(), false);
+    QuantizedLinear quantized(linear);
+    try {
+        quantized.forward(Matrix(3, 7));
+        assert(false && "Should throw exception for mismatched input");
+    } catch (const std::runtime_error&) {}
+    try {
+        Matrix gradient(3, 4);
+        quantized.backward(gradient);
+        assert(false && "Should throw exception, the layer is inference only");
+    } catch (const std::runtime_error&) {}
+    try {
+        set_quant_kernel(7);
+        assert(false && "Should throw exception for an unknown kernel");
+    } catch (const std::runtime_error&) {}
+    Layer identity;
+    Network network({&identity});
+    try {
+        QuantizedModel model(network);
+        assert(false && "Should throw exception for an unsupported layer");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Errors test passed!" << std::endl;
+}
+
+// held-out rows labeled by the fp64 network itself, so its accuracy is 1 and the int8
+// accuracy is the agreement
+void test_report() {
+    std::mt19937 gen(13);
+    std::vector<Layer*> layers = {new Linear(256, 128, true, true), new ReLU(), new Linear(128, 10, true, true)};
+    Network network(layers);
+    Matrix inputs = random_matrix(2000, 256, gen);
+    std::vector<size_t> classes = argmax_rows(network.predict(inputs));
+    Matrix labels(2000, 1);
+    for (size_t i = 0; i < 2000; i++) {
+        labels.data[i] = double(classes[i]);
+    }
+    QuantizedModel model(network);
+    QuantReport report = quantization_report(network, model, inputs, labels);
+    std::cout << report.str();
+    assert(report.samples == 2000 && report.referenceAccuracy == 1.0);
+    assert(report.quantizedAccuracy == report.agreement && report.agreement > 0.95);
+    assert(report.relativeError < 0.02 && report.maxError > 0.0 && report.meanError <= report.maxError);
+    assert(report.referenceBytes == parameter_bytes(network));
+    assert(double(report.referenceBytes) / report.quantizedBytes > 7.0);
+    for (Layer *layer : layers) {
+        delete layer;
+    }
+    std::cout << "Report test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_weights();
+        test_kernels();
+        test_errors();
+        test_report();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "All quantization tests passed!" << std::endl;
+    return 0;
+}
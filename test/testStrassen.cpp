@@ -0,0 +1,115 @@
+#include "strassen.h"
+#include "jit.h"
+#include "matrix.h"
+#include "fixtures.h"
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <omp.h>
+
+// largest entry error against a long double product
+static double max_error(const Matrix &result, const Matrix &a, const Matrix &b) {
+    double error = 0.0;
+    for (size_t i = 0; i < a.row; i++) {
+        for (size_t j = 0; j < b.col; j++) {
+            long double exact = 0.0L;
+            for (size_t p = 0; p < a.col; p++) {
+                exact += (long double)a(i, p) * b(p, j);
+            }
+            error = std::max(error, double(std::fabs(result(i, j) - exact)));
+        }
+    }
+    return error;
+}
+
+void test_depth() {
+    assert(strassen_depth(1024, 1024, 1024, 128) == 3);
+    assert(strassen_depth(100, 1000, 1000, 64) == 1);
+    assert(strassen_depth(64, 64, 64, 64) == 0);
+    assert(strassen_depth(500, 500, 500, 0) == 0);
+    std::cout << "Depth test passed!" << std::endl;
+}
+
+void test_shapes() {
+    std::mt19937 gen(21);
+    std::vector<int> bases = {Matrix::MKL};
+    if (JitGemm::available()) {
+        bases.push_back(Matrix::JIT);
+    }
+    // square, rectangular, odd (padded) and one below the cutoff
+    size_t shapes[][3] = {{64, 64, 64}, {96, 130, 72}, {101, 67, 99}, {40, 200, 200}, {8, 8, 8}};
+    for (int threads : {1, 4}) {
+        omp_set_num_threads(threads);
+        for (int base : bases) {
+            StrassenConfig config = {16, base};
+            for (auto &shape : shapes) {
+                Matrix a = random_matrix(shape[0], shape[1], gen);
+                Matrix b = random_matrix(shape[1], shape[2], gen);
+                Matrix result = multiply_strassen(a, b, config);
+                assert(result.row == shape[0] && result.col == shape[2]);
+                assert(max_error(result, a, b) < 1e-11);
+            }
+        }
+    }
+    omp_set_num_threads(1);
+    try {
+        multiply_strassen(Matrix(4, 3), Matrix(4, 3), {16, Matrix::MKL});
+        assert(false && "Should throw exception for mismatched dimensions");
+    } catch (const std::runtime_error&) {}
+    try {
+        set_strassen_config({16, Matrix::TILE});
+        assert(false && "Should throw exception for an unsupported base kernel");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Shapes test passed!" << std::endl;
+}
+
+// the error grows with every level, stays a small multiple of the standard kernel's
+void test_error() {
+    std::mt19937 gen(4);
+    Matrix a = random_matrix(256, 256, gen), b = random_matrix(256, 256, gen);
+    double standard = max_error(multiply(a, b), a, b);
+    std::cout << "max error, K = 256: standard " << standard;
+    double previous = 0.0;
+    for (size_t cutoff : {128, 64, 32, 16}) {
+        Matrix result = multiply_strassen(a, b, {cutoff, Matrix::MKL});
+        double error = max_error(result, a, b);
+        std::cout << ", " << strassen_depth(256, 256, 256, cutoff) << " levels " << error;
+        assert(error < 1000 * standard && error >= 0.5 * previous);
+        previous = error;
+    }
+    std::cout << std::endl << "Error test passed!" << std::endl;
+}
+
+void test_mode() {
+    std::mt19937 gen(9);
+    set_strassen_config({32, Matrix::MKL});
+    assert(strassen_config().cutoff == 32);
+    Matrix a = random_matrix(70, 90, gen), b = random_matrix(90, 65, gen);
+    int saved = Matrix::mulMode;
+    Matrix::setMulMode(Matrix::STRASSEN);
+    Matrix result = mat_multiply(a, b);
+    Matrix::setMulMode(saved);
+    assert(max_error(result, a, b) < 1e-11);
+
+    StrassenConfig tuned = tune_strassen(256);
+    assert(tuned.cutoff >= 64 && tuned.cutoff <= 256);
+    assert(tuned.base == Matrix::MKL || tuned.base == Matrix::JIT);
+    assert(strassen_config().cutoff == tuned.cutoff);
+    std::cout << "Mode test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_depth();
+        test_shapes();
+        test_error();
+        test_mode();
+    } catch (const std::exception &e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "All Strassen tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include "../function/stream.h"
+#include "fixtures.h"
+
+// rows hold their index (mod 256) in every feature, label = index % classes
+Dataset make_dataset(size_t rows, size_t features, size_t classes) {
+    std::vector<uint8_t> x(rows * features), y(rows);
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < features; j++) x[i * features + j] = i % 256;
+        y[i] = i % classes;
+    }
+    return Dataset(x, y, rows, features, classes, 1.0, 0.0);
+}
+
+void test_binary_shards() {
+    Dataset data = make_dataset(250, 5, 7);
+    write_binary_dataset(data, "/tmp/test-shard0.mofd", 0, 100);
+    write_binary_dataset(data, "/tmp/test-shard1.mofd", 100, 250);
+
+    auto shard = std::make_shared<BinarySampleFile>("/tmp/test-shard1.mofd");
+    assert(shard->size() == 150 && shard->getFeatureCount() == 5 && shard->getClassCount() == 7);
+
+    std::vector<std::shared_ptr<SampleFile>> shards = {
+        std::make_shared<BinarySampleFile>("/tmp/test-shard0.mofd"), shard};
+    // small chunks and readahead so the readers must wait for released buffers
+    StreamingDataset stream(shards, 7, 16, 32, 2, 3, true, false, 11, 1.0, 0.0);
+    assert(stream.size() == 250 && stream.num_batches() == 16);
+
+    for (int epoch = 0; epoch < 2; epoch++) {
+        std::vector<int> seen(250, 0);
+        size_t rows = 0, batches = 0;
+        const Matrix *x, *y;
+        stream.start();
+        while (stream.next(x, y)) {
+            for (size_t i = 0; i < x->getRow(); i++) {
+                // index mod 256 is the index itself below 256
+                size_t idx = (*x)(i, 0);
+                assert((*x)(i, 4) == idx);
+                assert((*y)(i, idx % 7) == 1.0);
+                seen[idx]++;
+            }
+            rows += x->getRow();
+            batches++;
+        }
+        assert(batches == 16 && rows == 250);
+        for (int count : seen) assert(count == 1);
+    }
+
+    // batches larger than all buffered chunks together, chunks shared by several batches
+    StreamingDataset wide(shards, 7, 100, 8, 2, 2, false, false, 0, 1.0, 0.0);
+    const Matrix *x, *y;
+    size_t expected = 0;
+    wide.start();
+    while (wide.next(x, y)) {
+        for (size_t i = 0; i < x->getRow(); i++, expected++) {
+            assert((*x)(i, 2) == expected && (*y)(i, expected % 7) == 1.0);
+        }
+    }
+    assert(expected == 250);
+    std::cout << "Binary shard streaming test passed!" << std::endl;
+}
+
+void test_npy_stream() {
+    std::vector<uint8_t> x(40 * 3);
+    std::vector<int64_t> y(40);
+    for (size_t i = 0; i < 40; i++) {
+        for (size_t j = 0; j < 3; j++) x[i * 3 + j] = i;
+        y[i] = i % 4;
+    }
+    write_npy("/tmp/test-features.npy", "|u1", "(40, 3)", x.data(), x.size());
+    write_npy("/tmp/test-labels.npy", "<i8", "(40,)", y.data(), y.size() * sizeof(int64_t));
+
+    auto file = std::make_shared<NpySampleFile>("/tmp/test-features.npy", "/tmp/test-labels.npy");
+    assert(file->size() == 40 && file->getFeatureCount() == 3);
+
+    // sequential order and the drop of the last partial batch
+    StreamingDataset stream({file}, 4, 12, 8, 3, 2, false, true, 0, 1.0, 0.0);
+    assert(stream.num_batches() == 3);
+    const Matrix *bx, *by;
+    stream.start();
+    size_t expected = 0;
+    while (stream.next(bx, by)) {
+        for (size_t i = 0; i < bx->getRow(); i++, expected++) {
+            assert((*bx)(i, 1) == expected);
+            assert((*by)(i, expected % 4) == 1.0);
+        }
+    }
+    assert(expected == 36);
+
+    // labels beyond the class count surface on the consumer side
+    StreamingDataset invalid({file}, 3, 8, 8, 2, 2, false, true);
+    invalid.start();
+    try {
+        while (invalid.next(bx, by)) {}
+        assert(false && "Should throw exception for label out of range");
+    } catch (const std::runtime_error&) {}
+    std::cout << "npy streaming test passed!" << std::endl;
+}
+
+// shard header written by hand, payload of the given length
+void write_shard(const std::string &path, uint64_t samples, uint64_t features, uint64_t classes, size_t payload) {
+    uint64_t dims[3] = {samples, features, classes};
+    std::vector<char> bytes(payload, 1);
+    std::ofstream file(path, std::ios::binary);
+    file.write("MOFDSET1", 8);
+    file.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+    file.write(bytes.data(), bytes.size());
+}
+
+// headers are checked against the file when the shard is opened
+void test_invalid_shards() {
+    write_shard("/tmp/test-shard-ok.mofd", 10, 4, 3, 50);
+    assert(BinarySampleFile("/tmp/test-shard-ok.mofd").size() == 10);
+
+    write_shard("/tmp/test-shard-short.mofd", 10, 4, 3, 49);
+    write_shard("/tmp/test-shard-empty.mofd", 10, 0, 3, 10);
+    write_shard("/tmp/test-shard-classes.mofd", 10, 4, 0, 50);
+    // samples x features wraps to 0, the labels alone fit
+    write_shard("/tmp/test-shard-wrap.mofd", 16, uint64_t(1) << 60, 3, 16);
+    for (const char *path : {"/tmp/test-shard-short.mofd", "/tmp/test-shard-empty.mofd",
+                             "/tmp/test-shard-classes.mofd", "/tmp/test-shard-wrap.mofd"}) {
+        try {
+            BinarySampleFile shard(path);
+            assert(false && "Should throw exception for an inconsistent shard header");
+        } catch (const std::runtime_error&) {}
+    }
+
+    std::vector<uint8_t> x(10 * 3, 0);
+    write_npy("/tmp/test-features-short.npy", "|u1", "(10, 3)", x.data(), 29);
+    write_npy("/tmp/test-labels-short.npy", "|u1", "(10,)", x.data(), 10);
+    try {
+        NpySampleFile file("/tmp/test-features-short.npy", "/tmp/test-labels-short.npy");
+        assert(false && "Should throw exception for truncated features");
+    } catch (const std::runtime_error&) {}
+    std::cout << "Invalid shard test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_binary_shards();
+        test_npy_stream();
+        test_invalid_shards();
+        std::cout << "All stream tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
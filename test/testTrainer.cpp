@@ -0,0 +1,83 @@
+#include <iostream>
+#include <cassert>
+#include <vector>
+#include "../function/trainer.h"
+#include "../function/linear.h"
+#include "../function/activation.h"
+
+// two features, class = which feature is larger
+Dataset make_dataset(size_t rows) {
+    std::vector<uint8_t> x(rows * 2), y(rows);
+    for (size_t i = 0; i < rows; i++) {
+        x[i * 2] = (i * 37) % 256;
+        x[i * 2 + 1] = (i * 91 + 13) % 256;
+        y[i] = x[i * 2] > x[i * 2 + 1] ? 1 : 0;
+    }
+    return Dataset(x, y, rows, 2, 2);
+}
+
+void test_fit() {
+    Matrix::setMulMode(Matrix::MulMode::STANDARD);
+    Dataset data = make_dataset(512);
+    DataLoader loader(data, 32, true, 2, 1);
+    Network network({new Linear(2, 8, true, true), new Sigmoid(), new Linear(8, 2, true, true)});
+    CategoricalCrossentropy loss_fn;
+    SGD optimizer(0.05, 0.9);
+    Trainer trainer(network, loss_fn, optimizer);
+
+    std::vector<size_t> reported;
+    trainer.setProgressCallback([&](const TrainProgress &progress) {
+        assert(progress.numBatches == 16);
+        reported.push_back(progress.batch);
+    }, 5);
+    size_t epochs_seen = 0;
+    trainer.setEpochCallback([&](const EpochStats &stats) {
+        assert(stats.epoch == epochs_seen++);
+    });
+
+    std::vector<EpochStats> history = trainer.fit(loader, 20);
+    assert(history.size() == 20 && epochs_seen == 20);
+    assert(trainer.getStep() == 20 * 16 && trainer.getEpoch() == 20);
+    // batches 0, 5, 10, 15 of every epoch
+    assert(reported.size() == 20 * 4 && reported[3] == 15);
+    assert(history[0].samples == 512 && history[0].samplesPerSecond > 0.0);
+    assert(history.back().loss < history[0].loss);
+
+    DataLoader eval_loader(data, 64, false);
+    EvalStats eval = trainer.evaluate(eval_loader);
+    assert(eval.samples == 512);
+    assert(eval.accuracy > 0.9);
+    std::cout << "Trainer fit test passed!" << std::endl;
+}
+
+void test_callback_error() {
+    Dataset data = make_dataset(64);
+    DataLoader loader(data, 16);
+    Network network({new Linear(2, 2, true, true)});
+    CategoricalCrossentropy loss_fn;
+    SGD optimizer(0.01, 0.0);
+    Trainer trainer(network, loss_fn, optimizer);
+    trainer.setProgressCallback([](const TrainProgress &progress) {
+        if (progress.batch == 2) throw std::runtime_error("stop");
+    }, 1);
+    try {
+        trainer.train_epoch(loader);
+        assert(false && "Should rethrow the callback exception");
+    } catch (const std::runtime_error&) {}
+    // the stream can be restarted after the interruption
+    trainer.setProgressCallback(nullptr, 1);
+    assert(trainer.train_epoch(loader).batches == 4);
+    std::cout << "Trainer callback error test passed!" << std::endl;
+}
+
+int main() {
+    try {
+        test_fit();
+        test_callback_error();
+        std::cout << "All trainer tests passed!" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}